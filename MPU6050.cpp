@@ -13,161 +13,243 @@
  * --------------------------------------------------------------------------------------------
  */
 
-#include "MPU6050.h" // Include definitions and declarations within the header file
-#include <iostream>  // Used for data output
-
-// Used for the I2C interface
-#include <linux/i2c-dev.h> // For SMBus commands
-#include <sys/ioctl.h>     // For ioctl()
-#include <fcntl.h>         // For O_RDWR
-#include <unistd.h>        // For open()
+#include "MPU6050.h"          // Include definitions and declarations within the header file
+#include "MPU6050Transport.h" // Used to access the device registers
+#include "MPU6050Config.h"    // For the register fields and scale tables
+#include <iostream>           // Used for data output
+#include <fstream>            // Used for the calibration cache
+#include <sstream>            // Used to parse the calibration cache
+#include <string>
+#include <vector>
+#include <utility>            // For std::move()
+#include <stdio.h>            // For snprintf() and rename()
+#include <string.h>           // For memcpy()
+#include <math.h>             // For fabs() and lround()
+#include <time.h>             // For clock_gettime()
+#include "MPU6050Acquisition.h" // For the clock - it is inline, so MPU6050Acquisition.cpp need not be linked
+#ifndef MPU_NO_METRICS
+#include "MPU6050Metrics.h"   // Only the inline recording functions are used, so MPU6050Metrics.cpp need not be linked
+#endif
+
+// Combine a big-endian pair of bytes from the device into a signed 16-bit value
+static inline int16_t combineBytes(const __u8 *bytes){
+    return int16_t(bytes[0] << 8 | bytes[1]);
+}
 
 // ----------------------------- Special class member definitions -----------------------------
-// Default constructor
+// Default constructor - nothing is opened, so arrays and containers of objects are cheap to make
 MPU6050::MPU6050(){
-    // If the address for the device is not specified, use the default address.
-    address = MPU_DEFAULT_I2C_ADDR;
-
-	// Get the user-space I2C interface
-    snprintf(fileName, 11, "/dev/i2c-%d", 1); // The I2C interface is 1 unless it is a rev0 Pi
-
-    // Initialise the I2C interface
-    i2cHandle = open(fileName, O_RDWR);
-    if (i2cHandle < 0) {
-        std::cout << std::endl << "Couldn't open the I2C Bus. Please ensure the I2C interface is enabled and that the correct Pi rev version is selected." << std::endl;
-        exit(I2C_BUS_INIT_ERROR);
-    }
-
-    // Set the slave address for the device
-	if (ioctl(i2cHandle, I2C_SLAVE, address) < 0) {
-		std::cout << std::endl << "The I2C Device couldn't be assigned a slave address." << std::endl;
-		exit(I2C_SET_SLAVE_ADDR_ERR);
-	}
-
-    // Set the registers for the MPU
-    defaultInitialise();
-
-	// Get an initial set of readings
-	updateData();
+    // If the address for the device is not specified, use the default address on bus 1 when the object is first used
+    transport = NULL;
+    ownsTransport = false;
+
+    // Keep the default configuration, with its scales, ready for the first use
+    pwrMgmtMode = MPU_PWR_MGMT_CLK_INTERNAL_8MHZ;
+    gyroConfig = MPU_GYRO_SENS_500;
+    accelConfig = MPU_ACC_SENS_2;
+    gyroScale = MPU_GYRO_SCALES[gyroConfig];
+    gyroReciprocal = 1.0f/gyroScale;
+    accelScale = MPU_ACC_SCALES[accelConfig];
+    accelReciprocal = 1.0f/accelScale;
+    gyroX = gyroY = gyroZ = 0;
+    accelX = accelY = accelZ = 0;
+    temperature = 0;
 }
 
 // Constructor which can be used if the Pi is rev0
 MPU6050::MPU6050(bool isPiRev0){
     // If the address for the device is not specified, use the default address.
-    address = MPU_DEFAULT_I2C_ADDR;
-
-	// Get the user-space I2C interface
-    if(isPiRev0){
-        snprintf(fileName, 11, "/dev/i2c-%d", 0); // The I2C interface is 0 on a rev0 Pi
-    }
-    else{
-        snprintf(fileName, 11, "/dev/i2c-%d", 1); // The I2C device is 1 otherwise
-    }
-
-    // Initialise the I2C interface
-    i2cHandle = open(fileName, O_RDWR);
-    if (i2cHandle < 0) {
-        std::cout << std::endl << "Couldn't open the I2C Bus. Please ensure the I2C interface is enabled and that the correct Pi rev version is selected." << std::endl;
-        exit(I2C_BUS_INIT_ERROR);
-    }
-
-    // Set the slave address for the device
-    if (ioctl(i2cHandle, I2C_SLAVE, address) < 0) {
-        std::cout << std::endl << "The I2C Device couldn't be assigned a slave address." << std::endl;
-        exit(I2C_SET_SLAVE_ADDR_ERR);
-    }
-
-    // Set the registers for the MPU
-    defaultInitialise();
-
-	// Get an initial set of readings
-	updateData();
+    // The I2C interface is 0 on a rev0 Pi, and 1 otherwise
+    busNumber = isPiRev0 ? 0 : 1;
+    transport = new MPU6050I2CTransport(busNumber, MPU_DEFAULT_I2C_ADDR);
+    ownsTransport = true;
+    construct(MPU_PWR_MGMT_CLK_INTERNAL_8MHZ, MPU_GYRO_SENS_500, MPU_ACC_SENS_2);
 }
 
 // Constructor with ability to select a custom address and select if the Pi is rev0
 MPU6050::MPU6050(int deviceAddress, bool isPiRev0){
     // For this constructor the device address MUST be specified, so use that address.
-    address = deviceAddress;
+    busNumber = isPiRev0 ? 0 : 1;
+    this->deviceAddress = deviceAddress;
+    transport = new MPU6050I2CTransport(busNumber, deviceAddress);
+    ownsTransport = true;
+    construct(MPU_PWR_MGMT_CLK_INTERNAL_8MHZ, MPU_GYRO_SENS_500, MPU_ACC_SENS_2);
+}
 
-	// Get the user-space I2C interface
-    if(isPiRev0){
-        snprintf(fileName, 11, "/dev/i2c-%d", 0); // The I2C interface is 0 on a rev0 Pi
-    }
-    else{
-        snprintf(fileName, 11, "/dev/i2c-%d", 1); // The I2C device is 1 otherwise
-    }
+// Constructor to allow adjustment of power management, gyro and accel sensitivities, device I2C address, and whether the Pi is rev 0
+MPU6050::MPU6050(int pwrMgmtMode, int gyroConfig, int accelConfig, int deviceAddress, bool isPiRev0){
+    busNumber = isPiRev0 ? 0 : 1;
+    this->deviceAddress = deviceAddress;
+    transport = new MPU6050I2CTransport(busNumber, deviceAddress);
+    ownsTransport = true;
+    construct(pwrMgmtMode, gyroConfig, accelConfig);
+}
 
-    // Initialise the I2C interface
-    i2cHandle = open(fileName, O_RDWR);
-    if (i2cHandle < 0) {
-        std::cout << std::endl << "Couldn't open the I2C Bus. Please ensure the I2C interface is enabled." << std::endl;
-        exit(I2C_BUS_INIT_ERROR);
-    }
+// Constructor using a transport supplied by the caller, such as the simulated device
+MPU6050::MPU6050(MPU6050Transport &busTransport, int pwrMgmtMode, int gyroConfig, int accelConfig){
+    busNumber = -1;
+    deviceAddress = busTransport.getAddress();
+    transport = &busTransport;
+    ownsTransport = false;
+    construct(pwrMgmtMode, gyroConfig, accelConfig);
+}
 
-    // Set the slave address for the device
-    if (ioctl(i2cHandle, I2C_SLAVE, address) < 0) {
-        std::cout << std::endl << "The I2C Device couldn't be assigned a slave address." << std::endl;
-        exit(I2C_SET_SLAVE_ADDR_ERR);
-    }
+// Constructor which reapplies cached offsets, or calibrates the device if there are none for this temperature
+MPU6050::MPU6050(const char *calibrationCache, int pwrMgmtMode, int gyroConfig, int accelConfig, int deviceAddress, bool isPiRev0){
+    busNumber = isPiRev0 ? 0 : 1;
+    this->deviceAddress = deviceAddress;
+    transport = new MPU6050I2CTransport(busNumber, deviceAddress);
+    ownsTransport = true;
 
-    // Set the registers for the MPU
-    defaultInitialise();
+    // Set the registers for the MPU with user-defined parameters
+    configureOrExit(pwrMgmtMode, gyroConfig, accelConfig);
+
+    // Writing six registers takes milliseconds, where calibrating takes around a second
+    if(!loadCalibration(calibrationCache, busNumber)){
+        if(!calibrate()){
+            std::cout << std::endl << getStatusMessage(MPU_CALIBRATION_ERROR) << std::endl;
+            exit(MPU_CALIBRATION_ERROR);
+        }
+        saveCalibration(calibrationCache, busNumber); // If the cache cannot be written the device is simply calibrated again next time
+    }
+    resetBusCounters();
 
 	// Get an initial set of readings
 	updateData();
 }
 
-// Constructor to allow adjustment of power management, gyro and accel sensitivities, device I2C address, and whether the Pi is rev 0
-MPU6050::MPU6050(int pwrMgmtMode, int gyroConfig, int accelConfig, int deviceAddress, bool isPiRev0){
-	// Set the device's I2C address
-    address = deviceAddress;
+// Constructor used by create() - the device is configured afterwards
+MPU6050::MPU6050(MPU6050Transport *busTransport, bool ownsTransport){
+    transport = busTransport;
+    this->ownsTransport = ownsTransport;
+}
 
-    if(isPiRev0){
-        snprintf(fileName, 11, "/dev/i2c-%d", 0); // The I2C interface is 0 on a rev0 Pi
-    }
-    else{
-        snprintf(fileName, 11, "/dev/i2c-%d", 1); // The I2C device is 1 otherwise
-    }
+// Move constructor - take over the transport, leaving M unopened
+MPU6050::MPU6050(MPU6050&& M) noexcept{
+    transport = NULL;
+    ownsTransport = false;
+    *this = std::move(M); // Make use of the move assignment operator
+}
 
-    // Initialise the I2C interface
-    i2cHandle = open(fileName, O_RDWR);
-    if (i2cHandle < 0) {
-        std::cout << std::endl << "Couldn't open the I2C Bus. Please ensure the I2C interface is enabled." << std::endl;
-        exit(I2C_BUS_INIT_ERROR);
+// Destructor - close the transport to end transmissions if this object created it
+MPU6050::~MPU6050(){
+    if(ownsTransport){
+        delete transport;
     }
+}
 
-    // Set the slave address for the device
-    if (ioctl(i2cHandle, I2C_SLAVE, address) < 0) {
-        std::cout << std::endl << "The I2C Device couldn't be assigned a slave address." << std::endl;
-        exit(I2C_SET_SLAVE_ADDR_ERR);
+// Open the device on a bus, sharing the handle with any other objects on it
+int MPU6050::open(int busNumber, int deviceAddress, int pwrMgmtMode, int gyroConfig, int accelConfig){
+    int status;
+
+    if(ownsTransport){
+        delete transport;
+    }
+    transport = NULL;
+    ownsTransport = false;
+    this->busNumber = busNumber;
+    this->deviceAddress = deviceAddress;
+
+    MPU6050I2CTransport *busTransport = new MPU6050I2CTransport(busNumber, deviceAddress, status);
+    if(status != CLEAN_EXIT){
+        delete busTransport;
+        return status;
+    }
+    transport = busTransport;
+    ownsTransport = true;
+
+    status = start(pwrMgmtMode, gyroConfig, accelConfig);
+    if(status != CLEAN_EXIT){
+        delete transport;
+        transport = NULL;
+        ownsTransport = false;
     }
+    return status;
+}
 
-    // Set the registers for the MPU with user-defined parameters
-    initialise(pwrMgmtMode, gyroConfig, accelConfig);
+bool MPU6050::isOpen(){return transport != NULL;}
+// --------------------------------------------------------------------------------------------
 
-	// Get an initial set of readings
-	updateData();
+// ------------------------------------ Status Construction -----------------------------------
+// Open the bus and configure the device, returning the error code rather than exiting
+int MPU6050::create(MPU6050 *&sensor, int pwrMgmtMode, int gyroConfig, int accelConfig, int deviceAddress, bool isPiRev0){
+    int status;
+    sensor = NULL;
+    MPU6050I2CTransport *busTransport = new MPU6050I2CTransport(isPiRev0 ? 0 : 1, deviceAddress, status);
+    if(status != CLEAN_EXIT){
+        delete busTransport;
+        return status;
+    }
+    MPU6050 *created = new MPU6050(busTransport, true);
+    created->busNumber = isPiRev0 ? 0 : 1;
+    created->deviceAddress = deviceAddress;
+    return finishCreate(sensor, created, pwrMgmtMode, gyroConfig, accelConfig);
 }
 
-// Copy constructor
-MPU6050::MPU6050(const MPU6050& M){
-    *this = M; // Make use of the assignment operator
+// Configure the device on a transport supplied by the caller, returning the error code rather than exiting
+int MPU6050::create(MPU6050 *&sensor, MPU6050Transport &busTransport, int pwrMgmtMode, int gyroConfig, int accelConfig){
+    sensor = NULL;
+    MPU6050 *created = new MPU6050(&busTransport, false);
+    created->busNumber = -1;
+    created->deviceAddress = busTransport.getAddress();
+    return finishCreate(sensor, created, pwrMgmtMode, gyroConfig, accelConfig);
 }
 
-// Destructor - close the I2C handle to end transmissions
-MPU6050::~MPU6050(){
-    if(i2cHandle){
-        close(i2cHandle);
+// Description of an exit code or status returned by create()
+const char* MPU6050::getStatusMessage(int status){
+    switch(status){
+    case CLEAN_EXIT:
+        return "OK";
+    case I2C_BUS_INIT_ERROR:
+        return "Couldn't open the I2C Bus. Please ensure the I2C interface is enabled and that the correct Pi rev version is selected.";
+    case I2C_SET_SLAVE_ADDR_ERR:
+        return "The I2C Device couldn't be assigned a slave address.";
+    case I2C_SET_SLAVE_PWR_MODE:
+        return "Error when setting the power register. Potential connectivity problem?";
+    case I2C_SET_GYRO_RES:
+        return "Error when setting up the Gyro. Potential connectivity problem?";
+    case I2C_SET_ACCEL_RES:
+        return "Error when setting up the Accelerometer. Potential connectivity problem?";
+    case MPU_INIT_PARAM_ERROR:
+        return "Initialise function received an invalid parameter";
+    case MPU_CALIBRATION_ERROR:
+        return "Error when calibrating the sensor. Potential connectivity problem?";
+    case I2C_SET_CONFIG:
+        return "Error when setting the sample rate and sensor configuration. Potential connectivity problem?";
+    case I2C_READ_ERROR:
+        return "Error when reading the first sample. Potential connectivity problem?";
+    case SHM_SETUP_ERROR:
+        return "Couldn't create or attach to the shared memory segment.";
+    default:
+        return "Unknown error";
     }
 }
+
+// Configure a newly created object and take its first sample, deleting it on failure
+int MPU6050::finishCreate(MPU6050 *&sensor, MPU6050 *created, int pwrMgmtMode, int gyroConfig, int accelConfig){
+    int status = created->start(pwrMgmtMode, gyroConfig, accelConfig);
+    if(status != CLEAN_EXIT){
+        delete created;
+        return status;
+    }
+    sensor = created;
+    return CLEAN_EXIT;
+}
 // --------------------------------------------------------------------------------------------
 
 // ----------------------------------- Operator Overloading -----------------------------------
-// Assignment Operator
-MPU6050& MPU6050::operator=(const MPU6050& M){
+// Move assignment - take over M's transport, configuration and counters, leaving M unopened
+MPU6050& MPU6050::operator=(MPU6050&& M) noexcept{
     if(this == &M)return *this; // Do nothing if assigned to itself
-    address = M.address;
-    i2cHandle = M.i2cHandle;
+    if(ownsTransport){
+        delete transport;
+    }
+    transport = M.transport;
+    ownsTransport = M.ownsTransport;
+    M.transport = NULL;
+    M.ownsTransport = false;
+    busNumber = M.busNumber;
+    deviceAddress = M.deviceAddress;
 
     // Set gyro data
     gyroX = M.gyroX;
@@ -182,6 +264,73 @@ MPU6050& MPU6050::operator=(const MPU6050& M){
     // Set the temperature
     temperature = M.temperature;
 
+    // Take the configuration, error handling policy and counters
+    gyroScale = M.gyroScale;
+    gyroReciprocal = M.gyroReciprocal;
+    accelScale = M.accelScale;
+    accelReciprocal = M.accelReciprocal;
+    pwrMgmtMode = M.pwrMgmtMode;
+    gyroConfig = M.gyroConfig;
+    accelConfig = M.accelConfig;
+    sampleRateDivider = M.sampleRateDivider;
+    dlpfConfig = M.dlpfConfig;
+    accelHpf = M.accelHpf;
+    interruptEnable = M.interruptEnable;
+    memcpy(motionThresholdDuration, M.motionThresholdDuration, 2);
+    cycling = M.cycling;
+    cycleWakeRate = M.cycleWakeRate;
+    lastOffsets = M.lastOffsets;
+    offsetsWritten = M.offsetsWritten;
+    channels = M.channels;
+    burstStart = M.burstStart;
+    burstLength = M.burstLength;
+    burstLayout = M.burstLayout;
+    fifoLayout = M.fifoLayout;
+    fifoFrameLength = M.fifoFrameLength;
+    M.accelHpf = MPU_ACC_HPF_RESET;
+    M.interruptEnable = 0;
+    M.cycling = false;
+    M.offsetsWritten = false;
+    fifoAuxLength = M.fifoAuxLength;
+    fifoEnabled = M.fifoEnabled;
+    fifoEnableBits = M.fifoEnableBits;
+    auxMaster = M.auxMaster;
+    auxMasterControl = M.auxMasterControl;
+    auxSlaves = M.auxSlaves;
+    memcpy(auxSlaveConfig, M.auxSlaveConfig, sizeof(auxSlaveConfig));
+    auxLength = M.auxLength;
+    M.channels = MPU_CONFIG_CHANNELS_ALL;
+    M.fifoAuxLength = 0;
+    M.fifoEnabled = false;
+    M.auxMaster = false;
+    M.auxMasterControl = 0;
+    M.auxSlaves = 0;
+    M.auxLength = 0;
+    M.planBurst();
+    maxRetries = M.maxRetries;
+    recoveryThreshold = M.recoveryThreshold;
+    consecutiveFailures = M.consecutiveFailures;
+    lastSampleStatus = M.lastSampleStatus;
+    errorLog = M.errorLog;
+    errorLogIntervalMs = M.errorLogIntervalMs;
+    lastLogMs = M.lastLogMs;
+    loggedFailures = M.loggedFailures;
+    for(int channel = 0; channel < MPU_CHANNEL_COUNT; channel++){
+        channelErrors[channel].store(M.channelErrors[channel].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    readFailures.store(M.readFailures.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    retries.store(M.retries.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    retrySuccesses.store(M.retrySuccesses.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    busRecoveries.store(M.busRecoveries.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    failedRecoveries.store(M.failedRecoveries.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    fifoOverflows.store(M.fifoOverflows.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+#ifndef MPU_NO_METRICS
+    metrics = M.metrics;
+    metricsTransactions = M.metricsTransactions;
+    metricsBytes = M.metricsBytes;
+    M.metrics = NULL;
+#endif
     return *this;
 }
 // --------------------------------------------------------------------------------------------
@@ -189,87 +338,263 @@ MPU6050& MPU6050::operator=(const MPU6050& M){
 // ------------------------------- MPU Configuration Functions --------------------------------
 // Reconfigure the power management 1 register, gyro config register and accel config register
 void MPU6050::reconfigure(int pwrMgmtMode, int gyroConfig, int accelConfig){
-    initialise(pwrMgmtMode, gyroConfig, accelConfig);
+    if(transport == NULL){
+        // Open straight into the new configuration
+        this->pwrMgmtMode = pwrMgmtMode;
+        this->gyroConfig = gyroConfig;
+        this->accelConfig = accelConfig;
+        openIfNeeded();
+        return;
+    }
+    configureOrExit(pwrMgmtMode, gyroConfig, accelConfig);
 }
-// --------------------------------------------------------------------------------------------
 
-// ---------------------------------- Data Access Functions -----------------------------------
-void MPU6050::updateData(){
-    bool readError = false;
-    int16_t rawData;
+// Write the sample rate divider and DLPF configuration in one transaction
+bool MPU6050::setSampleRate(float rateHz, int dlpfConfig){
+    openIfNeeded();
+    // Data Validation - DLPF_CONFIG 7 is reserved
+    if(rateHz <= 0 || dlpfConfig < MPU_CONFIG_DLPF_0 || dlpfConfig > MPU_CONFIG_DLPF_6){
+        return false;
+    }
 
-    // ------------ Get Gyro Data ------------
-    // X Axis
-	rawData = read16BitRegister(MPU_GYRO_X1, MPU_GYRO_X2, readError);
-    if(readError){
-        std::cout << std::endl << "Error accessing Gyro X axis data." << std::endl;
-        gyroX = 0;
+    // Sample Rate = Gyroscope Output Rate / (1 + SMPLRT_DIV), so round to the nearest divider the register can hold
+    float outputRate = dlpfConfig == MPU_CONFIG_DLPF_0 ? MPU_GYRO_OUTPUT_RATE_DLPF_OFF : MPU_GYRO_OUTPUT_RATE_DLPF_ON;
+    int divider = int(outputRate/rateHz + 0.5f) - 1;
+    if(divider < 0){
+        divider = 0;
     }
-    else{
-        gyroX = float(rawData)/gyroScale;
+    else if(divider > 255){
+        divider = 255;
     }
 
-    // Y Axis
-    rawData = read16BitRegister(MPU_GYRO_Y1, MPU_GYRO_Y2, readError);
-    if(readError){
-        std::cout << std::endl << "Error accessing Gyro Y axis data." << std::endl;
-        gyroY = 0;
+    __u8 values[2] = {__u8(divider), __u8(dlpfConfig)}; // SMPLRT_DIV and CONFIG are consecutive
+    if(transport->writeBlock(MPU_SMPLRT_DIV, values, 2) < 0){
+        return false;
     }
-    else{
-        gyroY = float(rawData)/gyroScale;
+    sampleRateDivider = divider;
+    this->dlpfConfig = dlpfConfig;
+    return true;
+}
+
+float MPU6050::getSampleRate(){
+    float outputRate = dlpfConfig == MPU_CONFIG_DLPF_0 ? MPU_GYRO_OUTPUT_RATE_DLPF_OFF : MPU_GYRO_OUTPUT_RATE_DLPF_ON;
+    return outputRate/(1 + sampleRateDivider);
+}
+
+int MPU6050::getDlpfConfig(){return dlpfConfig;}
+
+// Stop every sensor, keeping the configuration
+bool MPU6050::sleep(){
+    openIfNeeded();
+    if(transport->writeRegister(MPU_PWR_MGMT_1, powerManagement1(pwrMgmtMode) | MPU_FIELD_SLEEP.encode(1)) < 0){
+        return false;
     }
+    cycling = false;
+    return true;
+}
 
-    // Z Axis
-    rawData = read16BitRegister(MPU_GYRO_Z1, MPU_GYRO_Z2, readError);
-    if(readError){
-        std::cout << std::endl << "Error accessing Gyro Z axis data." << std::endl;
-        gyroZ = 0;
+// Return to full power. The gyros are brought out of standby first, as the clock may be taken from one of them.
+bool MPU6050::wake(){
+    openIfNeeded();
+    if(transport->writeRegister(MPU_PWR_MGMT_2, mpuStandbyBits(channels)) < 0 ||
+       transport->writeRegister(MPU_PWR_MGMT_1, powerManagement1(pwrMgmtMode)) < 0){
+        return false;
     }
-    else{
-        gyroZ = float(rawData)/gyroScale;
+    cycling = false;
+    return true;
+}
+
+// Low power accelerometer mode: the gyros go to standby and the device runs from its internal oscillator, waking at
+// wakeRate to take one accelerometer sample
+bool MPU6050::enterCycleMode(int wakeRate){
+    openIfNeeded();
+    if(!MPU_FIELD_LP_WAKE_CTRL.fits(wakeRate) || !(channels & MPU_CONFIG_CHANNELS_ACCEL)){
+        return false;
+    }
+    // Accelerometer axes which are off stay in standby
+    __u8 cyclePower2 = MPU_FIELD_LP_WAKE_CTRL.encode(wakeRate) | (mpuStandbyBits(channels) & MPU_FIELD_STBY_ACCEL.mask()) |
+                       MPU_FIELD_STBY_GYRO.encode(7);
+    __u8 cyclePower1 = MPU_FIELD_CYCLE.encode(1) | MPU_FIELD_TEMP_DIS.encode(1) | MPU_FIELD_CLKSEL.encode(MPU_PWR_MGMT_CLK_INTERNAL_8MHZ);
+    if(transport->writeRegister(MPU_PWR_MGMT_1, MPU_FIELD_CLKSEL.encode(MPU_PWR_MGMT_CLK_INTERNAL_8MHZ)) < 0 ||
+       transport->writeRegister(MPU_PWR_MGMT_2, cyclePower2) < 0 ||
+       transport->writeRegister(MPU_PWR_MGMT_1, cyclePower1) < 0){
+        return false;
     }
-    // ---------------------------------------
+    cycling = true;
+    cycleWakeRate = wakeRate;
+    return true;
+}
 
-    // ------- Get Accelerometer Data --------
-    // X Axis
-    rawData = read16BitRegister(MPU_ACC_X1, MPU_ACC_X2, readError);
-    if(readError){
-        std::cout << std::endl << "Error accessing Accel X axis data." << std::endl;
-        accelX = 0;
+bool MPU6050::isCycling(){return cycling;}
+
+// Put the channels which are off in standby and plan the burst read for the rest
+bool MPU6050::setChannels(int channels){
+    openIfNeeded();
+    if(channels <= 0 || (channels & ~MPU_CONFIG_CHANNELS_ALL) || cycling){
+        return false;
     }
-    else{
-        accelX = float(rawData)/accelScale;
+    int previous = this->channels;
+    this->channels = channels;
+    __u8 power[2] = {powerManagement1(pwrMgmtMode), mpuStandbyBits(channels)}; // PWR_MGMT_1 and PWR_MGMT_2 are consecutive
+    if(transport->writeBlock(MPU_PWR_MGMT_1, power, 2) < 0){
+        this->channels = previous;
+        return false;
     }
-    // Y Axis
-    rawData = read16BitRegister(MPU_ACC_Y1, MPU_ACC_Y2, readError);
-    if(readError){
-        std::cout << std::endl << "Error accessing Accel Y axis data." << std::endl;
-        accelY = 0;
+    planBurst();
+    return true;
+}
+
+int MPU6050::getChannels(){return channels;}
+
+bool MPU6050::disableTemp(){return setChannels(channels & ~MPU_CONFIG_CHANNELS_TEMP);}
+
+bool MPU6050::enableTemp(){return setChannels(channels | MPU_CONFIG_CHANNELS_TEMP);}
+
+bool MPU6050::disableGyro(){return setChannels(channels & ~MPU_CONFIG_CHANNELS_GYRO);}
+
+bool MPU6050::enableGyro(){return setChannels(channels | MPU_CONFIG_CHANNELS_GYRO);}
+
+bool MPU6050::disableAccel(){return setChannels(channels & ~MPU_CONFIG_CHANNELS_ACCEL);}
+
+bool MPU6050::enableAccel(){return setChannels(channels | MPU_CONFIG_CHANNELS_ACCEL);}
+
+// Pick a DLPF setting from the gyro bandwidths in the DLPF_CONFIG table
+int MPU6050::dlpfForBandwidth(float bandwidthHz){
+    const float bandwidths[] = {256, 188, 98, 42, 20, 10, 5}; // Indexed by DLPF_CONFIG
+    for(int config = MPU_CONFIG_DLPF_0; config < MPU_CONFIG_DLPF_6; config++){
+        if(bandwidths[config] <= bandwidthHz){
+            return config;
+        }
+    }
+    return MPU_CONFIG_DLPF_6;
+}
+// --------------------------------------------------------------------------------------------
+
+// ---------------------------------- Data Access Functions -----------------------------------
+int MPU6050::updateData(){
+    MPU6050RawSample raw;
+
+    if(!readRawSample(raw)){
+        // The error has been counted - see getErrorCounts()
+        gyroX = gyroY = gyroZ = 0;
+        accelX = accelY = accelZ = 0;
+        temperature = 0;
+        return lastSampleStatus;
+    }
+
+    // Scale each channel
+    MPU6050Sample sample;
+    convertSample(raw, sample);
+    storeSample(sample);
+    return lastSampleStatus;
+}
+
+// Read one unscaled sample
+bool MPU6050::readRawSample(MPU6050RawSample &sample){
+    openIfNeeded();
+    __u8 burst[MPU_BURST_LENGTH]; // Raw bytes from the first to the last enabled channel
+
+    // Read the output registers in one auto-incrementing transaction so all channels come from the same sample
+    if(!readSampleBlock(burstStart, burst, burstLength)){
+        return false;
+    }
+    decodeBurst(burst, sample);
+    return true;
+}
+
+__u8 MPU6050::getBurstStart(){return burstStart;}
+
+int MPU6050::getBurstLength(){return burstLength;}
+
+// Split a burst from the first to the last enabled channel
+void MPU6050::decodeBurst(const __u8 *burst, MPU6050RawSample &sample){
+    if(channels == MPU_CONFIG_CHANNELS_ALL){
+        decodeRawSample(burst, sample);
     }
     else{
-        accelY = float(rawData)/accelScale;
+        decodePackedSample(burst, burstLayout, channels, sample);
     }
-    // Z Axis
-    rawData = read16BitRegister(MPU_ACC_Z1, MPU_ACC_Z2, readError);
-    if(readError){
-        std::cout << std::endl << "Error accessing Accel Z axis data." << std::endl;
-        accelZ = 0;
+}
+
+// Read one unscaled sample along with the data ready flag
+bool MPU6050::readRawSample(MPU6050RawSample &sample, bool &dataReady){
+    int interruptStatus;
+    if(!readRawSampleStatus(sample, interruptStatus)){
+        return false;
+    }
+    dataReady = (interruptStatus & MPU_INT_STATUS_DATA_RDY) != 0;
+    return true;
+}
+
+// Read one unscaled sample along with the interrupt status
+bool MPU6050::readRawSampleStatus(MPU6050RawSample &sample, int &interruptStatus){
+    openIfNeeded();
+    __u8 burst[MPU_STATUS_BURST_LENGTH]; // Raw bytes from MPU_INT_STATUS to the last enabled channel
+
+    // INT_STATUS comes straight before the first channel, so only the end of the burst can be trimmed
+    int length = burstStart + burstLength - MPU_INT_STATUS;
+    if(!readSampleBlock(MPU_INT_STATUS, burst, length)){
+        return false;
+    }
+    interruptStatus = burst[0];
+    if(channels == MPU_CONFIG_CHANNELS_ALL){
+        decodeRawSample(burst + 1, sample);
     }
     else{
-        accelZ = float(rawData)/accelScale;
+        decodePackedSample(burst + 1, burstLayout | (MPU_CONFIG_CHANNEL(mpuFirstChannel(channels)) - 1), channels, sample);
     }
-    // ---------------------------------------
+    return true;
+}
 
-    // -------- Get Temperature Data ---------
-    rawData = read16BitRegister(MPU_TEMP1, MPU_TEMP2, readError);
-    if(readError){
-        std::cout << std::endl << "Error accessing Temperature data." << std::endl;
-        temperature = 0;
+// Scale a raw sample with the current gyro and accelerometer sensitivities
+void MPU6050::convertSample(const MPU6050RawSample &raw, MPU6050Sample &sample){
+    sample.gyroX = float(raw.gyroX)*gyroReciprocal;
+    sample.gyroY = float(raw.gyroY)*gyroReciprocal;
+    sample.gyroZ = float(raw.gyroZ)*gyroReciprocal;
+    sample.accelX = float(raw.accelX)*accelReciprocal;
+    sample.accelY = float(raw.accelY)*accelReciprocal;
+    sample.accelZ = float(raw.accelZ)*accelReciprocal;
+    sample.temperature = float(raw.temperature)*(1.0f/MPU_TEMP_SCALE) + float(MPU_TEMP_OFFSET); // Convert temperature to Celcius
+}
+
+// Read each channel with separate transactions. Channels may come from different samples.
+int MPU6050::updateDataPerRegister(){
+    openIfNeeded();
+    // Each channel's registers, in register order, and where its scaled value is stored
+    const __u8 MSBRegisters[MPU_CHANNEL_COUNT] = {MPU_ACC_X1, MPU_ACC_Y1, MPU_ACC_Z1, MPU_TEMP1, MPU_GYRO_X1, MPU_GYRO_Y1, MPU_GYRO_Z1};
+    const __u8 LSBRegisters[MPU_CHANNEL_COUNT] = {MPU_ACC_X2, MPU_ACC_Y2, MPU_ACC_Z2, MPU_TEMP2, MPU_GYRO_X2, MPU_GYRO_Y2, MPU_GYRO_Z2};
+    float *values[MPU_CHANNEL_COUNT] = {&accelX, &accelY, &accelZ, &temperature, &gyroX, &gyroY, &gyroZ};
+    int flags = MPU_SAMPLE_OK;
+
+    for(int channel = 0; channel < MPU_CHANNEL_COUNT; channel++){
+        if(!(channels & MPU_CONFIG_CHANNEL(channel))){
+            *values[channel] = 0;
+            continue;
+        }
+        bool readError = false;
+        int16_t rawData = read16BitRegister(MSBRegisters[channel], LSBRegisters[channel], readError, flags);
+        if(readError){
+            channelErrors[channel].fetch_add(1, std::memory_order_relaxed);
+            flags |= MPU_SAMPLE_CHANNEL_ERROR(channel);
+            *values[channel] = 0;
+        }
+        else if(channel == MPU_CHANNEL_TEMP){
+            *values[channel] = float(rawData)*(1.0f/MPU_TEMP_SCALE) + float(MPU_TEMP_OFFSET); // Convert temperature to Celcius
+        }
+        else{
+            *values[channel] = float(rawData)*(channel < MPU_CHANNEL_TEMP ? accelReciprocal : gyroReciprocal);
+        }
+    }
+
+    if(flags & MPU_SAMPLE_CHANNEL_ERRORS){
+        flags |= handleFailedSample();
     }
     else{
-        temperature = float(rawData)/320 + 36.53; // Convert temperature to Celcius
+        consecutiveFailures = 0;
+        recordSampleMetrics(1, true);
     }
-    // ---------------------------------------
+    lastSampleStatus = flags;
+    return flags;
 }
 
 float MPU6050::getGyroX(){return gyroX;}
@@ -286,143 +611,1091 @@ float MPU6050::getAccelZ(){return accelZ;}
 
 float MPU6050::getTemp(){return temperature;}
 
+float MPU6050::getGyroScale(){return gyroScale;}
+
+float MPU6050::getAccelScale(){return accelScale;}
+
+void MPU6050::setRetryPolicy(int maxRetries, int recoveryThreshold){
+    this->maxRetries = maxRetries < 0 ? 0 : maxRetries;
+    this->recoveryThreshold = recoveryThreshold < 0 ? 0 : recoveryThreshold;
+    consecutiveFailures = 0;
+}
+
+void MPU6050::setErrorLog(std::ostream *log, int intervalMs){
+    errorLog = log;
+    errorLogIntervalMs = intervalMs;
+}
+
+int MPU6050::getLastSampleStatus(){return lastSampleStatus;}
+
+void MPU6050::getErrorCounts(MPU6050ErrorCounts &counts){
+    for(int channel = 0; channel < MPU_CHANNEL_COUNT; channel++){
+        counts.channelErrors[channel] = channelErrors[channel].load(std::memory_order_relaxed);
+    }
+    counts.readFailures = readFailures.load(std::memory_order_relaxed);
+    counts.retries = retries.load(std::memory_order_relaxed);
+    counts.retrySuccesses = retrySuccesses.load(std::memory_order_relaxed);
+    counts.busRecoveries = busRecoveries.load(std::memory_order_relaxed);
+    counts.failedRecoveries = failedRecoveries.load(std::memory_order_relaxed);
+    counts.fifoOverflows = fifoOverflows.load(std::memory_order_relaxed);
+}
+
+void MPU6050::resetErrorCounts(){
+    for(int channel = 0; channel < MPU_CHANNEL_COUNT; channel++){
+        channelErrors[channel].store(0, std::memory_order_relaxed);
+    }
+    readFailures.store(0, std::memory_order_relaxed);
+    retries.store(0, std::memory_order_relaxed);
+    retrySuccesses.store(0, std::memory_order_relaxed);
+    busRecoveries.store(0, std::memory_order_relaxed);
+    failedRecoveries.store(0, std::memory_order_relaxed);
+    fifoOverflows.store(0, std::memory_order_relaxed);
+    loggedFailures = 0;
+}
+
+unsigned long MPU6050::getBusTransactions(){return transport != NULL ? transport->getTransactions() : 0;}
+
+unsigned long MPU6050::getBusBytes(){return transport != NULL ? transport->getBytes() : 0;}
+
+void MPU6050::resetBusCounters(){
+    if(transport != NULL){
+        transport->resetCounters();
+    }
+}
+
+void MPU6050::setMetrics(MPU6050Metrics *metrics){
+#ifndef MPU_NO_METRICS
+    this->metrics = metrics;
+    metricsTransactions = getBusTransactions();
+    metricsBytes = getBusBytes();
+#else
+    (void)metrics;
+#endif
+}
+
+MPU6050Metrics* MPU6050::getMetrics(){
+#ifndef MPU_NO_METRICS
+    return metrics;
+#else
+    return NULL;
+#endif
+}
 
 // --------------------------------------------------------------------------------------------
 
-// --------------------------------- Private Class Functions ----------------------------------
-// Default function to initialize the MPU6050
-void MPU6050::defaultInitialise(){
-    __u8 deviceRegister; // The device register to access
-    __s32 returnedData;  // The data returned by the device
-
-    // Configure the MPU Power Mode
-    deviceRegister = MPU_PWR_MGMT_1;
-    returnedData = i2c_smbus_write_byte_data(i2cHandle, deviceRegister, MPU_PWR_MGMT_CLK_INTERNAL_8MHZ);
+// ----------------------------------- Calibration Functions ----------------------------------
+// Number of microseconds to wait between calibration samples, and for new offsets to reach the output registers
+#define CALIBRATION_SAMPLE_US 1000
+#define CALIBRATION_SETTLE_US 10000
+
+// Name of the cache file for a device, such as <cacheDirectory>/mpu6050-1-0x68.cal
+static std::string calibrationCachePath(const char *cacheDirectory, int busNumber, int deviceAddress){
+    char fileName[32];
+    snprintf(fileName, sizeof(fileName), "/mpu6050-%d-0x%02x.cal", busNumber, deviceAddress);
+    return std::string(cacheDirectory) + fileName;
+}
+
+// Keep a value within the range of a signed 16-bit register
+static inline int16_t clamp16(long value){
+    return value > 32767 ? 32767 : (value < -32768 ? -32768 : int16_t(value));
+}
+
+// Average the biases while stationary and subtract them in the offset registers
+bool MPU6050::calibrate(int samples){
+    MPU6050Offsets offsets;
+    MPU6050RawSample raw;
+
+    if(samples <= 0 || !getOffsets(offsets)){
+        return false;
+    }
+
+    for(int pass = 0; pass < MPU_CALIBRATION_PASSES; pass++){
+        long long sums[6] = {0, 0, 0, 0, 0, 0};
+        for(int i = 0; i < samples; i++){
+            if(!readRawSample(raw)){
+                return false;
+            }
+            sums[0] += raw.accelX;
+            sums[1] += raw.accelY;
+            sums[2] += raw.accelZ;
+            sums[3] += raw.gyroX;
+            sums[4] += raw.gyroY;
+            sums[5] += raw.gyroZ;
+            usleep(CALIBRATION_SAMPLE_US);
+        }
+
+        // The accelerometer should read +1g on the Z axis and nothing elsewhere, and the gyro nothing at all
+        const double accelTargets[3] = {0, 0, accelScale};
+        int16_t *accelOffsets[3] = {&offsets.accelX, &offsets.accelY, &offsets.accelZ};
+        int16_t *gyroOffsets[3] = {&offsets.gyroX, &offsets.gyroY, &offsets.gyroZ};
+        for(int axis = 0; axis < 3; axis++){
+            double accelError = double(sums[axis])/samples - accelTargets[axis];
+            double gyroError = double(sums[axis + 3])/samples;
+
+            // Convert each error to offset register units. Bit 0 of the accelerometer offsets is reserved.
+            int16_t accelOffset = clamp16(*accelOffsets[axis] - lround(accelError*MPU_ACC_OFFSET_SCALE/accelScale));
+            *accelOffsets[axis] = (accelOffset & ~1) | (*accelOffsets[axis] & 1);
+            *gyroOffsets[axis] = clamp16(*gyroOffsets[axis] - lround(gyroError*MPU_GYRO_OFFSET_SCALE/gyroScale));
+        }
+
+        if(!setOffsets(offsets)){
+            return false;
+        }
+        usleep(CALIBRATION_SETTLE_US);
+    }
+    return true;
+}
+
+// Read the offset registers, two bursts of six bytes
+bool MPU6050::getOffsets(MPU6050Offsets &offsets){
+    openIfNeeded();
+    __u8 accel[6];
+    __u8 gyro[6];
+
+    if(transport->readBlock(MPU_XA_OFFS_H, accel, 6) != 6 || transport->readBlock(MPU_XG_OFFS_USRH, gyro, 6) != 6){
+        return false;
+    }
+    offsets.accelX = combineBytes(&accel[0]);
+    offsets.accelY = combineBytes(&accel[2]);
+    offsets.accelZ = combineBytes(&accel[4]);
+    offsets.gyroX = combineBytes(&gyro[0]);
+    offsets.gyroY = combineBytes(&gyro[2]);
+    offsets.gyroZ = combineBytes(&gyro[4]);
+    return true;
+}
+
+// Write the offset registers, two bursts of six bytes
+bool MPU6050::setOffsets(const MPU6050Offsets &offsets){
+    openIfNeeded();
+    const int16_t accelValues[3] = {offsets.accelX, offsets.accelY, offsets.accelZ};
+    const int16_t gyroValues[3] = {offsets.gyroX, offsets.gyroY, offsets.gyroZ};
+    __u8 accel[6];
+    __u8 gyro[6];
+
+    for(int i = 0; i < 3; i++){
+        accel[2*i] = __u8(accelValues[i] >> 8);
+        accel[2*i + 1] = __u8(accelValues[i]);
+        gyro[2*i] = __u8(gyroValues[i] >> 8);
+        gyro[2*i + 1] = __u8(gyroValues[i]);
+    }
+    if(transport->writeBlock(MPU_XA_OFFS_H, accel, 6) < 0 || transport->writeBlock(MPU_XG_OFFS_USRH, gyro, 6) < 0){
+        return false;
+    }
+    lastOffsets = offsets; // A reset loses the gyro offsets and reloads the accelerometer's factory trim, so keep them for a recovery
+    offsetsWritten = true;
+    return true;
+}
+
+// Replace any cached offsets near the current temperature with the current offsets
+bool MPU6050::saveCalibration(const char *cacheDirectory, int busNumber){
+    openIfNeeded();
+    MPU6050Offsets offsets;
+    MPU6050RawSample raw;
+    MPU6050Sample sample;
+
+    if(!getOffsets(offsets) || !readRawSample(raw)){
+        return false;
+    }
+    convertSample(raw, sample);
+
+    // Keep the entries for other temperatures. Each line is: temperature accelX accelY accelZ gyroX gyroY gyroZ
+    std::string path = calibrationCachePath(cacheDirectory, busNumber, transport->getAddress());
+    std::vector<std::string> entries;
+    std::ifstream existing(path.c_str());
+    std::string line;
+    while(std::getline(existing, line)){
+        std::istringstream fields(line);
+        float entryTemperature;
+        if(line[0] != '#' && (fields >> entryTemperature) && fabs(entryTemperature - sample.temperature) > MPU_CALIBRATION_TEMP_TOLERANCE){
+            entries.push_back(line);
+        }
+    }
+    existing.close();
+
+    // Write a new file and rename it over the old one, so the cache is never left half written
+    std::string temporaryPath = path + ".tmp";
+    std::ofstream cache(temporaryPath.c_str());
+    cache << "# MPU6050 offsets for bus " << busNumber << " address 0x" << std::hex << transport->getAddress() << std::dec << std::endl;
+    cache << "# temperature accelX accelY accelZ gyroX gyroY gyroZ" << std::endl;
+    for(size_t i = 0; i < entries.size(); i++){
+        cache << entries[i] << std::endl;
+    }
+    cache << sample.temperature << " " << offsets.accelX << " " << offsets.accelY << " " << offsets.accelZ << " "
+          << offsets.gyroX << " " << offsets.gyroY << " " << offsets.gyroZ << std::endl;
+    cache.close();
+    if(!cache){
+        remove(temporaryPath.c_str());
+        return false;
+    }
+    return rename(temporaryPath.c_str(), path.c_str()) == 0;
+}
+
+// Apply the cached offsets made nearest the current temperature
+bool MPU6050::loadCalibration(const char *cacheDirectory, int busNumber){
+    openIfNeeded();
+    MPU6050RawSample raw;
+    MPU6050Sample sample;
+
+    if(!readRawSample(raw)){
+        return false;
+    }
+    convertSample(raw, sample);
+
+    std::ifstream cache(calibrationCachePath(cacheDirectory, busNumber, transport->getAddress()).c_str());
+    std::string line;
+    bool found = false;
+    float bestDifference = MPU_CALIBRATION_TEMP_TOLERANCE;
+    MPU6050Offsets best;
+    while(std::getline(cache, line)){
+        std::istringstream fields(line);
+        float entryTemperature;
+        MPU6050Offsets entry;
+        if(line.empty() || line[0] == '#' ||
+           !(fields >> entryTemperature >> entry.accelX >> entry.accelY >> entry.accelZ >> entry.gyroX >> entry.gyroY >> entry.gyroZ)){
+            continue;
+        }
+        float difference = fabs(entryTemperature - sample.temperature);
+        if(difference <= bestDifference){
+            bestDifference = difference;
+            best = entry;
+            found = true;
+        }
+    }
+    return found && setOffsets(best);
+}
+// --------------------------------------------------------------------------------------------
+
+// ----------------------------------- Interrupt Functions ------------------------------------
+// Pulse the INT pin each time the output registers are updated
+void MPU6050::enableDataReadyInterrupt(){
+    openIfNeeded();
+    __s32 returnedData; // The data returned by the device
+
+    // Active high, push-pull, 50us pulse - a rising edge marks each new sample
+    returnedData = transport->writeRegister(MPU_INT_PIN_CFG, 0);
     if (returnedData < 0){
-        std::cout << std::endl << "Error when setting the power register. Potential connectivity problem?" << std::endl;
-        exit(I2C_SET_SLAVE_PWR_MODE);
-    }
-
-    // Configure Interrupts
-//    deviceRegister = MPU_INT_ENABLE;
-//    returnedData = i2c_smbus_write_byte_data(i2cHandle, deviceRegister, 1);
-//    if (returnedData < 0){
-//        std::cout << std::endl << "Error when setting up the interrupts. Potential connectivity problem?" << std::endl;
-//        exit(I2C_SETUP_INTERRUPTS);
-//    }
-
-    // Configure the Gyroscope
-    deviceRegister = MPU_GYRO_CONFIG;
-    // Set the sensitivity. Value shifted to the right to correctly position it in the register
-    returnedData = i2c_smbus_write_byte_data(i2cHandle, deviceRegister, MPU_GYRO_SENS_500 << 3);
+        std::cout << std::endl << "Error when setting up the interrupts. Potential connectivity problem?" << std::endl;
+        exit(I2C_SETUP_INTERRUPTS);
+    }
+
+    if (!setInterruptEnable(interruptEnable | MPU_INT_ENABLE_DATA_RDY)){
+        std::cout << std::endl << "Error when setting up the interrupts. Potential connectivity problem?" << std::endl;
+        exit(I2C_SETUP_INTERRUPTS);
+    }
+}
+
+// Stop pulsing the INT pin for new samples
+void MPU6050::disableDataReadyInterrupt(){
+    openIfNeeded();
+    if (!setInterruptEnable(interruptEnable & ~MPU_INT_ENABLE_DATA_RDY)){
+        std::cout << std::endl << "Error when setting up the interrupts. Potential connectivity problem?" << std::endl;
+        exit(I2C_SETUP_INTERRUPTS);
+    }
+}
+
+// Program the motion detector. It works on the high-pass filtered accelerometer output, so the filter is set too.
+bool MPU6050::enableMotionInterrupt(int thresholdMg, int duration){
+    openIfNeeded();
+    int threshold = (thresholdMg + MPU_MOT_THR_SCALE/2)/MPU_MOT_THR_SCALE;
+    if(thresholdMg <= 0 || !MPU_FIELD_MOT_THR.fits(threshold) || duration <= 0 || !MPU_FIELD_MOT_DUR.fits(duration)){
+        return false;
+    }
+
+    __u8 thresholdDuration[2] = {MPU_FIELD_MOT_THR.encode(threshold), MPU_FIELD_MOT_DUR.encode(duration)}; // MOT_THR and MOT_DUR are consecutive
+    __u8 accelConfigValue = MPU_FIELD_AFS_SEL.encode(accelConfig) | MPU_FIELD_ACCEL_HPF.encode(MPU_ACC_HPF_5HZ);
+    if(transport->writeBlock(MPU_MOT_THR, thresholdDuration, 2) < 0 || transport->writeRegister(MPU_ACC_CONFIG, accelConfigValue) < 0){
+        return false;
+    }
+    accelHpf = MPU_ACC_HPF_5HZ;
+    memcpy(motionThresholdDuration, thresholdDuration, 2);
+
+    // Active high, push-pull, 50us pulse, as for the data ready interrupt
+    return transport->writeRegister(MPU_INT_PIN_CFG, 0) >= 0 && setInterruptEnable(interruptEnable | MPU_INT_ENABLE_MOT);
+}
+
+bool MPU6050::disableMotionInterrupt(){
+    openIfNeeded();
+    if(!setInterruptEnable(interruptEnable & ~MPU_INT_ENABLE_MOT)){
+        return false;
+    }
+    if(transport->writeRegister(MPU_ACC_CONFIG, MPU_FIELD_AFS_SEL.encode(accelConfig)) < 0){
+        return false;
+    }
+    accelHpf = MPU_ACC_HPF_RESET;
+    return true;
+}
+
+bool MPU6050::setInterruptEnable(int flags){
+    openIfNeeded();
+    if(transport->writeRegister(MPU_INT_ENABLE, flags) < 0){
+        return false;
+    }
+    interruptEnable = flags;
+    return true;
+}
+
+int MPU6050::readInterruptStatus(){
+    openIfNeeded();
+    __s32 status = transport->readRegister(MPU_INT_STATUS);
+    return status < 0 ? -1 : status;
+}
+// --------------------------------------------------------------------------------------------
+
+// --------------------------------- FIFO Streaming Functions ---------------------------------
+// Configure the sample rate if a divider is given, and start writing the enabled channels to the FIFO
+void MPU6050::enableFifo(int sampleRateDivider){
+    openIfNeeded();
+    __s32 returnedData; // The data returned by the device
+
+    // Data Validation
+    if(sampleRateDivider != MPU_FIFO_KEEP_SMPLRT_DIV && (sampleRateDivider < 0 || sampleRateDivider > 255)){
+        std::cout << std::endl << "enableFifo received an invalid sample rate divider" << std::endl;
+        exit(MPU_INIT_PARAM_ERROR);
+    }
+
+    // Set the rate at which frames are written to the FIFO, unless the caller kept the one already programmed
+    if(sampleRateDivider != MPU_FIFO_KEEP_SMPLRT_DIV){
+        returnedData = transport->writeRegister(MPU_SMPLRT_DIV, sampleRateDivider);
+        if (returnedData < 0){
+            std::cout << std::endl << "Error when setting the sample rate. Potential connectivity problem?" << std::endl;
+            exit(I2C_SETUP_FIFO);
+        }
+        this->sampleRateDivider = sampleRateDivider;
+    }
+
+    // Stop any previous streaming and start from an empty FIFO so frames stay aligned
+    disableFifo();
+    resetFifo();
+
+    // Select the channels to write to the FIFO - these are written in register order, the same as a burst read. The
+    // accelerometer axes can only be enabled together.
+    int fifoEnable = 0;
+    fifoLayout = 0;
+    if(channels & MPU_CONFIG_CHANNELS_ACCEL){
+        fifoEnable |= MPU_FIFO_EN_ACCEL;
+        fifoLayout |= MPU_CONFIG_CHANNELS_ACCEL;
+    }
+    const int channelFifoBits[] = {MPU_FIFO_EN_TEMP, MPU_FIFO_EN_XG, MPU_FIFO_EN_YG, MPU_FIFO_EN_ZG}; // From MPU_CHANNEL_TEMP
+    for(int channel = MPU_CHANNEL_TEMP; channel < MPU_CHANNEL_COUNT; channel++){
+        if(channels & MPU_CONFIG_CHANNEL(channel)){
+            fifoEnable |= channelFifoBits[channel - MPU_CHANNEL_TEMP];
+            fifoLayout |= MPU_CONFIG_CHANNEL(channel);
+        }
+    }
+    fifoFrameLength = 0;
+    for(int channel = 0; channel < MPU_CHANNEL_COUNT; channel++){
+        fifoFrameLength += (fifoLayout & MPU_CONFIG_CHANNEL(channel)) ? 2 : 0;
+    }
+
+    // The external data follows the channels, in slave order
+    const int slaveFifoBits[] = {MPU_FIFO_EN_SLV0, MPU_FIFO_EN_SLV1, MPU_FIFO_EN_SLV2};
+    for(int slave = 0; slave < auxSlaves && slave < 3; slave++){
+        fifoEnable |= slaveFifoBits[slave];
+    }
+    if(auxSlaves == MPU_I2C_SLV_COUNT &&
+       transport->writeRegister(MPU_I2C_MST_CTRL, auxMasterControl | MPU_I2C_MST_CTRL_SLV_3_FIFO_EN) < 0){
+        std::cout << std::endl << "Error when setting up the FIFO. Potential connectivity problem?" << std::endl;
+        exit(I2C_SETUP_FIFO);
+    }
+    fifoAuxLength = auxLength;
+    fifoFrameLength += fifoAuxLength;
+
+    returnedData = transport->writeRegister(MPU_FIFO_EN, fifoEnable);
     if (returnedData < 0){
-        std::cout << std::endl << "Error when setting up the Gyro. Potential connectivity problem?" << std::endl;
-        exit(I2C_SET_GYRO_RES);
+        std::cout << std::endl << "Error when setting up the FIFO. Potential connectivity problem?" << std::endl;
+        exit(I2C_SETUP_FIFO);
     }
-    gyroScale = MPU_GYRO_SCALE_500;
 
+    // Read the interrupt status to clear any stale overflow flag
+    transport->readRegister(MPU_INT_STATUS);
 
-    // Configure the Accelerometer
-    deviceRegister = MPU_ACC_CONFIG;
-    // Set the sensitivity. Value shifted to the right to correctly position it in the register
-    returnedData = i2c_smbus_write_byte_data(i2cHandle, deviceRegister, MPU_ACC_SENS_2 << 3);
+    // Enable the FIFO, keeping the auxiliary master running
+    returnedData = transport->writeRegister(MPU_USER_CTRL, MPU_USER_CTRL_FIFO_EN | (auxMaster ? MPU_USER_CTRL_I2C_MST_EN : 0));
     if (returnedData < 0){
-        std::cout << std::endl << "Error when setting up the Accelerometer. Potential connectivity problem?" << std::endl;
-        exit(I2C_SET_ACCEL_RES);
+        std::cout << std::endl << "Error when setting up the FIFO. Potential connectivity problem?" << std::endl;
+        exit(I2C_SETUP_FIFO);
+    }
+    fifoEnabled = true;
+    fifoEnableBits = fifoEnable;
+}
+
+// Stop writing samples to the FIFO
+void MPU6050::disableFifo(){
+    openIfNeeded();
+    if (transport->writeRegister(MPU_FIFO_EN, 0) < 0 ||
+        transport->writeRegister(MPU_USER_CTRL, auxMaster ? MPU_USER_CTRL_I2C_MST_EN : 0) < 0 ||
+        (auxSlaves == MPU_I2C_SLV_COUNT && transport->writeRegister(MPU_I2C_MST_CTRL, auxMasterControl) < 0)){
+        std::cout << std::endl << "Error when disabling the FIFO. Potential connectivity problem?" << std::endl;
+        exit(I2C_SETUP_FIFO);
+    }
+    fifoEnabled = false;
+}
+
+// Discard the contents of the FIFO, leaving it enabled if it was already
+void MPU6050::resetFifo(){
+    openIfNeeded();
+    if (!clearFifo()){
+        std::cout << std::endl << "Error when resetting the FIFO. Potential connectivity problem?" << std::endl;
+        exit(I2C_SETUP_FIFO);
     }
-    accelScale = MPU_ACC_SCALE_2;
 }
 
-// Initialiser function to allow custom configuration of power management and gyro and accel configs
-void MPU6050::initialise(int pwrMgmtMode, int gyroConfig, int accelConfig){
-	__u8 deviceRegister; // The device register to access
-    __s32 returnedData;  // The data returned by the device
+// As resetFifo(), returning false on an error rather than exiting
+bool MPU6050::clearFifo(){
+    __s32 userControl = transport->readRegister(MPU_USER_CTRL);
+    __u8 keep = MPU_USER_CTRL_FIFO_EN | MPU_USER_CTRL_I2C_MST_EN;
+    return userControl >= 0 && transport->writeRegister(MPU_USER_CTRL, (userControl & keep) | MPU_USER_CTRL_FIFO_RESET) >= 0;
+}
+
+// Drain whole frames from the FIFO into the raw samples buffer
+int MPU6050::readFifoRaw(MPU6050RawSample *samples, int maxSamples, bool &overflow){
+    return readFifoRawAux(samples, NULL, maxSamples, overflow);
+}
+
+// As above, copying the external data at the end of each frame if auxData is not NULL
+int MPU6050::readFifoRawAux(MPU6050RawSample *samples, __u8 *auxData, int maxSamples, bool &overflow, MPU6050FifoTiming *timing){
+    openIfNeeded();
+    __u8 fifoData[MPU_FIFO_SIZE]; // Raw bytes popped from the FIFO
+    __u8 countBytes[2];           // FIFO_COUNT, MSB first
+    __s32 status;                 // The interrupt status register
+    int frames;                   // Number of whole frames to read
+    int flags = MPU_SAMPLE_OK;    // Status of the reads
+
+    overflow = false;
+
+    // Check for overflow first - once the FIFO has wrapped, the frame boundaries are lost
+    // Reading INT_STATUS clears it, so it is not retried
+    status = timedReadRegister(MPU_INT_STATUS);
+    if(status < 0){
+        readFailures.fetch_add(1, std::memory_order_relaxed);
+        failSample(flags);
+        return -1;
+    }
+    if(status & MPU_INT_STATUS_FIFO_OFLOW){
+        fifoOverflows.fetch_add(1, std::memory_order_relaxed);
+#ifndef MPU_NO_METRICS
+        if(metrics != NULL){
+            metrics->recordFifoOverflow();
+        }
+#endif
+        overflow = true;
+        // On the sampling path a failed reset is a read error like any other, rather than a reason to exit
+        if(!clearFifo()){
+            failSample(flags);
+            return -1;
+        }
+        lastSampleStatus = flags;
+        return 0;
+    }
+
+    // Find how many whole frames are waiting
+    uint64_t countStartNs = 0;
+    if(timing != NULL){
+        countStartNs = MPU6050Acquisition::nowNs(CLOCK_MONOTONIC_RAW);
+    }
+    if(!readBlockWithRetry(MPU_FIFO_COUNT1, countBytes, 2, flags)){
+        failSample(flags);
+        return -1;
+    }
+    int fifoCount = countBytes[0] << 8 | countBytes[1];
+    if(fifoCount > MPU_FIFO_SIZE){
+        // The FIFO can't hold this much, so the count is corrupt and the frame boundaries can't be trusted either
+        readFailures.fetch_add(1, std::memory_order_relaxed);
+        clearFifo();
+        failSample(flags);
+        return -1;
+    }
+    frames = fifoCount/fifoFrameLength;
+    if(timing != NULL){
+        uint64_t countEndNs = MPU6050Acquisition::nowNs(CLOCK_MONOTONIC_RAW);
+        timing->countTimeNs = countStartNs + (countEndNs - countStartNs)/2;
+        timing->framesWaiting = frames;
+    }
+    if(frames > maxSamples){
+        frames = maxSamples;
+    }
+    if(frames > MPU_FIFO_SIZE/fifoFrameLength){
+        frames = MPU_FIFO_SIZE/fifoFrameLength; // Never more than fifoData holds
+    }
+    if(frames == 0){
+        return 0;
+    }
+
+    // Pop every frame in one transaction. This is not retried, as a failed read may already have popped some bytes.
+    if(timedReadBlock(MPU_FIFO_R_W, fifoData, frames*fifoFrameLength) != frames*fifoFrameLength){
+        readFailures.fetch_add(1, std::memory_order_relaxed);
+        failSample(flags);
+        return -1;
+    }
+    consecutiveFailures = 0;
+    lastSampleStatus = flags;
+    recordSampleMetrics(frames, false);
+
+    if(fifoLayout == MPU_CONFIG_CHANNELS_ALL && channels == MPU_CONFIG_CHANNELS_ALL){
+        for(int i = 0; i < frames; i++){
+            decodeRawSample(&fifoData[i*fifoFrameLength], samples[i]);
+        }
+    }
+    else{
+        for(int i = 0; i < frames; i++){
+            decodePackedSample(&fifoData[i*fifoFrameLength], fifoLayout, channels, samples[i]);
+        }
+    }
+    if(auxData != NULL){
+        for(int i = 0; i < frames; i++){
+            memcpy(&auxData[i*fifoAuxLength], &fifoData[(i + 1)*fifoFrameLength - fifoAuxLength], fifoAuxLength);
+        }
+    }
+    return frames;
+}
+
+int MPU6050::getFifoFrameLength(){return fifoFrameLength;}
+// --------------------------------------------------------------------------------------------
+
+// ------------------------------ Auxiliary I2C Master Functions ------------------------------
+// Start the master. The data ready interrupt waits for the external reads, so every sample's external data is complete.
+bool MPU6050::enableAuxMaster(int clock){
+    openIfNeeded();
+    if(!MPU_FIELD_I2C_MST_CLK.fits(clock)){
+        return false;
+    }
+    __u8 control = MPU_I2C_MST_CTRL_WAIT_FOR_ES | MPU_FIELD_I2C_MST_CLK.encode(clock);
+    __s32 userControl = transport->readRegister(MPU_USER_CTRL);
+    if(userControl < 0 || transport->writeRegister(MPU_I2C_MST_CTRL, control) < 0 ||
+       transport->writeRegister(MPU_USER_CTRL, (userControl & MPU_USER_CTRL_FIFO_EN) | MPU_USER_CTRL_I2C_MST_EN) < 0){
+        return false;
+    }
+    auxMaster = true;
+    auxMasterControl = control;
+    return true;
+}
+
+// Disable every slave, then the master
+bool MPU6050::disableAuxMaster(){
+    openIfNeeded();
+    for(int slave = 0; slave < auxSlaves; slave++){
+        if(transport->writeRegister(MPU_I2C_SLV_CTRL(slave), 0) < 0){
+            return false;
+        }
+    }
+    auxSlaves = 0;
+    auxLength = 0;
+    __s32 userControl = transport->readRegister(MPU_USER_CTRL);
+    if(userControl < 0 || transport->writeRegister(MPU_USER_CTRL, userControl & MPU_USER_CTRL_FIFO_EN) < 0 ||
+       transport->writeRegister(MPU_I2C_MST_CTRL, 0) < 0){
+        return false;
+    }
+    auxMaster = false;
+    auxMasterControl = 0;
+    return true;
+}
+
+// Give the next free slave a read. Its data lands in EXT_SENS_DATA after that of the slaves before it.
+int MPU6050::addAuxRead(int address, __u8 startRegister, int length){
+    openIfNeeded();
+    if(!auxMaster || auxSlaves == MPU_I2C_SLV_COUNT || !MPU_FIELD_I2C_SLV_ADDR.fits(address) || length <= 0 ||
+       length > MPU_I2C_SLV_MAX_LENGTH || auxLength + length > MPU_EXT_SENS_DATA_LENGTH){
+        return -1;
+    }
+    __u8 slave[3] = {__u8(MPU_I2C_SLV_READ | MPU_FIELD_I2C_SLV_ADDR.encode(address)), startRegister,
+                     __u8(MPU_I2C_SLV_EN | MPU_FIELD_I2C_SLV_LEN.encode(length))}; // I2C_SLVx_ADDR, REG and CTRL are consecutive
+    if(transport->writeBlock(MPU_I2C_SLV_ADDR(auxSlaves), slave, 3) < 0){
+        return -1;
+    }
+    memcpy(auxSlaveConfig[auxSlaves], slave, 3);
+    int offset = auxLength;
+    auxSlaves++;
+    auxLength += length;
+    return offset;
+}
+
+// Write through slave 4, which transfers once at the next sample and then sets I2C_SLV4_DONE
+bool MPU6050::writeAuxRegister(int address, __u8 deviceRegister, __u8 value){
+    openIfNeeded();
+    if(!auxMaster || !MPU_FIELD_I2C_SLV_ADDR.fits(address)){
+        return false;
+    }
+    __u8 slave4[4] = {MPU_FIELD_I2C_SLV_ADDR.encode(address), deviceRegister, value, MPU_I2C_SLV_EN}; // I2C_SLV4_ADDR, REG, DO and CTRL
+    if(transport->writeBlock(MPU_I2C_SLV4_ADDR, slave4, 4) < 0){
+        return false;
+    }
+    for(int elapsedMs = 0; elapsedMs <= MPU_AUX_WRITE_TIMEOUT_MS; elapsedMs++){
+        int status = readAuxStatus();
+        if(status < 0 || (status & MPU_I2C_MST_STATUS_SLV4_NACK)){
+            return false;
+        }
+        if(status & MPU_I2C_MST_STATUS_SLV4_DONE){
+            return true;
+        }
+        usleep(1000);
+    }
+    return false;
+}
+
+int MPU6050::getAuxLength(){return auxLength;}
+
+int MPU6050::getFifoAuxLength(){return fifoAuxLength;}
+
+int MPU6050::readAuxStatus(){
+    openIfNeeded();
+    __s32 status = transport->readRegister(MPU_I2C_MST_STATUS);
+    return status < 0 ? -1 : status;
+}
+
+// Read from the first enabled channel through the end of the external data
+bool MPU6050::readRawSampleAux(MPU6050RawSample &sample, __u8 *auxData){
+    openIfNeeded();
+    __u8 burst[MPU_BURST_LENGTH + MPU_EXT_SENS_DATA_LENGTH];
+
+    // EXT_SENS_DATA follows GYRO_ZOUT, so the burst runs on to the end of the channels even if the last ones are off
+    int channelLength = MPU_BURST_START + MPU_BURST_LENGTH - burstStart;
+    if(!readSampleBlock(burstStart, burst, channelLength + auxLength)){
+        return false;
+    }
+    if(channels == MPU_CONFIG_CHANNELS_ALL){
+        decodeRawSample(burst, sample);
+    }
+    else{
+        decodePackedSample(burst, MPU_CONFIG_CHANNELS_ALL & ~(MPU_CONFIG_CHANNEL(mpuFirstChannel(channels)) - 1), channels, sample);
+    }
+    memcpy(auxData, burst + channelLength, auxLength);
+    return true;
+}
+
+// Drain whole frames from the FIFO into the scaled samples buffer
+int MPU6050::readFifo(MPU6050Sample *samples, int maxSamples, bool &overflow){
+    MPU6050RawSample raw[MPU_FIFO_MAX_FRAMES];
+
+    if(maxSamples > MPU_FIFO_MAX_FRAMES){
+        maxSamples = MPU_FIFO_MAX_FRAMES;
+    }
+    int count = readFifoRaw(raw, maxSamples, overflow);
+    for(int i = 0; i < count; i++){
+        convertSample(raw[i], samples[i]);
+    }
+    return count;
+}
+// --------------------------------------------------------------------------------------------
 
-    // Arrays to set the correct scaling parameters
-    const float gyroScales[] = {MPU_GYRO_SCALE_250, MPU_GYRO_SCALE_500, MPU_GYRO_SCALE_1000, MPU_GYRO_SCALE_2000};
-    const float accelScales[] = {MPU_ACC_SCALE_2, MPU_ACC_SCALE_4, MPU_ACC_SCALE_8, MPU_ACC_SCALE_16};
+// --------------------------------- Private Class Functions ----------------------------------
+// Bring the configuration registers to the requested values, writing only those which differ. Returns CLEAN_EXIT or the error code.
+int MPU6050::configure(int pwrMgmtMode, int gyroConfig, int accelConfig){
+    __u8 current[MPU_CONFIG_BLOCK_LENGTH]; // SMPLRT_DIV, CONFIG, GYRO_CONFIG and ACCEL_CONFIG as read from the device
+    __u8 wanted[MPU_CONFIG_BLOCK_LENGTH];  // The values they should have
+    __u8 power[2];                         // PWR_MGMT_1 and PWR_MGMT_2 as read from the device
 
 	// Data Validation
-	if(pwrMgmtMode < MPU_PWR_MGMT_CLK_INTERNAL_8MHZ || pwrMgmtMode > MPU_PWR_MGMT_CLK_STOP){
-		std::cout << std::endl << "Initialise function received an invalid power management parameter" << std::endl;
-		exit(MPU_INIT_PARAM_ERROR);
-	}
-	if(gyroConfig < MPU_GYRO_SENS_250 || gyroConfig > MPU_GYRO_SENS_2000){
-		std::cout << std::endl << "Initialise function received an invalid gyro configuration parameter" << std::endl;
-		exit(MPU_INIT_PARAM_ERROR);
-	}
-	if(accelConfig < MPU_ACC_SENS_2 || accelConfig > MPU_ACC_SENS_16){
-		std::cout << std::endl << "Initialise function received an invalid accel configuration parameter" << std::endl;
-		exit(MPU_INIT_PARAM_ERROR);
+	if(pwrMgmtMode < MPU_PWR_MGMT_CLK_INTERNAL_8MHZ || pwrMgmtMode > MPU_PWR_MGMT_CLK_STOP ||
+	   gyroConfig < MPU_GYRO_SENS_250 || gyroConfig > MPU_GYRO_SENS_2000 ||
+	   accelConfig < MPU_ACC_SENS_2 || accelConfig > MPU_ACC_SENS_16){
+		return MPU_INIT_PARAM_ERROR;
 	}
 
-    // Configure the MPU Power Mode
-    deviceRegister = MPU_PWR_MGMT_1;
-    returnedData = i2c_smbus_write_byte_data(i2cHandle, deviceRegister, pwrMgmtMode);
-    if (returnedData < 0){
-        std::cout << std::endl << "Error when setting the power register. Potential connectivity problem?" << std::endl;
-        exit(I2C_SET_SLAVE_PWR_MODE);
+    // Read back the current configuration. PWR_MGMT_1 and 2 are far from the others, and the registers between them have
+    // read side effects, so they are read on their own. If a read-back fails, every register it covers is written
+    // one at a time instead, as the constructors did before the configuration was read back.
+    bool powerKnown = transport->readBlock(MPU_PWR_MGMT_1, power, 2) == 2;
+    bool configKnown = transport->readBlock(MPU_SMPLRT_DIV, current, MPU_CONFIG_BLOCK_LENGTH) == MPU_CONFIG_BLOCK_LENGTH;
+
+    // Configure the MPU Power Mode and channel standby if they have changed - this also wakes the device after a reset
+    __u8 wantedPower[2] = {powerManagement1(pwrMgmtMode), mpuStandbyBits(channels)};
+    if(!powerKnown){
+        if(transport->writeRegister(MPU_PWR_MGMT_1, wantedPower[0]) < 0 || transport->writeRegister(MPU_PWR_MGMT_2, wantedPower[1]) < 0){
+            return I2C_SET_SLAVE_PWR_MODE;
+        }
+    }
+    else if(power[1] != wantedPower[1]){
+        if(transport->writeBlock(MPU_PWR_MGMT_1, wantedPower, 2) < 0){
+            return I2C_SET_SLAVE_PWR_MODE;
+        }
+    }
+    else if(power[0] != wantedPower[0] && transport->writeRegister(MPU_PWR_MGMT_1, wantedPower[0]) < 0){
+        return I2C_SET_SLAVE_PWR_MODE;
+    }
+    cycling = false;
+
+    // The sample rate divider and filter keep the last values set with setSampleRate(), which are the reset values unless
+    // it has been called.
+    wanted[0] = MPU_FIELD_SMPLRT_DIV.encode(sampleRateDivider);
+    wanted[1] = MPU_FIELD_DLPF_CFG.encode(dlpfConfig);
+    wanted[2] = MPU_FIELD_FS_SEL.encode(gyroConfig);
+    wanted[3] = MPU_FIELD_AFS_SEL.encode(accelConfig) | MPU_FIELD_ACCEL_HPF.encode(accelHpf);
+
+    if(!configKnown){
+        const int errors[MPU_CONFIG_BLOCK_LENGTH] = {I2C_SET_CONFIG, I2C_SET_CONFIG, I2C_SET_GYRO_RES, I2C_SET_ACCEL_RES};
+        for(int i = 0; i < MPU_CONFIG_BLOCK_LENGTH; i++){
+            if(transport->writeRegister(MPU_SMPLRT_DIV + i, wanted[i]) < 0){
+                return errors[i];
+            }
+        }
+        memcpy(current, wanted, MPU_CONFIG_BLOCK_LENGTH); // Nothing left to write below
     }
 
-    // Configure the Gyroscope
-    deviceRegister = MPU_GYRO_CONFIG;
-    // Set the sensitivity. Value shifted to the right to correctly position it in the register
-    returnedData = i2c_smbus_write_byte_data(i2cHandle, deviceRegister, gyroConfig << 3);
-    if (returnedData < 0){
-        std::cout << std::endl << "Error when setting up the Gyro. Potential connectivity problem?" << std::endl;
-        exit(I2C_SET_GYRO_RES);
+    // Write the registers that differ, from the first to the last, in one transaction
+    int first = 0, last = MPU_CONFIG_BLOCK_LENGTH - 1;
+    while(first <= last && current[first] == wanted[first]){
+        first++;
+    }
+    while(last >= first && current[last] == wanted[last]){
+        last--;
+    }
+    if(first <= last && transport->writeBlock(MPU_SMPLRT_DIV + first, &wanted[first], last - first + 1) < 0){
+        // Report the sensor whose sensitivity was being set, if any
+        if(MPU_SMPLRT_DIV + last >= MPU_GYRO_CONFIG && MPU_SMPLRT_DIV + first <= MPU_GYRO_CONFIG){
+            return I2C_SET_GYRO_RES;
+        }
+        return MPU_SMPLRT_DIV + last == MPU_ACC_CONFIG ? I2C_SET_ACCEL_RES : I2C_SET_CONFIG;
     }
-    gyroScale = gyroScales[gyroConfig];
 
+    gyroScale = MPU_GYRO_SCALES[gyroConfig];
+    gyroReciprocal = 1.0f/gyroScale;
+    accelScale = MPU_ACC_SCALES[accelConfig];
+    accelReciprocal = 1.0f/accelScale;
 
-    // Configure the Accelerometer
-    deviceRegister = MPU_ACC_CONFIG;
-    // Set the sensitivity. Value shifted to the right to correctly position it in the register
-    returnedData = i2c_smbus_write_byte_data(i2cHandle, deviceRegister, accelConfig << 3);
-    if (returnedData < 0){
-        std::cout << std::endl << "Error when setting up the Accelerometer. Potential connectivity problem?" << std::endl;
-        exit(I2C_SET_ACCEL_RES);
+    // Remember the configuration so it can be restored after a bus recovery
+    this->pwrMgmtMode = pwrMgmtMode;
+    this->gyroConfig = gyroConfig;
+    this->accelConfig = accelConfig;
+    return CLEAN_EXIT;
+}
+
+// PWR_MGMT_1 at full power. The clock falls back to the internal oscillator if its gyro axis is in standby.
+__u8 MPU6050::powerManagement1(int clockSource){
+    int clock = clockSource;
+    if(clock >= MPU_PWR_MGMT_CLK_PLL_X_GYRO && clock <= MPU_PWR_MGMT_CLK_PLL_Z_GYRO &&
+       !(channels & MPU_CONFIG_CHANNEL(MPU_CHANNEL_GYRO_X + clock - MPU_PWR_MGMT_CLK_PLL_X_GYRO))){
+        clock = MPU_PWR_MGMT_CLK_INTERNAL_8MHZ;
     }
-    accelScale = accelScales[accelConfig];
+    return MPU_FIELD_CLKSEL.encode(clock) | MPU_FIELD_TEMP_DIS.encode(!(channels & MPU_CONFIG_CHANNELS_TEMP));
+}
+
+// Read the contiguous registers from the first to the last enabled channel. Channels in between are read and dropped,
+// as one longer transaction is cheaper than two.
+void MPU6050::planBurst(){
+    int first = mpuFirstChannel(channels);
+    int last = mpuLastChannel(channels);
+    burstStart = MPU_BURST_START + 2*first;
+    burstLength = 2*(last - first + 1);
+    burstLayout = (MPU_CONFIG_CHANNEL(last + 1) - 1) & ~(MPU_CONFIG_CHANNEL(first) - 1);
+}
+
+// Configure the device, printing the error and exiting if it fails
+void MPU6050::configureOrExit(int pwrMgmtMode, int gyroConfig, int accelConfig){
+    int status = configure(pwrMgmtMode, gyroConfig, accelConfig);
+    if(status != CLEAN_EXIT){
+        std::cout << std::endl << getStatusMessage(status) << std::endl;
+        exit(status);
+    }
+}
+
+// Shared by the constructors: configure the device, exiting on error, then take the first sample
+void MPU6050::construct(int pwrMgmtMode, int gyroConfig, int accelConfig){
+    configureOrExit(pwrMgmtMode, gyroConfig, accelConfig);
+    resetBusCounters();
+
+	// Get an initial set of readings
+	updateData();
+}
+
+// Shared by create() and open(): configure the device and take the first sample, returning the error code rather than exiting
+int MPU6050::start(int pwrMgmtMode, int gyroConfig, int accelConfig){
+    int status = configure(pwrMgmtMode, gyroConfig, accelConfig);
+    if(status != CLEAN_EXIT){
+        return status;
+    }
+    resetBusCounters();
+
+    MPU6050RawSample raw;
+    MPU6050Sample sample;
+    if(!readRawSample(raw)){
+        return I2C_READ_ERROR;
+    }
+    convertSample(raw, sample);
+    storeSample(sample);
+    return CLEAN_EXIT;
+}
+
+// Open an object which was default constructed or moved from, exiting on error as the constructors do
+void MPU6050::openIfNeeded(){
+    if(transport != NULL){
+        return;
+    }
+    int status = open(busNumber, deviceAddress, pwrMgmtMode, gyroConfig, accelConfig);
+    if(status != CLEAN_EXIT){
+        std::cout << std::endl << getStatusMessage(status) << std::endl;
+        exit(status);
+    }
+}
+
+// Store a scaled sample as the latest readings
+void MPU6050::storeSample(const MPU6050Sample &sample){
+    gyroX = sample.gyroX;
+    gyroY = sample.gyroY;
+    gyroZ = sample.gyroZ;
+    accelX = sample.accelX;
+    accelY = sample.accelY;
+    accelZ = sample.accelZ;
+    temperature = sample.temperature;
 }
 
 // Function to read to read an entire 16-bit register from the MPU6050
-int16_t MPU6050::read16BitRegister(__u8 MSBRegister, __u8 LSBRegister, bool &readError){
-    __u32 MSB, LSB; // Variables to store the returned Most Significant Byte and Least Significant Byte
-    MSB = i2c_smbus_read_word_data(i2cHandle, MSBRegister); // Read the Most Significant Byte from the register
-    LSB = i2c_smbus_read_word_data(i2cHandle, LSBRegister); // Read the Least Significant Byte from the register
-	if(MSB < 0 || LSB < 0){
-		// If either byte is less than 0, there was a read error
-		readError = true; // Set the error variable to display the error message relevant to which register is being accessed
-		return 0;         // Return 0 - avoid pointless operations when the data is probably junk anyway
-	}
-	else{
-		readError = false; // Make sure the error flag is set to false
+int16_t MPU6050::read16BitRegister(__u8 MSBRegister, __u8 LSBRegister, bool &readError, int &flags){
+    __u8 bytes[2]; // The Most Significant Byte and Least Significant Byte
+    const __u8 registers[2] = {MSBRegister, LSBRegister};
+
+    for(int i = 0; i < 2; i++){
+        __s32 value = timedReadRegister(registers[i]);
+        for(int attempt = 0; value < 0 && attempt < maxRetries; attempt++){
+            readFailures.fetch_add(1, std::memory_order_relaxed);
+            retries.fetch_add(1, std::memory_order_relaxed);
+            value = timedReadRegister(registers[i]);
+            if(value >= 0){
+                retrySuccesses.fetch_add(1, std::memory_order_relaxed);
+                flags |= MPU_SAMPLE_RETRIED;
+            }
+        }
+        if(value < 0){
+            // If either byte could not be read, there was a read error
+            readFailures.fetch_add(1, std::memory_order_relaxed);
+            readError = true; // Set the error variable so the caller knows which channel failed
+            return 0;         // Return 0 - avoid pointless operations when the data is probably junk anyway
+        }
+        bytes[i] = value;
     }
-	return int16_t(MSB << 8 | LSB); // Combine the bytes into a 16-bit signed integer
+    readError = false; // Make sure the error flag is set to false
+	return combineBytes(bytes); // Combine the bytes into a 16-bit signed integer
 }
+
+// Read a whole sample, counting a failure against every channel
+bool MPU6050::readSampleBlock(__u8 startRegister, __u8 *buffer, int length){
+    int flags = MPU_SAMPLE_OK;
+
+    if(!readBlockWithRetry(startRegister, buffer, length, flags)){
+        failSample(flags);
+        return false;
+    }
+    consecutiveFailures = 0;
+    lastSampleStatus = flags;
+    recordSampleMetrics(1, true);
+    return true;
+}
+
+// Read a block, retrying immediately up to maxRetries times. Every failure is counted.
+bool MPU6050::readBlockWithRetry(__u8 startRegister, __u8 *buffer, int length, int &flags){
+    for(int attempt = 0; ; attempt++){
+        if(timedReadBlock(startRegister, buffer, length) == length){
+            if(attempt > 0){
+                retrySuccesses.fetch_add(1, std::memory_order_relaxed);
+                flags |= MPU_SAMPLE_RETRIED;
+            }
+            return true;
+        }
+        readFailures.fetch_add(1, std::memory_order_relaxed);
+        if(attempt >= maxRetries){
+            return false;
+        }
+        retries.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// After too many failed samples in a row, reopen the bus and restore the configuration
+int MPU6050::handleFailedSample(){
+    int recoveryFlags = 0;
+
+#ifndef MPU_NO_METRICS
+    if(metrics != NULL){
+        metrics->recordFailedSample();
+    }
+#endif
+    consecutiveFailures++;
+    if(recoveryThreshold > 0 && consecutiveFailures >= recoveryThreshold){
+        consecutiveFailures = 0; // Wait for another recoveryThreshold failures before trying again
+        bool wasCycling = cycling; // configure() returns the device to full power
+        if(transport->reopen() >= 0 && configure(pwrMgmtMode, gyroConfig, accelConfig) == CLEAN_EXIT && restoreSetup(wasCycling)){
+            busRecoveries.fetch_add(1, std::memory_order_relaxed);
+            recoveryFlags = MPU_SAMPLE_BUS_RECOVERED;
+        }
+        else{
+            failedRecoveries.fetch_add(1, std::memory_order_relaxed);
+            recoveryFlags = MPU_SAMPLE_RECOVERY_FAILED;
+        }
+    }
+    logErrors();
+    return recoveryFlags;
+}
+
+// A whole sample could not be read, so every channel failed
+void MPU6050::failSample(int flags){
+    for(int channel = 0; channel < MPU_CHANNEL_COUNT; channel++){
+        channelErrors[channel].fetch_add(1, std::memory_order_relaxed);
+    }
+    lastSampleStatus = flags | MPU_SAMPLE_CHANNEL_ERRORS | handleFailedSample();
+}
+
+// configure() restores the sampling registers. The device may have been reset too, so write back the rest of what has
+// been set up, and return to cycle mode if it was in it. The FIFO is reset, as a failed read may have left it part way
+// through a frame.
+bool MPU6050::restoreSetup(bool wasCycling){
+    if(offsetsWritten && !setOffsets(lastOffsets)){
+        return false;
+    }
+    if((interruptEnable & MPU_INT_ENABLE_MOT) && transport->writeBlock(MPU_MOT_THR, motionThresholdDuration, 2) < 0){
+        return false;
+    }
+    if(transport->writeRegister(MPU_INT_PIN_CFG, 0) < 0 || transport->writeRegister(MPU_INT_ENABLE, interruptEnable) < 0){
+        return false;
+    }
+    for(int slave = 0; slave < auxSlaves; slave++){
+        if(transport->writeBlock(MPU_I2C_SLV_ADDR(slave), auxSlaveConfig[slave], 3) < 0){
+            return false;
+        }
+    }
+    __u8 masterControl = auxMasterControl | (fifoEnabled && auxSlaves == MPU_I2C_SLV_COUNT ? MPU_I2C_MST_CTRL_SLV_3_FIFO_EN : 0);
+    if(auxMaster && transport->writeRegister(MPU_I2C_MST_CTRL, masterControl) < 0){
+        return false;
+    }
+    if(fifoEnabled && transport->writeRegister(MPU_FIFO_EN, fifoEnableBits) < 0){
+        return false;
+    }
+    __u8 userControl = (fifoEnabled ? MPU_USER_CTRL_FIFO_EN | MPU_USER_CTRL_FIFO_RESET : 0) | (auxMaster ? MPU_USER_CTRL_I2C_MST_EN : 0);
+    if(transport->writeRegister(MPU_USER_CTRL, userControl) < 0){
+        return false;
+    }
+    return !wasCycling || enterCycleMode(cycleWakeRate);
+}
+
+// Summarise the errors since the last log line, at most once per interval. The line is not flushed.
+void MPU6050::logErrors(){
+    if(errorLog == NULL){
+        return;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long nowMs = (long long)now.tv_sec*1000 + now.tv_nsec/1000000;
+    if(lastLogMs != 0 && nowMs - lastLogMs < errorLogIntervalMs){
+        return;
+    }
+    lastLogMs = nowMs;
+
+    unsigned long failures = readFailures.load(std::memory_order_relaxed);
+    *errorLog << "MPU6050 0x" << std::hex << transport->getAddress() << std::dec << " on " << transport->getName() << ": "
+              << failures - loggedFailures << " failed reads since the last report, " << busRecoveries.load(std::memory_order_relaxed)
+              << " bus recoveries, " << failedRecoveries.load(std::memory_order_relaxed) << " failed recoveries\n";
+    loggedFailures = failures;
+}
+
+// Function to convert a burst or FIFO frame into a raw sample - this is static so it can be used on frames read elsewhere
+void MPU6050::decodeRawSample(const __u8 *frame, MPU6050RawSample &sample){
+    sample.accelX = combineBytes(&frame[MPU_BURST_ACC_X]);
+    sample.accelY = combineBytes(&frame[MPU_BURST_ACC_Y]);
+    sample.accelZ = combineBytes(&frame[MPU_BURST_ACC_Z]);
+    sample.temperature = combineBytes(&frame[MPU_BURST_TEMP]);
+    sample.gyroX = combineBytes(&frame[MPU_BURST_GYRO_X]);
+    sample.gyroY = combineBytes(&frame[MPU_BURST_GYRO_Y]);
+    sample.gyroZ = combineBytes(&frame[MPU_BURST_GYRO_Z]);
+}
+
+// Function to convert a frame holding only some channels - those in layout are taken in register order, and then only
+// those also in channels are kept
+void MPU6050::decodePackedSample(const __u8 *frame, int layout, int channels, MPU6050RawSample &sample){
+    int16_t values[MPU_CHANNEL_COUNT];
+    for(int channel = 0; channel < MPU_CHANNEL_COUNT; channel++){
+        values[channel] = 0;
+        if(layout & MPU_CONFIG_CHANNEL(channel)){
+            if(channels & MPU_CONFIG_CHANNEL(channel)){
+                values[channel] = combineBytes(frame);
+            }
+            frame += 2;
+        }
+    }
+    sample.accelX = values[MPU_CHANNEL_ACCEL_X];
+    sample.accelY = values[MPU_CHANNEL_ACCEL_Y];
+    sample.accelZ = values[MPU_CHANNEL_ACCEL_Z];
+    sample.temperature = values[MPU_CHANNEL_TEMP];
+    sample.gyroX = values[MPU_CHANNEL_GYRO_X];
+    sample.gyroY = values[MPU_CHANNEL_GYRO_Y];
+    sample.gyroZ = values[MPU_CHANNEL_GYRO_Z];
+}
+
+// Read a register, timing the transaction if metrics are attached
+__s32 MPU6050::timedReadRegister(__u8 deviceRegister){
+#ifndef MPU_NO_METRICS
+    if(metrics != NULL){
+        uint64_t start = MPU6050Acquisition::nowNs();
+        __s32 value = transport->readRegister(deviceRegister);
+        metrics->recordTransaction(MPU6050Acquisition::nowNs() - start);
+        return value;
+    }
+#endif
+    return transport->readRegister(deviceRegister);
+}
+
+// Read a block, timing the transaction if metrics are attached
+__s32 MPU6050::timedReadBlock(__u8 startRegister, __u8 *buffer, int length){
+#ifndef MPU_NO_METRICS
+    if(metrics != NULL){
+        uint64_t start = MPU6050Acquisition::nowNs();
+        __s32 count = transport->readBlock(startRegister, buffer, length);
+        metrics->recordTransaction(MPU6050Acquisition::nowNs() - start);
+        return count;
+    }
+#endif
+    return transport->readBlock(startRegister, buffer, length);
+}
+
+// Record the bus usage since the last sample against the samples just read. Only single samples are timed - the
+// interval between FIFO batches says nothing about the sample rate.
+void MPU6050::recordSampleMetrics(int samples, bool timed){
+#ifndef MPU_NO_METRICS
+    if(metrics == NULL){
+        return;
+    }
+    unsigned long transactions = transport->getTransactions();
+    unsigned long bytes = transport->getBytes();
+    // If the bus counters were reset since the last sample, count from 0
+    unsigned long newTransactions = transactions >= metricsTransactions ? transactions - metricsTransactions : transactions;
+    unsigned long newBytes = bytes >= metricsBytes ? bytes - metricsBytes : bytes;
+    metricsTransactions = transactions;
+    metricsBytes = bytes;
+    if(timed){
+        metrics->recordSample(MPU6050Acquisition::nowNs(), newTransactions, newBytes);
+    }
+    else{
+        metrics->recordBatch(samples, newTransactions, newBytes);
+    }
+#else
+    (void)samples;
+    (void)timed;
+#endif
+}
+
 // --------------------------------------------------------------------------------------------
 
 // ---------------------------------- Data Display Function -----------------------------------
-std::ostream& operator<<(std::ostream& out, MPU6050& M){
-    out << std::endl;
-    out << "-------------------------------------" << std::endl;
-    out << "----- Basic Info -----" << std::endl;
-    out << "I2C Address: 0x" << std::hex << M.address << std::dec << std::endl; // This now outputs the address in hex to make it more clear
-    out << "I2C Interface: " << M.fileName << std::endl;
-    out << std::endl;
-    out << "---- Gyro Values -----" << std::endl;
-    out << "GyroX: " << M.gyroX << std::endl;
-    out << "GyroY: " << M.gyroY << std::endl;
-    out << "GyroZ: " << M.gyroZ << std::endl;
-    out << std::endl;
-    out << "---- Accel Values ----" << std::endl;
-    out << "AccelX: " << M.accelX << std::endl;
-    out << "AccelY: " << M.accelY << std::endl;
-    out << "AccelZ: " << M.accelZ << std::endl;
-    out << std::endl;
-    out << "Temp: " << M.temperature << std::endl;
-    out << "-------------------------------------" << std::endl;
+std::ostream& operator<<(std::ostream& out, const MPU6050& M){
+    out << '\n';
+    out << "-------------------------------------" << '\n';
+    out << "----- Basic Info -----" << '\n';
+    out << "I2C Address: 0x" << std::hex << M.deviceAddress << std::dec << '\n'; // This now outputs the address in hex to make it more clear
+    if(M.transport != NULL){
+        out << "I2C Interface: " << M.transport->getName() << '\n';
+    }
+    else{
+        out << "I2C Interface: /dev/i2c-" << M.busNumber << " (not open)" << '\n';
+    }
+    out << '\n';
+    out << "---- Gyro Values -----" << '\n';
+    out << "GyroX: " << M.gyroX << '\n';
+    out << "GyroY: " << M.gyroY << '\n';
+    out << "GyroZ: " << M.gyroZ << '\n';
+    out << '\n';
+    out << "---- Accel Values ----" << '\n';
+    out << "AccelX: " << M.accelX << '\n';
+    out << "AccelY: " << M.accelY << '\n';
+    out << "AccelZ: " << M.accelZ << '\n';
+    out << '\n';
+    out << "Temp: " << M.temperature << '\n';
+    out << "-------------------------------------" << '\n';
     return out;
 }
 // --------------------------------------------------------------------------------------------
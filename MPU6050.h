@@ -14,9 +14,13 @@
  */
 
 #include <iostream> // Used for the display function
+#include <atomic>   // Used for the error counters
 
 // Used for the I2C interface
-#include <linux/i2c-dev.h> // For SMBus commands
+#include <linux/i2c-dev.h> // For I2C_RDWR
+#ifdef MPU_KERNEL_I2C_HEADERS
+#include <linux/i2c.h>     // The kernel's own i2c-dev.h leaves struct i2c_msg to this header
+#endif
 #include <sys/ioctl.h>     // For ioctl()
 #include <fcntl.h>         // For O_RDWR
 #include <unistd.h>        // For open()
@@ -33,16 +37,51 @@
 #define I2C_SET_ACCEL_RES      5
 #define I2C_SETUP_INTERRUPTS   6
 #define MPU_INIT_PARAM_ERROR   7
+#define I2C_SETUP_FIFO         8
+#define GPIO_OPEN_ERROR        9
+#define GPIO_REQUEST_ERROR     10
+#define EPOLL_SETUP_ERROR      11
+#define MPU_CALIBRATION_ERROR  12
+#define I2C_SET_CONFIG         13
+#define I2C_READ_ERROR         14
+#define TIMER_SETUP_ERROR      15
+#define SHM_SETUP_ERROR        16
 
 // ---------- Basic Config Parameters ----------
 // Address used to access data
 #define MPU_DEFAULT_I2C_ADDR 0x68
 
+// Device identity register - reads back the upper 6 bits of the I2C address
+#define MPU_WHO_AM_I       0x75
+#define MPU_WHO_AM_I_VALUE 0x68
+
+// Interrupt pin configuration register
+#define MPU_INT_PIN_CFG 0x37 // Register as follows: {INT_LEVEL, INT_OPEN, LATCH_INT_EN, INT_RD_CLEAR, FSYNC_INT_LEVEL, FSYNC_INT_EN, I2C_BYPASS_EN, -}
+#define MPU_INT_PIN_CFG_I2C_BYPASS_EN (1 << 1) // Connects the auxiliary bus straight to the host's bus
+
 // Interrupt enable register
-#define MPU_INT_ENABLE 0x38 // Register as follows: {-, -, -, FIFO_OFLOW_EN, I2C_MST_INT_EN, -, -, DATA_RDY_EN}
+#define MPU_INT_ENABLE 0x38 // Register as follows: {-, MOT_EN, -, FIFO_OFLOW_EN, I2C_MST_INT_EN, -, -, DATA_RDY_EN}
+
+// Interrupt enable bits
+#define MPU_INT_ENABLE_MOT        (1 << 6)
+#define MPU_INT_ENABLE_FIFO_OFLOW (1 << 4)
+#define MPU_INT_ENABLE_I2C_MST    (1 << 3)
+#define MPU_INT_ENABLE_DATA_RDY   (1 << 0)
 
 // Interrupt status register
-#define MPU_INT_STATUS 0x3A // Register as follows: {-, -, -, FIFO_OFLOW_INT, I2C_MST_INT, -, -, DATA_RDY_INT}
+#define MPU_INT_STATUS 0x3A // Register as follows: {-, MOT_INT, -, FIFO_OFLOW_INT, I2C_MST_INT, -, -, DATA_RDY_INT}
+
+// Interrupt status bits
+#define MPU_INT_STATUS_MOT        (1 << 6)
+#define MPU_INT_STATUS_FIFO_OFLOW (1 << 4)
+#define MPU_INT_STATUS_I2C_MST    (1 << 3)
+#define MPU_INT_STATUS_DATA_RDY   (1 << 0)
+
+// Sample rate divider register - Sample Rate = Gyroscope Output Rate / (1 + SMPLRT_DIV)
+#define MPU_SMPLRT_DIV 0x19 // The gyro output rate is 8kHz with DLPF_CONFIG 0 or 7, and 1kHz otherwise
+
+// SMPLRT_DIV, CONFIG, GYRO_CONFIG and ACCEL_CONFIG are consecutive, so they are read and written as one block
+#define MPU_CONFIG_BLOCK_LENGTH 4
 
 // MPU configuration register
 #define MPU_CONFIG 0x1A // Register as follows: {-, -, EXT_SYNC_SET[3 bits], DLPF_CONFIG[3 bits]}
@@ -68,6 +107,10 @@
 #define MPU_CONFIG_DLPF_5 5 // |       10       |    13.8    |       10       |    13.4    |     1    |
 #define MPU_CONFIG_DLPF_6 6 // |        5       |    19.0    |        5       |    18.6    |     1    |
 #define MPU_CONFIG_DLPF_7 7 // |           RESERVED          |           RESERVED          |     8    |
+
+// Gyroscope output rates, before the sample rate divider
+#define MPU_GYRO_OUTPUT_RATE_DLPF_OFF 8000 // DLPF_CONFIG 0 or 7
+#define MPU_GYRO_OUTPUT_RATE_DLPF_ON  1000 // DLPF_CONFIG 1 to 6
 // ---------------------------------------------
 
 // ------------ Gyroscope Parameters -----------
@@ -97,7 +140,7 @@
 
 // ---------- Accelerometer Parameters ---------
 // Accelerometer configuration register
-#define MPU_ACC_CONFIG 0x1C // Register as follows: {XA_ST, YA_ST, ZA_ST, AFS_SEL[2 bits], -, -, -}
+#define MPU_ACC_CONFIG 0x1C // Register as follows: {XA_ST, YA_ST, ZA_ST, AFS_SEL[2 bits], ACCEL_HPF[3 bits]}
 
 // AFS_SEL parameters - Accelerometer sensitivity parameters
 #define MPU_ACC_SENS_2  0 // ±2g
@@ -126,6 +169,142 @@
 #define MPU_TEMP2 0x42 // Least significant byte
 
 // Temperature in degrees C = (TEMP_OUT Register Value as a signed quantity)/340 + 36.53
+#define MPU_TEMP_SCALE  340
+#define MPU_TEMP_OFFSET 36.53
+// ---------------------------------------------
+
+// ---------------- Burst Reads ----------------
+// The output registers are contiguous from MPU_ACC_X1 to MPU_GYRO_Z2, so a whole sample can be
+// read in a single auto-incrementing block read. Within the block each channel is MSB first.
+#define MPU_BURST_START  MPU_ACC_X1 // First register of the burst
+#define MPU_BURST_LENGTH 14         // Bytes from MPU_ACC_X1 to MPU_GYRO_Z2 inclusive
+
+// Byte offsets of each channel within the burst
+#define MPU_BURST_ACC_X  0
+#define MPU_BURST_ACC_Y  2
+#define MPU_BURST_ACC_Z  4
+#define MPU_BURST_TEMP   6
+#define MPU_BURST_GYRO_X 8
+#define MPU_BURST_GYRO_Y 10
+#define MPU_BURST_GYRO_Z 12
+
+// MPU_INT_STATUS is the register before MPU_ACC_X1, so the data ready flag can be read in the same burst
+#define MPU_STATUS_BURST_LENGTH (MPU_BURST_LENGTH + 1)
+// ---------------------------------------------
+
+// ---------------- FIFO Registers -------------
+// FIFO enable register - selects which channels are written to the FIFO at the sample rate
+#define MPU_FIFO_EN 0x23 // Register as follows: {TEMP_FIFO_EN, XG_FIFO_EN, YG_FIFO_EN, ZG_FIFO_EN, ACCEL_FIFO_EN, SLV2_FIFO_EN, SLV1_FIFO_EN, SLV0_FIFO_EN}
+
+// FIFO_EN bits
+#define MPU_FIFO_EN_TEMP  (1 << 7)
+#define MPU_FIFO_EN_XG    (1 << 6)
+#define MPU_FIFO_EN_YG    (1 << 5)
+#define MPU_FIFO_EN_ZG    (1 << 4)
+#define MPU_FIFO_EN_ACCEL (1 << 3)
+#define MPU_FIFO_EN_SLV2  (1 << 2) // Auxiliary slave 3 is enabled with SLV_3_FIFO_EN in I2C_MST_CTRL instead
+#define MPU_FIFO_EN_SLV1  (1 << 1)
+#define MPU_FIFO_EN_SLV0  (1 << 0)
+
+// User control register
+#define MPU_USER_CTRL 0x6A // Register as follows: {-, FIFO_EN, I2C_MST_EN, I2C_IF_DIS, -, FIFO_RESET, I2C_MST_RESET, SIG_COND_RESET}
+
+// USER_CTRL bits
+#define MPU_USER_CTRL_FIFO_EN    (1 << 6)
+#define MPU_USER_CTRL_I2C_MST_EN (1 << 5)
+#define MPU_USER_CTRL_FIFO_RESET (1 << 2)
+
+// FIFO count and data registers
+#define MPU_FIFO_COUNT1 0x72 // Most significant byte
+#define MPU_FIFO_COUNT2 0x73 // Least significant byte
+#define MPU_FIFO_R_W    0x74 // Reading this register pops bytes from the FIFO
+
+#define MPU_FIFO_SIZE 1024 // Size of the FIFO in bytes
+
+// With all channels enabled each FIFO frame has the same layout as a burst read (see below). Channels which are off
+// are left out, so frames can be as short as one gyro axis.
+#define MPU_FIFO_FRAME_LENGTH MPU_BURST_LENGTH
+#define MPU_FIFO_MAX_FRAMES   (MPU_FIFO_SIZE/2) // Most whole frames the FIFO can hold
+
+// Sample rate divider for 1kHz with the DLPF disabled
+#define MPU_FIFO_DEFAULT_SMPLRT_DIV 7
+// Passed to enableFifo() to keep the divider already programmed, such as by setSampleRate()
+#define MPU_FIFO_KEEP_SMPLRT_DIV -1
+// ---------------------------------------------
+
+// ----------- Auxiliary I2C Master ------------
+// The MPU6050 can read up to four devices on its auxiliary bus (AUX_DA and AUX_CL) itself at each sample, storing what
+// it reads in EXT_SENS_DATA. These registers follow GYRO_ZOUT, so the external data extends the burst read and FIFO frame.
+#define MPU_I2C_MST_CTRL 0x24 // Register as follows: {MULT_MST_EN, WAIT_FOR_ES, SLV_3_FIFO_EN, I2C_MST_P_NSR, I2C_MST_CLK[4 bits]}
+
+// I2C_MST_CTRL bits
+#define MPU_I2C_MST_CTRL_WAIT_FOR_ES   (1 << 6) // Hold the data ready interrupt until the external data has been read
+#define MPU_I2C_MST_CTRL_SLV_3_FIFO_EN (1 << 5)
+
+// I2C_MST_CLK parameters - the auxiliary bus clock, from the 8MHz internal clock
+#define MPU_I2C_MST_CLK_400KHZ 13
+#define MPU_I2C_MST_CLK_348KHZ 0
+#define MPU_I2C_MST_CLK_258KHZ 8
+
+// Slaves 0 to 3 each have three consecutive registers, read at every sample
+#define MPU_I2C_SLV0_ADDR 0x25 // Register as follows: {I2C_SLV0_RW, I2C_SLV0_ADDR[7 bits]}
+#define MPU_I2C_SLV0_REG  0x26 // First register of the external device to read
+#define MPU_I2C_SLV0_CTRL 0x27 // Register as follows: {I2C_SLV0_EN, I2C_SLV0_BYTE_SW, I2C_SLV0_REG_DIS, I2C_SLV0_GRP, I2C_SLV0_LEN[4 bits]}
+#define MPU_I2C_SLV_ADDR(slave) (MPU_I2C_SLV0_ADDR + 3*(slave))
+#define MPU_I2C_SLV_CTRL(slave) (MPU_I2C_SLV0_CTRL + 3*(slave))
+#define MPU_I2C_SLV_COUNT 4
+
+// I2C_SLVx_ADDR and I2C_SLVx_CTRL bits
+#define MPU_I2C_SLV_READ       (1 << 7)
+#define MPU_I2C_SLV_EN         (1 << 7)
+#define MPU_I2C_SLV_MAX_LENGTH 15
+
+// Slave 4 transfers one byte each time it is enabled, which is used to configure the external devices
+#define MPU_I2C_SLV4_ADDR 0x31
+#define MPU_I2C_SLV4_REG  0x32
+#define MPU_I2C_SLV4_DO   0x33 // Byte to write
+#define MPU_I2C_SLV4_CTRL 0x34 // Register as follows: {I2C_SLV4_EN, I2C_SLV4_INT_EN, I2C_SLV4_REG_DIS, I2C_MST_DLY[5 bits]}
+
+// Master status register - reading it clears the flags
+#define MPU_I2C_MST_STATUS 0x36 // Register as follows: {PASS_THROUGH, I2C_SLV4_DONE, I2C_LOST_ARB, I2C_SLV4_NACK, I2C_SLV3_NACK, I2C_SLV2_NACK, I2C_SLV1_NACK, I2C_SLV0_NACK}
+#define MPU_I2C_MST_STATUS_SLV4_DONE (1 << 6)
+#define MPU_I2C_MST_STATUS_LOST_ARB  (1 << 5)
+#define MPU_I2C_MST_STATUS_SLV4_NACK (1 << 4)
+#define MPU_I2C_MST_STATUS_SLV_NACK(slave) (1 << (slave))
+
+// External sensor data, filled in slave order
+#define MPU_EXT_SENS_DATA        0x49
+#define MPU_EXT_SENS_DATA_LENGTH 24
+
+// Time allowed for a slave 4 write, which happens at the next sample
+#define MPU_AUX_WRITE_TIMEOUT_MS 100
+// ---------------------------------------------
+
+// -------------- Offset Registers -------------
+// User offset registers, each a signed 16-bit value, MSB first. These are not in the register map document; see the
+// InvenSense application note "MPU Hardware Offset Registers". The offsets are added to the sensor output on chip, so
+// burst reads and the FIFO return corrected data.
+#define MPU_XA_OFFS_H     0x06 // Accelerometer offsets, with a factory trim already loaded
+#define MPU_XA_OFFS_L     0x07
+#define MPU_YA_OFFS_H     0x08
+#define MPU_YA_OFFS_L     0x09
+#define MPU_ZA_OFFS_H     0x0A
+#define MPU_ZA_OFFS_L     0x0B
+#define MPU_XG_OFFS_USRH  0x13 // Gyroscope offsets, 0 after a reset
+#define MPU_XG_OFFS_USRL  0x14
+#define MPU_YG_OFFS_USRH  0x15
+#define MPU_YG_OFFS_USRL  0x16
+#define MPU_ZG_OFFS_USRH  0x17
+#define MPU_ZG_OFFS_USRL  0x18
+
+// Offset register units, in LSB per unit
+#define MPU_ACC_OFFSET_SCALE  2048 // Accelerometer offsets are in ±16g units. Bit 0 is reserved and must be preserved.
+#define MPU_GYRO_OFFSET_SCALE 32.8 // Gyroscope offsets are in ±1000 °/s units
+
+// Calibration parameters
+#define MPU_CALIBRATION_SAMPLES        500 // Samples averaged for each calibration pass
+#define MPU_CALIBRATION_PASSES         2   // Passes - the second corrects any error left by the first
+#define MPU_CALIBRATION_TEMP_TOLERANCE 5.0 // A cached calibration is reused within this many °C of the temperature it was made at
 // ---------------------------------------------
 
 // -------------- Power Registers --------------
@@ -133,6 +312,9 @@
 #define MPU_PWR_MGMT_1 0x6B // Register is as follows: {DEVICE_REST, SLEEP, CYCLE, -, TEMP_DISABLE, CLK_SEL[3 bits]}
 #define MPU_PWR_MGMT_2 0x6C // Register is as follows: {LP_WAKE_CTRL[2 bits], STBY_XA, STBY_YA, STBY_ZA, STBY_XG, STBY_YG, STBY_ZG}
 
+// Value of PWR_MGMT_1 after a reset - the device starts asleep
+#define MPU_PWR_MGMT_1_RESET_VALUE 0x40
+
 // Clock configuration values
 #define MPU_PWR_MGMT_CLK_INTERNAL_8MHZ 0
 #define MPU_PWR_MGMT_CLK_PLL_X_GYRO    1
@@ -147,40 +329,212 @@
 #define MPU_PWR_MGMT_WAKE_5HZ    1
 #define MPU_PWR_MGMT_WAKE_20HZ   2
 #define MPU_PWR_MGMT_WAKE_40HZ   3
+// ---------------------------------------------
+
+// -------------- Motion Detection -------------
+// Motion detection registers. These are not in revision 4.2 of the register map; see revision 3.2 and the InvenSense
+// application note "MPU-6050 Accelerometer Motion Interrupt". The device compares the high-pass filtered accelerometer
+// output with the threshold, and raises MOT_INT once any axis has exceeded it for the duration.
+#define MPU_MOT_THR         0x1F // Threshold, 1 LSB = 2mg whatever the accelerometer sensitivity
+#define MPU_MOT_DUR         0x20 // Duration, 1 LSB = 1 accelerometer sample (1ms at full rate, one wake-up in cycle mode)
+
+#define MPU_MOT_THR_SCALE 2 // mg per LSB of MOT_THR
+
+// ACCEL_HPF parameters - the high-pass filter used only by the motion detector
+#define MPU_ACC_HPF_RESET  0 // Filter off, output settles to 0
+#define MPU_ACC_HPF_5HZ    1
+#define MPU_ACC_HPF_2_5HZ  2
+#define MPU_ACC_HPF_1_25HZ 3
+#define MPU_ACC_HPF_0_63HZ 4
+#define MPU_ACC_HPF_HOLD   7 // Compare against the sample taken when the filter was set
+
+// Defaults for enableMotionInterrupt() and MPU6050MotionMonitor
+#define MPU_MOTION_DEFAULT_THRESHOLD_MG 40   // Above the noise in cycle mode, below a gentle nudge
+#define MPU_MOTION_DEFAULT_DURATION     1    // Cycle mode takes one sample per wake-up, so longer durations are slow to trigger
+#define MPU_MOTION_DEFAULT_QUIET_MS     2000 // Time without motion before returning to low power
+// ---------------------------------------------
 
+// --------------- Error Handling --------------
+// Channels in register order, used to index the per-channel error counts
+#define MPU_CHANNEL_ACCEL_X 0
+#define MPU_CHANNEL_ACCEL_Y 1
+#define MPU_CHANNEL_ACCEL_Z 2
+#define MPU_CHANNEL_TEMP    3
+#define MPU_CHANNEL_GYRO_X  4
+#define MPU_CHANNEL_GYRO_Y  5
+#define MPU_CHANNEL_GYRO_Z  6
+#define MPU_CHANNEL_COUNT   7
+
+// Masks of channels to sample, with bits indexed by MPU_CHANNEL_*
+#define MPU_CONFIG_CHANNEL(channel) (1 << (channel))
+#define MPU_CONFIG_CHANNELS_ACCEL   0x07
+#define MPU_CONFIG_CHANNELS_TEMP    0x08
+#define MPU_CONFIG_CHANNELS_GYRO    0x70
+#define MPU_CONFIG_CHANNELS_ALL     0x7F
+
+// Sample status flags returned by updateData() and getLastSampleStatus()
+#define MPU_SAMPLE_OK             0
+#define MPU_SAMPLE_CHANNEL_ERROR(channel) (1 << (channel)) // That channel couldn't be read and is 0
+#define MPU_SAMPLE_CHANNEL_ERRORS 0x7F     // Mask of every channel error
+#define MPU_SAMPLE_RETRIED        (1 << 7) // A read failed but a retry succeeded
+#define MPU_SAMPLE_BUS_RECOVERED  (1 << 8) // After this sample the bus was reopened and the device re-initialised
+#define MPU_SAMPLE_RECOVERY_FAILED (1 << 9) // As above, but the recovery failed
+
+// Default error handling policy
+#define MPU_DEFAULT_MAX_RETRIES        1    // Retries of a failed read within the same sample
+#define MPU_DEFAULT_RECOVERY_THRESHOLD 10   // Consecutive failed samples before the bus is recovered - 0 never recovers
+#define MPU_ERROR_LOG_INTERVAL_MS      1000 // Minimum time between error log lines
 // ---------------------------------------------
 
+// Interface used to access the device registers - see MPU6050Transport.h
+class MPU6050Transport;
+
+// Optional instrumentation - see MPU6050Metrics.h
+class MPU6050Metrics;
+
+// Structure to hold one scaled sample from the MPU6050
+struct MPU6050Sample{
+	float gyroX;
+	float gyroY;
+	float gyroZ;
+	float accelX;
+	float accelY;
+	float accelZ;
+	float temperature;
+};
+
+// Structure to hold one unscaled sample from the MPU6050, in register order
+struct MPU6050RawSample{
+	int16_t accelX;
+	int16_t accelY;
+	int16_t accelZ;
+	int16_t temperature;
+	int16_t gyroX;
+	int16_t gyroY;
+	int16_t gyroZ;
+};
+
+// When a FIFO read found its frames, for lining the frames up with the host clock (see MPU6050Timestamp.h)
+struct MPU6050FifoTiming{
+	uint64_t countTimeNs; // CLOCK_MONOTONIC_RAW time halfway through reading FIFO_COUNT - every frame counted was written before it
+	int framesWaiting;    // Whole frames in the FIFO at that time, including any left for the next read
+};
+
+// Structure to hold the contents of the offset registers
+struct MPU6050Offsets{
+	int16_t accelX;
+	int16_t accelY;
+	int16_t accelZ;
+	int16_t gyroX;
+	int16_t gyroY;
+	int16_t gyroZ;
+};
+
+// Snapshot of the error counters
+struct MPU6050ErrorCounts{
+	unsigned long channelErrors[MPU_CHANNEL_COUNT]; // Samples where each channel couldn't be read, indexed by MPU_CHANNEL_*
+	unsigned long readFailures;      // Failed read transactions, including those which were retried
+	unsigned long retries;           // Reads retried
+	unsigned long retrySuccesses;    // Samples recovered by a retry
+	unsigned long busRecoveries;     // Successful bus recoveries
+	unsigned long failedRecoveries;  // Bus recoveries which failed
+	unsigned long fifoOverflows;     // FIFO overflows found by readFifo()
+};
+
 // Declare a class to process and store the data
 class MPU6050{
 public:
 	// ---------- Special class members -----------
-    MPU6050();                                         // Default constructor - used for making arrays of the object
+	// Default constructor - used for making arrays and containers of the object. Nothing is opened until open() is called
+	// or the object is first used, when the device at the default address on bus 1 is opened with the default configuration.
+	MPU6050();
 	MPU6050(bool isPiRev0);                            // Default constructor with compatibility for rev0 Pis
 	MPU6050(int deviceAddress, bool isPiRev0 = false); // Constructor with additional parameters to set the address and if the Pi is rev0
 	// Constructor to allow customization of basic configuration parameters
 	MPU6050(int pwrMgmtMode, int gyroConfig, int accelConfig, int deviceAddress = MPU_DEFAULT_I2C_ADDR, bool isPiRev0 = false);
-	MPU6050(const MPU6050& M);                         // Copy constructor
+	// Constructor using another transport, such as the simulated device. The transport must outlive the object.
+	MPU6050(MPU6050Transport &busTransport, int pwrMgmtMode = MPU_PWR_MGMT_CLK_INTERNAL_8MHZ, int gyroConfig = MPU_GYRO_SENS_500, int accelConfig = MPU_ACC_SENS_2);
+	// Constructor which reapplies the offsets cached in calibrationCache for this bus, address and temperature, or calibrates
+	// the device and caches the result if there are none. The device must be stationary and level, Z axis up, to calibrate.
+	MPU6050(const char *calibrationCache, int pwrMgmtMode, int gyroConfig, int accelConfig, int deviceAddress = MPU_DEFAULT_I2C_ADDR, bool isPiRev0 = false);
+	MPU6050(MPU6050&& M) noexcept;                     // Move constructor - M is left as described for move assignment below
+
+	// Create an object without exiting on error. Returns CLEAN_EXIT and sets sensor to a new object, which must be deleted,
+	// or returns the exit code for the error and sets sensor to NULL. Registers which already hold the requested values are
+	// not written, so creating an object for a device which is already configured is fast.
+	static int create(MPU6050 *&sensor, int pwrMgmtMode = MPU_PWR_MGMT_CLK_INTERNAL_8MHZ, int gyroConfig = MPU_GYRO_SENS_500,
+	                  int accelConfig = MPU_ACC_SENS_2, int deviceAddress = MPU_DEFAULT_I2C_ADDR, bool isPiRev0 = false);
+	static int create(MPU6050 *&sensor, MPU6050Transport &busTransport, int pwrMgmtMode = MPU_PWR_MGMT_CLK_INTERNAL_8MHZ,
+	                  int gyroConfig = MPU_GYRO_SENS_500, int accelConfig = MPU_ACC_SENS_2);
+	static const char* getStatusMessage(int status); // Description of an exit code or status returned by create()
 	~MPU6050();                                        // Destructor
+
+	// Open the device on /dev/i2c-<busNumber> and configure it, closing anything this object already had open. Objects on
+	// the same bus share one handle. Returns CLEAN_EXIT or the exit code for the error, after which the object is unopened.
+	int open(int busNumber, int deviceAddress = MPU_DEFAULT_I2C_ADDR, int pwrMgmtMode = MPU_PWR_MGMT_CLK_INTERNAL_8MHZ,
+	         int gyroConfig = MPU_GYRO_SENS_500, int accelConfig = MPU_ACC_SENS_2);
+	bool isOpen();
 	// --------------------------------------------
 
 	// ----------- Operator overloading -----------
-	MPU6050& operator=(const MPU6050& M); // Assignment operator
+	// Move assignment. Objects are moved rather than copied, as each owns its connection to the device. Only M's transport
+	// and metrics are released, and the interrupts, FIFO, auxiliary master, cycle mode, high pass filter, channel
+	// selection and remembered offsets are reset. M keeps its bus number, address, power management mode, sensitivities and scales, sample rate,
+	// DLPF, retry policy, error counters and last readings, so using it again reopens the same device with that
+	// configuration. Anything holding a pointer to M, such as an acquisition engine, must be stopped first.
+	MPU6050& operator=(MPU6050&& M) noexcept;
 	// --------------------------------------------
 
 	// ------ MPU Configuration Functions ---------
 	void reconfigure(int pwrMgmtMode, int gyroConfig = MPU_GYRO_SENS_500, int accelConfig = MPU_ACC_SENS_2);
-	void sleep();
-	void wake();
-	void disableTemp();
-	void enableTemp();
-	void disableGyro();
-	void enableGyro();
-	void disableAccel();
-	void enableAccel();
+	// Power modes. Each returns false on a write error. sleep() stops every sensor, and wake() returns to full power from
+	// sleep or cycle mode. In cycle mode the gyros and temperature sensor are off and the device sleeps between single
+	// accelerometer samples taken at wakeRate (one of MPU_PWR_MGMT_WAKE_*), so with the motion interrupt enabled it
+	// draws tens of microamps and needs nothing from the host until something moves.
+	bool sleep();
+	bool wake();
+	bool enterCycleMode(int wakeRate = MPU_PWR_MGMT_WAKE_5HZ);
+	bool isCycling(); // True in cycle mode
+	// Channel selection. Channels which are off are put in standby through PWR_MGMT_2, or TEMP_DIS for the temperature
+	// sensor, and read as 0. Burst reads cover only the registers from the first to the last channel which is on, so
+	// accelerometer only sampling reads 6 bytes rather than 14, and FIFO frames set up by a later enableFifo() hold only
+	// the channels which are on. If the clock is taken from a gyro axis which is put in standby, the internal oscillator is
+	// used instead. Each returns false on a write error, in cycle mode, or if no channel would be left on.
+	bool setChannels(int channels); // A mask of MPU_CONFIG_CHANNEL(MPU_CHANNEL_*) bits, such as MPU_CONFIG_CHANNELS_ACCEL
+	int getChannels();
+	bool disableTemp();
+	bool enableTemp();
+	bool disableGyro();
+	bool enableGyro();
+	bool disableAccel();
+	bool enableAccel();
+	// Program SMPLRT_DIV and the DLPF for the output rate closest to rateHz. Returns false on a write error or an invalid
+	// parameter. The setting is kept by reconfigure() and restored after a bus recovery.
+	bool setSampleRate(float rateHz, int dlpfConfig = MPU_CONFIG_DLPF_1);
+	float getSampleRate();                          // Output rate in Hz set on the device
+	int getDlpfConfig();
+	static int dlpfForBandwidth(float bandwidthHz); // The widest DLPF setting whose gyro bandwidth is no more than bandwidthHz
     // --------------------------------------------
 
 	// ---------- Data Access Functions -----------
-	void updateData();
+	// The update functions return the MPU_SAMPLE_* status flags for the sample. Channels which couldn't be read are set to 0.
+	int updateData();              // Read all channels in a single burst transaction
+	int updateDataPerRegister();   // Read each register separately - slower, for SMBus-only adapters without I2C block reads
+	bool readRawSample(MPU6050RawSample &sample); // Burst read one unscaled sample. Returns false on a read error.
+	// As above, also reading INT_STATUS in the same transaction. dataReady is true if the device produced a sample since
+	// INT_STATUS was last read. Reading it clears every interrupt flag, including the FIFO overflow flag.
+	bool readRawSample(MPU6050RawSample &sample, bool &dataReady);
+	bool readRawSampleStatus(MPU6050RawSample &sample, int &interruptStatus); // As above, giving all the MPU_INT_STATUS_* flags
+	void convertSample(const MPU6050RawSample &raw, MPU6050Sample &sample); // Scale a raw sample with the current configuration
+	static void decodeRawSample(const __u8 *frame, MPU6050RawSample &sample); // Split a 14 byte burst or FIFO frame into channels
+	// Split a frame holding only the channels in layout, in register order. Channels not in both layout and channels are 0.
+	static void decodePackedSample(const __u8 *frame, int layout, int channels, MPU6050RawSample &sample);
+	// The burst readRawSample() makes for the enabled channels, for callers which read it in their own transactions
+	__u8 getBurstStart();
+	int getBurstLength();
+	void decodeBurst(const __u8 *burst, MPU6050RawSample &sample); // Split getBurstLength() bytes read from getBurstStart()
+	float getGyroScale();  // LSB per °/s for the current gyro sensitivity
+	float getAccelScale(); // LSB per g for the current accelerometer sensitivity
 	float getGyroX();
 	float getGyroY();
 	float getGyroZ();
@@ -190,39 +544,216 @@ public:
 	float getTemp();
 	// --------------------------------------------
 
+	// ----------- Calibration Functions ----------
+	// Measure the gyro and accelerometer biases and write them to the on-chip offset registers. The device must be stationary
+	// and level, Z axis up. Returns false on a read or write error.
+	bool calibrate(int samples = MPU_CALIBRATION_SAMPLES);
+	bool getOffsets(MPU6050Offsets &offsets);       // Read the offset registers
+	bool setOffsets(const MPU6050Offsets &offsets); // Write the offset registers
+	// Save the current offsets to the cache file for this device in cacheDirectory, keyed by the current temperature
+	bool saveCalibration(const char *cacheDirectory, int busNumber);
+	// Apply cached offsets made within MPU_CALIBRATION_TEMP_TOLERANCE of the current temperature. Returns false if there are none.
+	bool loadCalibration(const char *cacheDirectory, int busNumber);
+	// --------------------------------------------
+
+	// ------------ Interrupt Functions -----------
+	void enableDataReadyInterrupt();  // Pulse the INT pin high each time a new sample is ready - see MPU6050Events.h to wait for it
+	void disableDataReadyInterrupt();
+	// Pulse the INT pin high when the acceleration changes by more than thresholdMg on any axis for duration samples.
+	// This works at full power and in cycle mode - see MPU6050Motion.h to switch between them automatically. Both keep
+	// the other interrupts enabled, and return false on a write error or an out of range parameter.
+	bool enableMotionInterrupt(int thresholdMg = MPU_MOTION_DEFAULT_THRESHOLD_MG, int duration = MPU_MOTION_DEFAULT_DURATION);
+	bool disableMotionInterrupt();
+	bool setInterruptEnable(int flags); // Write INT_ENABLE with the MPU_INT_ENABLE_* flags. Returns false on a write error.
+	int readInterruptStatus(); // Read and clear INT_STATUS. Returns the MPU_INT_STATUS_* flags, or -1 on a read error.
+	// --------------------------------------------
+
+	// ----------- FIFO Streaming Functions -----------
+	void enableFifo(int sampleRateDivider = MPU_FIFO_KEEP_SMPLRT_DIV);   // Start writing samples to the on-chip FIFO
+	void disableFifo();                                                  // Stop writing samples to the FIFO
+	void resetFifo();                                                    // Discard everything in the FIFO
+	// Drain up to maxSamples whole frames from the FIFO. Returns the number of samples read, or -1 on a read error.
+	// If the FIFO overflowed since the last call, it is reset, overflow is set to true and 0 is returned, or -1 if the
+	// reset failed.
+	int readFifo(MPU6050Sample *samples, int maxSamples, bool &overflow);
+	int readFifoRaw(MPU6050RawSample *samples, int maxSamples, bool &overflow); // As above, without scaling
+	int getFifoFrameLength(); // Bytes per FIFO frame for the channels enabled when the FIFO was started
+	// --------------------------------------------
+
+	// ----------- Auxiliary I2C Functions -----------
+	// Let the MPU6050 read devices on its auxiliary bus, such as a magnetometer or barometer, at each sample. Their data
+	// then comes back in the same burst read or FIFO frame as the IMU channels, with no extra host transactions, and is
+	// from the same sample. Each returns false on a write error or an invalid parameter.
+	bool enableAuxMaster(int clock = MPU_I2C_MST_CLK_400KHZ); // Start the master with I2C_MST_CLK set to clock
+	bool disableAuxMaster();                                  // Stop the master and remove every read
+	// Read length bytes from startRegister of the device at address at each sample. Reads are kept in the order they are
+	// added. Returns the offset of this device's bytes within the external data, or -1 if there is no slave free, the
+	// length is more than MPU_I2C_SLV_MAX_LENGTH or the total would be more than MPU_EXT_SENS_DATA_LENGTH. Add the reads
+	// before enableFifo() for them to be written to the FIFO - reads added after it only appear in burst reads until
+	// enableFifo() is called again.
+	int addAuxRead(int address, __u8 startRegister, int length);
+	// Write one register of an auxiliary device through slave 4, waiting up to MPU_AUX_WRITE_TIMEOUT_MS for it to be done.
+	// Returns false if the device does not acknowledge. Reading I2C_MST_STATUS clears the other slaves' NACK flags.
+	bool writeAuxRegister(int address, __u8 deviceRegister, __u8 value);
+	int getAuxLength();     // Bytes of external data per sample in a burst read
+	int getFifoAuxLength(); // Bytes of external data per FIFO frame, for the reads added when the FIFO was started
+	int readAuxStatus();   // Read and clear I2C_MST_STATUS. Returns the MPU_I2C_MST_STATUS_* flags, or -1 on a read error.
+	// Burst read one unscaled sample and the external data in one transaction. auxData must hold getAuxLength() bytes.
+	bool readRawSampleAux(MPU6050RawSample &sample, __u8 *auxData);
+	// As readFifoRaw(), also taking each frame's external data. auxData must hold maxSamples*getFifoAuxLength() bytes, or
+	// may be NULL. If timing is given it is set whenever frames are found, at the cost of two clock_gettime() calls.
+	int readFifoRawAux(MPU6050RawSample *samples, __u8 *auxData, int maxSamples, bool &overflow, MPU6050FifoTiming *timing = NULL);
+	// --------------------------------------------
+
+	// -------------- Error Handling --------------
+	// Read errors are counted rather than printed, so a failing bus does not slow the sampling loop down. Each failed read
+	// is retried up to maxRetries times straight away. After recoveryThreshold consecutive failed samples the bus is
+	// reopened and the device re-initialised with its last configuration, interrupts, auxiliary master and FIFO. The FIFO is
+	// emptied, so any samples waiting in it are lost.
+	void setRetryPolicy(int maxRetries = MPU_DEFAULT_MAX_RETRIES, int recoveryThreshold = MPU_DEFAULT_RECOVERY_THRESHOLD);
+	// Write a summary of new errors to log at most once every intervalMs, without flushing it. NULL turns logging off.
+	// The default is std::cout.
+	void setErrorLog(std::ostream *log, int intervalMs = MPU_ERROR_LOG_INTERVAL_MS);
+	int getLastSampleStatus();                  // MPU_SAMPLE_* flags for the last sample or FIFO read
+	void getErrorCounts(MPU6050ErrorCounts &counts); // Safe to call from another thread
+	void resetErrorCounts();
+	// --------------------------------------------
+
+	// ------------ Bus Usage Counters ------------
+	unsigned long getBusTransactions(); // Number of I2C transactions (and syscalls) made
+	unsigned long getBusBytes();        // Number of bytes clocked over the bus, including address bytes
+	void resetBusCounters();
+	// --------------------------------------------
+
+	// -------------- Instrumentation -------------
+	// Record transaction latencies, sample intervals and bus usage into metrics, which must outlive this object. NULL
+	// detaches it. Does nothing if MPU6050.cpp was compiled with MPU_NO_METRICS.
+	void setMetrics(MPU6050Metrics *metrics);
+	MPU6050Metrics* getMetrics(); // NULL if none is attached
+	// --------------------------------------------
+
 	// ----------- Data Output Function -----------
-	friend std::ostream& operator<<(std::ostream& out, MPU6050& M);
+	// Human readable summary of the latest values. For streams of samples use MPU6050Exporter (MPU6050Export.h).
+	friend std::ostream& operator<<(std::ostream& out, const MPU6050& M);
 	// --------------------------------------------
 
 private:
-	// I2C address of the device
-	int address;
+	MPU6050(const MPU6050& M);            // Each object owns its connection to the device, so objects cannot be copied
+	MPU6050& operator=(const MPU6050& M);
+
+	// Transport used to access the device registers, or NULL until the object is opened
+	MPU6050Transport *transport;
+	bool ownsTransport; // True if the transport was created by this object and must be deleted with it
+
+	// Bus and address opened on first use by an unopened object. The bus is -1 for objects made with a caller's transport.
+	int busNumber = 1;
+	int deviceAddress = MPU_DEFAULT_I2C_ADDR;
+
+	// Constructor used by create(), which leaves the device unconfigured
+	MPU6050(MPU6050Transport *busTransport, bool ownsTransport);
+
+	// Functions to configure the MPU6050. Only registers which differ from the requested values are written.
+	int configure(int pwrMgmtMode, int gyroConfig, int accelConfig);       // Returns CLEAN_EXIT or the error code
+	__u8 powerManagement1(int clockSource); // PWR_MGMT_1 at full power with a clock source and the current channels
+	void planBurst();        // Work out the burst read for the enabled channels
+	void configureOrExit(int pwrMgmtMode, int gyroConfig, int accelConfig); // Prints the error and exits on failure
+	void construct(int pwrMgmtMode, int gyroConfig, int accelConfig);       // Shared by the constructors
+	int start(int pwrMgmtMode, int gyroConfig, int accelConfig);           // Configure and take the first sample. Returns CLEAN_EXIT or the error code.
+	void openIfNeeded(); // Open an unopened object with its stored bus, address and configuration, exiting on error
+	static int finishCreate(MPU6050 *&sensor, MPU6050 *created, int pwrMgmtMode, int gyroConfig, int accelConfig);
+	void storeSample(const MPU6050Sample &sample); // Keep a scaled sample as the latest readings
 
-	// I2C Variables
-	char fileName[11];
-	int i2cHandle;
+	// Function to read an entire 16-bit register from the MPU6050
+	int16_t read16BitRegister(__u8 MSBRegister, __u8 LSBRegister, bool &readError, int &flags);
 
-	// Functions to initialise the MPU6050 - should only be called once
-	void defaultInitialise();
-	void initialise(int pwrMgmtMode, int gyroConfig, int accelConfig);
+	// Read a block on the sampling path with the error handling and metrics of a sample. Returns false on a read error.
+	bool readSampleBlock(__u8 startRegister, __u8 *buffer, int length);
 
-	// Function to read an entire 16-bit register from the MPU6050
-	int16_t read16BitRegister(__u8 MSBRegister, __u8 LSBRegister, bool &readError);
+	// Error handling helpers
+	bool readBlockWithRetry(__u8 startRegister, __u8 *buffer, int length, int &flags); // Retries according to the policy
+	int handleFailedSample();          // Count a failed sample, recover the bus if needed and log. Returns the flags to add.
+	void failSample(int flags);        // Count an unread sample against every channel, handle it and set lastSampleStatus
+	bool restoreSetup(bool wasCycling); // Re-program the offsets, interrupts, auxiliary master, FIFO and cycle mode after a recovery
+	bool clearFifo();                  // Reset the FIFO. Returns false on a bus error.
+	void logErrors();                  // Write the rate-limited summary
 
-	// Gyroscope values
+	// Transport reads on the sampling path, timed when metrics are attached
+	__s32 timedReadRegister(__u8 deviceRegister);
+	__s32 timedReadBlock(__u8 startRegister, __u8 *buffer, int length);
+	void recordSampleMetrics(int samples, bool timed); // Record bus usage since the last call, and the interval if timed
+
+	// Gyroscope values. The reciprocal of the scale is kept so that conversion is a multiplication.
 	float gyroScale;
+	float gyroReciprocal;
 	float gyroX;
 	float gyroY;
 	float gyroZ;
 
 	// Accelerometer values
 	float accelScale;
+	float accelReciprocal;
 	float accelX;
 	float accelY;
 	float accelZ;
 
 	// Temperature value
 	float temperature;
+
+	// Last configuration, used to re-initialise the device after a bus recovery
+	int pwrMgmtMode;
+	int gyroConfig;
+	int accelConfig;
+	int sampleRateDivider = 0;
+	int dlpfConfig = MPU_CONFIG_DLPF_0;
+	int accelHpf = MPU_ACC_HPF_RESET; // Kept in ACCEL_CONFIG alongside the sensitivity
+	int interruptEnable = 0;          // Last value written to INT_ENABLE
+	__u8 motionThresholdDuration[2] = {0, 0}; // MOT_THR and MOT_DUR
+	bool cycling = false;
+	int cycleWakeRate = MPU_PWR_MGMT_WAKE_5HZ; // LP_WAKE_CTRL of the last enterCycleMode()
+	MPU6050Offsets lastOffsets = {0, 0, 0, 0, 0, 0}; // Offsets last written by setOffsets(), if offsetsWritten
+	bool offsetsWritten = false;
+
+	// Enabled channels, and the burst and FIFO frame which read them. A layout is the mask of channels in a frame.
+	int channels = MPU_CONFIG_CHANNELS_ALL;
+	__u8 burstStart = MPU_BURST_START;
+	int burstLength = MPU_BURST_LENGTH;
+	int burstLayout = MPU_CONFIG_CHANNELS_ALL;
+	int fifoLayout = MPU_CONFIG_CHANNELS_ALL;
+	int fifoFrameLength = MPU_FIFO_FRAME_LENGTH;
+	int fifoAuxLength = 0; // External data at the end of each FIFO frame
+	bool fifoEnabled = false;
+	__u8 fifoEnableBits = 0; // FIFO_EN while the FIFO is enabled
+
+	// Auxiliary I2C master
+	bool auxMaster = false;
+	__u8 auxMasterControl = 0; // I2C_MST_CTRL, without SLV_3_FIFO_EN
+	int auxSlaves = 0;         // Slaves in use, from slave 0
+	__u8 auxSlaveConfig[MPU_I2C_SLV_COUNT][3]; // I2C_SLVx_ADDR, REG and CTRL of each slave in use
+	int auxLength = 0;
+
+	// Error handling policy and counters. The counters may be read from another thread.
+	int maxRetries = MPU_DEFAULT_MAX_RETRIES;
+	int recoveryThreshold = MPU_DEFAULT_RECOVERY_THRESHOLD;
+	int consecutiveFailures = 0;
+	int lastSampleStatus = MPU_SAMPLE_OK;
+	std::ostream *errorLog = &std::cout;
+	long errorLogIntervalMs = MPU_ERROR_LOG_INTERVAL_MS;
+	long long lastLogMs = 0;           // CLOCK_MONOTONIC time of the last log line
+	unsigned long loggedFailures = 0;  // Read failures already reported
+	std::atomic<unsigned long> channelErrors[MPU_CHANNEL_COUNT] = {};
+	std::atomic<unsigned long> readFailures{0};
+	std::atomic<unsigned long> retries{0};
+	std::atomic<unsigned long> retrySuccesses{0};
+	std::atomic<unsigned long> busRecoveries{0};
+	std::atomic<unsigned long> failedRecoveries{0};
+	std::atomic<unsigned long> fifoOverflows{0};
+
+#ifndef MPU_NO_METRICS
+	// Attached instrumentation, and the bus counters when it last recorded a sample
+	MPU6050Metrics *metrics = NULL;
+	unsigned long metricsTransactions = 0;
+	unsigned long metricsBytes = 0;
+#endif
 };
 
 #endif
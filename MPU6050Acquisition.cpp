@@ -0,0 +1,195 @@
+/* ============================================================================================
+ * MPU6050 Background Acquisition Code for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This source code defines the sample ring and acquisition engine. See MPU6050Acquisition.h for
+ * more information.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include "MPU6050Acquisition.h" // Include definitions and declarations within the header file
+#include <poll.h>               // For poll()
+#include <time.h>               // For clock_gettime() and clock_nanosleep()
+#ifndef MPU_NO_METRICS
+#include "MPU6050Metrics.h"     // To report dropped samples
+#endif
+
+// Time to wait for a data ready event before checking if the engine has been stopped
+#define ACQUISITION_POLL_TIMEOUT_MS 100
+
+// ---------------------------------------- Sample Ring ---------------------------------------
+MPU6050SampleRing::MPU6050SampleRing(int capacity){
+    // Round up to a power of 2 so the indices can be wrapped with a mask
+    unsigned int size = 1;
+    while(size < (unsigned int)capacity){
+        size <<= 1;
+    }
+    buffer = new MPU6050TimedSample[size];
+    mask = size - 1;
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+}
+
+MPU6050SampleRing::~MPU6050SampleRing(){
+    delete[] buffer;
+}
+
+// Add a sample - producer only
+bool MPU6050SampleRing::push(const MPU6050TimedSample &sample){
+    unsigned int currentHead = head.load(std::memory_order_relaxed);
+    if(currentHead - tail.load(std::memory_order_acquire) > mask){
+        return false; // Full
+    }
+    buffer[currentHead & mask] = sample;
+    head.store(currentHead + 1, std::memory_order_release); // Publish the sample to the consumer
+    return true;
+}
+
+// Remove the oldest sample - consumer only
+bool MPU6050SampleRing::pop(MPU6050TimedSample &sample){
+    unsigned int currentTail = tail.load(std::memory_order_relaxed);
+    if(currentTail == head.load(std::memory_order_acquire)){
+        return false; // Empty
+    }
+    sample = buffer[currentTail & mask];
+    tail.store(currentTail + 1, std::memory_order_release); // Hand the slot back to the producer
+    return true;
+}
+
+// Remove up to maxSamples of the oldest samples with a single update of the tail - consumer only
+int MPU6050SampleRing::popBatch(MPU6050TimedSample *samples, int maxSamples){
+    unsigned int currentTail = tail.load(std::memory_order_relaxed);
+    unsigned int count = head.load(std::memory_order_acquire) - currentTail;
+    if(count > (unsigned int)maxSamples){
+        count = maxSamples;
+    }
+    for(unsigned int i = 0; i < count; i++){
+        samples[i] = buffer[(currentTail + i) & mask];
+    }
+    tail.store(currentTail + count, std::memory_order_release);
+    return count;
+}
+
+int MPU6050SampleRing::size(){
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+}
+
+int MPU6050SampleRing::getCapacity(){return mask + 1;}
+// --------------------------------------------------------------------------------------------
+
+// ------------------------------------ Acquisition Engine ------------------------------------
+MPU6050Acquisition::MPU6050Acquisition(MPU6050 &sensor, int capacity) : ring(capacity){
+    this->sensor = &sensor;
+    running = false;
+    droppedSamples = 0;
+    readErrors = 0;
+}
+
+// Destructor - make sure the thread is not left using the sensor
+MPU6050Acquisition::~MPU6050Acquisition(){
+    stop();
+}
+
+// Start reading at a fixed period
+void MPU6050Acquisition::start(long periodNs){
+    stop();
+    running = true;
+    worker = std::thread(&MPU6050Acquisition::runPeriodic, this, periodNs);
+}
+
+// Start reading on each data ready event
+void MPU6050Acquisition::start(MPU6050EventSource &dataReady){
+    stop();
+    running = true;
+    worker = std::thread(&MPU6050Acquisition::runEvents, this, &dataReady);
+}
+
+// Stop the thread and wait for it to finish
+void MPU6050Acquisition::stop(){
+    running = false;
+    if(worker.joinable()){
+        worker.join();
+    }
+}
+
+bool MPU6050Acquisition::pop(MPU6050TimedSample &sample){return ring.pop(sample);}
+
+int MPU6050Acquisition::popBatch(MPU6050TimedSample *samples, int maxSamples){return ring.popBatch(samples, maxSamples);}
+
+int MPU6050Acquisition::available(){return ring.size();}
+
+unsigned long MPU6050Acquisition::getDroppedSamples(){return droppedSamples.load(std::memory_order_relaxed);}
+
+unsigned long MPU6050Acquisition::getReadErrors(){return readErrors.load(std::memory_order_relaxed);}
+
+// Time a read. The sample was latched somewhere during the read, so the midpoint is the best estimate.
+template<typename Read>
+static bool stampRead(MPU6050TimedSample &sample, Read read){
+    uint64_t start = MPU6050Acquisition::nowNs();
+    bool success = read();
+    uint64_t end = MPU6050Acquisition::nowNs();
+    sample.timestampNs = start + (end - start)/2;
+    return success;
+}
+
+bool MPU6050Acquisition::readTimedSample(MPU6050 &sensor, MPU6050TimedSample &sample){
+    return stampRead(sample, [&]{return sensor.readRawSample(sample.raw);});
+}
+
+bool MPU6050Acquisition::readTimedSample(MPU6050 &sensor, MPU6050TimedSample &sample, bool &dataReady){
+    return stampRead(sample, [&]{return sensor.readRawSample(sample.raw, dataReady);});
+}
+
+bool MPU6050Acquisition::readTimedSampleStatus(MPU6050 &sensor, MPU6050TimedSample &sample, int &interruptStatus){
+    return stampRead(sample, [&]{return sensor.readRawSampleStatus(sample.raw, interruptStatus);});
+}
+
+// Read on absolute deadlines so that time spent reading does not add to the period
+void MPU6050Acquisition::runPeriodic(long periodNs){
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    while(running.load(std::memory_order_relaxed)){
+        acquire();
+
+        deadline.tv_nsec += periodNs;
+        while(deadline.tv_nsec >= 1000000000L){
+            deadline.tv_nsec -= 1000000000L;
+            deadline.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+    }
+}
+
+// Sleep until the data ready event, then read straight after the conversion
+void MPU6050Acquisition::runEvents(MPU6050EventSource *dataReady){
+    struct pollfd event;
+    event.fd = dataReady->getFd();
+    event.events = POLLIN;
+
+    while(running.load(std::memory_order_relaxed)){
+        // Wake up periodically so that stop() does not wait for an event that may never come
+        if(poll(&event, 1, ACQUISITION_POLL_TIMEOUT_MS) > 0 && dataReady->acknowledge()){
+            acquire();
+        }
+    }
+}
+
+// Read, stamp and push one sample
+void MPU6050Acquisition::acquire(){
+    MPU6050TimedSample sample;
+    if(!readTimedSample(*sensor, sample)){
+        readErrors.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if(!ring.push(sample)){
+        droppedSamples.fetch_add(1, std::memory_order_relaxed);
+#ifndef MPU_NO_METRICS
+        if(MPU6050Metrics *metrics = sensor->getMetrics()){
+            metrics->recordDroppedSample();
+        }
+#endif
+    }
+}
+// --------------------------------------------------------------------------------------------
@@ -0,0 +1,114 @@
+/* ============================================================================================
+ * MPU6050 Background Acquisition Header for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This header declares an acquisition engine which owns the MPU6050 on a dedicated thread. The
+ * thread reads raw samples, either at a fixed period or each time a data ready event arrives,
+ * stamps them with CLOCK_MONOTONIC and pushes them into a fixed-capacity lock-free single
+ * producer, single consumer ring. The consumer pops single samples or batches without blocking
+ * or taking locks, so its latency is not coupled to the latency of the I2C bus. If the consumer
+ * falls behind and the ring fills up, new samples are dropped and counted.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include <atomic>   // Used for the lock-free ring indices
+#include <thread>   // Used for the acquisition thread
+#include <stdint.h> // For fixed width types
+#include <time.h>   // For clock_gettime()
+
+#include "MPU6050.h"
+#include "MPU6050Events.h"
+
+#ifndef MPU6050_ACQUISITION_H
+#define MPU6050_ACQUISITION_H
+
+// Size of a cache line - the producer and consumer indices are kept on separate lines to avoid false sharing
+#define MPU_CACHE_LINE_SIZE 64
+
+// Default capacity of the ring, in samples. This must be a power of 2.
+#define MPU_ACQUISITION_DEFAULT_CAPACITY 1024
+
+// A raw sample with the time it was read
+struct MPU6050TimedSample{
+	uint64_t timestampNs; // CLOCK_MONOTONIC time halfway through the read, in nanoseconds. MPU6050Timestamper gives the
+	                      // CLOCK_MONOTONIC time the sensor wrote the sample instead; only its fit runs on CLOCK_MONOTONIC_RAW.
+	MPU6050RawSample raw;
+};
+
+// Lock-free single producer, single consumer ring of timed samples
+class MPU6050SampleRing{
+public:
+	MPU6050SampleRing(int capacity = MPU_ACQUISITION_DEFAULT_CAPACITY); // capacity is rounded up to a power of 2
+	~MPU6050SampleRing();
+
+	bool push(const MPU6050TimedSample &sample);              // Producer only. Returns false if the ring is full.
+	bool pop(MPU6050TimedSample &sample);                     // Consumer only. Returns false if the ring is empty.
+	int popBatch(MPU6050TimedSample *samples, int maxSamples); // Consumer only. Returns the number of samples popped.
+	int size();                                               // Number of samples waiting - approximate while in use
+	int getCapacity();
+
+private:
+	MPU6050SampleRing(const MPU6050SampleRing& R);            // The ring cannot be copied
+	MPU6050SampleRing& operator=(const MPU6050SampleRing& R);
+
+	MPU6050TimedSample *buffer;
+	unsigned int mask; // capacity - 1, used to wrap the indices
+
+	// Free-running indices - only the producer writes head and only the consumer writes tail
+	alignas(MPU_CACHE_LINE_SIZE) std::atomic<unsigned int> head;
+	alignas(MPU_CACHE_LINE_SIZE) std::atomic<unsigned int> tail;
+	char padding[MPU_CACHE_LINE_SIZE - sizeof(std::atomic<unsigned int>)];
+};
+
+// Engine which reads an MPU6050 on its own thread
+class MPU6050Acquisition{
+public:
+	// The sensor must not be used by any other thread while the engine is running
+	MPU6050Acquisition(MPU6050 &sensor, int capacity = MPU_ACQUISITION_DEFAULT_CAPACITY);
+	~MPU6050Acquisition(); // Stops the thread
+
+	void start(long periodNs);                  // Read a sample every periodNs, on absolute deadlines so the rate does not drift
+	void start(MPU6050EventSource &dataReady);  // Read a sample each time the data ready event arrives
+	void stop();
+
+	// Consumer functions - these never block
+	bool pop(MPU6050TimedSample &sample);
+	int popBatch(MPU6050TimedSample *samples, int maxSamples);
+	int available();
+
+	unsigned long getDroppedSamples(); // Samples lost because the ring was full
+	unsigned long getReadErrors();     // Reads which failed on the bus
+
+	// Clock and read used by everything which stamps samples with CLOCK_MONOTONIC
+	static uint64_t nowNs(clockid_t clock = CLOCK_MONOTONIC); // Time in nanoseconds - CLOCK_MONOTONIC unless another clock is given
+	// Burst read one raw sample and stamp it halfway through the read. Returns false on a read error.
+	static bool readTimedSample(MPU6050 &sensor, MPU6050TimedSample &sample);
+	static bool readTimedSample(MPU6050 &sensor, MPU6050TimedSample &sample, bool &dataReady); // As readRawSample()
+	static bool readTimedSampleStatus(MPU6050 &sensor, MPU6050TimedSample &sample, int &interruptStatus); // As readRawSampleStatus()
+
+private:
+	MPU6050Acquisition(const MPU6050Acquisition& A);            // The engine cannot be copied
+	MPU6050Acquisition& operator=(const MPU6050Acquisition& A);
+
+	// Thread functions
+	void runPeriodic(long periodNs);
+	void runEvents(MPU6050EventSource *dataReady);
+	void acquire(); // Read, stamp and push one sample
+
+	MPU6050 *sensor;
+	MPU6050SampleRing ring;
+	std::thread worker;
+	std::atomic<bool> running;
+	std::atomic<unsigned long> droppedSamples;
+	std::atomic<unsigned long> readErrors;
+};
+
+// Inline so that the sensor's own instrumentation and other code which stamps samples can use it without linking the engine
+inline uint64_t MPU6050Acquisition::nowNs(clockid_t clock){
+	struct timespec now;
+	clock_gettime(clock, &now);
+	return uint64_t(now.tv_sec)*1000000000ULL + now.tv_nsec;
+}
+
+#endif
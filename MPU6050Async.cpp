@@ -0,0 +1,250 @@
+/* ============================================================================================
+ * MPU6050 Asynchronous Interface Code for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This source code defines the event loop, asynchronous sensor and sample awaiter. See
+ * MPU6050Async.h for more information. timerfd documentation was found at
+ * https://man7.org/linux/man-pages/man2/timerfd_create.2.html.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include "MPU6050Async.h" // Include definitions and declarations within the header file
+#include <iostream>       // Used for error output
+#include <errno.h>        // For EINTR
+#include <sys/timerfd.h>  // For timerfd_create() and timerfd_settime()
+#include <unistd.h>       // For read() and close()
+
+// ---------------------------------------- Event Loop ----------------------------------------
+MPU6050EventLoop::MPU6050EventLoop(){
+    running = false;
+    epollHandle = epoll_create1(EPOLL_CLOEXEC);
+    if(epollHandle < 0){
+        std::cout << std::endl << "Couldn't create the epoll instance." << std::endl;
+        exit(EPOLL_SETUP_ERROR);
+    }
+}
+
+// Destructor - close the epoll handle. The handlers belong to the caller.
+MPU6050EventLoop::~MPU6050EventLoop(){
+    close(epollHandle);
+}
+
+bool MPU6050EventLoop::add(int fd, MPU6050EventHandler &handler, uint32_t events){
+    struct epoll_event event;
+    event.events = events;
+    event.data.ptr = &handler;
+    return epoll_ctl(epollHandle, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+bool MPU6050EventLoop::remove(int fd){
+    return epoll_ctl(epollHandle, EPOLL_CTL_DEL, fd, NULL) == 0;
+}
+
+int MPU6050EventLoop::runOnce(int timeoutMs){
+    struct epoll_event events[MPU_EVENT_LOOP_MAX_EVENTS];
+
+    int eventCount = epoll_wait(epollHandle, events, MPU_EVENT_LOOP_MAX_EVENTS, timeoutMs);
+    if(eventCount < 0){
+        return errno == EINTR ? 0 : -1;
+    }
+    for(int i = 0; i < eventCount; i++){
+        ((MPU6050EventHandler*)events[i].data.ptr)->handleEvent(events[i].events);
+    }
+    return eventCount;
+}
+
+void MPU6050EventLoop::run(){
+    running = true;
+    while(running && runOnce(-1) >= 0);
+}
+
+void MPU6050EventLoop::stop(){running = false;}
+
+int MPU6050EventLoop::getFd(){return epollHandle;}
+// --------------------------------------------------------------------------------------------
+
+// -------------------------------------- Sample Awaiter --------------------------------------
+MPU6050SampleAwaiter::MPU6050SampleAwaiter(MPU6050AsyncSensor *sensor, MPU6050TimedSample *samples, int count){
+    this->sensor = sensor;
+    this->samples = samples;
+    wanted = count;
+    delivered = 0;
+    next = NULL;
+}
+
+// Take what is buffered. There is no need to suspend if that was enough or no more samples will come.
+bool MPU6050SampleAwaiter::await_ready(){
+    delivered = sensor->takeBuffered(samples, wanted);
+    return delivered >= wanted || !sensor->open;
+}
+
+void MPU6050SampleAwaiter::await_suspend(std::coroutine_handle<> handle){
+    this->handle = handle;
+    if(sensor->lastWaiter != NULL){
+        sensor->lastWaiter->next = this;
+    }
+    else{
+        sensor->firstWaiter = this;
+    }
+    sensor->lastWaiter = this;
+}
+// --------------------------------------------------------------------------------------------
+
+// ---------------------------------------- Async Sensor --------------------------------------
+MPU6050AsyncSensor::MPU6050AsyncSensor(MPU6050EventLoop &loop, MPU6050 &sensor, MPU6050EventSource &dataReady, int bufferCapacity){
+    this->dataReady = &dataReady;
+    timerHandle = -1;
+    setUp(loop, sensor, dataReady.getFd(), bufferCapacity);
+}
+
+MPU6050AsyncSensor::MPU6050AsyncSensor(MPU6050EventLoop &loop, MPU6050 &sensor, long periodNs, int bufferCapacity){
+    struct itimerspec period;
+
+    dataReady = NULL;
+    timerHandle = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(timerHandle < 0){
+        std::cout << std::endl << "Couldn't create the sample timer." << std::endl;
+        exit(TIMER_SETUP_ERROR);
+    }
+    if(periodNs <= 0){
+        periodNs = 1;
+    }
+    period.it_interval.tv_sec = periodNs/1000000000L;
+    period.it_interval.tv_nsec = periodNs%1000000000L;
+    period.it_value = period.it_interval; // The first sample is one period from now
+    if(timerfd_settime(timerHandle, 0, &period, NULL) < 0){
+        std::cout << std::endl << "Couldn't start the sample timer." << std::endl;
+        exit(TIMER_SETUP_ERROR);
+    }
+    setUp(loop, sensor, timerHandle, bufferCapacity);
+}
+
+// Shared by the constructors
+void MPU6050AsyncSensor::setUp(MPU6050EventLoop &loop, MPU6050 &sensor, int fd, int bufferCapacity){
+    this->loop = &loop;
+    this->sensor = &sensor;
+    this->fd = fd;
+    buffer.resize(bufferCapacity > 0 ? bufferCapacity : 1);
+    bufferStart = 0;
+    bufferCount = 0;
+    firstWaiter = lastWaiter = NULL;
+    droppedSamples = 0;
+    readErrors = 0;
+    missedTicks = 0;
+
+    open = loop.add(fd, *this);
+    if(!open){
+        std::cout << std::endl << "Couldn't add the event source to the epoll instance." << std::endl;
+        exit(EPOLL_SETUP_ERROR);
+    }
+}
+
+MPU6050AsyncSensor::~MPU6050AsyncSensor(){
+    close();
+}
+
+void MPU6050AsyncSensor::close(){
+    if(!open){
+        return;
+    }
+    open = false;
+    loop->remove(fd);
+    if(timerHandle >= 0){
+        ::close(timerHandle);
+        timerHandle = -1;
+    }
+
+    // Detach the queue before resuming anything, as a resumed coroutine may wait again
+    MPU6050SampleAwaiter *waiter = firstWaiter;
+    firstWaiter = lastWaiter = NULL;
+    while(waiter != NULL){
+        MPU6050SampleAwaiter *next = waiter->next;
+        waiter->handle.resume();
+        waiter = next;
+    }
+}
+
+bool MPU6050AsyncSensor::isOpen(){return open;}
+
+MPU6050SampleAwaiter MPU6050AsyncSensor::next(MPU6050TimedSample &sample){
+    return MPU6050SampleAwaiter(this, &sample, 1);
+}
+
+MPU6050SampleAwaiter MPU6050AsyncSensor::nextBatch(MPU6050TimedSample *samples, int count){
+    return MPU6050SampleAwaiter(this, samples, count);
+}
+
+int MPU6050AsyncSensor::available(){return bufferCount;}
+
+unsigned long MPU6050AsyncSensor::getDroppedSamples(){return droppedSamples;}
+
+unsigned long MPU6050AsyncSensor::getReadErrors(){return readErrors;}
+
+unsigned long MPU6050AsyncSensor::getMissedTicks(){return missedTicks;}
+
+// Read a sample when the event source or timer is ready
+void MPU6050AsyncSensor::handleEvent(uint32_t){
+    if(dataReady != NULL){
+        if(!dataReady->acknowledge()){
+            return;
+        }
+    }
+    else{
+        uint64_t expirations;
+        if(read(timerHandle, &expirations, sizeof(expirations)) != sizeof(expirations)){
+            return; // Nothing pending after all
+        }
+        if(expirations > 1){
+            missedTicks += expirations - 1;
+        }
+    }
+
+    MPU6050TimedSample sample;
+    if(!MPU6050Acquisition::readTimedSample(*sensor, sample)){
+        readErrors++;
+        return;
+    }
+    deliver(sample);
+}
+
+void MPU6050AsyncSensor::deliver(const MPU6050TimedSample &sample){
+    MPU6050SampleAwaiter *waiter = firstWaiter;
+    if(waiter == NULL){
+        // Nobody is waiting, so keep it - dropping the oldest if the buffer is full
+        int capacity = int(buffer.size());
+        if(bufferCount == capacity){
+            bufferStart = (bufferStart + 1) % capacity;
+            bufferCount--;
+            droppedSamples++;
+        }
+        buffer[(bufferStart + bufferCount) % capacity] = sample;
+        bufferCount++;
+        return;
+    }
+
+    waiter->samples[waiter->delivered++] = sample;
+    if(waiter->delivered < waiter->wanted){
+        return;
+    }
+
+    // The batch is complete - take the waiter off the queue before resuming it, as it may wait again
+    firstWaiter = waiter->next;
+    if(firstWaiter == NULL){
+        lastWaiter = NULL;
+    }
+    waiter->handle.resume();
+}
+
+// Copy up to count buffered samples, oldest first
+int MPU6050AsyncSensor::takeBuffered(MPU6050TimedSample *samples, int count){
+    int capacity = int(buffer.size());
+    int taken = 0;
+    while(taken < count && bufferCount > 0){
+        samples[taken++] = buffer[bufferStart];
+        bufferStart = (bufferStart + 1) % capacity;
+        bufferCount--;
+    }
+    return taken;
+}
+// --------------------------------------------------------------------------------------------
@@ -0,0 +1,167 @@
+/* ============================================================================================
+ * MPU6050 Asynchronous Interface Header for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This header declares a C++20 coroutine interface for reading sensors from a single-threaded
+ * epoll event loop. Each MPU6050AsyncSensor is read when its data ready event arrives or when
+ * its timerfd expires, and a coroutine can co_await the next sample or the next batch of
+ * samples:
+ *
+ *     MPU6050Task logSamples(MPU6050AsyncSensor &imu){
+ *         MPU6050TimedSample samples[100];
+ *         while(co_await imu.nextBatch(samples, 100) == 100){
+ *             ... // Process the batch
+ *         }
+ *     }
+ *
+ * Any number of sensors and coroutines can share one loop, along with other file descriptors
+ * such as CAN or serial ports, using MPU6050EventHandler. If the application already has an
+ * epoll loop, add the descriptor from getFd() to it and call runOnce(0) when it is readable.
+ * The loop never waits for anything except epoll_wait() and never creates threads. The I2C
+ * read made for each sample is still a blocking syscall - about 0.5ms for the 14 byte burst on
+ * a 400kHz bus - as i2c-dev has no asynchronous interface.
+ * Requires C++20 (-std=c++20, or -fcoroutines on GCC 10).
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include <coroutine>    // For the coroutine handles and awaiter interface
+#include <stdint.h>     // For fixed width types
+#include <vector>       // Used for the sample buffer
+#include <sys/epoll.h>  // For the EPOLL* event flags
+
+#include "MPU6050.h"
+#include "MPU6050Events.h"
+#include "MPU6050Acquisition.h" // For MPU6050TimedSample
+
+#ifndef MPU6050_ASYNC_H
+#define MPU6050_ASYNC_H
+
+// Default number of samples kept for a sensor while no coroutine is waiting
+#define MPU_ASYNC_DEFAULT_BUFFER 64
+
+// Maximum number of events handled per call to MPU6050EventLoop::runOnce()
+#define MPU_EVENT_LOOP_MAX_EVENTS 32
+
+// Interface for anything the event loop dispatches to
+class MPU6050EventHandler{
+public:
+	virtual ~MPU6050EventHandler(){}
+	virtual void handleEvent(uint32_t events) = 0; // Called with the EPOLL* flags when the descriptor is ready
+};
+
+// Single-threaded epoll event loop
+class MPU6050EventLoop{
+public:
+	MPU6050EventLoop();  // Exits with EPOLL_SETUP_ERROR if epoll can't be set up
+	~MPU6050EventLoop();
+
+	// Watch a file descriptor. The handler must stay valid until it is removed.
+	bool add(int fd, MPU6050EventHandler &handler, uint32_t events = EPOLLIN);
+	bool remove(int fd);
+
+	int runOnce(int timeoutMs); // Dispatch the ready handlers, waiting up to timeoutMs (-1 forever). Returns the number dispatched or -1.
+	void run();                 // Dispatch until stop() is called, for example from a handler or coroutine
+	void stop();
+
+	int getFd(); // Readable when a handler is ready, for adding this loop to another epoll loop
+
+private:
+	MPU6050EventLoop(const MPU6050EventLoop& L);            // The epoll handle cannot be shared
+	MPU6050EventLoop& operator=(const MPU6050EventLoop& L);
+
+	int epollHandle;
+	bool running;
+};
+
+class MPU6050AsyncSensor;
+
+// Awaitable returned by MPU6050AsyncSensor::next() and nextBatch(). co_await gives the number of samples delivered,
+// which is only less than the number asked for if the sensor was closed.
+class MPU6050SampleAwaiter{
+public:
+	bool await_ready();                               // True if the buffered samples were enough
+	void await_suspend(std::coroutine_handle<> handle); // Queue on the sensor until the rest arrive
+	int await_resume(){return delivered;}
+
+private:
+	friend class MPU6050AsyncSensor;
+	MPU6050SampleAwaiter(MPU6050AsyncSensor *sensor, MPU6050TimedSample *samples, int count);
+
+	MPU6050AsyncSensor *sensor;
+	MPU6050TimedSample *samples;
+	int wanted;
+	int delivered;
+	std::coroutine_handle<> handle;
+	MPU6050SampleAwaiter *next; // Next waiting coroutine on the same sensor
+};
+
+// A sensor read by an event loop. Samples are given to waiting coroutines in the order they started waiting. While no
+// coroutine is waiting, up to bufferCapacity samples are kept and the oldest are dropped after that.
+class MPU6050AsyncSensor : public MPU6050EventHandler{
+public:
+	// Read a sample each time the data ready event arrives - see MPU6050Events.h. The sensor's data ready interrupt
+	// must be enabled.
+	MPU6050AsyncSensor(MPU6050EventLoop &loop, MPU6050 &sensor, MPU6050EventSource &dataReady, int bufferCapacity = MPU_ASYNC_DEFAULT_BUFFER);
+	// Read a sample every periodNs nanoseconds from a timerfd. Exits with TIMER_SETUP_ERROR if the timer can't be set up.
+	MPU6050AsyncSensor(MPU6050EventLoop &loop, MPU6050 &sensor, long periodNs, int bufferCapacity = MPU_ASYNC_DEFAULT_BUFFER);
+	~MPU6050AsyncSensor(); // Closes the sensor
+
+	MPU6050SampleAwaiter next(MPU6050TimedSample &sample);                   // co_await for the next sample
+	MPU6050SampleAwaiter nextBatch(MPU6050TimedSample *samples, int count);  // co_await for the next count samples
+
+	// Stop reading and resume every waiting coroutine with the samples it has so far. The event source, the MPU6050
+	// object and the loop are left open.
+	void close();
+	bool isOpen();
+
+	int available();                   // Samples buffered
+	unsigned long getDroppedSamples(); // Samples dropped because the buffer was full
+	unsigned long getReadErrors();     // Failed reads - see the MPU6050 object's error counts for details
+	unsigned long getMissedTicks();    // Timer periods which passed without a read because the loop was busy
+
+	void handleEvent(uint32_t events);
+
+private:
+	MPU6050AsyncSensor(const MPU6050AsyncSensor& S);            // Coroutines hold pointers to the sensor
+	MPU6050AsyncSensor& operator=(const MPU6050AsyncSensor& S);
+	friend class MPU6050SampleAwaiter;
+
+	void setUp(MPU6050EventLoop &loop, MPU6050 &sensor, int fd, int bufferCapacity);
+	void deliver(const MPU6050TimedSample &sample); // Give a new sample to the first waiting coroutine, or buffer it
+	int takeBuffered(MPU6050TimedSample *samples, int count);
+
+	MPU6050EventLoop *loop;
+	MPU6050 *sensor;
+	MPU6050EventSource *dataReady; // NULL when read from the timer
+	int fd;                        // The event source or timerfd
+	int timerHandle;               // -1 when read from an event source
+	bool open;
+
+	// Buffered samples, in a ring
+	std::vector<MPU6050TimedSample> buffer;
+	int bufferStart;
+	int bufferCount;
+
+	// Queue of waiting coroutines
+	MPU6050SampleAwaiter *firstWaiter;
+	MPU6050SampleAwaiter *lastWaiter;
+
+	unsigned long droppedSamples;
+	unsigned long readErrors;
+	unsigned long missedTicks;
+};
+
+// Return type for coroutines which run on the event loop. The coroutine starts straight away, runs until its first
+// co_await, and is resumed by the loop from then on. Nothing needs to be kept - the coroutine frees itself when it ends.
+struct MPU6050Task{
+	struct promise_type{
+		MPU6050Task get_return_object(){return MPU6050Task();}
+		std::suspend_never initial_suspend() noexcept{return std::suspend_never();}
+		std::suspend_never final_suspend() noexcept{return std::suspend_never();}
+		void return_void(){}
+		void unhandled_exception(){throw;}
+	};
+};
+
+#endif
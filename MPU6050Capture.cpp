@@ -0,0 +1,551 @@
+/* ============================================================================================
+ * MPU6050 Capture File Code for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This source code defines the capture writer, reader and replay transport. See
+ * MPU6050Capture.h for the file layout.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include "MPU6050Capture.h" // Include definitions and declarations within the header file
+#include <fcntl.h>          // For open()
+#include <unistd.h>         // For write() and close()
+#include <sys/mman.h>       // For mmap() and munmap()
+#include <sys/stat.h>       // For fstat()
+#include <string.h>         // For memcpy(), memcmp() and memset()
+#include <errno.h>          // For EINTR
+#include <algorithm>        // For std::upper_bound()
+
+// Number of channels in a raw sample
+#define CHANNEL_COUNT 7
+
+// Largest encoding of one delta sample: a 10 byte timestamp varint and 3 bytes per channel
+#define MAX_DELTA_SAMPLE_BYTES (10 + 3*CHANNEL_COUNT)
+
+// Bytes used by the absolute first sample of a chunk
+#define FIRST_SAMPLE_BYTES (2*CHANNEL_COUNT)
+
+// Channels of a raw sample in register order
+static inline void getChannels(const MPU6050RawSample &raw, int32_t *channels){
+    channels[0] = raw.accelX;
+    channels[1] = raw.accelY;
+    channels[2] = raw.accelZ;
+    channels[3] = raw.temperature;
+    channels[4] = raw.gyroX;
+    channels[5] = raw.gyroY;
+    channels[6] = raw.gyroZ;
+}
+
+static inline void setChannels(MPU6050RawSample &raw, const int32_t *channels){
+    raw.accelX = int16_t(channels[0]);
+    raw.accelY = int16_t(channels[1]);
+    raw.accelZ = int16_t(channels[2]);
+    raw.temperature = int16_t(channels[3]);
+    raw.gyroX = int16_t(channels[4]);
+    raw.gyroY = int16_t(channels[5]);
+    raw.gyroZ = int16_t(channels[6]);
+}
+
+// Append an unsigned varint - 7 bits per byte, with the top bit set on all but the last byte
+static inline uint8_t* putVarint(uint8_t *out, uint64_t value){
+    while(value >= 0x80){
+        *out++ = uint8_t(value) | 0x80;
+        value >>= 7;
+    }
+    *out++ = uint8_t(value);
+    return out;
+}
+
+// Read an unsigned varint. Returns NULL if it runs past the end.
+static inline const uint8_t* getVarint(const uint8_t *in, const uint8_t *end, uint64_t &value){
+    value = 0;
+    for(int shift = 0; in < end && shift < 64; shift += 7){
+        uint8_t byte = *in++;
+        value |= uint64_t(byte & 0x7F) << shift;
+        if(!(byte & 0x80)){
+            return in;
+        }
+    }
+    return NULL;
+}
+
+// Zigzag encoding maps small negative and positive numbers to small unsigned numbers: 0, -1, 1, -2 ... to 0, 1, 2, 3 ...
+static inline uint32_t zigzag(int32_t value){
+    return (uint32_t(value) << 1) ^ uint32_t(value >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t value){
+    return int32_t(value >> 1) ^ -int32_t(value & 1);
+}
+
+// ----------------------------------------- Writer -------------------------------------------
+MPU6050CaptureWriter::MPU6050CaptureWriter(){
+    fileHandle = -1;
+    samplesPerChunk = MPU_CAPTURE_DEFAULT_CHUNK;
+    offset = 0;
+    sampleCount = 0;
+    memset(&chunk, 0, sizeof(chunk));
+}
+
+MPU6050CaptureWriter::~MPU6050CaptureWriter(){
+    close();
+}
+
+// Create the file and write the header
+bool MPU6050CaptureWriter::open(const char *path, const MPU6050CaptureConfig &config, int samplesPerChunk){
+    close();
+    fileHandle = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fileHandle < 0){
+        return false;
+    }
+
+    this->samplesPerChunk = samplesPerChunk > 0 ? samplesPerChunk : MPU_CAPTURE_DEFAULT_CHUNK;
+    payload.clear();
+    payload.reserve(FIRST_SAMPLE_BYTES + (this->samplesPerChunk - 1)*MAX_DELTA_SAMPLE_BYTES);
+    index.clear();
+    offset = 0;
+    sampleCount = 0;
+    memset(&chunk, 0, sizeof(chunk));
+
+    const float gyroScales[] = {MPU_GYRO_SCALE_250, MPU_GYRO_SCALE_500, MPU_GYRO_SCALE_1000, MPU_GYRO_SCALE_2000};
+    const float accelScales[] = {MPU_ACC_SCALE_2, MPU_ACC_SCALE_4, MPU_ACC_SCALE_8, MPU_ACC_SCALE_16};
+    MPU6050CaptureHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MPU_CAPTURE_MAGIC, sizeof(header.magic));
+    header.version = MPU_CAPTURE_VERSION;
+    header.samplesPerChunk = this->samplesPerChunk;
+    header.gyroScale = gyroScales[config.gyroConfig & 3];
+    header.accelScale = accelScales[config.accelConfig & 3];
+    header.sampleRateHz = config.sampleRateHz;
+    header.gyroConfig = config.gyroConfig & 3;
+    header.accelConfig = config.accelConfig & 3;
+    header.dlpfConfig = config.dlpfConfig & 7;
+    header.sampleRateDivider = config.sampleRateDivider;
+    if(!writeAll(&header, sizeof(header))){
+        close();
+        return false;
+    }
+    return true;
+}
+
+// Add a sample to the current chunk, writing the chunk once it is full
+bool MPU6050CaptureWriter::append(const MPU6050TimedSample &sample){
+    if(fileHandle < 0){
+        return false;
+    }
+
+    int32_t channels[CHANNEL_COUNT];
+    getChannels(sample.raw, channels);
+
+    if(chunk.sampleCount == 0){
+        // The first sample is stored whole
+        chunk.firstTimestampNs = sample.timestampNs;
+        payload.resize(FIRST_SAMPLE_BYTES);
+        for(int i = 0; i < CHANNEL_COUNT; i++){
+            int16_t value = int16_t(channels[i]);
+            memcpy(&payload[2*i], &value, 2);
+        }
+    }
+    else{
+        // Later samples are stored as the difference from the previous one
+        int32_t previousChannels[CHANNEL_COUNT];
+        getChannels(previous.raw, previousChannels);
+        size_t used = payload.size();
+        payload.resize(used + MAX_DELTA_SAMPLE_BYTES);
+        uint8_t *out = &payload[used];
+        out = putVarint(out, sample.timestampNs - previous.timestampNs);
+        for(int i = 0; i < CHANNEL_COUNT; i++){
+            out = putVarint(out, zigzag(channels[i] - previousChannels[i]));
+        }
+        payload.resize(out - &payload[0]);
+    }
+
+    previous = sample;
+    chunk.lastTimestampNs = sample.timestampNs;
+    chunk.sampleCount++;
+    sampleCount++;
+
+    if(chunk.sampleCount >= (uint32_t)samplesPerChunk){
+        return flush();
+    }
+    return true;
+}
+
+bool MPU6050CaptureWriter::appendBatch(const MPU6050TimedSample *samples, int count){
+    for(int i = 0; i < count; i++){
+        if(!append(samples[i])){
+            return false;
+        }
+    }
+    return true;
+}
+
+// Write the current chunk, even if it is not full
+bool MPU6050CaptureWriter::flush(){
+    if(fileHandle < 0){
+        return false;
+    }
+    if(chunk.sampleCount == 0){
+        return true;
+    }
+
+    chunk.magic = MPU_CAPTURE_CHUNK_MAGIC;
+    chunk.payloadBytes = payload.size();
+    MPU6050CaptureIndexEntry entry = {chunk.firstTimestampNs, offset, chunk.sampleCount, 0};
+    if(!writeAll(&chunk, sizeof(chunk)) || !writeAll(&payload[0], payload.size())){
+        return false;
+    }
+    index.push_back(entry);
+    memset(&chunk, 0, sizeof(chunk));
+    payload.clear();
+    return true;
+}
+
+// Write the last chunk, the index and the footer, then close the file
+bool MPU6050CaptureWriter::close(){
+    if(fileHandle < 0){
+        return true;
+    }
+
+    bool success = flush();
+    if(success){
+        MPU6050CaptureFooter footer = {offset, (uint32_t)index.size(), MPU_CAPTURE_FOOTER_MAGIC};
+        success = (index.empty() || writeAll(&index[0], index.size()*sizeof(MPU6050CaptureIndexEntry)))
+                  && writeAll(&footer, sizeof(footer));
+    }
+    ::close(fileHandle);
+    fileHandle = -1;
+    return success;
+}
+
+unsigned long MPU6050CaptureWriter::getSampleCount(){return sampleCount;}
+
+unsigned long MPU6050CaptureWriter::getBytesWritten(){return offset;}
+
+// Write the whole buffer, retrying short writes
+bool MPU6050CaptureWriter::writeAll(const void *data, size_t length){
+    const uint8_t *bytes = (const uint8_t*)data;
+    while(length > 0){
+        ssize_t written = write(fileHandle, bytes, length);
+        if(written < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            return false;
+        }
+        bytes += written;
+        length -= written;
+        offset += written;
+    }
+    return true;
+}
+// --------------------------------------------------------------------------------------------
+
+// ----------------------------------------- Reader -------------------------------------------
+MPU6050CaptureReader::MPU6050CaptureReader(){
+    data = NULL;
+    length = 0;
+    index = NULL;
+    chunkCount = 0;
+    sampleCount = 0;
+    currentChunk = 0;
+    position = chunkEnd = NULL;
+    remainingInChunk = 0;
+    firstInChunk = false;
+}
+
+MPU6050CaptureReader::~MPU6050CaptureReader(){
+    close();
+}
+
+// Map the file and load its index
+bool MPU6050CaptureReader::open(const char *path){
+    close();
+    int handle = ::open(path, O_RDONLY);
+    if(handle < 0){
+        return false;
+    }
+    struct stat info;
+    if(fstat(handle, &info) < 0 || (size_t)info.st_size < sizeof(MPU6050CaptureHeader)){
+        ::close(handle);
+        return false;
+    }
+    void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, handle, 0);
+    ::close(handle); // The mapping stays valid after the file is closed
+    if(mapping == MAP_FAILED){
+        return false;
+    }
+    data = (const uint8_t*)mapping;
+    length = info.st_size;
+    madvise(mapping, length, MADV_SEQUENTIAL);
+
+    const MPU6050CaptureHeader &header = getHeader();
+    if(memcmp(header.magic, MPU_CAPTURE_MAGIC, sizeof(header.magic)) != 0 || header.version != MPU_CAPTURE_VERSION || !buildIndex()){
+        close();
+        return false;
+    }
+    rewind();
+    return true;
+}
+
+void MPU6050CaptureReader::close(){
+    if(data != NULL){
+        munmap((void*)data, length);
+    }
+    data = NULL;
+    length = 0;
+    index = NULL;
+    entries.clear();
+    chunkCount = 0;
+    sampleCount = 0;
+    currentChunk = 0;
+    position = chunkEnd = NULL;
+    remainingInChunk = 0;
+}
+
+const MPU6050CaptureHeader& MPU6050CaptureReader::getHeader(){return *(const MPU6050CaptureHeader*)data;}
+
+unsigned long MPU6050CaptureReader::getSampleCount(){return sampleCount;}
+
+int MPU6050CaptureReader::getChunkCount(){return chunkCount;}
+
+uint64_t MPU6050CaptureReader::getFirstTimestampNs(){
+    return chunkCount > 0 ? index[0].firstTimestampNs : 0;
+}
+
+uint64_t MPU6050CaptureReader::getLastTimestampNs(){
+    MPU6050CaptureChunkHeader chunk;
+    if(chunkCount == 0 || !readChunkHeader(index[chunkCount - 1].offset, chunk)){
+        return 0;
+    }
+    return chunk.lastTimestampNs;
+}
+
+// Decode the next sample straight from the mapping
+bool MPU6050CaptureReader::next(MPU6050TimedSample &sample){
+    while(remainingInChunk == 0){
+        if(currentChunk + 1 >= chunkCount){
+            return false;
+        }
+        startChunk(currentChunk + 1);
+    }
+
+    int32_t channels[CHANNEL_COUNT];
+    if(firstInChunk){
+        for(int i = 0; i < CHANNEL_COUNT; i++){
+            int16_t value;
+            memcpy(&value, position + 2*i, 2);
+            channels[i] = value;
+        }
+        position += FIRST_SAMPLE_BYTES;
+        sample.timestampNs = index[currentChunk].firstTimestampNs;
+        firstInChunk = false;
+    }
+    else{
+        uint64_t value;
+        position = getVarint(position, chunkEnd, value);
+        if(position == NULL){
+            remainingInChunk = 0; // Corrupt chunk - skip the rest of it
+            return next(sample);
+        }
+        sample.timestampNs = previous.timestampNs + value;
+        getChannels(previous.raw, channels);
+        for(int i = 0; i < CHANNEL_COUNT && position != NULL; i++){
+            position = getVarint(position, chunkEnd, value);
+            channels[i] += unzigzag(uint32_t(value));
+        }
+        if(position == NULL){
+            remainingInChunk = 0;
+            return next(sample);
+        }
+    }
+    setChannels(sample.raw, channels);
+    previous = sample;
+    remainingInChunk--;
+    return true;
+}
+
+int MPU6050CaptureReader::nextBatch(MPU6050TimedSample *samples, int maxSamples){
+    int count = 0;
+    while(count < maxSamples && next(samples[count])){
+        count++;
+    }
+    return count;
+}
+
+// Binary search the index for the chunk, then decode forward through it
+bool MPU6050CaptureReader::seek(uint64_t timestampNs){
+    if(chunkCount == 0){
+        return false;
+    }
+
+    // Find the last chunk starting at or before the timestamp
+    MPU6050CaptureIndexEntry key;
+    key.firstTimestampNs = timestampNs;
+    const MPU6050CaptureIndexEntry *found = std::upper_bound(index, index + chunkCount, key,
+        [](const MPU6050CaptureIndexEntry &a, const MPU6050CaptureIndexEntry &b){return a.firstTimestampNs < b.firstTimestampNs;});
+    int chunkIndex = found == index ? 0 : int(found - index) - 1;
+    startChunk(chunkIndex);
+
+    // Decode until the sample at or after the timestamp, then step back onto it
+    while(true){
+        const uint8_t *savedPosition = position;
+        uint32_t savedRemaining = remainingInChunk;
+        bool savedFirst = firstInChunk;
+        int savedChunk = currentChunk;
+        MPU6050TimedSample savedPrevious = previous;
+
+        MPU6050TimedSample sample;
+        if(!next(sample)){
+            return false;
+        }
+        if(sample.timestampNs >= timestampNs){
+            if(savedChunk != currentChunk){
+                startChunk(currentChunk); // The sample was the first of the next chunk
+            }
+            else{
+                position = savedPosition;
+                remainingInChunk = savedRemaining;
+                firstInChunk = savedFirst;
+                previous = savedPrevious;
+            }
+            return true;
+        }
+    }
+}
+
+void MPU6050CaptureReader::rewind(){
+    if(chunkCount > 0){
+        startChunk(0);
+    }
+    else{
+        remainingInChunk = 0;
+    }
+}
+
+// Use the index written on close, or rebuild it by walking the chunk headers. Chunk payloads are variable length, so the
+// chunk headers, index and footer can be at any byte offset and are copied out rather than used in place.
+bool MPU6050CaptureReader::buildIndex(){
+    sampleCount = 0;
+    entries.clear();
+    if(length >= sizeof(MPU6050CaptureHeader) + sizeof(MPU6050CaptureFooter)){
+        MPU6050CaptureFooter footer;
+        memcpy(&footer, data + length - sizeof(MPU6050CaptureFooter), sizeof(footer));
+        if(footer.magic == MPU_CAPTURE_FOOTER_MAGIC && footer.indexOffset >= sizeof(MPU6050CaptureHeader) &&
+           footer.indexOffset <= length &&
+           footer.indexOffset + uint64_t(footer.chunkCount)*sizeof(MPU6050CaptureIndexEntry) + sizeof(MPU6050CaptureFooter) == length){
+            // Every entry must point at a whole chunk inside the file, or the index is ignored
+            bool valid = true;
+            entries.resize(footer.chunkCount);
+            for(uint32_t i = 0; i < footer.chunkCount && valid; i++){
+                MPU6050CaptureChunkHeader chunk;
+                memcpy(&entries[i], data + footer.indexOffset + i*sizeof(MPU6050CaptureIndexEntry), sizeof(MPU6050CaptureIndexEntry));
+                valid = entries[i].offset <= footer.indexOffset && readChunkHeader(entries[i].offset, chunk) &&
+                        chunk.sampleCount == entries[i].sampleCount;
+                sampleCount += entries[i].sampleCount;
+            }
+            if(valid){
+                index = entries.empty() ? NULL : &entries[0];
+                chunkCount = entries.size();
+                return true;
+            }
+            entries.clear();
+            sampleCount = 0;
+        }
+    }
+
+    // No footer - the writer did not close the file
+    uint64_t offset = sizeof(MPU6050CaptureHeader);
+    MPU6050CaptureChunkHeader chunk;
+    while(readChunkHeader(offset, chunk)){
+        MPU6050CaptureIndexEntry entry = {chunk.firstTimestampNs, offset, chunk.sampleCount, 0};
+        entries.push_back(entry);
+        sampleCount += chunk.sampleCount;
+        offset += sizeof(MPU6050CaptureChunkHeader) + chunk.payloadBytes;
+    }
+    index = entries.empty() ? NULL : &entries[0];
+    chunkCount = entries.size();
+    return true;
+}
+
+// Copy out the chunk header at offset. Returns false unless it is a chunk whose payload ends inside the file.
+bool MPU6050CaptureReader::readChunkHeader(uint64_t offset, MPU6050CaptureChunkHeader &chunk){
+    if(offset > length || length - offset < sizeof(MPU6050CaptureChunkHeader)){
+        return false;
+    }
+    memcpy(&chunk, data + offset, sizeof(chunk));
+    return chunk.magic == MPU_CAPTURE_CHUNK_MAGIC && chunk.sampleCount > 0 &&
+           chunk.payloadBytes <= length - offset - sizeof(MPU6050CaptureChunkHeader);
+}
+
+void MPU6050CaptureReader::startChunk(int chunkIndex){
+    MPU6050CaptureChunkHeader chunk;
+    readChunkHeader(index[chunkIndex].offset, chunk); // Checked when the index was built
+    currentChunk = chunkIndex;
+    position = data + index[chunkIndex].offset + sizeof(MPU6050CaptureChunkHeader);
+    chunkEnd = position + chunk.payloadBytes;
+    remainingInChunk = chunk.payloadBytes >= FIRST_SAMPLE_BYTES ? chunk.sampleCount : 0;
+    firstInChunk = true;
+}
+// --------------------------------------------------------------------------------------------
+
+// ------------------------------------- Replay Transport -------------------------------------
+MPU6050ReplayTransport::MPU6050ReplayTransport(MPU6050CaptureReader &reader) : MPU6050SimulatedTransport(){
+    this->reader = &reader;
+    finished = false;
+    lastTimestampNs = 0;
+}
+
+__s32 MPU6050ReplayTransport::readBlock(__u8 startRegister, __u8 *buffer, int length){
+    // Burst reads may start at INT_STATUS, and with channels in standby they cover only part of the output registers
+    if(startRegister < MPU_BURST_START + MPU_BURST_LENGTH && startRegister + length > MPU_BURST_START){
+        loadNext();
+    }
+    else if(startRegister == MPU_FIFO_COUNT1 && (peekRegister(MPU_USER_CTRL) & MPU_USER_CTRL_FIFO_EN) && peekRegister(MPU_FIFO_EN) != 0){
+        // Keep the FIFO half full so it never overflows
+        while(getFifoCount() < MPU_FIFO_SIZE/2 && loadNext());
+    }
+    return MPU6050SimulatedTransport::readBlock(startRegister, buffer, length);
+}
+
+void MPU6050ReplayTransport::rewind(){
+    reader->rewind();
+    finished = false;
+}
+
+bool MPU6050ReplayTransport::isFinished(){return finished;}
+
+uint64_t MPU6050ReplayTransport::getLastTimestampNs(){return lastTimestampNs;}
+
+// Put the next recorded sample on the simulated device. The last sample is held once the capture ends.
+bool MPU6050ReplayTransport::loadNext(){
+    MPU6050TimedSample sample;
+    if(finished || !reader->next(sample)){
+        finished = true;
+        return false;
+    }
+    const MPU6050RawSample &raw = sample.raw;
+    generateSample(raw.accelX, raw.accelY, raw.accelZ, raw.temperature, raw.gyroX, raw.gyroY, raw.gyroZ);
+    lastTimestampNs = sample.timestampNs;
+    return true;
+}
+// --------------------------------------------------------------------------------------------
+
+// ------------------------------------------ Helpers -----------------------------------------
+// Fill in the configuration from a sensor's current scales
+MPU6050CaptureConfig MPU6050Capture::configFromSensor(MPU6050 &sensor, int dlpfConfig, int sampleRateDivider, float sampleRateHz){
+    const float gyroScales[] = {MPU_GYRO_SCALE_250, MPU_GYRO_SCALE_500, MPU_GYRO_SCALE_1000, MPU_GYRO_SCALE_2000};
+    const float accelScales[] = {MPU_ACC_SCALE_2, MPU_ACC_SCALE_4, MPU_ACC_SCALE_8, MPU_ACC_SCALE_16};
+    MPU6050CaptureConfig config = {MPU_GYRO_SENS_500, MPU_ACC_SENS_2, dlpfConfig, sampleRateDivider, sampleRateHz};
+    for(int i = 0; i < 4; i++){
+        if(sensor.getGyroScale() == gyroScales[i]){
+            config.gyroConfig = i;
+        }
+        if(sensor.getAccelScale() == accelScales[i]){
+            config.accelConfig = i;
+        }
+    }
+    return config;
+}
+// --------------------------------------------------------------------------------------------
@@ -0,0 +1,198 @@
+/* ============================================================================================
+ * MPU6050 Capture File Header for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This header declares a compact binary format for recording raw timestamped samples, with a
+ * writer, a memory-mapped reader and a transport that replays a capture through the MPU6050
+ * class. All values are stored in host byte order (little-endian on the Pi and on x86).
+ *
+ * File layout:
+ *  - A 64 byte MPU6050CaptureHeader holding the sensor configuration.
+ *  - Chunks, each an MPU6050CaptureChunkHeader followed by its payload. The first sample of a
+ *    chunk is stored as 7 absolute int16 values, with its timestamp in the chunk header. Every
+ *    later sample is stored as the difference from the previous one: the timestamp difference
+ *    as an unsigned varint, then each channel difference as a zigzag varint. A steady sensor
+ *    therefore takes around 10 bytes per sample rather than 22.
+ *  - When the writer is closed, an index of every chunk and an MPU6050CaptureFooter. If the
+ *    footer is missing, for example after a crash, the reader rebuilds the index by walking
+ *    the chunk headers, so a capture is never lost.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include <stdint.h> // For fixed width types
+#include <vector>   // Used for the chunk buffer and rebuilt index
+
+#include "MPU6050.h"
+#include "MPU6050Transport.h"
+#include "MPU6050Acquisition.h"
+
+#ifndef MPU6050_CAPTURE_H
+#define MPU6050_CAPTURE_H
+
+// Format identifiers
+#define MPU_CAPTURE_MAGIC         "MPU6050C" // First 8 bytes of the file
+#define MPU_CAPTURE_VERSION       1
+#define MPU_CAPTURE_CHUNK_MAGIC   0x4B4E4843 // "CHNK"
+#define MPU_CAPTURE_FOOTER_MAGIC  0x58444E49 // "INDX"
+
+// Default number of samples per chunk - about a second at 1kHz
+#define MPU_CAPTURE_DEFAULT_CHUNK 1024
+
+// Sensor configuration stored at the start of the file
+struct MPU6050CaptureHeader{
+	char magic[8];
+	uint32_t version;
+	uint32_t samplesPerChunk;
+	float gyroScale;           // LSB per °/s
+	float accelScale;          // LSB per g
+	float sampleRateHz;        // Nominal sample rate
+	uint8_t gyroConfig;        // FS_SEL, as MPU_GYRO_SENS_*
+	uint8_t accelConfig;       // AFS_SEL, as MPU_ACC_SENS_*
+	uint8_t dlpfConfig;        // DLPF_CONFIG, as MPU_CONFIG_DLPF_*
+	uint8_t sampleRateDivider; // SMPLRT_DIV
+	uint8_t reserved[32];
+};
+
+// Header before the payload of each chunk
+struct MPU6050CaptureChunkHeader{
+	uint32_t magic;
+	uint32_t sampleCount;
+	uint32_t payloadBytes;
+	uint32_t reserved;
+	uint64_t firstTimestampNs;
+	uint64_t lastTimestampNs;
+};
+
+// Entry in the chunk index
+struct MPU6050CaptureIndexEntry{
+	uint64_t firstTimestampNs;
+	uint64_t offset;      // Offset of the chunk header from the start of the file
+	uint32_t sampleCount;
+	uint32_t reserved;
+};
+
+// Last 16 bytes of a cleanly closed file
+struct MPU6050CaptureFooter{
+	uint64_t indexOffset;
+	uint32_t chunkCount;
+	uint32_t magic;
+};
+
+// Sensor configuration for a capture. Use MPU6050Capture::configFromSensor() to fill in the scales.
+struct MPU6050CaptureConfig{
+	int gyroConfig;
+	int accelConfig;
+	int dlpfConfig;
+	int sampleRateDivider;
+	float sampleRateHz;
+};
+
+// Writes samples to a capture file, one chunk at a time
+class MPU6050CaptureWriter{
+public:
+	MPU6050CaptureWriter();
+	~MPU6050CaptureWriter(); // Closes the file
+
+	// Create the file. Returns false if it could not be created.
+	bool open(const char *path, const MPU6050CaptureConfig &config, int samplesPerChunk = MPU_CAPTURE_DEFAULT_CHUNK);
+	bool append(const MPU6050TimedSample &sample);                 // Returns false on a write error
+	bool appendBatch(const MPU6050TimedSample *samples, int count);
+	bool flush(); // Write the current partial chunk
+	bool close(); // Flush, then write the index and footer
+
+	unsigned long getSampleCount();
+	unsigned long getBytesWritten();
+
+private:
+	MPU6050CaptureWriter(const MPU6050CaptureWriter& W);            // The file cannot be shared
+	MPU6050CaptureWriter& operator=(const MPU6050CaptureWriter& W);
+
+	bool writeAll(const void *data, size_t length);
+
+	int fileHandle;
+	int samplesPerChunk;
+	std::vector<uint8_t> payload;               // Payload of the current chunk
+	std::vector<MPU6050CaptureIndexEntry> index;
+	MPU6050CaptureChunkHeader chunk;             // Header of the current chunk
+	MPU6050TimedSample previous;                 // Last sample, for delta encoding
+	uint64_t offset;                             // Bytes written so far
+	unsigned long sampleCount;
+};
+
+// Reads a capture file through a read-only memory mapping. Samples are decoded straight from the mapping.
+class MPU6050CaptureReader{
+public:
+	MPU6050CaptureReader();
+	~MPU6050CaptureReader(); // Unmaps the file
+
+	bool open(const char *path); // Returns false if the file could not be mapped or is not a capture
+	void close();
+
+	const MPU6050CaptureHeader& getHeader();
+	unsigned long getSampleCount();
+	int getChunkCount();
+	uint64_t getFirstTimestampNs();
+	uint64_t getLastTimestampNs();
+
+	bool next(MPU6050TimedSample &sample);       // Read the next sample. Returns false at the end of the capture.
+	int nextBatch(MPU6050TimedSample *samples, int maxSamples);
+	bool seek(uint64_t timestampNs);             // Move to the first sample at or after timestampNs, in O(log n) chunks
+	void rewind();
+
+private:
+	MPU6050CaptureReader(const MPU6050CaptureReader& R);            // The mapping cannot be shared
+	MPU6050CaptureReader& operator=(const MPU6050CaptureReader& R);
+
+	bool buildIndex();             // Use the footer index, or walk the chunks if there is none
+	bool readChunkHeader(uint64_t offset, MPU6050CaptureChunkHeader &chunk); // Copy and bounds check a chunk header
+	void startChunk(int chunkIndex);
+
+	const uint8_t *data;  // The mapped file
+	size_t length;
+	const MPU6050CaptureIndexEntry *index;        // The entries below
+	std::vector<MPU6050CaptureIndexEntry> entries; // Copied from the footer index, or rebuilt from the chunk headers
+	int chunkCount;
+	unsigned long sampleCount;
+
+	// Read position
+	int currentChunk;
+	const uint8_t *position;
+	const uint8_t *chunkEnd;
+	uint32_t remainingInChunk;
+	bool firstInChunk;
+	MPU6050TimedSample previous;
+};
+
+// Transport which replays a capture through the MPU6050 class, as fast as it is read. Each block read which
+// covers any of the output registers returns the next recorded sample with DATA_RDY set. This includes reads
+// which start at INT_STATUS and the shorter bursts used once channels are put in standby with setChannels().
+// The FIFO is refilled from the capture whenever its count is read. Construct the MPU6050 with the gyroConfig
+// and accelConfig from the capture header so the samples are scaled as they were recorded. The constructor
+// reads one sample, so call rewind() afterwards to replay from the start.
+class MPU6050ReplayTransport : public MPU6050SimulatedTransport{
+public:
+	MPU6050ReplayTransport(MPU6050CaptureReader &reader);
+
+	__s32 readBlock(__u8 startRegister, __u8 *buffer, int length);
+
+	void rewind();                  // Replay from the start of the capture again
+	bool isFinished();              // True once every sample has been replayed
+	uint64_t getLastTimestampNs();  // Timestamp of the last sample replayed
+
+private:
+	bool loadNext(); // Generate the next recorded sample on the simulated device
+
+	MPU6050CaptureReader *reader;
+	bool finished;
+	uint64_t lastTimestampNs;
+};
+
+// Helpers for captures
+class MPU6050Capture{
+public:
+	// Fill in the configuration from a sensor's current gyro and accelerometer settings
+	static MPU6050CaptureConfig configFromSensor(MPU6050 &sensor, int dlpfConfig, int sampleRateDivider, float sampleRateHz);
+};
+
+#endif
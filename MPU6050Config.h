@@ -0,0 +1,272 @@
+/* ============================================================================================
+ * MPU6050 Compile-Time Configuration Header for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This header describes the configuration registers as constexpr bit fields, and declares a
+ * configuration type whose settings are template parameters:
+ *
+ *     typedef MPU6050Config<MPU_PWR_MGMT_CLK_PLL_X_GYRO, MPU_GYRO_SENS_1000, MPU_ACC_SENS_4,
+ *                           MPU_CONFIG_DLPF_2, 4> FlightConfig; // 200Hz, every channel
+ *     MPU6050Fixed<FlightConfig> IMU(busTransport);
+ *     IMU.configure();
+ *     IMU.readSample(sample);
+ *
+ * Every setting is checked with static_assert, so an invalid configuration does not compile.
+ * The register values, the scales and their reciprocals, the sample rate and the range of the
+ * burst read are all constants. MPU6050Fixed then configures the device with two block writes
+ * and reads and converts only the channels the configuration enables, with no branches on the
+ * configuration. Channels which are left out are put in standby. MPU6050Fixed has no retries,
+ * bus recovery or metrics; use the MPU6050 class when those are needed, passing it the
+ * configuration's settings.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include <stdint.h> // For fixed width types
+
+#include "MPU6050.h"
+#include "MPU6050Transport.h" // Used to access the device registers
+#include "MPU6050Converter.h" // For MPU6050SampleArrays
+
+#ifndef MPU6050_CONFIG_H
+#define MPU6050_CONFIG_H
+
+// ---------------- Bit Fields -----------------
+// A field of width bits starting at bit shift of a register
+struct MPU6050Field{
+	__u8 address;
+	int shift;
+	int width;
+
+	constexpr __u8 mask() const {return __u8(((1 << width) - 1) << shift);}
+	constexpr bool fits(int value) const {return value >= 0 && value < (1 << width);}
+	constexpr __u8 encode(int value) const {return __u8(value << shift);}    // Position a value within the register
+	constexpr int decode(__u8 registerValue) const {return (registerValue & mask()) >> shift;}
+};
+
+constexpr MPU6050Field MPU_FIELD_SMPLRT_DIV{MPU_SMPLRT_DIV, 0, 8};
+constexpr MPU6050Field MPU_FIELD_DLPF_CFG{MPU_CONFIG, 0, 3};
+constexpr MPU6050Field MPU_FIELD_EXT_SYNC_SET{MPU_CONFIG, 3, 3};
+constexpr MPU6050Field MPU_FIELD_FS_SEL{MPU_GYRO_CONFIG, 3, 2};
+constexpr MPU6050Field MPU_FIELD_AFS_SEL{MPU_ACC_CONFIG, 3, 2};
+constexpr MPU6050Field MPU_FIELD_ACCEL_HPF{MPU_ACC_CONFIG, 0, 3};
+constexpr MPU6050Field MPU_FIELD_MOT_THR{MPU_MOT_THR, 0, 8};
+constexpr MPU6050Field MPU_FIELD_MOT_DUR{MPU_MOT_DUR, 0, 8};
+constexpr MPU6050Field MPU_FIELD_I2C_MST_CLK{MPU_I2C_MST_CTRL, 0, 4};
+constexpr MPU6050Field MPU_FIELD_I2C_SLV_ADDR{MPU_I2C_SLV0_ADDR, 0, 7}; // The same in every slave's registers
+constexpr MPU6050Field MPU_FIELD_I2C_SLV_LEN{MPU_I2C_SLV0_CTRL, 0, 4};
+constexpr MPU6050Field MPU_FIELD_CLKSEL{MPU_PWR_MGMT_1, 0, 3};
+constexpr MPU6050Field MPU_FIELD_TEMP_DIS{MPU_PWR_MGMT_1, 3, 1};
+constexpr MPU6050Field MPU_FIELD_CYCLE{MPU_PWR_MGMT_1, 5, 1};
+constexpr MPU6050Field MPU_FIELD_SLEEP{MPU_PWR_MGMT_1, 6, 1};
+constexpr MPU6050Field MPU_FIELD_LP_WAKE_CTRL{MPU_PWR_MGMT_2, 6, 2};
+constexpr MPU6050Field MPU_FIELD_STBY_ACCEL{MPU_PWR_MGMT_2, 3, 3}; // {STBY_XA, STBY_YA, STBY_ZA}
+constexpr MPU6050Field MPU_FIELD_STBY_GYRO{MPU_PWR_MGMT_2, 0, 3};  // {STBY_XG, STBY_YG, STBY_ZG}
+
+// Scales indexed by FS_SEL and AFS_SEL, in LSB per unit
+constexpr float MPU_GYRO_SCALES[] = {MPU_GYRO_SCALE_250, MPU_GYRO_SCALE_500, MPU_GYRO_SCALE_1000, MPU_GYRO_SCALE_2000};
+constexpr float MPU_ACC_SCALES[] = {MPU_ACC_SCALE_2, MPU_ACC_SCALE_4, MPU_ACC_SCALE_8, MPU_ACC_SCALE_16};
+// ---------------------------------------------
+
+// ------------- Channel Selection -------------
+// Channel masks are MPU_CONFIG_CHANNEL(MPU_CHANNEL_*) bits, as defined in MPU6050.h
+
+// Index of the lowest and highest channel in a mask
+constexpr int mpuFirstChannel(int channels){
+	int channel = 0;
+	while(channel < MPU_CHANNEL_COUNT - 1 && !((channels >> channel) & 1)){
+		channel++;
+	}
+	return channel;
+}
+
+constexpr int mpuLastChannel(int channels){
+	int channel = MPU_CHANNEL_COUNT - 1;
+	while(channel > 0 && !((channels >> channel) & 1)){
+		channel--;
+	}
+	return channel;
+}
+
+// PWR_MGMT_2 standby bits for the accelerometer and gyro axes not in a mask. Each field is ordered {X, Y, Z}.
+constexpr __u8 mpuStandbyBits(int channels){
+	int bits = 0;
+	for(int axis = 0; axis < 3; axis++){
+		if(!((channels >> (MPU_CHANNEL_ACCEL_X + axis)) & 1)){
+			bits |= MPU_FIELD_STBY_ACCEL.encode(4 >> axis);
+		}
+		if(!((channels >> (MPU_CHANNEL_GYRO_X + axis)) & 1)){
+			bits |= MPU_FIELD_STBY_GYRO.encode(4 >> axis);
+		}
+	}
+	return __u8(bits);
+}
+// ---------------------------------------------
+
+// -------------- Configuration Type -----------
+template<int ClockSource = MPU_PWR_MGMT_CLK_INTERNAL_8MHZ, int GyroSensitivity = MPU_GYRO_SENS_500,
+         int AccelSensitivity = MPU_ACC_SENS_2, int DlpfConfig = MPU_CONFIG_DLPF_0, int SampleRateDivider = 0,
+         int Channels = MPU_CONFIG_CHANNELS_ALL>
+struct MPU6050Config{
+	static_assert(MPU_FIELD_CLKSEL.fits(ClockSource) && ClockSource != 6, "The clock source must be one of MPU_PWR_MGMT_CLK_*");
+	static_assert(ClockSource != MPU_PWR_MGMT_CLK_STOP, "The device does not sample with its clock stopped");
+	static_assert(MPU_FIELD_FS_SEL.fits(GyroSensitivity), "The gyro sensitivity must be one of MPU_GYRO_SENS_*");
+	static_assert(MPU_FIELD_AFS_SEL.fits(AccelSensitivity), "The accelerometer sensitivity must be one of MPU_ACC_SENS_*");
+	static_assert(MPU_FIELD_DLPF_CFG.fits(DlpfConfig) && DlpfConfig != MPU_CONFIG_DLPF_7, "The DLPF setting must be MPU_CONFIG_DLPF_0 to MPU_CONFIG_DLPF_6");
+	static_assert(MPU_FIELD_SMPLRT_DIV.fits(SampleRateDivider), "The sample rate divider must be from 0 to 255");
+	static_assert(Channels > 0 && (Channels & ~MPU_CONFIG_CHANNELS_ALL) == 0, "The channels must be a non-empty mask of MPU_CONFIG_CHANNEL(MPU_CHANNEL_*)");
+	static_assert(ClockSource < MPU_PWR_MGMT_CLK_PLL_X_GYRO || ClockSource > MPU_PWR_MGMT_CLK_PLL_Z_GYRO ||
+	              (Channels & MPU_CONFIG_CHANNEL(MPU_CHANNEL_GYRO_X + ClockSource - MPU_PWR_MGMT_CLK_PLL_X_GYRO)),
+	              "The gyro PLL clock source needs that gyro axis, which would be in standby");
+
+	static constexpr int clockSource = ClockSource;
+	static constexpr int gyroSensitivity = GyroSensitivity;
+	static constexpr int accelSensitivity = AccelSensitivity;
+	static constexpr int dlpfConfig = DlpfConfig;
+	static constexpr int sampleRateDivider = SampleRateDivider;
+	static constexpr int channels = Channels;
+
+	// Output rate in Hz
+	static constexpr float sampleRateHz = float(DlpfConfig == MPU_CONFIG_DLPF_0 ? MPU_GYRO_OUTPUT_RATE_DLPF_OFF : MPU_GYRO_OUTPUT_RATE_DLPF_ON)/(1 + SampleRateDivider);
+	static_assert((Channels & MPU_CONFIG_CHANNELS_GYRO) || sampleRateHz <= MPU_GYRO_OUTPUT_RATE_DLPF_ON,
+	              "The accelerometer only produces 1kHz, so faster rates without the gyro repeat samples");
+
+	// Scales in LSB per unit, and their reciprocals for conversion
+	static constexpr float gyroScale = MPU_GYRO_SCALES[GyroSensitivity];
+	static constexpr float gyroReciprocal = 1.0f/gyroScale;
+	static constexpr float accelScale = MPU_ACC_SCALES[AccelSensitivity];
+	static constexpr float accelReciprocal = 1.0f/accelScale;
+	static constexpr float tempReciprocal = 1.0f/MPU_TEMP_SCALE;
+
+	static constexpr bool hasChannel(int channel){return (Channels >> channel) & 1;}
+
+	// PWR_MGMT_1 and PWR_MGMT_2, which are consecutive. Unused sensors are in standby and the device is awake.
+	static constexpr __u8 powerBlock[2] = {
+		__u8(MPU_FIELD_CLKSEL.encode(ClockSource) | MPU_FIELD_TEMP_DIS.encode(!hasChannel(MPU_CHANNEL_TEMP))),
+		mpuStandbyBits(Channels)
+	};
+
+	// SMPLRT_DIV, CONFIG, GYRO_CONFIG and ACCEL_CONFIG
+	static constexpr __u8 configBlock[MPU_CONFIG_BLOCK_LENGTH] = {
+		MPU_FIELD_SMPLRT_DIV.encode(SampleRateDivider),
+		MPU_FIELD_DLPF_CFG.encode(DlpfConfig),
+		MPU_FIELD_FS_SEL.encode(GyroSensitivity),
+		MPU_FIELD_AFS_SEL.encode(AccelSensitivity)
+	};
+
+	// The burst covers the output registers from the first channel used to the last. Each channel is 2 bytes.
+	static constexpr int firstChannel = mpuFirstChannel(Channels);
+	static constexpr int lastChannel = mpuLastChannel(Channels);
+	static constexpr __u8 burstStart = MPU_BURST_START + 2*firstChannel;
+	static constexpr int burstLength = 2*(lastChannel - firstChannel + 1);
+	static constexpr int burstOffset(int channel){return 2*(channel - firstChannel);} // Byte offset of a channel in the burst
+};
+// ---------------------------------------------
+
+// ------------ Specialised Interface ----------
+// Reads and converts samples for one fixed configuration. The transport must outlive the object.
+template<class Config>
+class MPU6050Fixed{
+public:
+	MPU6050Fixed(MPU6050Transport &busTransport) : transport(&busTransport){}
+
+	// Write the configuration in two block writes. Returns CLEAN_EXIT, I2C_SET_SLAVE_PWR_MODE or I2C_SET_CONFIG.
+	int configure(){
+		if(transport->writeBlock(MPU_PWR_MGMT_1, Config::powerBlock, 2) < 0){
+			return I2C_SET_SLAVE_PWR_MODE;
+		}
+		if(transport->writeBlock(MPU_SMPLRT_DIV, Config::configBlock, MPU_CONFIG_BLOCK_LENGTH) < 0){
+			return I2C_SET_CONFIG;
+		}
+		return CLEAN_EXIT;
+	}
+
+	// Burst read only the registers of the channels used. Other channels are 0. Returns false on a read error.
+	bool readRawSample(MPU6050RawSample &sample){
+		__u8 burst[Config::burstLength];
+		if(transport->readBlock(Config::burstStart, burst, Config::burstLength) != Config::burstLength){
+			return false;
+		}
+		sample.accelX = channel<MPU_CHANNEL_ACCEL_X>(burst);
+		sample.accelY = channel<MPU_CHANNEL_ACCEL_Y>(burst);
+		sample.accelZ = channel<MPU_CHANNEL_ACCEL_Z>(burst);
+		sample.temperature = channel<MPU_CHANNEL_TEMP>(burst);
+		sample.gyroX = channel<MPU_CHANNEL_GYRO_X>(burst);
+		sample.gyroY = channel<MPU_CHANNEL_GYRO_Y>(burst);
+		sample.gyroZ = channel<MPU_CHANNEL_GYRO_Z>(burst);
+		return true;
+	}
+
+	bool readSample(MPU6050Sample &sample){
+		MPU6050RawSample raw;
+		if(!readRawSample(raw)){
+			return false;
+		}
+		convertSample(raw, sample);
+		return true;
+	}
+
+	// Scale with the configuration's constants. Channels not used are 0.
+	static void convertSample(const MPU6050RawSample &raw, MPU6050Sample &sample){
+		sample.gyroX = scale<MPU_CHANNEL_GYRO_X>(raw.gyroX, Config::gyroReciprocal, 0);
+		sample.gyroY = scale<MPU_CHANNEL_GYRO_Y>(raw.gyroY, Config::gyroReciprocal, 0);
+		sample.gyroZ = scale<MPU_CHANNEL_GYRO_Z>(raw.gyroZ, Config::gyroReciprocal, 0);
+		sample.accelX = scale<MPU_CHANNEL_ACCEL_X>(raw.accelX, Config::accelReciprocal, 0);
+		sample.accelY = scale<MPU_CHANNEL_ACCEL_Y>(raw.accelY, Config::accelReciprocal, 0);
+		sample.accelZ = scale<MPU_CHANNEL_ACCEL_Z>(raw.accelZ, Config::accelReciprocal, 0);
+		sample.temperature = scale<MPU_CHANNEL_TEMP>(raw.temperature, Config::tempReciprocal, float(MPU_TEMP_OFFSET));
+	}
+
+	// Convert count samples into the output arrays, as MPU6050Converter does. Channels not used are skipped, as are NULL outputs.
+	static void convertBatch(const MPU6050RawSample *raw, int count, const MPU6050SampleArrays &out){
+		convertChannel<MPU_CHANNEL_ACCEL_X>(raw, count, out.accelX, &MPU6050RawSample::accelX, Config::accelReciprocal, 0);
+		convertChannel<MPU_CHANNEL_ACCEL_Y>(raw, count, out.accelY, &MPU6050RawSample::accelY, Config::accelReciprocal, 0);
+		convertChannel<MPU_CHANNEL_ACCEL_Z>(raw, count, out.accelZ, &MPU6050RawSample::accelZ, Config::accelReciprocal, 0);
+		convertChannel<MPU_CHANNEL_TEMP>(raw, count, out.temperature, &MPU6050RawSample::temperature, Config::tempReciprocal, float(MPU_TEMP_OFFSET));
+		convertChannel<MPU_CHANNEL_GYRO_X>(raw, count, out.gyroX, &MPU6050RawSample::gyroX, Config::gyroReciprocal, 0);
+		convertChannel<MPU_CHANNEL_GYRO_Y>(raw, count, out.gyroY, &MPU6050RawSample::gyroY, Config::gyroReciprocal, 0);
+		convertChannel<MPU_CHANNEL_GYRO_Z>(raw, count, out.gyroZ, &MPU6050RawSample::gyroZ, Config::gyroReciprocal, 0);
+	}
+
+private:
+	MPU6050Fixed(const MPU6050Fixed& F);            // Holds a pointer to a transport it doesn't own
+	MPU6050Fixed& operator=(const MPU6050Fixed& F);
+
+	// Combine a channel's bytes from the burst, or give 0 if it is not read
+	template<int Channel>
+	static int16_t channel(const __u8 *burst){
+		if constexpr(Config::hasChannel(Channel)){
+			return int16_t((burst[Config::burstOffset(Channel)] << 8) | burst[Config::burstOffset(Channel) + 1]);
+		}
+		else{
+			return 0;
+		}
+	}
+
+	template<int Channel>
+	static float scale(int16_t value, float reciprocal, float offset){
+		if constexpr(Config::hasChannel(Channel)){
+			return float(value)*reciprocal + offset;
+		}
+		else{
+			return 0;
+		}
+	}
+
+	template<int Channel>
+	static void convertChannel(const MPU6050RawSample *raw, int count, float *out, int16_t MPU6050RawSample::*field, float reciprocal, float offset){
+		if constexpr(Config::hasChannel(Channel)){
+			if(out == NULL){
+				return;
+			}
+			for(int i = 0; i < count; i++){
+				out[i] = scale<Channel>(raw[i].*field, reciprocal, offset);
+			}
+		}
+	}
+
+	MPU6050Transport *transport;
+};
+// ---------------------------------------------
+
+#endif
@@ -0,0 +1,188 @@
+/* ============================================================================================
+ * MPU6050 Batch Conversion Code for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This source code defines the batch converter. See MPU6050Converter.h for more information.
+ * The raw samples are interleaved with a stride of 7 channels. Each block of MPU_CONVERT_BLOCK
+ * samples is loaded as 8 rows of 8 values, one row per sample running one value into the
+ * next sample, and transposed with vector shuffles so that each channel's values end up in
+ * one register. Each channel is then widened, converted to float, scaled and offset with
+ * vector instructions. Without a vector instruction set each channel is converted in its own
+ * scalar loop.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include "MPU6050Converter.h" // Include definitions and declarations within the header file
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MPU_CONVERT_NEON
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define MPU_CONVERT_AVX2
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define MPU_CONVERT_SSE2
+#endif
+
+// Number of channels in a raw sample
+#define CHANNEL_COUNT 7
+
+// The samples are read as an array of values, so the structure must have no padding
+static_assert(sizeof(MPU6050RawSample) == CHANNEL_COUNT*sizeof(int16_t), "MPU6050RawSample must be 7 packed values");
+
+#if defined(MPU_CONVERT_NEON)
+typedef int16x8_t ChannelLanes;
+#elif defined(MPU_CONVERT_AVX2) || defined(MPU_CONVERT_SSE2)
+typedef __m128i ChannelLanes;
+#endif
+
+#if defined(MPU_CONVERT_NEON) || defined(MPU_CONVERT_AVX2) || defined(MPU_CONVERT_SSE2)
+// Split MPU_CONVERT_BLOCK samples into one register per channel, in the order of the fields of MPU6050RawSample. Each
+// row is loaded from the start of a sample, so it ends with the first value of the next one, which is never used. The
+// last row would read past the block, so it is loaded one value early and shifted down instead.
+static inline void splitChannels(const MPU6050RawSample *block, ChannelLanes *channels){
+    const int16_t *values = &block[0].accelX;
+#if defined(MPU_CONVERT_NEON)
+    int16x8_t rows[MPU_CONVERT_BLOCK];
+    for(int row = 0; row < MPU_CONVERT_BLOCK - 1; row++){
+        rows[row] = vld1q_s16(values + row*CHANNEL_COUNT);
+    }
+    int16x8_t last = vld1q_s16(values + (MPU_CONVERT_BLOCK - 1)*CHANNEL_COUNT - 1);
+    rows[MPU_CONVERT_BLOCK - 1] = vextq_s16(last, last, 1);
+
+    // Interleave pairs of rows, then pairs of pairs, leaving the channels for rows 0-3 and 4-7 in 64 bit halves
+    int16x8x2_t rows01 = vtrnq_s16(rows[0], rows[1]);
+    int16x8x2_t rows23 = vtrnq_s16(rows[2], rows[3]);
+    int16x8x2_t rows45 = vtrnq_s16(rows[4], rows[5]);
+    int16x8x2_t rows67 = vtrnq_s16(rows[6], rows[7]);
+    int32x4x2_t even03 = vtrnq_s32(vreinterpretq_s32_s16(rows01.val[0]), vreinterpretq_s32_s16(rows23.val[0])); // Channels 0 and 4, 2 and 6
+    int32x4x2_t odd03 = vtrnq_s32(vreinterpretq_s32_s16(rows01.val[1]), vreinterpretq_s32_s16(rows23.val[1]));  // Channels 1 and 5, 3 and 7
+    int32x4x2_t even47 = vtrnq_s32(vreinterpretq_s32_s16(rows45.val[0]), vreinterpretq_s32_s16(rows67.val[0]));
+    int32x4x2_t odd47 = vtrnq_s32(vreinterpretq_s32_s16(rows45.val[1]), vreinterpretq_s32_s16(rows67.val[1]));
+    channels[0] = vcombine_s16(vget_low_s16(vreinterpretq_s16_s32(even03.val[0])), vget_low_s16(vreinterpretq_s16_s32(even47.val[0])));
+    channels[1] = vcombine_s16(vget_low_s16(vreinterpretq_s16_s32(odd03.val[0])), vget_low_s16(vreinterpretq_s16_s32(odd47.val[0])));
+    channels[2] = vcombine_s16(vget_low_s16(vreinterpretq_s16_s32(even03.val[1])), vget_low_s16(vreinterpretq_s16_s32(even47.val[1])));
+    channels[3] = vcombine_s16(vget_low_s16(vreinterpretq_s16_s32(odd03.val[1])), vget_low_s16(vreinterpretq_s16_s32(odd47.val[1])));
+    channels[4] = vcombine_s16(vget_high_s16(vreinterpretq_s16_s32(even03.val[0])), vget_high_s16(vreinterpretq_s16_s32(even47.val[0])));
+    channels[5] = vcombine_s16(vget_high_s16(vreinterpretq_s16_s32(odd03.val[0])), vget_high_s16(vreinterpretq_s16_s32(odd47.val[0])));
+    channels[6] = vcombine_s16(vget_high_s16(vreinterpretq_s16_s32(even03.val[1])), vget_high_s16(vreinterpretq_s16_s32(even47.val[1])));
+#else
+    __m128i rows[MPU_CONVERT_BLOCK];
+    for(int row = 0; row < MPU_CONVERT_BLOCK - 1; row++){
+        rows[row] = _mm_loadu_si128((const __m128i*)(values + row*CHANNEL_COUNT));
+    }
+    rows[MPU_CONVERT_BLOCK - 1] = _mm_srli_si128(_mm_loadu_si128((const __m128i*)(values + (MPU_CONVERT_BLOCK - 1)*CHANNEL_COUNT - 1)), 2);
+
+    // Interleave the 16 bit values of pairs of rows, then the 32 bit pairs, then the 64 bit halves
+    __m128i pairs[MPU_CONVERT_BLOCK];
+    for(int row = 0; row < MPU_CONVERT_BLOCK; row += 2){
+        pairs[row] = _mm_unpacklo_epi16(rows[row], rows[row + 1]);     // Channels 0-3 of both rows
+        pairs[row + 1] = _mm_unpackhi_epi16(rows[row], rows[row + 1]); // Channels 4-7
+    }
+    __m128i quads[MPU_CONVERT_BLOCK];
+    for(int half = 0; half < 2; half++){
+        __m128i *low = &pairs[4*half];   // Rows 0-1 then 2-3, or 4-5 then 6-7
+        __m128i *out = &quads[4*half];
+        out[0] = _mm_unpacklo_epi32(low[0], low[2]); // Channels 0 and 1 of four rows
+        out[1] = _mm_unpackhi_epi32(low[0], low[2]); // Channels 2 and 3
+        out[2] = _mm_unpacklo_epi32(low[1], low[3]); // Channels 4 and 5
+        out[3] = _mm_unpackhi_epi32(low[1], low[3]); // Channels 6 and 7
+    }
+    for(int channel = 0; channel < CHANNEL_COUNT; channel++){
+        __m128i rows03 = quads[channel/2];
+        __m128i rows47 = quads[4 + channel/2];
+        channels[channel] = channel % 2 == 0 ? _mm_unpacklo_epi64(rows03, rows47) : _mm_unpackhi_epi64(rows03, rows47);
+    }
+#endif
+}
+
+// Convert MPU_CONVERT_BLOCK values of one channel: out = in*scale + offset
+static inline void convertLanes(ChannelLanes values, float scale, float offset, float *out){
+#if defined(MPU_CONVERT_NEON)
+    float32x4_t scales = vdupq_n_f32(scale);
+    float32x4_t offsets = vdupq_n_f32(offset);
+    float32x4_t low = vcvtq_f32_s32(vmovl_s16(vget_low_s16(values)));
+    float32x4_t high = vcvtq_f32_s32(vmovl_s16(vget_high_s16(values)));
+    vst1q_f32(out, vmlaq_f32(offsets, low, scales));
+    vst1q_f32(out + 4, vmlaq_f32(offsets, high, scales));
+#elif defined(MPU_CONVERT_AVX2)
+    __m256 wide = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(values));
+    _mm256_storeu_ps(out, _mm256_add_ps(_mm256_mul_ps(wide, _mm256_set1_ps(scale)), _mm256_set1_ps(offset)));
+#else
+    // Sign extend to 32 bits by unpacking each value into the top half of a lane and shifting it back down
+    __m128 low = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(values, values), 16));
+    __m128 high = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(values, values), 16));
+    __m128 scales = _mm_set1_ps(scale);
+    __m128 offsets = _mm_set1_ps(offset);
+    _mm_storeu_ps(out, _mm_add_ps(_mm_mul_ps(low, scales), offsets));
+    _mm_storeu_ps(out + 4, _mm_add_ps(_mm_mul_ps(high, scales), offsets));
+#endif
+}
+#endif
+
+// ----------------------------- Special class member definitions -----------------------------
+MPU6050Converter::MPU6050Converter(float gyroScale, float accelScale){
+    gyroReciprocal = 1.0f/gyroScale;
+    accelReciprocal = 1.0f/accelScale;
+}
+
+MPU6050Converter::MPU6050Converter(MPU6050 &sensor){
+    gyroReciprocal = 1.0f/sensor.getGyroScale();
+    accelReciprocal = 1.0f/sensor.getAccelScale();
+}
+// --------------------------------------------------------------------------------------------
+
+// ----------------------------------- Conversion Functions -----------------------------------
+// Convert count raw samples into the output arrays
+void MPU6050Converter::convert(const MPU6050RawSample *raw, int count, const MPU6050SampleArrays &out){
+    // Channels in the order of the fields of MPU6050RawSample, with their output, scale and offset
+    float *outputs[CHANNEL_COUNT] = {out.accelX, out.accelY, out.accelZ, out.temperature, out.gyroX, out.gyroY, out.gyroZ};
+    const float scales[CHANNEL_COUNT] = {accelReciprocal, accelReciprocal, accelReciprocal, 1.0f/MPU_TEMP_SCALE,
+                                         gyroReciprocal, gyroReciprocal, gyroReciprocal};
+    const float offsets[CHANNEL_COUNT] = {0, 0, 0, float(MPU_TEMP_OFFSET), 0, 0, 0};
+
+    int i = 0;
+#if defined(MPU_CONVERT_NEON) || defined(MPU_CONVERT_AVX2) || defined(MPU_CONVERT_SSE2)
+    for(; i + MPU_CONVERT_BLOCK <= count; i += MPU_CONVERT_BLOCK){
+        ChannelLanes channels[CHANNEL_COUNT];
+        splitChannels(&raw[i], channels);
+        for(int channel = 0; channel < CHANNEL_COUNT; channel++){
+            if(outputs[channel] != NULL){
+                convertLanes(channels[channel], scales[channel], offsets[channel], &outputs[channel][i]);
+            }
+        }
+    }
+#endif
+
+    // Convert the samples left over after the last whole block, or every sample without vector instructions. Each
+    // channel has its own loop so the compiler can vectorise it if it is able to.
+    if(i >= count){
+        return;
+    }
+    for(int channel = 0; channel < CHANNEL_COUNT; channel++){
+        float *output = outputs[channel];
+        if(output == NULL){
+            continue;
+        }
+        const int16_t *values = &raw[0].accelX + channel;
+        for(int j = i; j < count; j++){
+            output[j] = float(values[j*CHANNEL_COUNT])*scales[channel] + offsets[channel];
+        }
+    }
+}
+
+// Name of the instruction set used
+const char* MPU6050Converter::getImplementation(){
+#if defined(MPU_CONVERT_NEON)
+    return "NEON";
+#elif defined(MPU_CONVERT_AVX2)
+    return "AVX2";
+#elif defined(MPU_CONVERT_SSE2)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
+// --------------------------------------------------------------------------------------------
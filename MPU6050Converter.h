@@ -0,0 +1,50 @@
+/* ============================================================================================
+ * MPU6050 Batch Conversion Header for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This header declares a converter which scales a block of raw samples into physical units.
+ * The output is a structure of arrays - one float array per channel - which is the layout most
+ * processing code wants. The reciprocal of each scale is computed once, so there is no division
+ * per sample, and the channels are converted with NEON on ARM or SSE2/AVX on x86 when the
+ * compiler targets them (for example with -mfpu=neon, -msse2 or -mavx2). Otherwise a scalar
+ * loop is used. Gyro values are in °/s, accelerometer values in g and temperatures in °C.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include "MPU6050.h"
+
+#ifndef MPU6050_CONVERTER_H
+#define MPU6050_CONVERTER_H
+
+// Number of samples converted together by the vector code
+#define MPU_CONVERT_BLOCK 8
+
+// Output channels for a block of samples. Each pointer must have room for the number of samples converted.
+// Set a pointer to NULL to skip that channel.
+struct MPU6050SampleArrays{
+	float *gyroX;
+	float *gyroY;
+	float *gyroZ;
+	float *accelX;
+	float *accelY;
+	float *accelZ;
+	float *temperature;
+};
+
+class MPU6050Converter{
+public:
+	MPU6050Converter(float gyroScale, float accelScale); // Scales in LSB per unit, as MPU_GYRO_SCALE_* and MPU_ACC_SCALE_*
+	MPU6050Converter(MPU6050 &sensor);                   // Use the current scales of a sensor
+
+	// Convert count raw samples into the output arrays
+	void convert(const MPU6050RawSample *raw, int count, const MPU6050SampleArrays &out);
+
+	const char* getImplementation(); // Name of the instruction set used, for benchmarks
+
+private:
+	float gyroReciprocal;
+	float accelReciprocal;
+};
+
+#endif
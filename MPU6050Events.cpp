@@ -0,0 +1,137 @@
+/* ============================================================================================
+ * MPU6050 Data Ready Events Code for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This source code defines the event sources and poller used to wait for the MPU6050's data
+ * ready interrupt. See MPU6050Events.h for more information.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include "MPU6050Events.h" // Include definitions and declarations within the header file
+#include <iostream>        // Used for error output
+#include <stdio.h>         // For snprintf()
+#include <string.h>        // For strncpy()
+
+// Used for the GPIO and epoll interfaces
+#include <linux/gpio.h>  // For the GPIO character device ioctls
+#include <sys/epoll.h>   // For epoll
+#include <sys/ioctl.h>   // For ioctl()
+#include <fcntl.h>       // For O_RDONLY
+#include <unistd.h>      // For open(), read() and close()
+
+// ---------------------------------- GPIO Event Source ---------------------------------------
+// Request rising edge events on a GPIO line connected to the INT pin
+MPU6050GpioEventSource::MPU6050GpioEventSource(int chipNumber, int lineNumber){
+    char chipName[32];
+    struct gpioevent_request request;
+
+    // Open the GPIO character device
+    snprintf(chipName, sizeof(chipName), "/dev/gpiochip%d", chipNumber);
+    int chipHandle = open(chipName, O_RDONLY);
+    if (chipHandle < 0) {
+        std::cout << std::endl << "Couldn't open the GPIO chip. Please ensure the correct chip number is selected." << std::endl;
+        exit(GPIO_OPEN_ERROR);
+    }
+
+    // Request the line as an input with rising edge events - the INT pin is configured active high
+    memset(&request, 0, sizeof(request));
+    request.lineoffset = lineNumber;
+    request.handleflags = GPIOHANDLE_REQUEST_INPUT;
+    request.eventflags = GPIOEVENT_REQUEST_RISING_EDGE;
+    strncpy(request.consumer_label, "MPU6050", sizeof(request.consumer_label) - 1);
+    if (ioctl(chipHandle, GPIO_GET_LINEEVENT_IOCTL, &request) < 0) {
+        close(chipHandle);
+        std::cout << std::endl << "The GPIO line couldn't be requested. Check the line number and that nothing else is using it." << std::endl;
+        exit(GPIO_REQUEST_ERROR);
+    }
+
+    // The line handle stays valid once the chip is closed
+    close(chipHandle);
+    lineHandle = request.fd;
+}
+
+// Destructor - release the GPIO line
+MPU6050GpioEventSource::~MPU6050GpioEventSource(){
+    close(lineHandle);
+}
+
+int MPU6050GpioEventSource::getFd(){return lineHandle;}
+
+// Read one edge event from the line
+bool MPU6050GpioEventSource::acknowledge(){
+    struct gpioevent_data event;
+    return read(lineHandle, &event, sizeof(event)) == sizeof(event);
+}
+// --------------------------------------------------------------------------------------------
+
+// ----------------------------------- FD Event Source ----------------------------------------
+MPU6050FdEventSource::MPU6050FdEventSource(int fd){
+    eventHandle = fd;
+}
+
+int MPU6050FdEventSource::getFd(){return eventHandle;}
+
+// Read the pending event. An eventfd returns its 8 byte counter, a pipe returns whatever was written.
+bool MPU6050FdEventSource::acknowledge(){
+    char buffer[64];
+    return read(eventHandle, buffer, sizeof(buffer)) > 0;
+}
+// --------------------------------------------------------------------------------------------
+
+// --------------------------------------- Poller ---------------------------------------------
+MPU6050Poller::MPU6050Poller(){
+    epollHandle = epoll_create1(EPOLL_CLOEXEC);
+    if (epollHandle < 0) {
+        std::cout << std::endl << "Couldn't create the epoll instance." << std::endl;
+        exit(EPOLL_SETUP_ERROR);
+    }
+}
+
+// Destructor - close the epoll handle. The sensors and event sources belong to the caller.
+MPU6050Poller::~MPU6050Poller(){
+    close(epollHandle);
+}
+
+// Register a sensor with the source of its data ready events
+void MPU6050Poller::add(MPU6050 &sensor, MPU6050EventSource &source){
+    Registration registration;
+    registration.sensor = &sensor;
+    registration.source = &source;
+    registrations.push_back(registration);
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = &registrations.back();
+    if (epoll_ctl(epollHandle, EPOLL_CTL_ADD, source.getFd(), &event) < 0) {
+        std::cout << std::endl << "Couldn't add the event source to the epoll instance." << std::endl;
+        exit(EPOLL_SETUP_ERROR);
+    }
+}
+
+// Wait for data to be ready on any registered sensor and read it
+int MPU6050Poller::wait(MPU6050 **readySensors, int maxSensors, int timeoutMs){
+    struct epoll_event events[MPU_POLLER_MAX_EVENTS];
+
+    if (maxSensors > MPU_POLLER_MAX_EVENTS) {
+        maxSensors = MPU_POLLER_MAX_EVENTS;
+    }
+
+    int eventCount = epoll_wait(epollHandle, events, maxSensors, timeoutMs);
+    if (eventCount < 0) {
+        return -1;
+    }
+
+    // Read each sensor straight after its conversion
+    int readyCount = 0;
+    for (int i = 0; i < eventCount; i++) {
+        Registration *registration = (Registration*)events[i].data.ptr;
+        if (!registration->source->acknowledge()) {
+            continue;
+        }
+        registration->sensor->updateData();
+        readySensors[readyCount++] = registration->sensor;
+    }
+    return readyCount;
+}
+// --------------------------------------------------------------------------------------------
@@ -0,0 +1,89 @@
+/* ============================================================================================
+ * MPU6050 Data Ready Events Header for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This header declares the classes used to wait for the MPU6050's data ready interrupt rather
+ * than polling updateData(). An event source provides a file descriptor which becomes readable
+ * each time a new sample is ready. On a Pi this is a GPIO line connected to the INT pin of the
+ * MPU6050, requested through the GPIO character device (/dev/gpiochipN). Any other readable
+ * file descriptor, such as an eventfd or a pipe, can stand in for the GPIO line so the code can
+ * be run on a Linux machine without the hardware. The poller waits on many sensors at once
+ * using epoll. GPIO documentation was found at
+ * https://www.kernel.org/doc/html/latest/userspace-api/gpio/chardev.html.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include <list> // Used to store the poller's registrations
+
+#include "MPU6050.h"
+
+#ifndef MPU6050_EVENTS_H
+#define MPU6050_EVENTS_H
+
+// Maximum number of events handled per call to MPU6050Poller::wait()
+#define MPU_POLLER_MAX_EVENTS 16
+
+// Interface for anything that can signal that a new sample is ready
+class MPU6050EventSource{
+public:
+	virtual ~MPU6050EventSource(){}
+	virtual int getFd() = 0;        // File descriptor which becomes readable when a sample is ready
+	virtual bool acknowledge() = 0; // Consume the pending event. Returns false on a read error.
+};
+
+// Event source for the MPU6050 INT pin connected to a GPIO line
+class MPU6050GpioEventSource : public MPU6050EventSource{
+public:
+	MPU6050GpioEventSource(int chipNumber, int lineNumber); // Request rising edge events from /dev/gpiochip<chipNumber>
+	~MPU6050GpioEventSource();
+	int getFd();
+	bool acknowledge();
+
+private:
+	MPU6050GpioEventSource(const MPU6050GpioEventSource& S);            // The line handle cannot be shared
+	MPU6050GpioEventSource& operator=(const MPU6050GpioEventSource& S);
+
+	int lineHandle; // File descriptor for the line events
+};
+
+// Event source wrapping an existing file descriptor, for example an eventfd or the read end of a pipe.
+// The file descriptor is not closed by this class.
+class MPU6050FdEventSource : public MPU6050EventSource{
+public:
+	MPU6050FdEventSource(int fd);
+	int getFd();
+	bool acknowledge();
+
+private:
+	int eventHandle;
+};
+
+// Waits on the event sources of many sensors from a single thread
+class MPU6050Poller{
+public:
+	MPU6050Poller();
+	~MPU6050Poller();
+
+	// Register a sensor with the source of its data ready events. Both must outlive the poller.
+	void add(MPU6050 &sensor, MPU6050EventSource &source);
+
+	// Wait up to timeoutMs (-1 waits forever) for data to be ready. Each ready sensor is updated with
+	// updateData() and stored in readySensors. Returns the number of ready sensors, or -1 on error.
+	int wait(MPU6050 **readySensors, int maxSensors, int timeoutMs);
+
+private:
+	MPU6050Poller(const MPU6050Poller& P);            // The epoll handle cannot be shared
+	MPU6050Poller& operator=(const MPU6050Poller& P);
+
+	// A sensor and its event source, pointed to by the epoll event data
+	struct Registration{
+		MPU6050 *sensor;
+		MPU6050EventSource *source;
+	};
+
+	int epollHandle;
+	std::list<Registration> registrations; // A list so the addresses given to epoll stay valid
+};
+
+#endif
@@ -0,0 +1,241 @@
+/* ============================================================================================
+ * MPU6050 Export Code for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This source code defines the CSV and JSON lines exporter. See MPU6050Export.h for more
+ * information.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include "MPU6050Export.h" // Include definitions and declarations within the header file
+#include <charconv>        // For std::to_chars()
+#include <iostream>        // Used for error output
+#include <errno.h>         // For EINTR
+#include <math.h>          // For isfinite() and signbit()
+#include <string.h>        // For memcpy()
+#include <unistd.h>        // For write()
+
+// Column names, indexed by MPU_CHANNEL_*
+static const char *columnNames[MPU_CHANNEL_COUNT] = {"accel_x", "accel_y", "accel_z", "temp", "gyro_x", "gyro_y", "gyro_z"};
+
+// Copy a string literal, returning the end
+template<size_t N>
+static char* append(char *out, const char (&text)[N]){
+    memcpy(out, text, N - 1);
+    return out + N - 1;
+}
+
+// Powers of 10 up to MPU_EXPORT_MAX_PRECISION
+static const uint64_t powersOf10[MPU_EXPORT_MAX_PRECISION + 1] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+// Format a value with a fixed number of decimal places. Every value from the sensor is scaled to an integer number of
+// the last decimal place and formatted as an integer, which gives the same text as the floating point std::to_chars()
+// several times faster. Values too large for that, and non-finite values, are left to std::to_chars().
+static char* formatFixed(char *out, char *end, float value, int precision){
+    double scaled = double(value)*double(powersOf10[precision]);
+    if(!(fabs(scaled) < 1e18)){
+        return std::to_chars(out, end, value, std::chars_format::fixed, precision).ptr;
+    }
+    if(signbit(scaled)){
+        scaled = -scaled;
+        *out++ = '-';
+    }
+    // A float times a power of 10 up to 10^9 is exact in a double, so ties are exact and round to even as in to_chars()
+    uint64_t units = uint64_t(scaled);
+    double remainder = scaled - double(units);
+    if(remainder > 0.5 || (remainder == 0.5 && (units & 1))){
+        units++;
+    }
+    out = std::to_chars(out, end, units/powersOf10[precision]).ptr;
+    if(precision > 0){
+        uint64_t fraction = units % powersOf10[precision];
+        *out = '.';
+        for(int digit = precision; digit > 0; digit--){
+            out[digit] = char('0' + fraction%10);
+            fraction /= 10;
+        }
+        out += precision + 1;
+    }
+    return out;
+}
+
+// ---------------------------------------- Exporter ------------------------------------------
+MPU6050Exporter::MPU6050Exporter(int fd, float gyroScale, float accelScale, int format, int columns, int precision, int bufferSize){
+    setup(fd, gyroScale, accelScale, format, columns, precision, bufferSize);
+}
+
+MPU6050Exporter::MPU6050Exporter(int fd, MPU6050 &sensor, int format, int columns, int precision, int bufferSize){
+    setup(fd, sensor.getGyroScale(), sensor.getAccelScale(), format, columns, precision, bufferSize);
+}
+
+MPU6050Exporter::~MPU6050Exporter(){
+    flush();
+}
+
+void MPU6050Exporter::setup(int fd, float gyroScale, float accelScale, int format, int columns, int precision, int bufferSize){
+    // Data Validation
+    if(fd < 0 || !(gyroScale > 0) || !(accelScale > 0) || (format != MPU_EXPORT_CSV && format != MPU_EXPORT_JSON) ||
+       columns <= 0 || (columns & ~MPU_EXPORT_COLUMNS_ALL) || precision < 0 || precision > MPU_EXPORT_MAX_PRECISION ||
+       bufferSize < MPU_EXPORT_MAX_LINE){
+        std::cout << std::endl << "MPU6050Exporter received an invalid parameter" << std::endl;
+        exit(MPU_INIT_PARAM_ERROR);
+    }
+
+    this->fd = fd;
+    this->format = format;
+    this->columns = columns;
+    this->precision = precision;
+    gyroReciprocal = 1.0f/gyroScale;
+    accelReciprocal = 1.0f/accelScale;
+    buffer.resize(bufferSize);
+}
+
+void MPU6050Exporter::writeHeader(){
+    if(format != MPU_EXPORT_CSV || !reserveLine()){
+        return;
+    }
+    char *out = buffer.data() + used;
+    bool first = true;
+    if(columns & MPU_EXPORT_COLUMN_TIME){
+        out = append(out, "time_ns");
+        first = false;
+    }
+    for(int channel = 0; channel < MPU_CHANNEL_COUNT; channel++){
+        if(columns & MPU_CONFIG_CHANNEL(channel)){
+            if(!first){
+                *out++ = ',';
+            }
+            size_t length = strlen(columnNames[channel]);
+            memcpy(out, columnNames[channel], length);
+            out += length;
+            first = false;
+        }
+    }
+    *out++ = '\n';
+    used = out - buffer.data();
+}
+
+bool MPU6050Exporter::write(const MPU6050TimedSample *samples, int count){
+    float values[MPU_CHANNEL_COUNT];
+    for(int i = 0; i < count && reserveLine(); i++){
+        const MPU6050RawSample &raw = samples[i].raw;
+        values[MPU_CHANNEL_ACCEL_X] = float(raw.accelX)*accelReciprocal;
+        values[MPU_CHANNEL_ACCEL_Y] = float(raw.accelY)*accelReciprocal;
+        values[MPU_CHANNEL_ACCEL_Z] = float(raw.accelZ)*accelReciprocal;
+        values[MPU_CHANNEL_TEMP] = float(raw.temperature)*(1.0f/MPU_TEMP_SCALE) + float(MPU_TEMP_OFFSET);
+        values[MPU_CHANNEL_GYRO_X] = float(raw.gyroX)*gyroReciprocal;
+        values[MPU_CHANNEL_GYRO_Y] = float(raw.gyroY)*gyroReciprocal;
+        values[MPU_CHANNEL_GYRO_Z] = float(raw.gyroZ)*gyroReciprocal;
+        formatLine(samples[i].timestampNs, values);
+    }
+    return error == 0;
+}
+
+bool MPU6050Exporter::write(const uint64_t *timestampsNs, const MPU6050SampleArrays &samples, int count){
+    float values[MPU_CHANNEL_COUNT];
+    for(int i = 0; i < count && reserveLine(); i++){
+        values[MPU_CHANNEL_ACCEL_X] = samples.accelX[i];
+        values[MPU_CHANNEL_ACCEL_Y] = samples.accelY[i];
+        values[MPU_CHANNEL_ACCEL_Z] = samples.accelZ[i];
+        values[MPU_CHANNEL_TEMP] = samples.temperature != NULL ? samples.temperature[i] : NAN;
+        values[MPU_CHANNEL_GYRO_X] = samples.gyroX[i];
+        values[MPU_CHANNEL_GYRO_Y] = samples.gyroY[i];
+        values[MPU_CHANNEL_GYRO_Z] = samples.gyroZ[i];
+        formatLine(timestampsNs != NULL ? timestampsNs[i] : 0, values);
+    }
+    return error == 0;
+}
+
+void MPU6050Exporter::receive(const MPU6050SampleBlock &block){
+    write(block.timestampsNs, block.samples, block.count);
+}
+
+int MPU6050Exporter::drain(MPU6050Acquisition &acquisition){
+    MPU6050TimedSample samples[64];
+    int total = 0;
+    int count;
+    while((count = acquisition.popBatch(samples, 64)) > 0){
+        write(samples, count);
+        total += count;
+    }
+    return total;
+}
+
+bool MPU6050Exporter::flush(){
+    const char *data = buffer.data();
+    size_t remaining = used;
+    while(remaining > 0 && error == 0){
+        ssize_t written = ::write(fd, data, remaining);
+        if(written < 0){
+            if(errno != EINTR){
+                error = errno;
+            }
+            continue;
+        }
+        data += written;
+        remaining -= written;
+        bytesWritten += written;
+    }
+    used = 0; // After a failure the rest is dropped rather than kept forever
+    return error == 0;
+}
+
+unsigned long long MPU6050Exporter::getBytesWritten(){return bytesWritten;}
+
+int MPU6050Exporter::getError(){return error;}
+
+bool MPU6050Exporter::reserveLine(){
+    if(buffer.size() - used < MPU_EXPORT_MAX_LINE){
+        flush();
+    }
+    return error == 0;
+}
+
+// The caller has reserved MPU_EXPORT_MAX_LINE bytes, which is enough for every column at any value
+void MPU6050Exporter::formatLine(uint64_t timestampNs, const float *values){
+    char *out = buffer.data() + used;
+    char *end = buffer.data() + buffer.size();
+    const bool json = format == MPU_EXPORT_JSON;
+    bool first = true;
+
+    if(json){
+        *out++ = '{';
+    }
+    if(columns & MPU_EXPORT_COLUMN_TIME){
+        if(json){
+            out = append(out, "\"time_ns\":");
+        }
+        out = std::to_chars(out, end, timestampNs).ptr;
+        first = false;
+    }
+    for(int channel = 0; channel < MPU_CHANNEL_COUNT; channel++){
+        if(!(columns & MPU_CONFIG_CHANNEL(channel))){
+            continue;
+        }
+        if(!first){
+            *out++ = ',';
+        }
+        first = false;
+        if(json){
+            size_t length = strlen(columnNames[channel]);
+            *out++ = '"';
+            memcpy(out, columnNames[channel], length);
+            out += length;
+            out = append(out, "\":");
+            if(!isfinite(values[channel])){
+                out = append(out, "null"); // JSON has no NaN or infinity
+                continue;
+            }
+        }
+        out = formatFixed(out, end, values[channel], precision);
+    }
+    if(json){
+        *out++ = '}';
+    }
+    *out++ = '\n';
+    used = out - buffer.data();
+}
+// --------------------------------------------------------------------------------------------
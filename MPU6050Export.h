@@ -0,0 +1,91 @@
+/* ============================================================================================
+ * MPU6050 Export Header for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This header declares an exporter which writes streams of samples to a file descriptor as CSV
+ * or as JSON lines (one object per sample), for log shippers and other tools:
+ *
+ *     MPU6050Exporter exporter(STDOUT_FILENO, IMU, MPU_EXPORT_JSON);
+ *     while(...) exporter.drain(engine);  // {"time_ns":123,"accel_x":0.0123,...}
+ *
+ * Numbers are formatted with std::to_chars, which ignores the locale and is several times
+ * faster than iostreams or printf, into a buffer allocated once by the constructor. The
+ * buffer is only written out when it is nearly full, so each write() syscall carries many
+ * samples, and nothing is allocated per sample. The columns are any of the channels, as a
+ * mask of MPU_CONFIG_CHANNEL(MPU_CHANNEL_*) bits, plus MPU_EXPORT_COLUMN_TIME, and are
+ * written in MPU_CHANNEL_* order after the time. Values have a fixed number of decimal
+ * places. The exporter is also a pipeline subscriber, so it can log a decimated stream.
+ * Needs a compiler whose standard library has floating point std::to_chars (GCC 11 or later),
+ * so CMake builds it as the separate mpu6050_export library only when the compiler has it.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include <stdint.h> // For fixed width types
+#include <vector>   // Used for the output buffer
+
+#include "MPU6050.h"
+#include "MPU6050Acquisition.h" // For MPU6050TimedSample
+#include "MPU6050Pipeline.h"    // For MPU6050Subscriber
+
+#ifndef MPU6050_EXPORT_H
+#define MPU6050_EXPORT_H
+
+// Output formats
+#define MPU_EXPORT_CSV  0 // A header line, then comma separated values
+#define MPU_EXPORT_JSON 1 // One JSON object per line, with non-finite values as null
+
+// Columns, as a mask of MPU_CONFIG_CHANNEL(MPU_CHANNEL_*) bits plus the time
+#define MPU_EXPORT_COLUMN_TIME  (1 << MPU_CHANNEL_COUNT) // Timestamp in nanoseconds
+#define MPU_EXPORT_COLUMNS_ALL  (MPU_CONFIG_CHANNELS_ALL | MPU_EXPORT_COLUMN_TIME)
+
+#define MPU_EXPORT_DEFAULT_PRECISION 4     // Decimal places
+#define MPU_EXPORT_MAX_PRECISION     9
+#define MPU_EXPORT_DEFAULT_BUFFER    65536 // Bytes
+#define MPU_EXPORT_MAX_LINE          1024  // Longest possible line, which is also the smallest buffer
+
+class MPU6050Exporter : public MPU6050Subscriber{
+public:
+	// Write to fd, which the exporter does not close. The scales convert raw samples, as MPU_GYRO_SCALE_* and
+	// MPU_ACC_SCALE_*. Exits with MPU_INIT_PARAM_ERROR if a parameter is invalid.
+	MPU6050Exporter(int fd, float gyroScale, float accelScale, int format = MPU_EXPORT_CSV, int columns = MPU_EXPORT_COLUMNS_ALL,
+	                int precision = MPU_EXPORT_DEFAULT_PRECISION, int bufferSize = MPU_EXPORT_DEFAULT_BUFFER);
+	// As above, with the sensor's current scales
+	MPU6050Exporter(int fd, MPU6050 &sensor, int format = MPU_EXPORT_CSV, int columns = MPU_EXPORT_COLUMNS_ALL,
+	                int precision = MPU_EXPORT_DEFAULT_PRECISION, int bufferSize = MPU_EXPORT_DEFAULT_BUFFER);
+	~MPU6050Exporter(); // Flushes anything still buffered
+
+	void writeHeader(); // Buffer the CSV header line. Does nothing for JSON lines.
+
+	// Format samples into the buffer, writing it out whenever it fills. Return false if a write has failed.
+	bool write(const MPU6050TimedSample *samples, int count);                               // Raw samples, converted with the scales
+	bool write(const uint64_t *timestampsNs, const MPU6050SampleArrays &samples, int count); // Converted samples. timestampsNs may be NULL.
+	void receive(const MPU6050SampleBlock &block);  // As a pipeline subscriber
+	int drain(MPU6050Acquisition &acquisition);     // Export everything waiting in an engine's ring. Returns the number of samples.
+
+	bool flush(); // Write out everything buffered. Returns false if a write has failed.
+	unsigned long long getBytesWritten();
+	int getError(); // errno of the first failed write, or 0. The exporter stops writing after a failure.
+
+private:
+	MPU6050Exporter(const MPU6050Exporter& E);            // Each exporter owns its buffer
+	MPU6050Exporter& operator=(const MPU6050Exporter& E);
+
+	void setup(int fd, float gyroScale, float accelScale, int format, int columns, int precision, int bufferSize);
+	void formatLine(uint64_t timestampNs, const float *values); // values indexed by MPU_CHANNEL_*
+	bool reserveLine(); // Make room for one more line
+
+	int fd;
+	int format;
+	int columns;
+	int precision;
+	float gyroReciprocal;
+	float accelReciprocal;
+
+	std::vector<char> buffer;
+	size_t used = 0;
+	unsigned long long bytesWritten = 0;
+	int error = 0;
+};
+
+#endif
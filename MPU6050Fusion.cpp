@@ -0,0 +1,281 @@
+/* ============================================================================================
+ * MPU6050 Orientation Fusion Code for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This source code defines the orientation estimator. See MPU6050Fusion.h for more
+ * information. The Mahony and Madgwick steps follow the reference implementations by Sebastian
+ * Madgwick at https://x-io.co.uk/open-source-imu-and-ahrs-algorithms/.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include "MPU6050Fusion.h" // Include definitions and declarations within the header file
+#include <math.h>          // For sqrtf(), atan2f() and asinf()
+
+#define DEG_TO_RAD 0.017453292519943295f
+#define RAD_TO_DEG 57.29577951308232f
+
+// ----------------------------- Special class member definitions -----------------------------
+MPU6050Fusion::MPU6050Fusion(int filterType){
+    this->filterType = filterType;
+    switch(filterType){
+    case MPU_FUSION_COMPLEMENTARY:
+        setGains(MPU_FUSION_COMPLEMENTARY_GAIN);
+        break;
+    case MPU_FUSION_MAHONY:
+        setGains(MPU_FUSION_MAHONY_KP, MPU_FUSION_MAHONY_KI);
+        break;
+    default:
+        this->filterType = MPU_FUSION_MADGWICK;
+        setGains(MPU_FUSION_MADGWICK_BETA);
+        break;
+    }
+    reset();
+}
+// --------------------------------------------------------------------------------------------
+
+// ------------------------------------- Fusion Functions -------------------------------------
+void MPU6050Fusion::setGains(float gain, float integralGain){
+    this->gain = gain;
+    this->integralGain = integralGain;
+}
+
+// Return to the identity orientation
+void MPU6050Fusion::reset(){
+    q0 = 1;
+    q1 = q2 = q3 = 0;
+    integralX = integralY = integralZ = 0;
+    lastTimestampNs = 0;
+}
+
+// Fuse one sample taken dt seconds after the last
+void MPU6050Fusion::update(const MPU6050Sample &sample, float dt){
+    step(sample.gyroX*DEG_TO_RAD, sample.gyroY*DEG_TO_RAD, sample.gyroZ*DEG_TO_RAD,
+         sample.accelX, sample.accelY, sample.accelZ, dt);
+}
+
+// Fuse one sample, using the real time since the last timestamped sample
+void MPU6050Fusion::updateAt(const MPU6050Sample &sample, uint64_t timestampNs){
+    if(lastTimestampNs != 0 && timestampNs > lastTimestampNs){
+        update(sample, float(timestampNs - lastTimestampNs)*1e-9f);
+    }
+    lastTimestampNs = timestampNs;
+}
+
+// Fuse a block of samples. The filter is chosen once for the whole block rather than per sample.
+void MPU6050Fusion::updateBatch(const MPU6050SampleArrays &samples, int count, float dt){
+    switch(filterType){
+    case MPU_FUSION_COMPLEMENTARY:
+        for(int i = 0; i < count; i++){
+            stepComplementary(samples.gyroX[i]*DEG_TO_RAD, samples.gyroY[i]*DEG_TO_RAD, samples.gyroZ[i]*DEG_TO_RAD,
+                              samples.accelX[i], samples.accelY[i], samples.accelZ[i], dt);
+        }
+        break;
+    case MPU_FUSION_MAHONY:
+        for(int i = 0; i < count; i++){
+            stepMahony(samples.gyroX[i]*DEG_TO_RAD, samples.gyroY[i]*DEG_TO_RAD, samples.gyroZ[i]*DEG_TO_RAD,
+                       samples.accelX[i], samples.accelY[i], samples.accelZ[i], dt);
+        }
+        break;
+    default:
+        for(int i = 0; i < count; i++){
+            stepMadgwick(samples.gyroX[i]*DEG_TO_RAD, samples.gyroY[i]*DEG_TO_RAD, samples.gyroZ[i]*DEG_TO_RAD,
+                         samples.accelX[i], samples.accelY[i], samples.accelZ[i], dt);
+        }
+        break;
+    }
+}
+
+MPU6050Quaternion MPU6050Fusion::getQuaternion(){
+    MPU6050Quaternion q = {q0, q1, q2, q3};
+    return q;
+}
+
+// Convert the quaternion to Euler angles - this is the only place trigonometry is used
+MPU6050Euler MPU6050Fusion::getEuler(){
+    MPU6050Euler angles;
+    float sinPitch = 2*(q0*q2 - q3*q1);
+    if(sinPitch > 1){
+        sinPitch = 1;
+    }
+    else if(sinPitch < -1){
+        sinPitch = -1;
+    }
+    angles.roll = atan2f(2*(q0*q1 + q2*q3), 1 - 2*(q1*q1 + q2*q2))*RAD_TO_DEG;
+    angles.pitch = asinf(sinPitch)*RAD_TO_DEG;
+    angles.yaw = atan2f(2*(q0*q3 + q1*q2), 1 - 2*(q2*q2 + q3*q3))*RAD_TO_DEG;
+    return angles;
+}
+// --------------------------------------------------------------------------------------------
+
+// ------------------------------------- Filter Functions -------------------------------------
+void MPU6050Fusion::step(float gx, float gy, float gz, float ax, float ay, float az, float dt){
+    switch(filterType){
+    case MPU_FUSION_COMPLEMENTARY:
+        stepComplementary(gx, gy, gz, ax, ay, az, dt);
+        break;
+    case MPU_FUSION_MAHONY:
+        stepMahony(gx, gy, gz, ax, ay, az, dt);
+        break;
+    default:
+        stepMadgwick(gx, gy, gz, ax, ay, az, dt);
+        break;
+    }
+}
+
+// Integrate the gyro, then rotate a fraction of the way from the estimated gravity direction to the measured one
+void MPU6050Fusion::stepComplementary(float gx, float gy, float gz, float ax, float ay, float az, float dt){
+    // Integrate the rate of change of the quaternion from the gyro
+    float qa = q0, qb = q1, qc = q2;
+    gx *= 0.5f*dt;
+    gy *= 0.5f*dt;
+    gz *= 0.5f*dt;
+    q0 += -qb*gx - qc*gy - q3*gz;
+    q1 += qa*gx + qc*gz - q3*gy;
+    q2 += qa*gy - qb*gz + q3*gx;
+    q3 += qa*gz + qb*gy - qc*gx;
+
+    float norm = sqrtf(ax*ax + ay*ay + az*az);
+    if(norm > 0){
+        ax /= norm;
+        ay /= norm;
+        az /= norm;
+
+        // Estimated direction of gravity in the sensor frame
+        float vx = 2*(q1*q3 - q0*q2);
+        float vy = 2*(q0*q1 + q2*q3);
+        float vz = q0*q0 - q1*q1 - q2*q2 + q3*q3;
+        float vNorm = sqrtf(vx*vx + vy*vy + vz*vz);
+        vx /= vNorm;
+        vy /= vNorm;
+        vz /= vNorm;
+
+        // The shortest rotation between them, scaled by the gain and renormalised (nlerp from the identity)
+        float cw = 1 + ax*vx + ay*vy + az*vz;
+        float cx = ay*vz - az*vy;
+        float cy = az*vx - ax*vz;
+        float cz = ax*vy - ay*vx;
+        float cNorm = sqrtf(cw*cw + cx*cx + cy*cy + cz*cz);
+        if(cNorm > 0){
+            float scale = gain/cNorm;
+            cw = (1 - gain) + cw*scale;
+            cx *= scale;
+            cy *= scale;
+            cz *= scale;
+
+            // Apply the correction in the sensor frame
+            qa = q0; qb = q1; qc = q2;
+            float qd = q3;
+            q0 = qa*cw - qb*cx - qc*cy - qd*cz;
+            q1 = qa*cx + qb*cw + qc*cz - qd*cy;
+            q2 = qa*cy - qb*cz + qc*cw + qd*cx;
+            q3 = qa*cz + qb*cy - qc*cx + qd*cw;
+        }
+    }
+
+    norm = 1.0f/sqrtf(q0*q0 + q1*q1 + q2*q2 + q3*q3);
+    q0 *= norm;
+    q1 *= norm;
+    q2 *= norm;
+    q3 *= norm;
+}
+
+// Feed the gravity error back into the gyro through a proportional-integral controller
+void MPU6050Fusion::stepMahony(float gx, float gy, float gz, float ax, float ay, float az, float dt){
+    float norm = sqrtf(ax*ax + ay*ay + az*az);
+    if(norm > 0){
+        ax /= norm;
+        ay /= norm;
+        az /= norm;
+
+        // Half the estimated direction of gravity
+        float halfvx = q1*q3 - q0*q2;
+        float halfvy = q0*q1 + q2*q3;
+        float halfvz = q0*q0 - 0.5f + q3*q3;
+
+        // The error is the cross product between the measured and estimated directions of gravity
+        float halfex = ay*halfvz - az*halfvy;
+        float halfey = az*halfvx - ax*halfvz;
+        float halfez = ax*halfvy - ay*halfvx;
+
+        if(integralGain > 0){
+            integralX += 2*integralGain*halfex*dt;
+            integralY += 2*integralGain*halfey*dt;
+            integralZ += 2*integralGain*halfez*dt;
+            gx += integralX;
+            gy += integralY;
+            gz += integralZ;
+        }
+        else{
+            integralX = integralY = integralZ = 0;
+        }
+
+        gx += 2*gain*halfex;
+        gy += 2*gain*halfey;
+        gz += 2*gain*halfez;
+    }
+
+    // Integrate the rate of change of the quaternion
+    float qa = q0, qb = q1, qc = q2;
+    gx *= 0.5f*dt;
+    gy *= 0.5f*dt;
+    gz *= 0.5f*dt;
+    q0 += -qb*gx - qc*gy - q3*gz;
+    q1 += qa*gx + qc*gz - q3*gy;
+    q2 += qa*gy - qb*gz + q3*gx;
+    q3 += qa*gz + qb*gy - qc*gx;
+
+    norm = 1.0f/sqrtf(q0*q0 + q1*q1 + q2*q2 + q3*q3);
+    q0 *= norm;
+    q1 *= norm;
+    q2 *= norm;
+    q3 *= norm;
+}
+
+// Subtract a gradient descent step on the gravity error from the gyro rate of change
+void MPU6050Fusion::stepMadgwick(float gx, float gy, float gz, float ax, float ay, float az, float dt){
+    // Rate of change of the quaternion from the gyro
+    float qDot0 = 0.5f*(-q1*gx - q2*gy - q3*gz);
+    float qDot1 = 0.5f*(q0*gx + q2*gz - q3*gy);
+    float qDot2 = 0.5f*(q0*gy - q1*gz + q3*gx);
+    float qDot3 = 0.5f*(q0*gz + q1*gy - q2*gx);
+
+    float norm = sqrtf(ax*ax + ay*ay + az*az);
+    if(norm > 0){
+        ax /= norm;
+        ay /= norm;
+        az /= norm;
+
+        // Auxiliary variables to avoid repeated arithmetic
+        float _2q0 = 2*q0, _2q1 = 2*q1, _2q2 = 2*q2, _2q3 = 2*q3;
+        float _4q0 = 4*q0, _4q1 = 4*q1, _4q2 = 4*q2;
+        float _8q1 = 8*q1, _8q2 = 8*q2;
+        float q0q0 = q0*q0, q1q1 = q1*q1, q2q2 = q2*q2, q3q3 = q3*q3;
+
+        // Gradient of the objective function
+        float s0 = _4q0*q2q2 + _2q2*ax + _4q0*q1q1 - _2q1*ay;
+        float s1 = _4q1*q3q3 - _2q3*ax + 4*q0q0*q1 - _2q0*ay - _4q1 + _8q1*q1q1 + _8q1*q2q2 + _4q1*az;
+        float s2 = 4*q0q0*q2 + _2q0*ax + _4q2*q3q3 - _2q3*ay - _4q2 + _8q2*q1q1 + _8q2*q2q2 + _4q2*az;
+        float s3 = 4*q1q1*q3 - _2q1*ax + 4*q2q2*q3 - _2q2*ay;
+        float sNorm = sqrtf(s0*s0 + s1*s1 + s2*s2 + s3*s3);
+        if(sNorm > 0){
+            float step = gain/sNorm;
+            qDot0 -= step*s0;
+            qDot1 -= step*s1;
+            qDot2 -= step*s2;
+            qDot3 -= step*s3;
+        }
+    }
+
+    q0 += qDot0*dt;
+    q1 += qDot1*dt;
+    q2 += qDot2*dt;
+    q3 += qDot3*dt;
+
+    norm = 1.0f/sqrtf(q0*q0 + q1*q1 + q2*q2 + q3*q3);
+    q0 *= norm;
+    q1 *= norm;
+    q2 *= norm;
+    q3 *= norm;
+}
+// --------------------------------------------------------------------------------------------
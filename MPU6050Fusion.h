@@ -0,0 +1,87 @@
+/* ============================================================================================
+ * MPU6050 Orientation Fusion Header for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This header declares an orientation estimator which fuses the gyro and accelerometer
+ * readings into a quaternion. Three filters are available:
+ *  - Complementary: integrates the gyro, then moves a fraction of the way towards the tilt
+ *    measured by the accelerometer.
+ *  - Mahony: corrects the gyro with a proportional-integral feedback on the gravity error, so
+ *    it also estimates the gyro bias. See https://hal.archives-ouvertes.fr/hal-00488376.
+ *  - Madgwick: corrects the gyro with a gradient descent step on the gravity error. See
+ *    https://x-io.co.uk/open-source-imu-and-ahrs-algorithms/.
+ * All three work on the quaternion directly, with no trigonometry per sample. Trigonometry is
+ * only used when Euler angles are requested. Without a magnetometer the yaw angle drifts.
+ * Gyro values are in °/s, accelerometer values in g and dt in seconds, as from the MPU6050
+ * class. Angles are returned in degrees.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include <stdint.h> // For uint64_t
+
+#include "MPU6050.h"
+#include "MPU6050Converter.h"
+
+#ifndef MPU6050_FUSION_H
+#define MPU6050_FUSION_H
+
+// Filter types
+#define MPU_FUSION_COMPLEMENTARY 0
+#define MPU_FUSION_MAHONY        1
+#define MPU_FUSION_MADGWICK      2
+
+// Default gains for each filter
+#define MPU_FUSION_COMPLEMENTARY_GAIN 0.02f // Fraction of the accelerometer tilt applied each sample
+#define MPU_FUSION_MAHONY_KP          1.0f  // Proportional gain
+#define MPU_FUSION_MAHONY_KI          0.0f  // Integral gain - set above 0 to estimate gyro bias
+#define MPU_FUSION_MADGWICK_BETA      0.1f  // Gradient descent step size
+
+// Orientation as a unit quaternion
+struct MPU6050Quaternion{
+	float w;
+	float x;
+	float y;
+	float z;
+};
+
+// Orientation as Euler angles in degrees, applied in the order yaw, pitch, roll
+struct MPU6050Euler{
+	float roll;
+	float pitch;
+	float yaw;
+};
+
+class MPU6050Fusion{
+public:
+	MPU6050Fusion(int filterType = MPU_FUSION_MADGWICK); // Uses the default gains for the filter
+
+	// Set the gains. For the complementary filter gain is the fraction of the accelerometer tilt applied per sample,
+	// for Mahony gain and integralGain are Kp and Ki, and for Madgwick gain is beta.
+	void setGains(float gain, float integralGain = 0);
+	void reset(); // Return to the identity orientation and clear the integral term
+
+	void update(const MPU6050Sample &sample, float dt);             // Fuse one sample taken dt seconds after the last
+	void updateAt(const MPU6050Sample &sample, uint64_t timestampNs); // Fuse one sample, taking dt from its timestamp
+	// Fuse a block of samples, such as a converted FIFO batch, taken dt seconds apart. Every channel except temperature must be set.
+	void updateBatch(const MPU6050SampleArrays &samples, int count, float dt);
+
+	MPU6050Quaternion getQuaternion();
+	MPU6050Euler getEuler();
+
+private:
+	// One step of each filter, with the gyro in rad/s and the accelerometer in any units
+	void stepComplementary(float gx, float gy, float gz, float ax, float ay, float az, float dt);
+	void stepMahony(float gx, float gy, float gz, float ax, float ay, float az, float dt);
+	void stepMadgwick(float gx, float gy, float gz, float ax, float ay, float az, float dt);
+	void step(float gx, float gy, float gz, float ax, float ay, float az, float dt);
+
+	int filterType;
+	float gain;
+	float integralGain;
+	float q0, q1, q2, q3;                      // Orientation quaternion
+	float integralX, integralY, integralZ;     // Mahony integral term
+	uint64_t lastTimestampNs;                  // 0 until the first timestamped sample
+};
+
+#endif
@@ -0,0 +1,244 @@
+/* ============================================================================================
+ * MPU6050 Multi-Sensor Manager Code for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This source code defines the multi-sensor manager. See MPU6050Manager.h for more information.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include "MPU6050Manager.h" // Include definitions and declarations within the header file
+#include <time.h>           // For clock_nanosleep()
+
+// ----------------------------- Special class member definitions -----------------------------
+MPU6050Manager::MPU6050Manager(){
+    running = false;
+}
+
+// Destructor - stop the workers, then release the sensors before the buses they use
+MPU6050Manager::~MPU6050Manager(){
+    stop();
+    for(unsigned int i = 0; i < sensors.size(); i++){
+        delete sensors[i]->sensor;
+        delete sensors[i]->transport;
+        delete sensors[i]->ring;
+        delete sensors[i];
+    }
+    for(unsigned int i = 0; i < buses.size(); i++){
+        buses[i]->bus->release();
+        delete buses[i];
+    }
+}
+// --------------------------------------------------------------------------------------------
+
+// --------------------------------- Configuration Functions ----------------------------------
+// Add a sensor, opening its bus if this is the first sensor on it
+int MPU6050Manager::addSensor(int busNumber, int deviceAddress, long periodNs, int pwrMgmtMode, int gyroConfig, int accelConfig, int capacity){
+    // Data Validation - the worker divides by the period to find missed deadlines
+    if(periodNs <= 0){
+        std::cout << std::endl << "addSensor received an invalid period" << std::endl;
+        exit(MPU_INIT_PARAM_ERROR);
+    }
+
+    int busIndex = -1;
+    for(unsigned int i = 0; i < buses.size(); i++){
+        if(buses[i]->bus->getBusNumber() == busNumber){
+            busIndex = i;
+        }
+    }
+    if(busIndex < 0){
+        // Share the handle with any other objects using the bus
+        int status;
+        Bus *bus = new Bus;
+        bus->bus = MPU6050I2CBus::acquire(busNumber, status);
+        if(bus->bus == NULL){
+            std::cout << std::endl << MPU6050::getStatusMessage(status) << std::endl;
+            exit(status);
+        }
+        buses.push_back(bus);
+        busIndex = buses.size() - 1;
+    }
+
+    Sensor *sensor = new Sensor;
+    sensor->busIndex = busIndex;
+    sensor->address = deviceAddress;
+    sensor->periodNs = periodNs;
+    sensor->nextDeadlineNs = 0;
+    sensor->transport = new MPU6050I2CTransport(*buses[busIndex]->bus, deviceAddress);
+    sensor->sensor = new MPU6050(*sensor->transport, pwrMgmtMode, gyroConfig, accelConfig);
+    sensor->ring = new MPU6050SampleRing(capacity);
+    sensor->isolated = false;
+    sensor->droppedSamples = 0;
+    sensor->readErrors = 0;
+    sensor->missedDeadlines = 0;
+    sensors.push_back(sensor);
+
+    buses[busIndex]->sensorIDs.push_back(sensors.size() - 1);
+    return sensors.size() - 1;
+}
+
+// Start one worker per bus, all sharing the same start time so that their timestamps line up
+void MPU6050Manager::start(){
+    stop();
+    running = true;
+    uint64_t startNs = MPU6050Acquisition::nowNs();
+    for(unsigned int i = 0; i < buses.size(); i++){
+        buses[i]->worker = std::thread(&MPU6050Manager::runBus, this, i, startNs);
+    }
+}
+
+// Stop the workers and wait for them to finish
+void MPU6050Manager::stop(){
+    running = false;
+    for(unsigned int i = 0; i < buses.size(); i++){
+        if(buses[i]->worker.joinable()){
+            buses[i]->worker.join();
+        }
+    }
+}
+// --------------------------------------------------------------------------------------------
+
+// ------------------------------------ Consumer Functions ------------------------------------
+bool MPU6050Manager::pop(int sensorID, MPU6050TimedSample &sample){return sensors[sensorID]->ring->pop(sample);}
+
+int MPU6050Manager::popBatch(int sensorID, MPU6050TimedSample *samples, int maxSamples){
+    return sensors[sensorID]->ring->popBatch(samples, maxSamples);
+}
+
+MPU6050& MPU6050Manager::getSensor(int sensorID){return *sensors[sensorID]->sensor;}
+
+int MPU6050Manager::getSensorCount(){return sensors.size();}
+
+unsigned long MPU6050Manager::getDroppedSamples(int sensorID){return sensors[sensorID]->droppedSamples.load(std::memory_order_relaxed);}
+
+unsigned long MPU6050Manager::getReadErrors(int sensorID){return sensors[sensorID]->readErrors.load(std::memory_order_relaxed);}
+
+unsigned long MPU6050Manager::getMissedDeadlines(int sensorID){return sensors[sensorID]->missedDeadlines.load(std::memory_order_relaxed);}
+// --------------------------------------------------------------------------------------------
+
+// ------------------------------------- Worker Functions -------------------------------------
+// Sleep until the next sensor is due, then read every sensor which is due in as few transactions as possible
+void MPU6050Manager::runBus(int busIndex, uint64_t startNs){
+    Bus &bus = *buses[busIndex];
+    int batch[MPU_MANAGER_MAX_BATCH];
+
+    for(unsigned int i = 0; i < bus.sensorIDs.size(); i++){
+        sensors[bus.sensorIDs[i]]->nextDeadlineNs = startNs;
+    }
+
+    while(running.load(std::memory_order_relaxed)){
+        // Find the earliest deadline on this bus
+        uint64_t wakeNs = UINT64_MAX;
+        for(unsigned int i = 0; i < bus.sensorIDs.size(); i++){
+            if(sensors[bus.sensorIDs[i]]->nextDeadlineNs < wakeNs){
+                wakeNs = sensors[bus.sensorIDs[i]]->nextDeadlineNs;
+            }
+        }
+
+        struct timespec deadline;
+        deadline.tv_sec = wakeNs/1000000000ULL;
+        deadline.tv_nsec = wakeNs%1000000000ULL;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+
+        // Gather every sensor which is now due, reading a batch whenever the transaction is full
+        uint64_t nowNs = MPU6050Acquisition::nowNs();
+        int count = 0;
+        for(unsigned int i = 0; i < bus.sensorIDs.size(); i++){
+            Sensor &sensor = *sensors[bus.sensorIDs[i]];
+            if(sensor.nextDeadlineNs > nowNs){
+                continue;
+            }
+
+            // A batch needs I2C_RDWR, so SMBus-only adapters read each sensor on its own
+            if(sensor.isolated || bus.bus->isSmbusOnly()){
+                readSingle(bus.sensorIDs[i]);
+            }
+            else{
+                batch[count++] = bus.sensorIDs[i];
+            }
+            if(count == MPU_MANAGER_MAX_BATCH){
+                readBatch(bus, batch, count);
+                count = 0;
+            }
+
+            // Move to the next deadline, skipping any periods which have already passed
+            sensor.nextDeadlineNs += sensor.periodNs;
+            if(sensor.nextDeadlineNs <= nowNs){
+                uint64_t missed = (nowNs - sensor.nextDeadlineNs)/sensor.periodNs + 1;
+                sensor.nextDeadlineNs += missed*sensor.periodNs;
+                sensor.missedDeadlines.fetch_add(missed, std::memory_order_relaxed);
+            }
+        }
+        if(count > 0){
+            readBatch(bus, batch, count);
+        }
+    }
+}
+
+// Read several sensors in one I2C_RDWR transaction, with a write/read message pair for each device
+void MPU6050Manager::readBatch(Bus &bus, int *batch, int count){
+    struct i2c_msg messages[2*MPU_MANAGER_MAX_BATCH];
+    __u8 startRegister[MPU_MANAGER_MAX_BATCH];
+    __u8 data[MPU_MANAGER_MAX_BATCH][MPU_BURST_LENGTH];
+
+    // Each sensor's read covers only its enabled channels, as its own burst reads do
+    for(int i = 0; i < count; i++){
+        MPU6050 *sensor = sensors[batch[i]]->sensor;
+        startRegister[i] = sensor->getBurstStart();
+
+        messages[2*i].addr = sensors[batch[i]]->address;
+        messages[2*i].flags = 0;
+        messages[2*i].len = 1;
+        messages[2*i].buf = &startRegister[i];
+
+        messages[2*i + 1].addr = sensors[batch[i]]->address;
+        messages[2*i + 1].flags = I2C_M_RD;
+        messages[2*i + 1].len = sensor->getBurstLength();
+        messages[2*i + 1].buf = data[i];
+    }
+
+    uint64_t start = MPU6050Acquisition::nowNs();
+    bool success = bus.bus->transfer(messages, 2*count) >= 0;
+    uint64_t end = MPU6050Acquisition::nowNs();
+
+    for(int i = 0; i < count; i++){
+        sensors[batch[i]]->transport->countBatchedRead(messages[2*i + 1].len);
+    }
+
+    // If one device fails the whole transaction fails, so read each of them on its own to find out which
+    if(!success){
+        for(int i = 0; i < count; i++){
+            readSingle(batch[i]);
+        }
+        return;
+    }
+
+    // Every sensor in the batch gets the same timestamp
+    MPU6050TimedSample sample;
+    sample.timestampNs = start + (end - start)/2;
+    for(int i = 0; i < count; i++){
+        sensors[batch[i]]->sensor->decodeBurst(data[i], sample.raw);
+        push(*sensors[batch[i]], sample);
+    }
+}
+
+// Read one sensor through the MPU6050 object, so its retries and bus recovery apply
+void MPU6050Manager::readSingle(int sensorID){
+    Sensor &sensor = *sensors[sensorID];
+    MPU6050TimedSample sample;
+
+    bool success = MPU6050Acquisition::readTimedSample(*sensor.sensor, sample);
+    sensor.isolated = !success;
+    if(!success){
+        sensor.readErrors.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    push(sensor, sample);
+}
+
+void MPU6050Manager::push(Sensor &sensor, const MPU6050TimedSample &sample){
+    if(!sensor.ring->push(sample)){
+        sensor.droppedSamples.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+// --------------------------------------------------------------------------------------------
@@ -0,0 +1,90 @@
+/* ============================================================================================
+ * MPU6050 Multi-Sensor Manager Header for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This header declares a manager for several MPU6050s spread across one or more I2C buses. The
+ * sensors on each bus share one file descriptor, and each bus is read by its own worker thread
+ * so buses are sampled in parallel. Each sensor has its own sample period. Deadlines for every
+ * sensor are multiples of its period from a common start time, so sensors which are due at the
+ * same time are read together in a single I2C_RDWR transaction with one message pair per device,
+ * and receive the same timestamp. Each device's read covers only the channels enabled on it with
+ * setChannels() before the workers start. If a batch fails, each of its sensors is read on its own
+ * through the MPU6050 object's retry and recovery, and a sensor which fails on its own is kept
+ * out of the batches until it reads successfully, so one bad device cannot starve the others.
+ * Samples are delivered through one lock-free ring per sensor.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include <atomic> // Used for the worker flags and counters
+#include <thread> // Used for the worker threads
+#include <vector> // Used to store the buses and sensors
+
+#include "MPU6050.h"
+#include "MPU6050Transport.h"
+#include "MPU6050Acquisition.h"
+
+#ifndef MPU6050_MANAGER_H
+#define MPU6050_MANAGER_H
+
+// Each device read needs a write message for the register and a read message for the data
+#define MPU_MANAGER_MAX_BATCH (I2C_RDWR_IOCTL_MAX_MSGS/2)
+
+class MPU6050Manager{
+public:
+	MPU6050Manager();
+	~MPU6050Manager(); // Stops the workers and closes every bus
+
+	// Add a sensor read every periodNs. The bus handle is shared with any other object using the bus. Returns the sensor ID.
+	// Sensors cannot be added while the workers are running.
+	int addSensor(int busNumber, int deviceAddress, long periodNs, int pwrMgmtMode = MPU_PWR_MGMT_CLK_INTERNAL_8MHZ,
+	              int gyroConfig = MPU_GYRO_SENS_500, int accelConfig = MPU_ACC_SENS_2, int capacity = MPU_ACQUISITION_DEFAULT_CAPACITY);
+
+	void start(); // Start one worker per bus
+	void stop();
+
+	// Consumer functions for one sensor - these never block. Use a single consumer thread per sensor.
+	bool pop(int sensorID, MPU6050TimedSample &sample);
+	int popBatch(int sensorID, MPU6050TimedSample *samples, int maxSamples);
+
+	MPU6050& getSensor(int sensorID);            // Only use the sensor directly while the workers are stopped
+	int getSensorCount();
+	unsigned long getDroppedSamples(int sensorID); // Samples lost because the ring was full
+	unsigned long getReadErrors(int sensorID);     // Reads which failed on the bus
+	unsigned long getMissedDeadlines(int sensorID); // Periods skipped because the worker fell behind
+
+private:
+	MPU6050Manager(const MPU6050Manager& M);            // The manager cannot be copied
+	MPU6050Manager& operator=(const MPU6050Manager& M);
+
+	struct Sensor{
+		int busIndex;
+		int address;
+		long periodNs;
+		uint64_t nextDeadlineNs;
+		MPU6050I2CTransport *transport;
+		MPU6050 *sensor;
+		MPU6050SampleRing *ring;
+		bool isolated; // Read on its own after failing, until a read succeeds
+		std::atomic<unsigned long> droppedSamples;
+		std::atomic<unsigned long> readErrors;
+		std::atomic<unsigned long> missedDeadlines;
+	};
+
+	struct Bus{
+		MPU6050I2CBus *bus;
+		std::vector<int> sensorIDs;
+		std::thread worker;
+	};
+
+	void runBus(int busIndex, uint64_t startNs); // Worker thread for one bus
+	void readBatch(Bus &bus, int *batch, int count); // Read several due sensors in one transaction
+	void readSingle(int sensorID);                   // Read one sensor with its own retries and recovery
+	void push(Sensor &sensor, const MPU6050TimedSample &sample);
+
+	std::vector<Bus*> buses;
+	std::vector<Sensor*> sensors;
+	std::atomic<bool> running;
+};
+
+#endif
@@ -0,0 +1,258 @@
+/* ============================================================================================
+ * MPU6050 Instrumentation Code for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This source code defines the histogram snapshots, metrics snapshots and Prometheus exporter.
+ * See MPU6050Metrics.h for more information. The text format is described at
+ * https://prometheus.io/docs/instrumenting/exposition_formats/.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include "MPU6050Metrics.h" // Include definitions and declarations within the header file
+#include <fstream>          // Used to write the exporter file
+#include <string>
+#include <chrono>           // For the exporter interval
+#include <string.h>         // For strncpy()
+#include <stdio.h>          // For rename()
+#include <math.h>           // For sqrt()
+
+// Exporter histogram buckets are every power of 2 from 2^10ns (about 1µs) to 2^30ns (about 1s), so the series stay the same
+#define EXPORT_FIRST_EXPONENT 10
+#define EXPORT_LAST_EXPONENT  30
+
+// How often the exporter thread checks if it has been stopped
+#define EXPORT_POLL_MS 100
+
+// --------------------------------------- Histograms ---------------------------------------
+MPU6050Histogram::MPU6050Histogram(){
+    reset();
+}
+
+void MPU6050Histogram::reset(){
+    for(int i = 0; i < MPU_HISTOGRAM_BUCKETS; i++){
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+    count.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    min.store(UINT64_MAX, std::memory_order_relaxed);
+    max.store(0, std::memory_order_relaxed);
+}
+
+// Copy the histogram. Recording may continue, so the count is taken from the buckets to keep the copy consistent.
+void MPU6050Histogram::snapshot(MPU6050HistogramSnapshot &copy){
+    copy.count = 0;
+    for(int i = 0; i < MPU_HISTOGRAM_BUCKETS; i++){
+        copy.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+        copy.count += copy.buckets[i];
+    }
+    copy.sum = sum.load(std::memory_order_relaxed);
+    copy.max = max.load(std::memory_order_relaxed);
+    copy.min = copy.count > 0 ? min.load(std::memory_order_relaxed) : 0;
+}
+
+uint64_t MPU6050Histogram::bucketLowerBound(int index){
+    if(index < MPU_HISTOGRAM_SUB_BUCKETS){
+        return index;
+    }
+    int exponent = index/MPU_HISTOGRAM_SUB_BUCKETS + MPU_HISTOGRAM_SUB_BITS - 1;
+    uint64_t subBucket = index % MPU_HISTOGRAM_SUB_BUCKETS;
+    return (MPU_HISTOGRAM_SUB_BUCKETS + subBucket) << (exponent - MPU_HISTOGRAM_SUB_BITS);
+}
+
+uint64_t MPU6050Histogram::bucketUpperBound(int index){
+    if(index >= MPU_HISTOGRAM_BUCKETS - 1){
+        return UINT64_MAX;
+    }
+    return bucketLowerBound(index + 1) - 1;
+}
+
+double MPU6050HistogramSnapshot::mean() const{
+    return count > 0 ? double(sum)/count : 0;
+}
+
+uint64_t MPU6050HistogramSnapshot::percentile(double p) const{
+    if(count == 0){
+        return 0;
+    }
+    // Rank of the wanted value, counting from 1
+    uint64_t rank = uint64_t(ceil(p/100*count));
+    if(rank < 1){
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for(int i = 0; i < MPU_HISTOGRAM_BUCKETS; i++){
+        seen += buckets[i];
+        if(seen >= rank){
+            // The bucket bound may be above the largest value recorded
+            uint64_t bound = MPU6050Histogram::bucketUpperBound(i);
+            return bound < max ? bound : max;
+        }
+    }
+    return max;
+}
+// --------------------------------------------------------------------------------------------
+
+// ----------------------------------------- Metrics ------------------------------------------
+MPU6050Metrics::MPU6050Metrics(){
+    reset();
+}
+
+void MPU6050Metrics::reset(){
+    transactionLatency.reset();
+    sampleInterval.reset();
+    lastSampleNs.store(0, std::memory_order_relaxed);
+    intervalSum.store(0, std::memory_order_relaxed);
+    intervalSumSquares.store(0, std::memory_order_relaxed);
+    samples.store(0, std::memory_order_relaxed);
+    transactions.store(0, std::memory_order_relaxed);
+    bytes.store(0, std::memory_order_relaxed);
+    failedSamples.store(0, std::memory_order_relaxed);
+    fifoOverflows.store(0, std::memory_order_relaxed);
+    droppedSamples.store(0, std::memory_order_relaxed);
+}
+
+void MPU6050Metrics::snapshot(MPU6050MetricsSnapshot &copy){
+    transactionLatency.snapshot(copy.transactionLatency);
+    sampleInterval.snapshot(copy.sampleInterval);
+
+    // Mean and standard deviation of the interval
+    double intervals = double(copy.sampleInterval.count);
+    double total = intervalSum.load(std::memory_order_relaxed);
+    double totalSquares = intervalSumSquares.load(std::memory_order_relaxed);
+    copy.intervalMeanNs = intervals > 0 ? total/intervals : 0;
+    double variance = intervals > 0 ? totalSquares/intervals - copy.intervalMeanNs*copy.intervalMeanNs : 0;
+    copy.intervalJitterNs = variance > 0 ? sqrt(variance) : 0;
+
+    copy.samples = samples.load(std::memory_order_relaxed);
+    copy.transactions = transactions.load(std::memory_order_relaxed);
+    copy.bytes = bytes.load(std::memory_order_relaxed);
+    copy.transactionsPerSample = copy.samples > 0 ? double(copy.transactions)/copy.samples : 0;
+    copy.bytesPerSample = copy.samples > 0 ? double(copy.bytes)/copy.samples : 0;
+    copy.failedSamples = failedSamples.load(std::memory_order_relaxed);
+    copy.fifoOverflows = fifoOverflows.load(std::memory_order_relaxed);
+    copy.droppedSamples = droppedSamples.load(std::memory_order_relaxed);
+}
+// --------------------------------------------------------------------------------------------
+
+// ----------------------------------------- Exporter -----------------------------------------
+MPU6050MetricsExporter::MPU6050MetricsExporter(MPU6050Metrics &metrics, const char *path, const char *labels, int intervalMs){
+    this->metrics = &metrics;
+    strncpy(this->path, path, sizeof(this->path) - 1);
+    this->path[sizeof(this->path) - 1] = 0;
+    strncpy(this->labels, labels, sizeof(this->labels) - 1);
+    this->labels[sizeof(this->labels) - 1] = 0;
+    this->intervalMs = intervalMs > 0 ? intervalMs : MPU_METRICS_EXPORT_INTERVAL_MS;
+    running = false;
+}
+
+MPU6050MetricsExporter::~MPU6050MetricsExporter(){
+    stop();
+}
+
+void MPU6050MetricsExporter::start(){
+    if(running.exchange(true)){
+        return; // Already started
+    }
+    thread = std::thread(&MPU6050MetricsExporter::run, this);
+}
+
+void MPU6050MetricsExporter::stop(){
+    if(!running.exchange(false)){
+        return;
+    }
+    thread.join();
+    writeFile();
+}
+
+// Write to a temporary file, then rename it over the old one
+bool MPU6050MetricsExporter::writeFile(){
+    MPU6050MetricsSnapshot snapshot;
+    metrics->snapshot(snapshot);
+
+    std::string temporary = std::string(path) + ".tmp";
+    std::ofstream file(temporary.c_str());
+    if(!file){
+        return false;
+    }
+    writePrometheus(file, snapshot, labels);
+    file.close();
+    if(!file || rename(temporary.c_str(), path) != 0){
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+void MPU6050MetricsExporter::run(){
+    int waitedMs = 0;
+    while(running.load()){
+        std::this_thread::sleep_for(std::chrono::milliseconds(EXPORT_POLL_MS));
+        waitedMs += EXPORT_POLL_MS;
+        if(waitedMs >= intervalMs){
+            writeFile();
+            waitedMs = 0;
+        }
+    }
+}
+
+// Write one histogram as cumulative buckets in seconds
+static void writeHistogram(std::ostream &out, const char *name, const char *help, const MPU6050HistogramSnapshot &histogram,
+                           const char *labels){
+    const char *separator = labels[0] ? "," : "";
+    out << "# HELP " << name << " " << help << "\n";
+    out << "# TYPE " << name << " histogram\n";
+
+    uint64_t cumulative = 0;
+    int index = 0;
+    for(int exponent = EXPORT_FIRST_EXPONENT; exponent <= EXPORT_LAST_EXPONENT; exponent++){
+        // Add every bucket whose values are all below 2^exponent
+        uint64_t limit = uint64_t(1) << exponent;
+        while(index < MPU_HISTOGRAM_BUCKETS && MPU6050Histogram::bucketLowerBound(index) < limit){
+            cumulative += histogram.buckets[index++];
+        }
+        out << name << "_bucket{" << labels << separator << "le=\"" << double(limit)*1e-9 << "\"} " << cumulative << "\n";
+    }
+    out << name << "_bucket{" << labels << separator << "le=\"+Inf\"} " << histogram.count << "\n";
+    out << name << "_sum{" << labels << "} " << double(histogram.sum)*1e-9 << "\n";
+    out << name << "_count{" << labels << "} " << histogram.count << "\n";
+}
+
+// Write one gauge
+static void writeValue(std::ostream &out, const char *name, const char *help, double value, const char *labels){
+    out << "# HELP " << name << " " << help << "\n";
+    out << "# TYPE " << name << " gauge\n";
+    out << name << "{" << labels << "} " << value << "\n";
+}
+
+// Write one counter. These are written as integers so large counts keep every digit.
+static void writeCounter(std::ostream &out, const char *name, const char *help, uint64_t value, const char *labels){
+    out << "# HELP " << name << " " << help << "\n";
+    out << "# TYPE " << name << " counter\n";
+    out << name << "{" << labels << "} " << value << "\n";
+}
+
+void MPU6050MetricsExporter::writePrometheus(std::ostream &out, const MPU6050MetricsSnapshot &snapshot, const char *labels){
+    std::streamsize oldPrecision = out.precision(9);
+
+    writeHistogram(out, "mpu6050_transaction_latency_seconds", "Latency of I2C transactions on the sampling path.",
+                   snapshot.transactionLatency, labels);
+    writeHistogram(out, "mpu6050_sample_interval_seconds", "Time between consecutive single samples.",
+                   snapshot.sampleInterval, labels);
+    writeValue(out, "mpu6050_sample_interval_jitter_seconds", "Standard deviation of the sample interval.",
+               snapshot.intervalJitterNs*1e-9, labels);
+    writeCounter(out, "mpu6050_samples_total", "Samples read, including FIFO samples.", snapshot.samples, labels);
+    writeCounter(out, "mpu6050_bus_transactions_total", "I2C transactions (syscalls) made while sampling.",
+               snapshot.transactions, labels);
+    writeCounter(out, "mpu6050_bus_bytes_total", "Bytes clocked over the bus while sampling.", snapshot.bytes, labels);
+    writeValue(out, "mpu6050_bus_transactions_per_sample", "Mean I2C transactions per sample.",
+               snapshot.transactionsPerSample, labels);
+    writeValue(out, "mpu6050_bus_bytes_per_sample", "Mean bus bytes per sample.", snapshot.bytesPerSample, labels);
+    writeCounter(out, "mpu6050_failed_samples_total", "Samples which could not be read.", snapshot.failedSamples, labels);
+    writeCounter(out, "mpu6050_fifo_overflows_total", "FIFO overflows.", snapshot.fifoOverflows, labels);
+    writeCounter(out, "mpu6050_dropped_samples_total", "Samples lost because an acquisition ring was full.",
+               snapshot.droppedSamples, labels);
+
+    out.precision(oldPrecision);
+}
+// --------------------------------------------------------------------------------------------
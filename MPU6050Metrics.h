@@ -0,0 +1,199 @@
+/* ============================================================================================
+ * MPU6050 Instrumentation Header for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This header declares the instrumentation which can be attached to an MPU6050 object with
+ * setMetrics(). It records:
+ *  - The latency of every I2C transaction on the sampling path, in a histogram.
+ *  - The interval between samples, in a histogram, with its mean and jitter (standard
+ *    deviation).
+ *  - Bus bytes and transactions (syscalls) per sample, FIFO overflows, dropped samples and
+ *    failed samples.
+ * Recording is lock-free and allocation-free: each value is a few relaxed atomic additions, so
+ * snapshot() can be called from any thread while sampling continues. The histograms are
+ * log-linear - each power of 2 is split into MPU_HISTOGRAM_SUB_BUCKETS linear buckets, so
+ * every value is placed within 12.5% with a fixed 2.4kB table covering 1ns to 18 minutes.
+ * MPU6050MetricsExporter writes snapshots to a file in the Prometheus text exposition format,
+ * for the node exporter textfile collector.
+ * Define MPU_NO_METRICS when compiling every file to remove the instrumentation hooks
+ * entirely, leaving no timing calls or branches on the sampling path. setMetrics() then does
+ * nothing and MPU6050Metrics.cpp need not be built.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include <stdint.h> // For fixed width types
+#include <atomic>   // Used for the lock-free counters
+#include <thread>   // Used for the exporter thread
+#include <ostream>
+
+#include "MPU6050.h"
+#include "MPU6050Acquisition.h" // For the clock
+
+#ifndef MPU6050_METRICS_H
+#define MPU6050_METRICS_H
+
+// Histogram layout
+#define MPU_HISTOGRAM_SUB_BITS      3                             // Each power of 2 is split into 2^3 buckets
+#define MPU_HISTOGRAM_SUB_BUCKETS   (1 << MPU_HISTOGRAM_SUB_BITS)
+#define MPU_HISTOGRAM_MAX_EXPONENT  40                            // Values from 2^40ns (about 18 minutes) go in the last bucket
+#define MPU_HISTOGRAM_BUCKETS       ((MPU_HISTOGRAM_MAX_EXPONENT - MPU_HISTOGRAM_SUB_BITS + 1)*MPU_HISTOGRAM_SUB_BUCKETS)
+
+// Default time between files written by the exporter
+#define MPU_METRICS_EXPORT_INTERVAL_MS 10000
+
+// Copy of a histogram at one point in time
+struct MPU6050HistogramSnapshot{
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;  // 0 if count is 0
+	uint64_t max;
+	uint64_t buckets[MPU_HISTOGRAM_BUCKETS];
+
+	double mean() const;
+	uint64_t percentile(double p) const; // Upper bound of the bucket holding the pth percentile, for p from 0 to 100
+};
+
+// Lock-free log-linear histogram of nanosecond values. One thread may record while others take snapshots.
+class MPU6050Histogram{
+public:
+	MPU6050Histogram();
+
+	void record(uint64_t value){
+		buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+		count.fetch_add(1, std::memory_order_relaxed);
+		sum.fetch_add(value, std::memory_order_relaxed);
+		uint64_t seen = max.load(std::memory_order_relaxed);
+		while(value > seen && !max.compare_exchange_weak(seen, value, std::memory_order_relaxed));
+		seen = min.load(std::memory_order_relaxed);
+		while(value < seen && !min.compare_exchange_weak(seen, value, std::memory_order_relaxed));
+	}
+	void snapshot(MPU6050HistogramSnapshot &copy);
+	void reset();
+
+	// Bucket for a value: values below MPU_HISTOGRAM_SUB_BUCKETS have their own bucket, and above that the bucket is chosen
+	// by the position of the top bit and the MPU_HISTOGRAM_SUB_BITS bits below it
+	static int bucketIndex(uint64_t value){
+		if(value < MPU_HISTOGRAM_SUB_BUCKETS){
+			return int(value);
+		}
+		int exponent = 63 - __builtin_clzll(value);
+		if(exponent >= MPU_HISTOGRAM_MAX_EXPONENT){
+			return MPU_HISTOGRAM_BUCKETS - 1;
+		}
+		int subBucket = int(value >> (exponent - MPU_HISTOGRAM_SUB_BITS)) & (MPU_HISTOGRAM_SUB_BUCKETS - 1);
+		return (exponent - MPU_HISTOGRAM_SUB_BITS + 1)*MPU_HISTOGRAM_SUB_BUCKETS + subBucket;
+	}
+	static uint64_t bucketLowerBound(int index); // Smallest value placed in a bucket
+	static uint64_t bucketUpperBound(int index); // Largest value placed in a bucket
+
+private:
+	MPU6050Histogram(const MPU6050Histogram& H);            // Atomics cannot be copied
+	MPU6050Histogram& operator=(const MPU6050Histogram& H);
+
+	std::atomic<uint64_t> buckets[MPU_HISTOGRAM_BUCKETS];
+	std::atomic<uint64_t> count;
+	std::atomic<uint64_t> sum;
+	std::atomic<uint64_t> min;
+	std::atomic<uint64_t> max;
+};
+
+// Copy of all the metrics at one point in time
+struct MPU6050MetricsSnapshot{
+	MPU6050HistogramSnapshot transactionLatency; // Nanoseconds per I2C transaction on the sampling path
+	MPU6050HistogramSnapshot sampleInterval;     // Nanoseconds between consecutive single samples
+	double intervalMeanNs;
+	double intervalJitterNs;                     // Standard deviation of the interval
+	uint64_t samples;                            // Samples read, including FIFO samples
+	uint64_t transactions;                       // Bus transactions made while sampling
+	uint64_t bytes;                              // Bus bytes while sampling
+	double transactionsPerSample;
+	double bytesPerSample;
+	uint64_t failedSamples;
+	uint64_t fifoOverflows;
+	uint64_t droppedSamples;                     // Samples lost because an acquisition ring was full
+};
+
+// Metrics for one sensor. Attach to an MPU6050 object with setMetrics(). Recording is done by the sampling thread only.
+class MPU6050Metrics{
+public:
+	MPU6050Metrics();
+
+	// ---------- Recording - called by the driver ----------
+	void recordTransaction(uint64_t latencyNs){
+		transactionLatency.record(latencyNs);
+	}
+	// A single sample read at timestampNs, which used the given bus transactions and bytes
+	void recordSample(uint64_t timestampNs, unsigned long sampleTransactions, unsigned long sampleBytes){
+		uint64_t last = lastSampleNs.load(std::memory_order_relaxed);
+		if(last != 0 && timestampNs > last){
+			double interval = double(timestampNs - last);
+			sampleInterval.record(timestampNs - last);
+			// Only the sampling thread writes these, so a load and a store is enough
+			intervalSum.store(intervalSum.load(std::memory_order_relaxed) + interval, std::memory_order_relaxed);
+			intervalSumSquares.store(intervalSumSquares.load(std::memory_order_relaxed) + interval*interval, std::memory_order_relaxed);
+		}
+		lastSampleNs.store(timestampNs, std::memory_order_relaxed);
+		recordBatch(1, sampleTransactions, sampleBytes);
+	}
+	// Several samples read together, such as from the FIFO. These are not used for the interval.
+	void recordBatch(unsigned long batchSamples, unsigned long batchTransactions, unsigned long batchBytes){
+		samples.fetch_add(batchSamples, std::memory_order_relaxed);
+		transactions.fetch_add(batchTransactions, std::memory_order_relaxed);
+		bytes.fetch_add(batchBytes, std::memory_order_relaxed);
+	}
+	void recordFailedSample(){failedSamples.fetch_add(1, std::memory_order_relaxed);}
+	void recordFifoOverflow(){fifoOverflows.fetch_add(1, std::memory_order_relaxed);}
+	void recordDroppedSample(){droppedSamples.fetch_add(1, std::memory_order_relaxed);}
+	// ------------------------------------------------------
+
+	void snapshot(MPU6050MetricsSnapshot &copy); // Safe to call from any thread
+	void reset();                               // Only while nothing is recording
+
+private:
+	MPU6050Metrics(const MPU6050Metrics& M);            // Atomics cannot be copied
+	MPU6050Metrics& operator=(const MPU6050Metrics& M);
+
+	MPU6050Histogram transactionLatency;
+	MPU6050Histogram sampleInterval;
+	std::atomic<uint64_t> lastSampleNs;
+	std::atomic<double> intervalSum;
+	std::atomic<double> intervalSumSquares;
+	std::atomic<uint64_t> samples;
+	std::atomic<uint64_t> transactions;
+	std::atomic<uint64_t> bytes;
+	std::atomic<uint64_t> failedSamples;
+	std::atomic<uint64_t> fifoOverflows;
+	std::atomic<uint64_t> droppedSamples;
+};
+
+// Writes metrics to a file in the Prometheus text format on its own thread. Each file is written in full and renamed into
+// place, so the collector never reads a partial file.
+class MPU6050MetricsExporter{
+public:
+	// labels is added to every metric, for example "sensor=\"imu0\"". It may be empty.
+	MPU6050MetricsExporter(MPU6050Metrics &metrics, const char *path, const char *labels = "", int intervalMs = MPU_METRICS_EXPORT_INTERVAL_MS);
+	~MPU6050MetricsExporter(); // Stops the thread
+
+	void start();
+	void stop();       // Writes the file a final time
+	bool writeFile();  // Write the file now. Returns false if it couldn't be written.
+
+	// Write a snapshot in the Prometheus text format
+	static void writePrometheus(std::ostream &out, const MPU6050MetricsSnapshot &snapshot, const char *labels = "");
+
+private:
+	MPU6050MetricsExporter(const MPU6050MetricsExporter& E);            // The thread cannot be shared
+	MPU6050MetricsExporter& operator=(const MPU6050MetricsExporter& E);
+
+	void run(); // Body of the exporter thread
+
+	MPU6050Metrics *metrics;
+	char path[256];
+	char labels[128];
+	int intervalMs;
+	std::thread thread;
+	std::atomic<bool> running;
+};
+
+#endif
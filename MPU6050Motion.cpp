@@ -0,0 +1,152 @@
+/* ============================================================================================
+ * MPU6050 Wake-on-Motion Code for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This source code defines the monitor which switches the MPU6050 between its low power cycle
+ * mode and full rate streaming. See MPU6050Motion.h for more information.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include "MPU6050Motion.h" // Include definitions and declarations within the header file
+#include "MPU6050Config.h" // For the register fields
+#include <iostream>        // Used for error output
+#include <errno.h>         // For EINTR
+#include <poll.h>          // For poll()
+
+// Milliseconds until a time, rounded up so that poll() does not return just before it
+static int msUntil(uint64_t timeNs, uint64_t nowNs){
+    return timeNs > nowNs ? int((timeNs - nowNs + 999999)/1000000) : 0;
+}
+
+// ---------------------------------------- Monitor -------------------------------------------
+MPU6050MotionMonitor::MPU6050MotionMonitor(MPU6050 &sensor, MPU6050EventSource &interrupt, int thresholdMg, int quietMs,
+                                           int wakeRate, int duration){
+    // Data Validation - the ranges of MOT_THR, MOT_DUR and LP_WAKE_CTRL
+    if(thresholdMg <= 0 || !MPU_FIELD_MOT_THR.fits((thresholdMg + MPU_MOT_THR_SCALE/2)/MPU_MOT_THR_SCALE) ||
+       duration <= 0 || !MPU_FIELD_MOT_DUR.fits(duration) || !MPU_FIELD_LP_WAKE_CTRL.fits(wakeRate) || quietMs <= 0){
+        std::cout << std::endl << "MPU6050MotionMonitor received an invalid parameter" << std::endl;
+        exit(MPU_INIT_PARAM_ERROR);
+    }
+
+    this->sensor = &sensor;
+    this->interrupt = &interrupt;
+    this->thresholdMg = thresholdMg;
+    this->duration = duration;
+    this->wakeRate = wakeRate;
+    quietNs = uint64_t(quietMs)*1000000ULL;
+}
+
+bool MPU6050MotionMonitor::start(){
+    return sensor->enableMotionInterrupt(thresholdMg, duration) && enterIdle();
+}
+
+bool MPU6050MotionMonitor::stop(){
+    streaming = false;
+    return sensor->setInterruptEnable(0) && sensor->disableMotionInterrupt() && sensor->wake();
+}
+
+int MPU6050MotionMonitor::wait(MPU6050TimedSample &sample, int timeoutMs){
+    const uint64_t deadline = MPU6050Acquisition::nowNs() + uint64_t(timeoutMs > 0 ? timeoutMs : 0)*1000000ULL;
+
+    for(;;){
+        // While streaming, wake in time for the end of the quiet period even if the samples stop
+        uint64_t now = MPU6050Acquisition::nowNs();
+        int waitMs = timeoutMs < 0 ? -1 : msUntil(deadline, now);
+        if(streaming){
+            int quietMs = msUntil(lastMotionNs + quietNs, now);
+            waitMs = waitMs < 0 || quietMs < waitMs ? quietMs : waitMs;
+        }
+
+        struct pollfd event = {interrupt->getFd(), POLLIN, 0};
+        int ready = poll(&event, 1, waitMs);
+        if(ready < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            return MPU_MOTION_ERROR;
+        }
+        if(ready > 0 && !interrupt->acknowledge()){
+            return MPU_MOTION_ERROR;
+        }
+        now = MPU6050Acquisition::nowNs();
+
+        if(!streaming){
+            if(ready > 0){
+                // Only the motion interrupt is enabled, so this is a single byte read
+                int status = sensor->readInterruptStatus();
+                if(status < 0){
+                    return MPU_MOTION_ERROR;
+                }
+                if(status & MPU_INT_STATUS_MOT){
+                    if(!enterStreaming()){
+                        return MPU_MOTION_ERROR;
+                    }
+                    wakeCount++;
+                    return MPU_MOTION_DETECTED;
+                }
+            }
+        }
+        else if(now - lastMotionNs >= quietNs){
+            return enterIdle() ? MPU_MOTION_QUIET : MPU_MOTION_ERROR;
+        }
+        else if(ready > 0){
+            // The motion flag comes in the same transaction as the sample
+            int status;
+            if(!MPU6050Acquisition::readTimedSampleStatus(*sensor, sample, status)){
+                return MPU_MOTION_ERROR;
+            }
+            if(status & MPU_INT_STATUS_MOT){
+                lastMotionNs = sample.timestampNs;
+            }
+            if(status & MPU_INT_STATUS_DATA_RDY){
+                return MPU_MOTION_SAMPLE;
+            }
+        }
+
+        if(timeoutMs >= 0 && now >= deadline){
+            return MPU_MOTION_TIMEOUT;
+        }
+    }
+}
+
+bool MPU6050MotionMonitor::waitForMotion(int timeoutMs){
+    MPU6050TimedSample sample;
+    const uint64_t deadline = MPU6050Acquisition::nowNs() + uint64_t(timeoutMs > 0 ? timeoutMs : 0)*1000000ULL;
+
+    while(!streaming){
+        int remainingMs = timeoutMs < 0 ? -1 : msUntil(deadline, MPU6050Acquisition::nowNs());
+        int result = wait(sample, remainingMs);
+        if(result == MPU_MOTION_ERROR || result == MPU_MOTION_TIMEOUT){
+            return false;
+        }
+    }
+    return true;
+}
+
+int MPU6050MotionMonitor::getFd(){return interrupt->getFd();}
+
+int MPU6050MotionMonitor::getTimeoutMs(){
+    return streaming ? msUntil(lastMotionNs + quietNs, MPU6050Acquisition::nowNs()) : -1;
+}
+
+bool MPU6050MotionMonitor::isStreaming(){return streaming;}
+
+unsigned long MPU6050MotionMonitor::getWakeCount(){return wakeCount;}
+
+// Go to cycle mode, then clear any flags raised while streaming so the next event is new motion
+bool MPU6050MotionMonitor::enterIdle(){
+    streaming = false;
+    return sensor->setInterruptEnable(MPU_INT_ENABLE_MOT) && sensor->enterCycleMode(wakeRate) &&
+           sensor->readInterruptStatus() >= 0;
+}
+
+bool MPU6050MotionMonitor::enterStreaming(){
+    if(!sensor->wake() || !sensor->setInterruptEnable(MPU_INT_ENABLE_MOT | MPU_INT_ENABLE_DATA_RDY)){
+        return false;
+    }
+    streaming = true;
+    lastMotionNs = MPU6050Acquisition::nowNs();
+    return true;
+}
+// --------------------------------------------------------------------------------------------
@@ -0,0 +1,89 @@
+/* ============================================================================================
+ * MPU6050 Wake-on-Motion Header for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This header declares a monitor which keeps the MPU6050 in its low power cycle mode until
+ * something moves, streams at the full sample rate while it is moving, and drops back to low
+ * power once it has been still for a quiet period. While idle the device wakes itself at the
+ * wake-up rate to take one accelerometer sample, and only pulses the INT pin when the motion
+ * threshold is crossed, so the host sleeps in poll() and makes no bus transactions at all.
+ *
+ *     MPU6050GpioEventSource interrupt(0, 17);   // INT pin on GPIO 17
+ *     MPU6050MotionMonitor monitor(IMU, interrupt);
+ *     monitor.start();
+ *     while(monitor.waitForMotion(-1)){          // Blocks while idle
+ *         while(monitor.wait(sample, -1) == MPU_MOTION_SAMPLE){
+ *             ...                                 // Full rate until it has been still for the quiet period
+ *         }
+ *     }
+ *
+ * The INT pin is pulsed both for motion and, while streaming, for each new sample, so a single
+ * GPIO line serves both. While streaming the motion flag is read in the same transaction as
+ * each sample. The event source's file descriptor can be added to an existing epoll set
+ * instead: call wait() with a timeout of 0 when it is readable, and use getTimeoutMs() as the
+ * epoll timeout so the quiet period is noticed even if the samples stop. The monitor owns the
+ * device's power mode and interrupts while it is started.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include <stdint.h> // For fixed width types
+
+#include "MPU6050.h"
+#include "MPU6050Events.h"      // For MPU6050EventSource
+#include "MPU6050Acquisition.h" // For MPU6050TimedSample
+
+#ifndef MPU6050_MOTION_H
+#define MPU6050_MOTION_H
+
+// Results of MPU6050MotionMonitor::wait()
+#define MPU_MOTION_ERROR    -1 // A read or write failed, or poll() failed
+#define MPU_MOTION_TIMEOUT  0  // Nothing happened before the timeout
+#define MPU_MOTION_SAMPLE   1  // A new sample was read while streaming
+#define MPU_MOTION_DETECTED 2  // Motion woke the device and it is now streaming
+#define MPU_MOTION_QUIET    3  // The quiet period passed and the device is back in low power
+
+class MPU6050MotionMonitor{
+public:
+	// The sensor and source of its INT pin events must outlive the monitor. thresholdMg and duration are passed to
+	// MPU6050::enableMotionInterrupt(), and wakeRate is one of MPU_PWR_MGMT_WAKE_*. The full sample rate is whatever the
+	// sensor is set to. Exits with MPU_INIT_PARAM_ERROR if a parameter is invalid.
+	MPU6050MotionMonitor(MPU6050 &sensor, MPU6050EventSource &interrupt, int thresholdMg = MPU_MOTION_DEFAULT_THRESHOLD_MG,
+	                     int quietMs = MPU_MOTION_DEFAULT_QUIET_MS, int wakeRate = MPU_PWR_MGMT_WAKE_5HZ,
+	                     int duration = MPU_MOTION_DEFAULT_DURATION);
+
+	bool start(); // Program the motion detector and go to low power. Returns false on a write error.
+	bool stop();  // Return the device to full power with its interrupts off. Returns false on a write error.
+
+	// Wait up to timeoutMs (-1 waits forever) and handle the next event. Returns one of MPU_MOTION_*; sample is only
+	// written for MPU_MOTION_SAMPLE, stamped with the CLOCK_MONOTONIC time halfway through the read.
+	int wait(MPU6050TimedSample &sample, int timeoutMs);
+	// Block until motion is detected. Returns true straight away if already streaming, and false on a timeout or error.
+	// Must only be called while idle or when the samples are not wanted, as any streamed samples are discarded.
+	bool waitForMotion(int timeoutMs);
+
+	int getFd();           // File descriptor to add to an epoll set
+	int getTimeoutMs();    // Longest the caller may wait before calling wait() again, or -1 while idle
+	bool isStreaming();
+	unsigned long getWakeCount(); // Times motion has woken the device
+
+private:
+	MPU6050MotionMonitor(const MPU6050MotionMonitor& M);            // Only one monitor may own the device's power mode
+	MPU6050MotionMonitor& operator=(const MPU6050MotionMonitor& M);
+
+	bool enterIdle();      // Cycle mode with only the motion interrupt
+	bool enterStreaming(); // Full power with the motion and data ready interrupts
+
+	MPU6050 *sensor;
+	MPU6050EventSource *interrupt;
+	int thresholdMg;
+	int duration;
+	int wakeRate;
+	uint64_t quietNs;
+
+	bool streaming = false;
+	uint64_t lastMotionNs = 0; // CLOCK_MONOTONIC time motion was last seen while streaming
+	unsigned long wakeCount = 0;
+};
+
+#endif
@@ -0,0 +1,345 @@
+/* ============================================================================================
+ * MPU6050 Multi-Rate Pipeline Code for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This source code defines the pipeline and decimators. See MPU6050Pipeline.h for more
+ * information. The FIR taps are a sinc windowed with a Blackman window, as described at
+ * https://www.dspguide.com/ch16.htm. The CIC filter follows Hogenauer, "An Economical Class of
+ * Digital Filters for Decimation and Interpolation", 1981.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include "MPU6050Pipeline.h" // Include definitions and declarations within the header file
+#include <iostream>          // Used for error output
+#include <algorithm>         // For std::find()
+#include <string.h>          // For memcpy() and memmove()
+#include <math.h>            // For sin(), cos() and pow()
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MPU_PIPELINE_NEON
+#elif defined(__AVX__)
+#include <immintrin.h>
+#define MPU_PIPELINE_AVX
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define MPU_PIPELINE_SSE2
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Dot product of two float arrays
+static inline float dotProduct(const float *a, const float *b, int n){
+    int i = 0;
+    float sum = 0;
+#if defined(MPU_PIPELINE_NEON)
+    float32x4_t sum0 = vdupq_n_f32(0), sum1 = vdupq_n_f32(0);
+    for(; i + 8 <= n; i += 8){
+        sum0 = vmlaq_f32(sum0, vld1q_f32(a + i), vld1q_f32(b + i));
+        sum1 = vmlaq_f32(sum1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    float32x4_t total = vaddq_f32(sum0, sum1);
+    float32x2_t pairs = vadd_f32(vget_low_f32(total), vget_high_f32(total));
+    sum = vget_lane_f32(vpadd_f32(pairs, pairs), 0);
+#elif defined(MPU_PIPELINE_AVX)
+    __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+    for(; i + 16 <= n; i += 16){
+        sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+        sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+    }
+    __m256 total = _mm256_add_ps(sum0, sum1);
+    __m128 quad = _mm_add_ps(_mm256_castps256_ps128(total), _mm256_extractf128_ps(total, 1));
+    quad = _mm_add_ps(quad, _mm_movehl_ps(quad, quad));
+    sum = _mm_cvtss_f32(_mm_add_ss(quad, _mm_shuffle_ps(quad, quad, 1)));
+#elif defined(MPU_PIPELINE_SSE2)
+    __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+    for(; i + 8 <= n; i += 8){
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    __m128 quad = _mm_add_ps(sum0, sum1);
+    quad = _mm_add_ps(quad, _mm_movehl_ps(quad, quad));
+    sum = _mm_cvtss_f32(_mm_add_ss(quad, _mm_shuffle_ps(quad, quad, 1)));
+#endif
+    for(; i < n; i++){
+        sum += a[i]*b[i];
+    }
+    return sum;
+}
+
+// Channel arrays in a fixed order, so every channel can be handled by one loop
+static void channelPointers(const MPU6050SampleArrays &arrays, const float **pointers){
+    pointers[0] = arrays.gyroX;
+    pointers[1] = arrays.gyroY;
+    pointers[2] = arrays.gyroZ;
+    pointers[3] = arrays.accelX;
+    pointers[4] = arrays.accelY;
+    pointers[5] = arrays.accelZ;
+    pointers[6] = arrays.temperature;
+}
+
+static MPU6050SampleArrays channelArrays(float channels[MPU_CHANNEL_COUNT][MPU_PIPELINE_BLOCK]){
+    MPU6050SampleArrays arrays = {channels[0], channels[1], channels[2], channels[3], channels[4], channels[5], channels[6]};
+    return arrays;
+}
+
+static void removeSubscriber(std::vector<MPU6050Subscriber*> &subscribers, MPU6050Subscriber *subscriber){
+    std::vector<MPU6050Subscriber*>::iterator found = std::find(subscribers.begin(), subscribers.end(), subscriber);
+    if(found != subscribers.end()){
+        subscribers.erase(found);
+    }
+}
+
+// ----------------------------------------- Pipeline -----------------------------------------
+MPU6050Pipeline::MPU6050Pipeline(MPU6050 &sensor) : converter(sensor){
+    block.timestampsNs = timestamps;
+    block.samples = channelArrays(channels);
+    block.count = 0;
+}
+
+MPU6050Pipeline::MPU6050Pipeline(float gyroScale, float accelScale) : converter(gyroScale, accelScale){
+    block.timestampsNs = timestamps;
+    block.samples = channelArrays(channels);
+    block.count = 0;
+}
+
+void MPU6050Pipeline::subscribe(MPU6050Subscriber &subscriber){
+    subscribers.push_back(&subscriber);
+}
+
+void MPU6050Pipeline::unsubscribe(MPU6050Subscriber &subscriber){
+    removeSubscriber(subscribers, &subscriber);
+}
+
+// Convert one block at a time and give each block to every subscriber
+void MPU6050Pipeline::push(const MPU6050TimedSample *samples, int count){
+    while(count > 0){
+        int blockCount = count < MPU_PIPELINE_BLOCK ? count : MPU_PIPELINE_BLOCK;
+        for(int i = 0; i < blockCount; i++){
+            raw[i] = samples[i].raw;
+            timestamps[i] = samples[i].timestampNs;
+        }
+        converter.convert(raw, blockCount, block.samples);
+
+        block.count = blockCount;
+        for(size_t i = 0; i < subscribers.size(); i++){
+            subscribers[i]->receive(block);
+        }
+        samples += blockCount;
+        count -= blockCount;
+    }
+}
+
+int MPU6050Pipeline::drain(MPU6050Acquisition &acquisition){
+    MPU6050TimedSample samples[MPU_PIPELINE_BLOCK];
+    int total = 0;
+    int count;
+    while((count = acquisition.popBatch(samples, MPU_PIPELINE_BLOCK)) > 0){
+        push(samples, count);
+        total += count;
+    }
+    return total;
+}
+// --------------------------------------------------------------------------------------------
+
+// ---------------------------------------- Decimator -----------------------------------------
+MPU6050Decimator::MPU6050Decimator(int factor, int filterType, int length){
+    // Data Validation
+    bool valid = factor >= 1;
+    if(filterType == MPU_DECIMATE_CIC){
+        stages = length > 0 ? length : MPU_DECIMATE_CIC_STAGES;
+        double gain = pow(double(factor), stages);
+        valid = valid && stages <= MPU_DECIMATE_CIC_MAX_STAGES && gain < double(MPU_DECIMATE_CIC_MAX_GAIN);
+        cicScale = float(1.0/(gain*(1 << MPU_DECIMATE_CIC_FRACTION_BITS)));
+    }
+    else if(filterType == MPU_DECIMATE_FIR){
+        length = length > 0 ? length : MPU_DECIMATE_FIR_TAPS_PER_FACTOR*factor + 1;
+    }
+    else if(filterType == MPU_DECIMATE_MOVING_AVERAGE){
+        length = factor;
+    }
+    else{
+        valid = false;
+    }
+    if(!valid){
+        std::cout << std::endl << "MPU6050Decimator received an invalid parameter" << std::endl;
+        exit(MPU_INIT_PARAM_ERROR);
+    }
+    this->factor = factor;
+    this->filterType = filterType;
+
+    if(filterType != MPU_DECIMATE_CIC){
+        stages = 0;
+        taps.resize(length);
+        if(filterType == MPU_DECIMATE_MOVING_AVERAGE){
+            for(int i = 0; i < length; i++){
+                taps[i] = 1.0f/length;
+            }
+        }
+        else{
+            // Windowed sinc with the cutoff below the output Nyquist frequency, normalised to a gain of 1 at DC
+            double cutoff = MPU_DECIMATE_FIR_CUTOFF*0.5/factor; // In cycles per input sample
+            double centre = (length - 1)/2.0;
+            double total = 0;
+            for(int i = 0; i < length; i++){
+                double x = i - centre;
+                double sinc = x == 0 ? 2*cutoff : sin(2*M_PI*cutoff*x)/(M_PI*x);
+                double window = length > 1 ? 0.42 - 0.5*cos(2*M_PI*i/(length - 1)) + 0.08*cos(4*M_PI*i/(length - 1)) : 1;
+                taps[i] = float(sinc*window);
+                total += taps[i];
+            }
+            for(int i = 0; i < length; i++){
+                taps[i] = float(taps[i]/total);
+            }
+        }
+        std::reverse(taps.begin(), taps.end());
+
+        // Room for the history, a block, and the same again so that it is only compacted every few blocks
+        for(int channel = 0; channel < MPU_CHANNEL_COUNT; channel++){
+            history[channel].resize(2*(length - 1) + 2*MPU_PIPELINE_BLOCK);
+        }
+    }
+    reset();
+}
+
+void MPU6050Decimator::subscribe(MPU6050Subscriber &subscriber){
+    subscribers.push_back(&subscriber);
+}
+
+void MPU6050Decimator::unsubscribe(MPU6050Subscriber &subscriber){
+    removeSubscriber(subscribers, &subscriber);
+}
+
+void MPU6050Decimator::reset(){
+    phase = 0;
+    historyFilled = taps.empty() ? 0 : int(taps.size()) - 1; // Starts as zeros
+    for(int channel = 0; channel < MPU_CHANNEL_COUNT; channel++){
+        std::fill(history[channel].begin(), history[channel].end(), 0.0f);
+    }
+    memset(integrators, 0, sizeof(integrators));
+    memset(combs, 0, sizeof(combs));
+}
+
+int MPU6050Decimator::getFactor(){return factor;}
+
+double MPU6050Decimator::getDelaySamples(){
+    if(filterType == MPU_DECIMATE_CIC){
+        return stages*(factor - 1)/2.0;
+    }
+    return (taps.size() - 1)/2.0;
+}
+
+void MPU6050Decimator::receive(const MPU6050SampleBlock &block){
+    for(int start = 0; start < block.count; start += MPU_PIPELINE_BLOCK){
+        int count = block.count - start;
+        receiveChunk(block, start, count < MPU_PIPELINE_BLOCK ? count : MPU_PIPELINE_BLOCK);
+    }
+}
+
+// Filter a chunk and give any outputs to the subscribers
+void MPU6050Decimator::receiveChunk(const MPU6050SampleBlock &block, int start, int count){
+    const float *inputs[MPU_CHANNEL_COUNT];
+    channelPointers(block.samples, inputs);
+    for(int channel = 0; channel < MPU_CHANNEL_COUNT; channel++){
+        inputs[channel] += start;
+    }
+
+    int outputCount;
+    if(filterType == MPU_DECIMATE_CIC){
+        outputCount = filterCic(inputs, block.timestampsNs + start, count);
+    }
+    else{
+        outputCount = filterFir(inputs, block.timestampsNs + start, count);
+    }
+    if(outputCount == 0){
+        return;
+    }
+
+    MPU6050SampleBlock output;
+    output.timestampsNs = timestamps;
+    output.samples = channelArrays(outputs);
+    output.count = outputCount;
+    for(size_t i = 0; i < subscribers.size(); i++){
+        subscribers[i]->receive(output);
+    }
+}
+
+// Append the inputs to the history, then compute only the outputs which are kept
+int MPU6050Decimator::filterFir(const float *const *inputs, const uint64_t *inputTimestamps, int count){
+    int length = int(taps.size());
+    int capacity = int(history[0].size());
+
+    // Keep the last length - 1 inputs and make room for the new ones
+    if(historyFilled + count > capacity){
+        for(int channel = 0; channel < MPU_CHANNEL_COUNT; channel++){
+            memmove(&history[channel][0], &history[channel][historyFilled - (length - 1)], (length - 1)*sizeof(float));
+        }
+        historyFilled = length - 1;
+    }
+    for(int channel = 0; channel < MPU_CHANNEL_COUNT; channel++){
+        memcpy(&history[channel][historyFilled], inputs[channel], count*sizeof(float));
+    }
+
+    // The first output is at the input which completes the current phase
+    int outputCount = 0;
+    for(int i = factor - 1 - phase; i < count; i += factor){
+        int oldest = historyFilled + i - (length - 1); // First input in this output's window
+        for(int channel = 0; channel < MPU_CHANNEL_COUNT; channel++){
+            outputs[channel][outputCount] = dotProduct(&taps[0], &history[channel][oldest], length);
+        }
+        timestamps[outputCount++] = inputTimestamps[i];
+    }
+    phase = (phase + count) % factor;
+    historyFilled += count;
+    return outputCount;
+}
+
+// Integrate every input, and run the combs only for the outputs which are kept
+int MPU6050Decimator::filterCic(const float *const *inputs, const uint64_t *inputTimestamps, int count){
+    const float fixedPoint = float(1 << MPU_DECIMATE_CIC_FRACTION_BITS);
+    int first = factor - 1 - phase; // Input which completes the current phase
+    int outputCount = 0;
+
+    // Each channel's integrators stay in registers for the whole chunk
+    for(int channel = 0; channel < MPU_CHANNEL_COUNT; channel++){
+        uint64_t sums[MPU_DECIMATE_CIC_MAX_STAGES];
+        for(int stage = 0; stage < stages; stage++){
+            sums[stage] = integrators[stage][channel];
+        }
+
+        int next = first;
+        outputCount = 0;
+        for(int i = 0; i < count; i++){
+            uint64_t value = uint64_t(int64_t(inputs[channel][i]*fixedPoint));
+            for(int stage = 0; stage < stages; stage++){
+                sums[stage] += value;
+                value = sums[stage];
+            }
+            if(i != next){
+                continue;
+            }
+            next += factor;
+
+            for(int stage = 0; stage < stages; stage++){
+                uint64_t previous = combs[stage][channel];
+                combs[stage][channel] = value;
+                value -= previous;
+            }
+            outputs[channel][outputCount++] = float(int64_t(value))*cicScale;
+        }
+
+        for(int stage = 0; stage < stages; stage++){
+            integrators[stage][channel] = sums[stage];
+        }
+    }
+
+    for(int i = 0; i < outputCount; i++){
+        timestamps[i] = inputTimestamps[first + i*factor];
+    }
+    phase = (phase + count) % factor;
+    return outputCount;
+}
+// --------------------------------------------------------------------------------------------
@@ -0,0 +1,152 @@
+/* ============================================================================================
+ * MPU6050 Multi-Rate Pipeline Header for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This header declares a pipeline stage which takes one acquired stream and gives it to any
+ * number of subscribers at different rates, so adding a consumer adds no bus traffic. The
+ * pipeline converts blocks of timed raw samples into one float array per channel, as
+ * MPU6050Converter does, and passes each block to its subscribers. MPU6050Decimator is a
+ * subscriber which low-pass filters and decimates the block before passing it on to its own
+ * subscribers, so decimators can be chained:
+ *
+ *     MPU6050Pipeline pipeline(IMU);         // 1kHz from an acquisition engine or scheduler
+ *     MPU6050Decimator navigation(10);       // 100Hz
+ *     MPU6050Decimator telemetry(10);        // 10Hz, from the 100Hz stream
+ *     pipeline.subscribe(stabilisation);
+ *     pipeline.subscribe(navigation);
+ *     navigation.subscribe(navigationFilter);
+ *     navigation.subscribe(telemetry);
+ *     telemetry.subscribe(telemetryLink);
+ *     while(...) pipeline.drain(engine);
+ *
+ * Three filters are available:
+ *  - MPU_DECIMATE_FIR: a linear phase windowed-sinc low-pass. Only the outputs which are kept
+ *    are computed, which is the polyphase form of the filter, so the cost is the filter length
+ *    per output sample rather than per input sample. The dot products use NEON, AVX or SSE.
+ *  - MPU_DECIMATE_MOVING_AVERAGE: the mean of the factor samples since the last output.
+ *  - MPU_DECIMATE_CIC: a cascaded integrator-comb filter. Its cost is a few additions per
+ *    input whatever the factor, but its pass band droops. The integrators run at
+ *    the input rate in 64-bit fixed point, which wraps without any loss.
+ * Each output is stamped with the time of the newest input it includes. getDelaySamples()
+ * gives the filter's group delay in input samples, to correct this if needed.
+ * Subscribers are called on the thread which pushes samples into the pipeline.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include <stdint.h> // For fixed width types
+#include <vector>   // Used for the subscribers and filter state
+
+#include "MPU6050.h"
+#include "MPU6050Converter.h"
+#include "MPU6050Acquisition.h"
+
+#ifndef MPU6050_PIPELINE_H
+#define MPU6050_PIPELINE_H
+
+// Largest number of samples in a block given to a subscriber
+#define MPU_PIPELINE_BLOCK 64
+
+// Decimation filters
+#define MPU_DECIMATE_FIR            0
+#define MPU_DECIMATE_MOVING_AVERAGE 1
+#define MPU_DECIMATE_CIC            2
+
+// Default FIR length is this many taps per unit of the decimation factor, plus one
+#define MPU_DECIMATE_FIR_TAPS_PER_FACTOR 8
+// FIR cutoff as a fraction of the output Nyquist frequency
+#define MPU_DECIMATE_FIR_CUTOFF 0.8
+// Default and largest number of CIC stages
+#define MPU_DECIMATE_CIC_STAGES     3
+#define MPU_DECIMATE_CIC_MAX_STAGES 5
+// CIC inputs are converted to fixed point with this many fractional bits
+#define MPU_DECIMATE_CIC_FRACTION_BITS 16
+// Largest CIC gain - inputs up to 2^11 (2000°/s) with 16 fractional bits leave this much room in 63 bits
+#define MPU_DECIMATE_CIC_MAX_GAIN (1ULL << 35)
+
+// A block of samples in physical units, in the order they were read. The arrays are only valid during the call.
+struct MPU6050SampleBlock{
+	const uint64_t *timestampsNs;
+	MPU6050SampleArrays samples; // Every channel is present
+	int count;                   // At most MPU_PIPELINE_BLOCK
+};
+
+// Interface for anything which receives blocks from a pipeline or decimator
+class MPU6050Subscriber{
+public:
+	virtual ~MPU6050Subscriber(){}
+	virtual void receive(const MPU6050SampleBlock &block) = 0;
+};
+
+// Converts the acquired stream and passes it to the subscribers at the full rate
+class MPU6050Pipeline{
+public:
+	MPU6050Pipeline(MPU6050 &sensor);                    // Use the current scales of a sensor
+	MPU6050Pipeline(float gyroScale, float accelScale);  // Scales in LSB per unit, as MPU_GYRO_SCALE_* and MPU_ACC_SCALE_*
+
+	void subscribe(MPU6050Subscriber &subscriber); // The subscriber must outlive the pipeline or be unsubscribed
+	void unsubscribe(MPU6050Subscriber &subscriber);
+
+	void push(const MPU6050TimedSample *samples, int count); // Convert samples and pass them on in blocks
+	int drain(MPU6050Acquisition &acquisition);            // Push everything waiting in an engine's ring. Returns the number of samples.
+
+private:
+	MPU6050Pipeline(const MPU6050Pipeline& P);            // The block points into this object's working space
+	MPU6050Pipeline& operator=(const MPU6050Pipeline& P);
+
+	MPU6050Converter converter;
+	std::vector<MPU6050Subscriber*> subscribers;
+
+	// Working space for one block
+	MPU6050RawSample raw[MPU_PIPELINE_BLOCK];
+	uint64_t timestamps[MPU_PIPELINE_BLOCK];
+	float channels[MPU_CHANNEL_COUNT][MPU_PIPELINE_BLOCK];
+	MPU6050SampleBlock block;
+};
+
+// Low-pass filters and decimates a stream by an integer factor
+class MPU6050Decimator : public MPU6050Subscriber{
+public:
+	// length is the FIR length (default MPU_DECIMATE_FIR_TAPS_PER_FACTOR*factor + 1) or the number of CIC stages (default
+	// MPU_DECIMATE_CIC_STAGES), and is not used by the moving average. Exits with MPU_INIT_PARAM_ERROR if a parameter is invalid.
+	MPU6050Decimator(int factor, int filterType = MPU_DECIMATE_FIR, int length = 0);
+
+	void subscribe(MPU6050Subscriber &subscriber); // The subscriber must outlive the decimator or be unsubscribed
+	void unsubscribe(MPU6050Subscriber &subscriber);
+
+	void receive(const MPU6050SampleBlock &block);
+	void reset(); // Clear the filter history
+
+	int getFactor();
+	double getDelaySamples(); // Group delay in input samples
+
+private:
+	void receiveChunk(const MPU6050SampleBlock &block, int start, int count); // At most MPU_PIPELINE_BLOCK samples
+	// Each writes the outputs for count inputs and returns how many there are
+	int filterFir(const float *const *inputs, const uint64_t *inputTimestamps, int count);
+	int filterCic(const float *const *inputs, const uint64_t *inputTimestamps, int count);
+
+	int factor;
+	int filterType;
+	int phase; // Inputs since the last output
+	std::vector<MPU6050Subscriber*> subscribers;
+
+	// FIR and moving average state. Each channel's history holds the last taps - 1 inputs followed by the new ones, and
+	// is only compacted when full, so most blocks are appended without copying.
+	std::vector<float> taps; // Reversed, so each output is a dot product with the newest inputs
+	std::vector<float> history[MPU_CHANNEL_COUNT];
+	int historyFilled;
+
+	// CIC state, indexed by stage then channel. Unsigned arithmetic wraps, which the combs undo. The gain of factor^stages
+	// must stay below MPU_DECIMATE_CIC_MAX_GAIN so that no output overflows.
+	int stages;
+	uint64_t integrators[MPU_DECIMATE_CIC_MAX_STAGES][MPU_CHANNEL_COUNT];
+	uint64_t combs[MPU_DECIMATE_CIC_MAX_STAGES][MPU_CHANNEL_COUNT];
+	float cicScale; // Undoes the fixed point scaling and the filter gain
+
+	// Output for one chunk
+	uint64_t timestamps[MPU_PIPELINE_BLOCK];
+	float outputs[MPU_CHANNEL_COUNT][MPU_PIPELINE_BLOCK];
+};
+
+#endif
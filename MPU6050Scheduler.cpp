@@ -0,0 +1,181 @@
+/* ============================================================================================
+ * MPU6050 Sampling Scheduler Code for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This source code defines the sampling scheduler. See MPU6050Scheduler.h for more information.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include "MPU6050Scheduler.h" // Include definitions and declarations within the header file
+#include <errno.h>            // For EINTR
+#include <math.h>             // For sqrt()
+#include <pthread.h>          // For pthread_setschedparam() and pthread_setaffinity_np()
+#include <sched.h>            // For SCHED_FIFO and cpu_set_t
+#include <sys/mman.h>         // For mlockall()
+#include <time.h>             // For clock_nanosleep()
+
+// Sleep until an absolute CLOCK_MONOTONIC time in nanoseconds
+static void sleepUntil(uint64_t timeNs){
+    struct timespec deadline;
+    deadline.tv_sec = timeNs/1000000000ULL;
+    deadline.tv_nsec = timeNs%1000000000ULL;
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+}
+
+MPU6050Scheduler::MPU6050Scheduler(MPU6050 &sensor){
+    this->sensor = &sensor;
+    nominalPeriodNs = periodNs = 1e9/sensor.getSampleRate();
+    deadlineNs = MPU6050Acquisition::nowNs() + periodNs;
+    lastEdgeNs = 0;
+    samplesSinceEdge = 0;
+    resetStats();
+}
+
+// Program the sensor for the rate and restart the deadlines from now
+int MPU6050Scheduler::start(float rateHz, float bandwidthHz){
+    if(rateHz <= 0 || bandwidthHz < 0){
+        return MPU_INIT_PARAM_ERROR;
+    }
+    int dlpfConfig = MPU6050::dlpfForBandwidth(bandwidthHz > 0 ? bandwidthHz : rateHz/2);
+    if(!sensor->setSampleRate(rateHz, dlpfConfig)){
+        return I2C_SET_CONFIG;
+    }
+
+    nominalPeriodNs = periodNs = 1e9/sensor->getSampleRate();
+    deadlineNs = MPU6050Acquisition::nowNs() + periodNs;
+    lastEdgeNs = 0;
+    samplesSinceEdge = 0;
+    resetStats();
+    return CLEAN_EXIT;
+}
+
+bool MPU6050Scheduler::setRealtime(int priority, int cpu){
+    bool success = true;
+
+    struct sched_param parameters;
+    parameters.sched_priority = priority;
+    if(pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameters) != 0){
+        success = false;
+    }
+    if(cpu >= 0){
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        if(pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0){
+            success = false;
+        }
+    }
+    if(mlockall(MCL_CURRENT | MCL_FUTURE) != 0){
+        success = false;
+    }
+    return success;
+}
+
+bool MPU6050Scheduler::next(MPU6050TimedSample &sample){
+    uint64_t now = MPU6050Acquisition::nowNs();
+
+    // If the caller overran, skip the deadlines which have passed rather than reading a burst of samples to catch up
+    if(now >= deadlineNs + periodNs){
+        unsigned long skipped = (unsigned long)((now - deadlineNs)/periodNs);
+        deadlineNs += skipped*periodNs;
+        missedDeadlines += skipped;
+        lastEdgeNs = 0; // The number of sensor samples since the last edge is no longer known
+        samplesSinceEdge = 0;
+    }
+
+    // Only time the wake up if there was a sleep, so that a late caller is not counted as jitter
+    uint64_t deadline = uint64_t(deadlineNs);
+    if(now < deadline){
+        sleepUntil(deadline);
+        uint64_t latency = MPU6050Acquisition::nowNs() - deadline;
+        wakes++;
+        wakeLatencySum += latency;
+        wakeLatencySumSquares += double(latency)*latency;
+        if(latency > wakeLatencyMax){
+            wakeLatencyMax = latency;
+        }
+    }
+
+    // Compare the read with the sensor's sample to find which way to move the deadlines
+    double lateStep = nominalPeriodNs*MPU_SCHEDULER_LATE_STEP;
+    double earlyStep = lateStep/MPU_SCHEDULER_STEP_RATIO;
+    double correction = -earlyStep;
+    bool dataReady;
+    uint64_t firstRead = MPU6050Acquisition::nowNs();
+    bool success = MPU6050Acquisition::readTimedSample(*sensor, sample, dataReady);
+    samplesSinceEdge++;
+    if(success && !dataReady){
+        // Too early - the sample is due within about one step, so wait for it rather than returning the last one again
+        earlyReads++;
+        correction = lateStep;
+        uint64_t secondRead = MPU6050Acquisition::nowNs() + uint64_t(lateStep);
+        sleepUntil(secondRead);
+        success = MPU6050Acquisition::readTimedSample(*sensor, sample, dataReady);
+        if(success && dataReady){
+            // The sensor's sample arrived between the two reads. Dividing the time since the last one found like this by
+            // the samples in between measures the sensor's period on the Pi's clock.
+            double edgeNs = firstRead + (secondRead - firstRead)/2.0;
+            if(lastEdgeNs > 0){
+                double measured = (edgeNs - lastEdgeNs)/samplesSinceEdge;
+                periodNs += (measured - periodNs)*MPU_SCHEDULER_PERIOD_GAIN;
+            }
+            lastEdgeNs = edgeNs;
+        }
+        else{
+            repeatedSamples += success;
+            lastEdgeNs = 0;
+        }
+        samplesSinceEdge = 0;
+    }
+    else if(samplesSinceEdge > 2*MPU_SCHEDULER_STEP_RATIO){
+        // Every read has been after the sample for longer than the small steps explain, so the sensor is faster
+        periodNs -= earlyStep*MPU_SCHEDULER_PERIOD_GAIN;
+    }
+
+    // Stay within the tolerance of the sensor's oscillator
+    if(periodNs > nominalPeriodNs*(1 + MPU_SCHEDULER_MAX_DRIFT)){
+        periodNs = nominalPeriodNs*(1 + MPU_SCHEDULER_MAX_DRIFT);
+    }
+    else if(periodNs < nominalPeriodNs*(1 - MPU_SCHEDULER_MAX_DRIFT)){
+        periodNs = nominalPeriodNs*(1 - MPU_SCHEDULER_MAX_DRIFT);
+    }
+    deadlineNs += periodNs + (success ? correction : 0);
+
+    if(!success){
+        readErrors++;
+        return false;
+    }
+    samples++;
+    return true;
+}
+
+void MPU6050Scheduler::getStats(MPU6050SchedulerStats &stats){
+    stats.samples = samples;
+    stats.missedDeadlines = missedDeadlines;
+    stats.earlyReads = earlyReads;
+    stats.repeatedSamples = repeatedSamples;
+    stats.readErrors = readErrors;
+
+    stats.wakeLatencyMeanNs = wakes > 0 ? wakeLatencySum/wakes : 0;
+    double variance = wakes > 0 ? wakeLatencySumSquares/wakes - stats.wakeLatencyMeanNs*stats.wakeLatencyMeanNs : 0;
+    stats.wakeLatencyJitterNs = variance > 0 ? sqrt(variance) : 0;
+    stats.wakeLatencyMaxNs = wakeLatencyMax;
+
+    stats.sensorRateHz = 1e9/periodNs;
+    stats.driftPpm = (nominalPeriodNs/periodNs - 1)*1e6;
+}
+
+void MPU6050Scheduler::resetStats(){
+    samples = 0;
+    missedDeadlines = 0;
+    earlyReads = 0;
+    repeatedSamples = 0;
+    readErrors = 0;
+    wakes = 0;
+    wakeLatencySum = 0;
+    wakeLatencySumSquares = 0;
+    wakeLatencyMax = 0;
+}
+
+long MPU6050Scheduler::getPeriodNs(){return long(periodNs);}
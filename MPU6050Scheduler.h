@@ -0,0 +1,105 @@
+/* ============================================================================================
+ * MPU6050 Sampling Scheduler Header for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This header declares a scheduler which paces a control loop from the sensor's own output
+ * rate. start() programs SMPLRT_DIV and the DLPF, then each call to next() sleeps until an
+ * absolute clock_nanosleep() deadline and reads one sample, so time spent in the loop does not
+ * add to the period.
+ *
+ * The MPU6050 samples from its own oscillator, which can be a percent or more away from the
+ * Pi's clock, so a fixed host period slowly slides past the sensor's samples - every so often
+ * a sample is read twice or skipped. To prevent this each read includes INT_STATUS, whose
+ * DATA_RDY flag says whether the sensor has produced a sample since the last read. Reading
+ * before the sample moves the following deadlines later by a large step, and reading after it
+ * moves them earlier by a small one, so the reads settle just after each new sample. An early
+ * read is repeated one step later, which also pins down when the sensor's sample arrived. The
+ * time between two of these, divided by the samples in between, measures the sensor's period
+ * on the Pi's clock, and the deadlines follow that period.
+ *
+ * For the lowest jitter, call setRealtime() from the control loop thread to run it under
+ * SCHED_FIFO on its own CPU with its memory locked. This needs root or CAP_SYS_NICE. Adding
+ * isolcpus=<cpu> to /boot/cmdline.txt keeps other tasks off that CPU.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include <stdint.h> // For fixed width types
+
+#include "MPU6050.h"
+#include "MPU6050Acquisition.h" // For MPU6050TimedSample
+
+#ifndef MPU6050_SCHEDULER_H
+#define MPU6050_SCHEDULER_H
+
+// Fraction of the period the deadlines move later by after reading before the sensor's sample
+#define MPU_SCHEDULER_LATE_STEP 0.02
+// The step earlier after reading a new sample is this many times smaller, so about 1 read in this many is early
+#define MPU_SCHEDULER_STEP_RATIO 64
+// Fraction of each period measurement applied - this sets how quickly the period follows the sensor's clock
+#define MPU_SCHEDULER_PERIOD_GAIN 0.25
+// Largest difference allowed between the sensor's and the Pi's clocks, as a fraction of the period
+#define MPU_SCHEDULER_MAX_DRIFT 0.05
+
+// Snapshot of the scheduler's counters and clock estimate
+struct MPU6050SchedulerStats{
+	unsigned long samples;          // Samples returned by next()
+	unsigned long missedDeadlines;  // Periods skipped because next() was called after the following deadline
+	unsigned long earlyReads;       // Reads made before the sensor had a new sample, which were read again
+	unsigned long repeatedSamples;  // Samples returned without the sensor having a new one, even after reading again
+	unsigned long readErrors;       // Failed reads - see the MPU6050 object's error counts for details
+	double wakeLatencyMeanNs;       // Time from each deadline to waking up
+	double wakeLatencyJitterNs;     // Standard deviation of the above
+	uint64_t wakeLatencyMaxNs;
+	double sensorRateHz;            // The sensor's output rate measured against CLOCK_MONOTONIC
+	double driftPpm;                // How much faster the sensor's clock runs than the Pi's, in parts per million
+};
+
+class MPU6050Scheduler{
+public:
+	// The sensor must not be used elsewhere while the scheduler is in use. Until start() is called, the rate already set
+	// on the sensor is used and the first deadline is one period after construction.
+	MPU6050Scheduler(MPU6050 &sensor);
+
+	// Program the output rate and DLPF and set the first deadline one period from now. A bandwidthHz of 0 picks the
+	// widest bandwidth below the Nyquist frequency. Returns CLEAN_EXIT, MPU_INIT_PARAM_ERROR or I2C_SET_CONFIG.
+	int start(float rateHz, float bandwidthHz = 0);
+
+	// Run the calling thread under SCHED_FIFO at priority (1-99), pinned to cpu unless it is -1, and lock the process's
+	// memory so page faults can't delay it. Returns false if any of these were refused.
+	static bool setRealtime(int priority, int cpu = -1);
+
+	// Sleep until the next deadline and read a sample stamped with CLOCK_MONOTONIC. Returns false on a read error - the
+	// deadline still passes, so call again to carry on.
+	bool next(MPU6050TimedSample &sample);
+
+	void getStats(MPU6050SchedulerStats &stats);
+	void resetStats();   // Resets the counters, not the clock estimate
+	long getPeriodNs();  // Current period, following the sensor's clock
+
+private:
+	MPU6050Scheduler(const MPU6050Scheduler& S);            // A copy would double the reads
+	MPU6050Scheduler& operator=(const MPU6050Scheduler& S);
+
+	MPU6050 *sensor;
+
+	// Deadlines, in CLOCK_MONOTONIC nanoseconds. This is a double so fractions of a nanosecond in the period add up.
+	double deadlineNs;
+	double periodNs;        // Tracks the sensor's period
+	double nominalPeriodNs; // Period the sensor was programmed with
+	double lastEdgeNs;      // When the last early read found the sensor's sample arriving, or 0 if unknown
+	unsigned long samplesSinceEdge;
+
+	// Counters
+	unsigned long samples;
+	unsigned long missedDeadlines;
+	unsigned long earlyReads;
+	unsigned long repeatedSamples;
+	unsigned long readErrors;
+	unsigned long wakes;    // Deadlines which were slept until
+	double wakeLatencySum;
+	double wakeLatencySumSquares;
+	uint64_t wakeLatencyMax;
+};
+
+#endif
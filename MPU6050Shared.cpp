@@ -0,0 +1,287 @@
+/* ============================================================================================
+ * MPU6050 Shared Memory Code for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This source code defines the shared memory publisher and reader. See MPU6050Shared.h for more
+ * information. The seqlock follows Boehm, "Can Seqlocks Get Along With Programming Language
+ * Memory Models?", 2012.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include "MPU6050Shared.h" // Include definitions and declarations within the header file
+#include <iostream>        // Used for error output
+#include <string.h>        // For strncpy() and memset()
+#include <sys/mman.h>      // For shm_open() and mmap()
+#include <sys/stat.h>      // For fstat()
+#include <fcntl.h>         // For O_* constants
+#include <unistd.h>        // For ftruncate() and close()
+
+// The slots start on a cache line after the header
+static size_t slotsOffset(){
+    return (sizeof(MPU6050SharedHeader) + MPU_CACHE_LINE_SIZE - 1)/MPU_CACHE_LINE_SIZE*MPU_CACHE_LINE_SIZE;
+}
+
+// ---------------------------------------- Publisher -----------------------------------------
+MPU6050Publisher::MPU6050Publisher(MPU6050 &sensor, const char *name, int capacity){
+    this->sensor = &sensor;
+    strncpy(this->name, name, sizeof(this->name) - 1);
+    this->name[sizeof(this->name) - 1] = 0;
+
+    // Round up to a power of 2 so the indices can be wrapped with a mask
+    uint32_t slotCount = 1;
+    while(slotCount < (uint32_t)capacity){
+        slotCount <<= 1;
+    }
+    mask = slotCount - 1;
+    size = slotsOffset() + slotCount*sizeof(MPU6050SharedSlot);
+
+    // Start from a new segment, so readers of an old one are not confused by a different layout
+    shm_unlink(this->name);
+    int fd = shm_open(this->name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if(fd < 0){
+        std::cout << std::endl << "Couldn't create the shared memory segment " << this->name << "." << std::endl;
+        exit(SHM_SETUP_ERROR);
+    }
+    if(ftruncate(fd, size) != 0){
+        std::cout << std::endl << "Couldn't size the shared memory segment " << this->name << "." << std::endl;
+        close(fd);
+        shm_unlink(this->name); // Don't leave an empty segment for readers to find
+        exit(SHM_SETUP_ERROR);
+    }
+    void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // The mapping keeps the segment open
+    if(mapping == MAP_FAILED){
+        std::cout << std::endl << "Couldn't map the shared memory segment " << this->name << "." << std::endl;
+        shm_unlink(this->name);
+        exit(SHM_SETUP_ERROR);
+    }
+
+    // The new segment is zeroed, so every sequence number starts at 0
+    header = (MPU6050SharedHeader*)mapping;
+    slots = (MPU6050SharedSlot*)((char*)mapping + slotsOffset());
+    header->version = MPU_SHARED_VERSION;
+    header->capacity = slotCount;
+    header->gyroScale = sensor.getGyroScale();
+    header->accelScale = sensor.getAccelScale();
+    header->publishing.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release); // Readers check the magic number before anything else
+    header->magic = MPU_SHARED_MAGIC;
+}
+
+MPU6050Publisher::~MPU6050Publisher(){
+    header->publishing.store(0, std::memory_order_release);
+    munmap(header, size);
+    shm_unlink(name);
+}
+
+bool MPU6050Publisher::update(){
+    MPU6050TimedSample sample;
+    if(!MPU6050Acquisition::readTimedSample(*sensor, sample)){
+        return false;
+    }
+    publish(sample);
+    return true;
+}
+
+void MPU6050Publisher::publish(const MPU6050TimedSample &sample){
+    // Write the ring slot, marking it as being written first
+    uint64_t index = header->head.load(std::memory_order_relaxed);
+    MPU6050SharedSlot &slot = slots[index & mask];
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release); // Keep the sample writes after the mark
+    slot.sample = sample;
+    slot.sequence.store(index + 1, std::memory_order_release);
+    header->head.store(index + 1, std::memory_order_release);
+
+    // Then the latest sample, with the sequence number odd while it is written
+    uint32_t sequence = header->latestSequence.load(std::memory_order_relaxed);
+    header->latestSequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    header->latest = sample;
+    header->latestSequence.store(sequence + 2, std::memory_order_release);
+}
+
+void MPU6050Publisher::publishBatch(const MPU6050TimedSample *samples, int count){
+    for(int i = 0; i < count; i++){
+        publish(samples[i]);
+    }
+}
+
+int MPU6050Publisher::drain(MPU6050Acquisition &acquisition){
+    MPU6050TimedSample samples[64];
+    int total = 0;
+    int count;
+    while((count = acquisition.popBatch(samples, 64)) > 0){
+        publishBatch(samples, count);
+        total += count;
+    }
+    return total;
+}
+// --------------------------------------------------------------------------------------------
+
+// ------------------------------------------ Reader ------------------------------------------
+MPU6050SharedReader::MPU6050SharedReader(const char *name){
+    if(attach(name) != CLEAN_EXIT){
+        std::cout << std::endl << "Couldn't attach to the shared memory segment " << name << ". Is the publisher running?" << std::endl;
+        exit(SHM_SETUP_ERROR);
+    }
+}
+
+MPU6050SharedReader::MPU6050SharedReader(const char *name, int &status){
+    status = attach(name);
+}
+
+MPU6050SharedReader::~MPU6050SharedReader(){
+    if(header != NULL){
+        munmap((void*)header, size);
+    }
+}
+
+// Map the segment read-only and check its layout
+int MPU6050SharedReader::attach(const char *name){
+    header = NULL;
+    slots = NULL;
+    size = 0;
+    mask = 0;
+    cursor = 0;
+    started = false;
+    lostSamples = 0;
+    lastSequence = 0;
+    timestampNs = 0;
+    memset(&latest, 0, sizeof(latest));
+    gyroReciprocal = accelReciprocal = 0;
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    if(fd < 0){
+        return SHM_SETUP_ERROR;
+    }
+    struct stat info;
+    if(fstat(fd, &info) != 0 || size_t(info.st_size) < slotsOffset()){
+        close(fd);
+        return SHM_SETUP_ERROR;
+    }
+    void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED){
+        return SHM_SETUP_ERROR;
+    }
+    header = (const MPU6050SharedHeader*)mapping;
+    size = info.st_size;
+
+    // Pairs with the publisher's release fence: once the magic number is seen, the rest of the header is complete
+    uint32_t magic = header->magic;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(magic != MPU_SHARED_MAGIC || header->version != MPU_SHARED_VERSION ||
+       slotsOffset() + header->capacity*sizeof(MPU6050SharedSlot) > size){
+        munmap(mapping, size);
+        header = NULL;
+        return SHM_SETUP_ERROR;
+    }
+    slots = (const MPU6050SharedSlot*)((const char*)mapping + slotsOffset());
+    mask = header->capacity - 1;
+    gyroReciprocal = 1.0f/header->gyroScale;
+    accelReciprocal = 1.0f/header->accelScale;
+    return CLEAN_EXIT;
+}
+
+bool MPU6050SharedReader::getLatest(MPU6050TimedSample &sample){
+    for(int attempt = 0; attempt < MPU_SHARED_READ_RETRIES; attempt++){
+        uint32_t before = header->latestSequence.load(std::memory_order_acquire);
+        if(before & 1){
+            continue; // Being written
+        }
+        sample = header->latest;
+        std::atomic_thread_fence(std::memory_order_acquire); // Keep the copy before the second check
+        if(header->latestSequence.load(std::memory_order_relaxed) == before){
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MPU6050SharedReader::update(){
+    uint32_t sequence = header->latestSequence.load(std::memory_order_acquire);
+    if(sequence == lastSequence){
+        return false; // Nothing new, so there is nothing to copy
+    }
+    MPU6050TimedSample sample;
+    if(!getLatest(sample)){
+        return false;
+    }
+    lastSequence = sequence;
+    timestampNs = sample.timestampNs;
+    convertSample(sample.raw, latest);
+    return true;
+}
+
+float MPU6050SharedReader::getGyroX(){return latest.gyroX;}
+float MPU6050SharedReader::getGyroY(){return latest.gyroY;}
+float MPU6050SharedReader::getGyroZ(){return latest.gyroZ;}
+float MPU6050SharedReader::getAccelX(){return latest.accelX;}
+float MPU6050SharedReader::getAccelY(){return latest.accelY;}
+float MPU6050SharedReader::getAccelZ(){return latest.accelZ;}
+float MPU6050SharedReader::getTemp(){return latest.temperature;}
+uint64_t MPU6050SharedReader::getTimestampNs(){return timestampNs;}
+
+bool MPU6050SharedReader::pop(MPU6050TimedSample &sample){
+    uint64_t head = header->head.load(std::memory_order_acquire);
+    if(!started){
+        cursor = head > 0 ? head - 1 : 0; // Start from the newest sample
+        started = true;
+    }
+
+    while(cursor < head){
+        // Skip anything the publisher has already overwritten
+        if(head - cursor > mask + 1){
+            lostSamples += head - (mask + 1) - cursor;
+            cursor = head - (mask + 1);
+        }
+
+        const MPU6050SharedSlot &slot = slots[cursor & mask];
+        uint64_t before = slot.sequence.load(std::memory_order_acquire);
+        if(before == cursor + 1){
+            sample = slot.sample;
+            std::atomic_thread_fence(std::memory_order_acquire); // Keep the copy before the second check
+            if(slot.sequence.load(std::memory_order_relaxed) == before){
+                cursor++;
+                return true;
+            }
+        }
+
+        // The publisher lapped this reader while it was copying
+        lostSamples++;
+        cursor++;
+        head = header->head.load(std::memory_order_acquire);
+    }
+    return false;
+}
+
+int MPU6050SharedReader::popBatch(MPU6050TimedSample *samples, int maxSamples){
+    int count = 0;
+    while(count < maxSamples && pop(samples[count])){
+        count++;
+    }
+    return count;
+}
+
+unsigned long MPU6050SharedReader::getLostSamples(){return lostSamples;}
+
+void MPU6050SharedReader::convertSample(const MPU6050RawSample &raw, MPU6050Sample &sample){
+    sample.gyroX = float(raw.gyroX)*gyroReciprocal;
+    sample.gyroY = float(raw.gyroY)*gyroReciprocal;
+    sample.gyroZ = float(raw.gyroZ)*gyroReciprocal;
+    sample.accelX = float(raw.accelX)*accelReciprocal;
+    sample.accelY = float(raw.accelY)*accelReciprocal;
+    sample.accelZ = float(raw.accelZ)*accelReciprocal;
+    sample.temperature = float(raw.temperature)*(1.0f/MPU_TEMP_SCALE) + float(MPU_TEMP_OFFSET);
+}
+
+float MPU6050SharedReader::getGyroScale(){return header->gyroScale;}
+
+float MPU6050SharedReader::getAccelScale(){return header->accelScale;}
+
+bool MPU6050SharedReader::isPublishing(){
+    return header->publishing.load(std::memory_order_acquire) != 0;
+}
+// --------------------------------------------------------------------------------------------
@@ -0,0 +1,146 @@
+/* ============================================================================================
+ * MPU6050 Shared Memory Header for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This header declares a publisher which writes samples into a POSIX shared memory segment,
+ * and a reader which other processes use to get them without touching the I2C bus. One
+ * process owns the sensor and publishes; any number of readers attach by name.
+ *
+ * The segment holds the latest sample behind a seqlock, and a ring of recent samples. The
+ * publisher never waits for readers: the seqlock's sequence number is odd while the sample is
+ * being written, and a reader copies the sample and then checks that the sequence number did
+ * not change. Each ring slot carries the index of the sample in it, in the same way, so every
+ * reader keeps its own position and can tell when the publisher has lapped it and samples have
+ * been lost. Readers map the segment read-only and reading takes no syscalls or locks.
+ * Link with -lrt on systems with glibc older than 2.34.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include <atomic>   // Used for the sequence numbers
+#include <stdint.h> // For fixed width types
+
+#include "MPU6050.h"
+#include "MPU6050Acquisition.h" // For MPU6050TimedSample
+
+#ifndef MPU6050_SHARED_H
+#define MPU6050_SHARED_H
+
+// Default segment name - segments appear in /dev/shm
+#define MPU_SHARED_DEFAULT_NAME "/mpu6050"
+
+// Default number of samples in the ring. This must be a power of 2.
+#define MPU_SHARED_DEFAULT_CAPACITY 1024
+
+// Identifies the segment and its layout
+#define MPU_SHARED_MAGIC   0x4D505536 // "MPU6"
+#define MPU_SHARED_VERSION 1
+
+// Times a reader retries the latest sample while the publisher is writing it
+#define MPU_SHARED_READ_RETRIES 100
+
+// The atomics are shared between processes, which only works if they are lock free - a lock would live in each process
+// rather than in the segment. Targets without 64 bit atomic instructions, such as ARMv6, cannot use the segment, so CMake
+// only builds it as mpu6050_shared where these hold.
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "MPU6050Shared needs lock free 64 bit atomics");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "MPU6050Shared needs lock free 32 bit atomics");
+
+// One ring slot
+struct MPU6050SharedSlot{
+	std::atomic<uint64_t> sequence; // Index of the sample plus 1, or 0 while it is being written
+	MPU6050TimedSample sample;
+};
+
+// Start of the segment. The ring slots follow it.
+struct MPU6050SharedHeader{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t capacity;       // Slots in the ring
+	float gyroScale;         // Used by readers to convert the raw samples
+	float accelScale;
+	std::atomic<uint32_t> publishing; // Cleared when the publisher closes
+
+	// Latest sample, behind a seqlock
+	alignas(MPU_CACHE_LINE_SIZE) std::atomic<uint32_t> latestSequence; // Odd while the sample is being written
+	MPU6050TimedSample latest;
+
+	// Number of samples ever written to the ring
+	alignas(MPU_CACHE_LINE_SIZE) std::atomic<uint64_t> head;
+};
+
+// Owns the segment and writes samples into it
+class MPU6050Publisher{
+public:
+	// Create the segment, replacing any left by an earlier publisher. Exits with SHM_SETUP_ERROR on failure.
+	MPU6050Publisher(MPU6050 &sensor, const char *name = MPU_SHARED_DEFAULT_NAME, int capacity = MPU_SHARED_DEFAULT_CAPACITY);
+	~MPU6050Publisher(); // Marks the segment closed and removes its name. Attached readers keep their mapping.
+
+	bool update();                                     // Read a sample from the sensor and publish it. Returns false on a read error.
+	void publish(const MPU6050TimedSample &sample);   // Publish a sample read elsewhere
+	void publishBatch(const MPU6050TimedSample *samples, int count);
+	int drain(MPU6050Acquisition &acquisition);      // Publish everything waiting in an engine's ring. Returns the number of samples.
+
+private:
+	MPU6050Publisher(const MPU6050Publisher& P);            // The segment cannot be shared
+	MPU6050Publisher& operator=(const MPU6050Publisher& P);
+
+	MPU6050 *sensor;
+	char name[64];
+	MPU6050SharedHeader *header;
+	MPU6050SharedSlot *slots;
+	size_t size;
+	uint64_t mask; // capacity - 1
+};
+
+// Reads a segment written by a publisher in another process. Nothing here touches the I2C bus.
+class MPU6050SharedReader{
+public:
+	MPU6050SharedReader(const char *name = MPU_SHARED_DEFAULT_NAME);  // Exits with SHM_SETUP_ERROR if there is no valid segment
+	MPU6050SharedReader(const char *name, int &status);              // As above, setting status to CLEAN_EXIT or SHM_SETUP_ERROR instead
+	~MPU6050SharedReader();
+
+	// Copy the latest sample for the getters below. Returns true if it is newer than the last one copied.
+	bool update();
+	float getGyroX();
+	float getGyroY();
+	float getGyroZ();
+	float getAccelX();
+	float getAccelY();
+	float getAccelZ();
+	float getTemp();
+	uint64_t getTimestampNs(); // CLOCK_MONOTONIC time of the latest sample copied
+	bool getLatest(MPU6050TimedSample &sample); // Copy the latest raw sample. Returns false if it couldn't be read consistently.
+
+	// Take samples from the ring, oldest first. The first call starts from the newest sample published before it.
+	bool pop(MPU6050TimedSample &sample);
+	int popBatch(MPU6050TimedSample *samples, int maxSamples);
+	unsigned long getLostSamples(); // Samples overwritten before this reader took them
+
+	void convertSample(const MPU6050RawSample &raw, MPU6050Sample &sample); // Scale with the publisher's configuration
+	float getGyroScale();
+	float getAccelScale();
+	bool isPublishing(); // False once the publisher has closed the segment
+
+private:
+	MPU6050SharedReader(const MPU6050SharedReader& R);            // Each reader keeps its own position
+	MPU6050SharedReader& operator=(const MPU6050SharedReader& R);
+
+	int attach(const char *name); // Returns CLEAN_EXIT or SHM_SETUP_ERROR
+
+	const MPU6050SharedHeader *header;
+	const MPU6050SharedSlot *slots;
+	size_t size;
+	uint64_t mask;
+	uint64_t cursor;       // Index of the next sample to pop
+	bool started;          // False until the first pop sets the cursor
+	unsigned long lostSamples;
+
+	// Latest sample copied by update()
+	uint32_t lastSequence;
+	uint64_t timestampNs;
+	MPU6050Sample latest;
+	float gyroReciprocal;
+	float accelReciprocal;
+};
+
+#endif
@@ -0,0 +1,181 @@
+/* ============================================================================================
+ * MPU6050 Timestamping Code for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This source code defines the timestamper which lines the sensor's samples up with the host
+ * clock. See MPU6050Timestamp.h for more information.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include "MPU6050Timestamp.h" // Include definitions and declarations within the header file
+#include <iostream>           // Used for error output
+#include <math.h>             // For exp() and fabs()
+
+// ---------------------------------------- Timestamper ---------------------------------------
+MPU6050Timestamper::MPU6050Timestamper(MPU6050 &sensor, int timeConstantSamples){
+    // Data Validation
+    if(timeConstantSamples < MPU_TIMESTAMP_MIN_SPAN){
+        std::cout << std::endl << "MPU6050Timestamper received an invalid parameter" << std::endl;
+        exit(MPU_INIT_PARAM_ERROR);
+    }
+
+    this->sensor = &sensor;
+    timeConstant = timeConstantSamples;
+    reset();
+}
+
+uint64_t MPU6050Timestamper::nowNs(){
+    return MPU6050Acquisition::nowNs(CLOCK_MONOTONIC_RAW);
+}
+
+int MPU6050Timestamper::readFifo(MPU6050TimedSample *samples, int maxSamples, bool &overflow){
+    MPU6050RawSample raw[MPU_FIFO_MAX_FRAMES];
+    MPU6050FifoTiming timing;
+
+    if(maxSamples > MPU_FIFO_MAX_FRAMES){
+        maxSamples = MPU_FIFO_MAX_FRAMES;
+    }
+    int count = sensor->readFifoRawAux(raw, NULL, maxSamples, overflow, &timing);
+    if(count < 0 || overflow){
+        // Samples have been lost or a failed read may have popped some, so the count can't be trusted
+        restart();
+        restarts++;
+        return count;
+    }
+    if(count == 0){
+        return 0;
+    }
+
+    // The newest frame counted, which may not have been read if maxSamples was reached, was written by the count's read
+    observe(sampleCount + timing.framesWaiting - 1, timing.countTimeNs);
+    measureClockOffset();
+    for(int i = 0; i < count; i++){
+        samples[i].raw = raw[i];
+        samples[i].timestampNs = stamp(sampleCount + i);
+    }
+    sampleCount += count;
+    return count;
+}
+
+bool MPU6050Timestamper::read(MPU6050TimedSample &sample){
+    // The registers are latched as the burst begins, so a sample written later in a long burst is not in it. The start
+    // of the read is the time which matters, not the midpoint.
+    bool dataReady;
+    uint64_t readNs = nowNs();
+    if(!sensor->readRawSample(sample.raw, dataReady)){
+        return false;
+    }
+
+    if(!started){
+        sampleCount = 1;
+        observe(0, readNs);
+    }
+    else if(dataReady){
+        // Every sample due by the time of the read has been written, and there is at least one new one
+        double sinceNewest = double(int64_t(readNs - baseNs)) - (offsetNs + periodNs*double(sampleCount - 1));
+        uint64_t newSamples = sinceNewest >= 2*periodNs ? uint64_t(sinceNewest/periodNs) : 1;
+        sampleCount += newSamples;
+        observe(sampleCount - 1, readNs);
+    }
+    measureClockOffset();
+    sample.timestampNs = stamp(sampleCount - 1);
+    return true;
+}
+
+void MPU6050Timestamper::restart(){
+    started = false;
+    sampleCount = 0;
+    offsetNs = 0;
+    weight = meanX = meanY = varianceX = covarianceXY = 0;
+    firstX = lastX = 0;
+    envelopeCount = envelopeNext = 0;
+    observations = 0;
+}
+
+void MPU6050Timestamper::reset(){
+    nominalPeriodNs = periodNs = 1e9/sensor->getSampleRate();
+    restart();
+}
+
+void MPU6050Timestamper::getStats(MPU6050TimestampStats &stats){
+    stats.sensorRateHz = 1e9/periodNs;
+    stats.driftPpm = (nominalPeriodNs/periodNs - 1)*1e6;
+    double latencySum = 0;
+    for(int i = 0; i < envelopeCount; i++){
+        latencySum += envelopeY[i] - (offsetNs + periodNs*envelopeX[i]);
+    }
+    stats.readLatencyNs = envelopeCount > 0 ? latencySum/envelopeCount : 0;
+    stats.observations = observations;
+    stats.restarts = restarts;
+}
+
+double MPU6050Timestamper::getPeriodNs(){return periodNs;}
+
+// Add a read to the fit and the envelope
+void MPU6050Timestamper::observe(uint64_t index, uint64_t hostNs){
+    if(!started){
+        baseNs = hostNs;
+        started = true;
+    }
+    double x = double(index);
+    double y = double(int64_t(hostNs - baseNs));
+
+    // Weighted mean and covariance, updated in place. Earlier reads fade by one time constant per that many samples.
+    double fade = observations > 0 ? exp(-(x - lastX)/timeConstant) : 0;
+    weight = weight*fade + 1;
+    double dx = x - meanX;
+    meanX += dx/weight;
+    meanY += (y - meanY)/weight;
+    varianceX = varianceX*fade + dx*(x - meanX);
+    covarianceXY = covarianceXY*fade + dx*(y - meanY);
+    if(observations == 0){
+        firstX = x;
+    }
+    lastX = x;
+    observations++;
+
+    // Until the reads cover enough samples the slope is mostly bus jitter, so the previous period is kept
+    if(x - firstX >= MPU_TIMESTAMP_MIN_SPAN && varianceX > 0){
+        double slope = covarianceXY/varianceX;
+        if(fabs(slope/nominalPeriodNs - 1) <= MPU_TIMESTAMP_MAX_DRIFT){
+            periodNs = slope;
+        }
+    }
+
+    envelopeX[envelopeNext] = x;
+    envelopeY[envelopeNext] = y;
+    envelopeNext = (envelopeNext + 1) % MPU_TIMESTAMP_ENVELOPE;
+    if(envelopeCount < MPU_TIMESTAMP_ENVELOPE){
+        envelopeCount++;
+    }
+
+    // No read can find a sample before it is written, so the earliest line through any recent read is the closest
+    offsetNs = envelopeY[0] - periodNs*envelopeX[0];
+    for(int i = 1; i < envelopeCount; i++){
+        double offset = envelopeY[i] - periodNs*envelopeX[i];
+        if(offset < offsetNs){
+            offsetNs = offset;
+        }
+    }
+}
+
+// The line is fitted on CLOCK_MONOTONIC_RAW. NTP slews CLOCK_MONOTONIC against it, so the offset is taken at each read.
+uint64_t MPU6050Timestamper::stamp(uint64_t index){
+    double timeNs = offsetNs + periodNs*double(index);
+    uint64_t stampNs = baseNs + int64_t(timeNs) + monotonicOffsetNs;
+    if(stampNs < lastStampNs){
+        stampNs = lastStampNs;
+    }
+    lastStampNs = stampNs;
+    return stampNs;
+}
+
+// Read CLOCK_MONOTONIC between two reads of CLOCK_MONOTONIC_RAW, and compare it with their midpoint
+void MPU6050Timestamper::measureClockOffset(){
+    uint64_t rawBefore = nowNs();
+    uint64_t monotonicNs = MPU6050Acquisition::nowNs();
+    uint64_t rawAfter = nowNs();
+    monotonicOffsetNs = int64_t(monotonicNs - (rawBefore + (rawAfter - rawBefore)/2));
+}
+// --------------------------------------------------------------------------------------------
@@ -0,0 +1,121 @@
+/* ============================================================================================
+ * MPU6050 Timestamping Header for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This header declares a timestamper which gives each sample the host time the sensor wrote
+ * it, rather than the time a read happened to find it. Stamping a sample when its read
+ * completes adds the whole I2C latency and scheduling delay to it, and a FIFO batch read in
+ * one transaction has only one such time for every sample in it.
+ *
+ * The MPU6050 writes its samples at a steady rate from its own oscillator, so sample n is
+ * written at offset + n*period on the host clock. The timestamper counts the samples and
+ * estimates the two terms from the reads it makes anyway, with no extra bus traffic:
+ *  - Each FIFO read notes when FIFO_COUNT was read. Every frame counted had been written by
+ *    then, so the newest one was written at or before that time. For single reads, the data
+ *    ready flag read with each sample says whether the sensor has written a new one.
+ *  - The period, and so the drift of the sensor's oscillator against the host, is the slope
+ *    of a least squares fit of these read times against the sample count. Old reads fade out
+ *    over a time constant given in samples, so the fit follows the oscillator as it warms up.
+ *  - Every read is late by some delay which is never negative, so the offset is taken from
+ *    the lower envelope of recent reads - the one which found its sample soonest - rather
+ *    than their mean.
+ * Samples are then stamped from the fitted line, so their spacing is the sensor's own and
+ * bus jitter does not reach them. Stamps never go backwards. The fit uses CLOCK_MONOTONIC_RAW,
+ * which NTP does not slew, so it sees only the two oscillators. The stamps are converted to
+ * CLOCK_MONOTONIC, as every other MPU6050TimedSample is, with the offset between the two
+ * clocks measured at each read. Use either readFifo() or read() with one timestamper, not both.
+ *
+ *     MPU6050Timestamper timestamper(IMU);    // After setting the rate and enabling the FIFO
+ *     int n = timestamper.readFifo(samples, MPU_FIFO_MAX_FRAMES, overflow);
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include <stdint.h> // For fixed width types
+
+#include "MPU6050.h"
+#include "MPU6050Acquisition.h" // For MPU6050TimedSample
+
+#ifndef MPU6050_TIMESTAMP_H
+#define MPU6050_TIMESTAMP_H
+
+// Samples over which old reads fade out of the period fit
+#define MPU_TIMESTAMP_DEFAULT_TIME_CONSTANT 10000
+// Samples the reads must cover before the fitted period replaces the programmed one
+#define MPU_TIMESTAMP_MIN_SPAN 1000
+// Number of recent reads whose lower envelope sets the offset
+#define MPU_TIMESTAMP_ENVELOPE 64
+// Largest difference allowed between the sensor's and the host's clocks, as a fraction of the period
+#define MPU_TIMESTAMP_MAX_DRIFT 0.05
+
+// Snapshot of the timestamper's clock estimate
+struct MPU6050TimestampStats{
+	double sensorRateHz;     // The sensor's output rate measured against CLOCK_MONOTONIC_RAW
+	double driftPpm;         // How much faster the sensor's clock runs than its programmed rate, in parts per million
+	double readLatencyNs;    // Mean time from a sample being written to a read finding it, over the recent reads
+	unsigned long observations; // Reads used in the fit since the last restart
+	unsigned long restarts;     // Times the sample count was lost, on a FIFO overflow or read error
+};
+
+class MPU6050Timestamper{
+public:
+	// The sensor must not be read elsewhere while it is being timestamped. Its programmed rate is the starting period.
+	MPU6050Timestamper(MPU6050 &sensor, int timeConstantSamples = MPU_TIMESTAMP_DEFAULT_TIME_CONSTANT);
+
+	static uint64_t nowNs(); // CLOCK_MONOTONIC_RAW time in nanoseconds, as used by the fit
+
+	// Read up to maxSamples FIFO frames as readFifoRaw() does, stamping each with the CLOCK_MONOTONIC time it was written. Returns the number
+	// of samples, or -1 on a read error. After an overflow or error the sample count is lost, so the offset is found
+	// again from the following reads.
+	int readFifo(MPU6050TimedSample *samples, int maxSamples, bool &overflow);
+	// Burst read the latest sample and stamp it with when it was written. Returns false on a read error. The samples
+	// written since the last read are counted from the estimated period, so read at least once every few periods.
+	bool read(MPU6050TimedSample &sample);
+
+	void restart(); // Forget the sample count and offset, but keep the period. Call after resetting the FIFO.
+	void reset();   // Restart from the rate now programmed on the sensor. Call after changing the rate.
+
+	void getStats(MPU6050TimestampStats &stats);
+	double getPeriodNs(); // Current period, following the sensor's clock
+
+private:
+	MPU6050Timestamper(const MPU6050Timestamper& T);            // A copy would lose track of the sample count
+	MPU6050Timestamper& operator=(const MPU6050Timestamper& T);
+
+	void observe(uint64_t index, uint64_t hostNs); // Sample index had been written by hostNs
+	uint64_t stamp(uint64_t index);                // CLOCK_MONOTONIC time of a sample from the fitted line
+	void measureClockOffset();                     // Update monotonicOffsetNs
+
+	MPU6050 *sensor;
+	double timeConstant;
+	double nominalPeriodNs; // Period the sensor was programmed with
+	double periodNs;        // Tracks the sensor's period
+
+	// Samples are counted from the first read after a restart, and host times are relative to that read
+	bool started = false;
+	uint64_t baseNs = 0;
+	uint64_t sampleCount = 0; // Index of the next sample the sensor will write, as far as the reads have seen
+	double offsetNs = 0;      // When sample 0 was written, relative to baseNs
+	int64_t monotonicOffsetNs = 0; // CLOCK_MONOTONIC minus CLOCK_MONOTONIC_RAW at the last read
+	uint64_t lastStampNs = 0;      // Last CLOCK_MONOTONIC stamp given
+
+	// Exponentially weighted least squares of read time against sample index
+	double weight = 0;
+	double meanX = 0;
+	double meanY = 0;
+	double varianceX = 0;
+	double covarianceXY = 0;
+	double firstX = 0;
+	double lastX = 0;
+
+	// Recent reads, for the lower envelope
+	double envelopeX[MPU_TIMESTAMP_ENVELOPE];
+	double envelopeY[MPU_TIMESTAMP_ENVELOPE];
+	int envelopeCount = 0;
+	int envelopeNext = 0;
+
+	unsigned long observations = 0;
+	unsigned long restarts = 0;
+};
+
+#endif
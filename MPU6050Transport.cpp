@@ -0,0 +1,739 @@
+/* ============================================================================================
+ * MPU6050 Bus Transport Code for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This source code defines the transports the MPU6050 class uses to access the device
+ * registers. See MPU6050Transport.h for more information.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include "MPU6050Transport.h" // Include definitions and declarations within the header file
+#include "MPU6050Config.h"    // For the register fields
+#include <iostream>           // Used for error output
+#include <stdio.h>            // For snprintf()
+#include <string.h>           // For memset() and memcpy()
+#include <time.h>             // For clock_gettime()
+
+// Used for the I2C interface
+#include <linux/i2c-dev.h> // For I2C_RDWR and I2C_SLAVE
+#include <sys/ioctl.h>     // For ioctl()
+#include <fcntl.h>         // For O_RDWR
+#include <unistd.h>        // For open(), close() and dup2()
+
+// Bytes on the bus for each type of transaction, including address and register bytes
+#define BUS_BYTES_READ_REGISTER  4 // Address and register bytes, repeated start address byte, then one data byte
+#define BUS_BYTES_WRITE_REGISTER 3 // Address and register bytes, then one data byte
+#define BUS_BYTES_READ_BLOCK     3 // As for a register read, plus the data
+#define BUS_BYTES_WRITE_BLOCK    2 // As for a register write, plus the data
+
+// Longest block write supported by the I2C transport
+#define MAX_WRITE_BLOCK_LENGTH 32
+
+// SMBus command through the ioctl, as the helpers are only in the old libi2c-dev header (newer libi2c moved them to
+// <i2c/smbus.h>). size is I2C_SMBUS_BYTE_DATA or I2C_SMBUS_I2C_BLOCK_DATA. The handle must already be bound to the
+// device with I2C_SLAVE.
+static __s32 smbusAccess(int i2cHandle, char readWrite, __u8 command, int size, union i2c_smbus_data *data){
+    struct i2c_smbus_ioctl_data arguments;
+    arguments.read_write = readWrite;
+    arguments.command = command;
+    arguments.size = size;
+    arguments.data = data;
+    return ioctl(i2cHandle, I2C_SMBUS, &arguments);
+}
+
+// --------------------------------------- Transport ------------------------------------------
+MPU6050Transport::MPU6050Transport(){
+    resetCounters();
+}
+
+__s32 MPU6050Transport::reopen(){return 0;}
+
+unsigned long MPU6050Transport::getTransactions(){return transactions;}
+
+unsigned long MPU6050Transport::getBytes(){return bytes;}
+
+void MPU6050Transport::resetCounters(){
+    transactions = 0;
+    bytes = 0;
+}
+
+void MPU6050Transport::countTransaction(unsigned long bytesOnBus){
+    transactions++;
+    bytes += bytesOnBus;
+}
+// --------------------------------------------------------------------------------------------
+
+// ---------------------------------------- I2C Bus -------------------------------------------
+// Buses shared through acquire(), and the lock for the list and their reference counts
+static MPU6050I2CBus *sharedBuses = NULL;
+static std::mutex sharedBusesLock;
+
+// Open the user-space I2C interface without selecting a device
+MPU6050I2CBus::MPU6050I2CBus(int busNumber){
+    if(openHandle(busNumber) != CLEAN_EXIT){
+        std::cout << std::endl << "Couldn't open the I2C Bus. Please ensure the I2C interface is enabled and that the correct Pi rev version is selected." << std::endl;
+        exit(I2C_BUS_INIT_ERROR);
+    }
+}
+
+// As above, but the error is returned in status rather than exiting
+MPU6050I2CBus::MPU6050I2CBus(int busNumber, int &status){
+    status = openHandle(busNumber);
+}
+
+// Destructor - close the I2C handle to end transmissions
+MPU6050I2CBus::~MPU6050I2CBus(){
+    if(i2cHandle >= 0){
+        close(i2cHandle);
+    }
+}
+
+// Find the bus in the shared list, or open it and add it
+MPU6050I2CBus* MPU6050I2CBus::acquire(int busNumber, int &status){
+    std::lock_guard<std::mutex> lock(sharedBusesLock);
+    for(MPU6050I2CBus *bus = sharedBuses; bus != NULL; bus = bus->next){
+        if(bus->busNumber == busNumber){
+            bus->references++;
+            status = CLEAN_EXIT;
+            return bus;
+        }
+    }
+
+    MPU6050I2CBus *bus = new MPU6050I2CBus(busNumber, status);
+    if(status != CLEAN_EXIT){
+        delete bus;
+        return NULL;
+    }
+    bus->references = 1;
+    bus->next = sharedBuses;
+    sharedBuses = bus;
+    return bus;
+}
+
+// Drop a reference, closing the bus and removing it from the list with the last one
+void MPU6050I2CBus::release(){
+    std::lock_guard<std::mutex> lock(sharedBusesLock);
+    if(--references > 0){
+        return;
+    }
+    for(MPU6050I2CBus **link = &sharedBuses; *link != NULL; link = &(*link)->next){
+        if(*link == this){
+            *link = next;
+            break;
+        }
+    }
+    delete this;
+}
+
+// Run a set of messages, each with its own address, in one transaction
+__s32 MPU6050I2CBus::transfer(struct i2c_msg *messages, int count){
+    struct i2c_rdwr_ioctl_data transferData;
+    transferData.msgs = messages;
+    transferData.nmsgs = count;
+    return ioctl(i2cHandle, I2C_RDWR, &transferData);
+}
+
+// Bind the handle to the device if another device used it last, then read one register. The lock stops another thread
+// binding the handle to its own device in between.
+__s32 MPU6050I2CBus::smbusReadByte(int deviceAddress, __u8 deviceRegister){
+    union i2c_smbus_data data;
+    std::lock_guard<std::mutex> lock(smbusLock);
+    if(bindLocked(deviceAddress) < 0){
+        return -1;
+    }
+    if(smbusAccess(i2cHandle, I2C_SMBUS_READ, deviceRegister, I2C_SMBUS_BYTE_DATA, &data) < 0){
+        return -1;
+    }
+    return data.byte;
+}
+
+__s32 MPU6050I2CBus::smbusWriteByte(int deviceAddress, __u8 deviceRegister, __u8 value){
+    union i2c_smbus_data data;
+    data.byte = value;
+    std::lock_guard<std::mutex> lock(smbusLock);
+    if(bindLocked(deviceAddress) < 0){
+        return -1;
+    }
+    return smbusAccess(i2cHandle, I2C_SMBUS_WRITE, deviceRegister, I2C_SMBUS_BYTE_DATA, &data) < 0 ? -1 : 0;
+}
+
+// The length goes in the first byte of the block, followed by the data
+__s32 MPU6050I2CBus::smbusReadBlock(int deviceAddress, __u8 startRegister, __u8 *buffer, int length){
+    union i2c_smbus_data data;
+    if(length < 1 || length > I2C_SMBUS_BLOCK_MAX){
+        return -1;
+    }
+    data.block[0] = length;
+    std::lock_guard<std::mutex> lock(smbusLock);
+    if(bindLocked(deviceAddress) < 0 || smbusAccess(i2cHandle, I2C_SMBUS_READ, startRegister, I2C_SMBUS_I2C_BLOCK_DATA, &data) < 0){
+        return -1;
+    }
+    if(data.block[0] != length){
+        return -1;
+    }
+    memcpy(buffer, &data.block[1], length);
+    return length;
+}
+
+__s32 MPU6050I2CBus::smbusWriteBlock(int deviceAddress, __u8 startRegister, const __u8 *buffer, int length){
+    union i2c_smbus_data data;
+    if(length < 1 || length > I2C_SMBUS_BLOCK_MAX){
+        return -1;
+    }
+    data.block[0] = length;
+    memcpy(&data.block[1], buffer, length);
+    std::lock_guard<std::mutex> lock(smbusLock);
+    if(bindLocked(deviceAddress) < 0){
+        return -1;
+    }
+    return smbusAccess(i2cHandle, I2C_SMBUS_WRITE, startRegister, I2C_SMBUS_I2C_BLOCK_DATA, &data) < 0 ? -1 : 0;
+}
+
+__s32 MPU6050I2CBus::bindDevice(int deviceAddress){
+    std::lock_guard<std::mutex> lock(smbusLock);
+    boundAddress = -1; // Always ask again, so that an address in use is reported
+    return bindLocked(deviceAddress);
+}
+
+__s32 MPU6050I2CBus::bindLocked(int deviceAddress){
+    if(boundAddress != deviceAddress){
+        if(ioctl(i2cHandle, I2C_SLAVE, deviceAddress) < 0){
+            boundAddress = -1;
+            return -1;
+        }
+        boundAddress = deviceAddress;
+    }
+    return 0;
+}
+
+bool MPU6050I2CBus::supports(unsigned long functionality){
+    return (functions & functionality) == functionality;
+}
+
+// Adapters which report plain I2C can take I2C_RDWR. Those with only the SMBus byte commands must use them instead.
+bool MPU6050I2CBus::isSmbusOnly(){
+    return !(functions & I2C_FUNC_I2C) && (functions & I2C_FUNC_SMBUS_BYTE_DATA) == I2C_FUNC_SMBUS_BYTE_DATA;
+}
+
+// Open the interface again and move the new handle onto the old number with dup2(), which closes the old one atomically.
+// This clears any error state held by the adapter driver without another thread ever seeing a closed handle.
+__s32 MPU6050I2CBus::reopen(){
+    int newHandle = open(fileName, O_RDWR);
+    if(newHandle < 0){
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(smbusLock); // The new handle is not bound to any device
+    boundAddress = -1;
+    if(i2cHandle < 0){
+        i2cHandle = newHandle;
+        return 0;
+    }
+    int result = dup2(newHandle, i2cHandle);
+    close(newHandle);
+    return result < 0 ? -1 : 0;
+}
+
+int MPU6050I2CBus::getHandle(){return i2cHandle;}
+
+int MPU6050I2CBus::getBusNumber(){return busNumber;}
+
+const char* MPU6050I2CBus::getName(){return fileName;}
+
+// Open /dev/i2c-<busNumber>. Returns CLEAN_EXIT or I2C_BUS_INIT_ERROR.
+int MPU6050I2CBus::openHandle(int busNumber){
+    this->busNumber = busNumber;
+
+    // Get the user-space I2C interface
+    snprintf(fileName, sizeof(fileName), "/dev/i2c-%d", busNumber);
+    functions = 0;
+
+    // Initialise the I2C interface
+    i2cHandle = open(fileName, O_RDWR);
+    if(i2cHandle < 0){
+        return I2C_BUS_INIT_ERROR;
+    }
+
+    // Find out whether the adapter can take I2C_RDWR. If it can't say, assume it can as most adapters do.
+    if(ioctl(i2cHandle, I2C_FUNCS, &functions) < 0){
+        functions = I2C_FUNC_I2C;
+    }
+    return CLEAN_EXIT;
+}
+// --------------------------------------------------------------------------------------------
+
+// ------------------------------------- I2C Transport ----------------------------------------
+// Share the bus with any other devices on it and check the device's address
+MPU6050I2CTransport::MPU6050I2CTransport(int busNumber, int deviceAddress){
+    switch(openBus(busNumber, deviceAddress)){
+    case I2C_BUS_INIT_ERROR:
+        std::cout << std::endl << "Couldn't open the I2C Bus. Please ensure the I2C interface is enabled and that the correct Pi rev version is selected." << std::endl;
+        exit(I2C_BUS_INIT_ERROR);
+    case I2C_SET_SLAVE_ADDR_ERR:
+        std::cout << std::endl << "The I2C Device couldn't be assigned a slave address." << std::endl;
+        exit(I2C_SET_SLAVE_ADDR_ERR);
+    }
+}
+
+// As above, but the error is returned in status rather than exiting
+MPU6050I2CTransport::MPU6050I2CTransport(int busNumber, int deviceAddress, int &status){
+    status = openBus(busNumber, deviceAddress);
+}
+
+// Use a bus owned by the caller
+MPU6050I2CTransport::MPU6050I2CTransport(MPU6050I2CBus &bus, int deviceAddress){
+    address = deviceAddress;
+    this->bus = &bus;
+    acquiredBus = false;
+}
+
+// Destructor - give the bus back, which closes it if no other device is using it
+MPU6050I2CTransport::~MPU6050I2CTransport(){
+    if(acquiredBus){
+        bus->release();
+    }
+}
+
+// Single registers are read and written as one byte blocks, which is one transaction each. SMBus-only adapters use the
+// SMBus byte commands, which the bus binds to this device first.
+__s32 MPU6050I2CTransport::readRegister(__u8 deviceRegister){
+    if(bus->isSmbusOnly()){
+        countTransaction(BUS_BYTES_READ_REGISTER);
+        return bus->smbusReadByte(address, deviceRegister);
+    }
+    __u8 value;
+    return readBlock(deviceRegister, &value, 1) == 1 ? value : -1;
+}
+
+__s32 MPU6050I2CTransport::writeRegister(__u8 deviceRegister, __u8 value){
+    if(bus->isSmbusOnly()){
+        countTransaction(BUS_BYTES_WRITE_REGISTER);
+        return bus->smbusWriteByte(address, deviceRegister, value);
+    }
+    return writeBlock(deviceRegister, &value, 1);
+}
+
+// Read a block of any length. The SMBus block read is limited to 32 bytes, so this uses I2C_RDWR to write the
+// start register and read the data back in one combined transaction.
+__s32 MPU6050I2CTransport::readBlock(__u8 startRegister, __u8 *buffer, int length){
+    struct i2c_msg messages[2];
+
+    if(bus->isSmbusOnly()){
+        return smbusReadBlock(startRegister, buffer, length);
+    }
+
+    // Write the register to start reading from
+    messages[0].addr = address;
+    messages[0].flags = 0;
+    messages[0].len = 1;
+    messages[0].buf = &startRegister;
+
+    // Then read the data back after a repeated start
+    messages[1].addr = address;
+    messages[1].flags = I2C_M_RD;
+    messages[1].len = length;
+    messages[1].buf = buffer;
+
+    countTransaction(BUS_BYTES_READ_BLOCK + length);
+    if(bus->transfer(messages, 2) < 0){
+        return -1;
+    }
+    return length;
+}
+
+// Write a block of consecutive registers in one transaction
+__s32 MPU6050I2CTransport::writeBlock(__u8 startRegister, const __u8 *buffer, int length){
+    __u8 data[MAX_WRITE_BLOCK_LENGTH + 1]; // The start register followed by the data
+    struct i2c_msg message;
+
+    if(length > MAX_WRITE_BLOCK_LENGTH){
+        return -1;
+    }
+    if(bus->isSmbusOnly()){
+        return smbusWriteBlock(startRegister, buffer, length);
+    }
+    data[0] = startRegister;
+    memcpy(&data[1], buffer, length);
+
+    message.addr = address;
+    message.flags = 0;
+    message.len = length + 1;
+    message.buf = data;
+
+    countTransaction(BUS_BYTES_WRITE_BLOCK + length);
+    if(bus->transfer(&message, 1) < 0){
+        return -1;
+    }
+    return 0;
+}
+
+const char* MPU6050I2CTransport::getName(){return bus->getName();}
+
+int MPU6050I2CTransport::getAddress(){return address;}
+
+// Reopen the bus, which clears any error state held by the adapter driver
+__s32 MPU6050I2CTransport::reopen(){
+    return bus->reopen();
+}
+
+void MPU6050I2CTransport::countBatchedRead(int length){
+    countTransaction(BUS_BYTES_READ_BLOCK + length);
+}
+
+// Split the block into I2C block reads, or single register reads if the adapter can't do those. Only the bytes within
+// one read are from the same moment, so a 14 byte sample burst still comes from one sample.
+__s32 MPU6050I2CTransport::smbusReadBlock(__u8 startRegister, __u8 *buffer, int length){
+    bool blocks = bus->supports(I2C_FUNC_SMBUS_READ_I2C_BLOCK);
+    int step = blocks ? I2C_SMBUS_BLOCK_MAX : 1;
+    for(int done = 0; done < length; done += step){
+        int chunk = length - done < step ? length - done : step;
+        __u8 deviceRegister = startRegister == MPU_FIFO_R_W ? startRegister : startRegister + done;
+        __s32 result;
+        if(blocks){
+            countTransaction(BUS_BYTES_READ_BLOCK + chunk);
+            result = bus->smbusReadBlock(address, deviceRegister, &buffer[done], chunk);
+        }
+        else{
+            countTransaction(BUS_BYTES_READ_REGISTER);
+            result = bus->smbusReadByte(address, deviceRegister);
+            if(result >= 0){
+                buffer[done] = __u8(result);
+            }
+        }
+        if(result < 0){
+            return -1;
+        }
+    }
+    return length;
+}
+
+// As above, for writes
+__s32 MPU6050I2CTransport::smbusWriteBlock(__u8 startRegister, const __u8 *buffer, int length){
+    bool blocks = bus->supports(I2C_FUNC_SMBUS_WRITE_I2C_BLOCK);
+    int step = blocks ? I2C_SMBUS_BLOCK_MAX : 1;
+    for(int done = 0; done < length; done += step){
+        int chunk = length - done < step ? length - done : step;
+        __u8 deviceRegister = startRegister == MPU_FIFO_R_W ? startRegister : startRegister + done;
+        __s32 result;
+        if(blocks){
+            countTransaction(BUS_BYTES_WRITE_BLOCK + chunk);
+            result = bus->smbusWriteBlock(address, deviceRegister, &buffer[done], chunk);
+        }
+        else{
+            countTransaction(BUS_BYTES_WRITE_REGISTER);
+            result = bus->smbusWriteByte(address, deviceRegister, buffer[done]);
+        }
+        if(result < 0){
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Acquire the shared bus, and check that no kernel driver has claimed the device's address. Returns CLEAN_EXIT or the
+// exit code for the error.
+int MPU6050I2CTransport::openBus(int busNumber, int deviceAddress){
+    int status;
+    address = deviceAddress;
+    acquiredBus = false;
+    bus = MPU6050I2CBus::acquire(busNumber, status);
+    if(bus == NULL){
+        return status;
+    }
+    acquiredBus = true;
+
+    // I2C_SLAVE fails if the address is in use. It binds the handle to the address, which I2C_RDWR ignores. The SMBus
+    // commands rebind the handle to their own device when it changes.
+    if(bus->bindDevice(address) < 0){
+        bus->release();
+        bus = NULL;
+        acquiredBus = false;
+        return I2C_SET_SLAVE_ADDR_ERR;
+    }
+    return CLEAN_EXIT;
+}
+// --------------------------------------------------------------------------------------------
+
+// ---------------------------------- Simulated Transport -------------------------------------
+// Start with the register values the device has after a reset
+MPU6050SimulatedTransport::MPU6050SimulatedTransport(int deviceAddress){
+    address = deviceAddress;
+    memset(registers, 0, sizeof(registers));
+    registers[MPU_PWR_MGMT_1] = MPU_PWR_MGMT_1_RESET_VALUE;
+    registers[MPU_WHO_AM_I] = MPU_WHO_AM_I_VALUE;
+
+    fifoHead = 0;
+    fifoCount = 0;
+    memset(sensorValues, 0, sizeof(sensorValues));
+    motionSamples = 0;
+
+    latencyTransactionNs = 0;
+    latencyByteNs = 0;
+    pendingErrors = 0;
+    errorInterval = 0;
+    transactionNumber = 0;
+}
+
+__s32 MPU6050SimulatedTransport::readRegister(__u8 deviceRegister){
+    if(!beginTransaction(BUS_BYTES_READ_REGISTER) || deviceRegister >= MPU_SIM_REGISTER_COUNT){
+        return -1;
+    }
+    return readInternal(deviceRegister);
+}
+
+__s32 MPU6050SimulatedTransport::writeRegister(__u8 deviceRegister, __u8 value){
+    if(!beginTransaction(BUS_BYTES_WRITE_REGISTER) || deviceRegister >= MPU_SIM_REGISTER_COUNT){
+        return -1;
+    }
+    writeInternal(deviceRegister, value);
+    return 0;
+}
+
+// Burst reads auto-increment through the registers, except that FIFO_R_W is read repeatedly
+__s32 MPU6050SimulatedTransport::readBlock(__u8 startRegister, __u8 *buffer, int length){
+    if(!beginTransaction(BUS_BYTES_READ_BLOCK + length) || startRegister + (startRegister == MPU_FIFO_R_W ? 0 : length - 1) >= MPU_SIM_REGISTER_COUNT){
+        return -1;
+    }
+    for(int i = 0; i < length; i++){
+        buffer[i] = readInternal(startRegister == MPU_FIFO_R_W ? startRegister : startRegister + i);
+    }
+    return length;
+}
+
+__s32 MPU6050SimulatedTransport::writeBlock(__u8 startRegister, const __u8 *buffer, int length){
+    if(!beginTransaction(BUS_BYTES_WRITE_BLOCK + length) || startRegister + length - 1 >= MPU_SIM_REGISTER_COUNT){
+        return -1;
+    }
+    for(int i = 0; i < length; i++){
+        writeInternal(startRegister + i, buffer[i]);
+    }
+    return 0;
+}
+
+const char* MPU6050SimulatedTransport::getName(){return "simulated";}
+
+int MPU6050SimulatedTransport::getAddress(){return address;}
+
+// Produce a new sample as the device would at its sample rate
+void MPU6050SimulatedTransport::generateSample(int16_t accelX, int16_t accelY, int16_t accelZ, int16_t temperature,
+                                               int16_t gyroX, int16_t gyroY, int16_t gyroZ){
+    const int16_t channels[] = {accelX, accelY, accelZ, temperature, gyroX, gyroY, gyroZ};
+
+    // Motion detection, with the change since the last sample standing in for the high-pass filter
+    if(registers[MPU_INT_ENABLE] & MPU_INT_ENABLE_MOT){
+        const long lsbPerG = MPU_ACC_SCALE_2 >> MPU_FIELD_AFS_SEL.decode(registers[MPU_ACC_CONFIG]);
+        const long thresholdMg = long(registers[MPU_MOT_THR])*MPU_MOT_THR_SCALE;
+        bool moving = false;
+        for(int axis = 0; axis < 3; axis++){
+            long change = long(channels[axis]) - sensorValues[axis];
+            moving = moving || (change < 0 ? -change : change)*1000 > thresholdMg*lsbPerG;
+        }
+        motionSamples = moving ? motionSamples + 1 : 0;
+        if(moving && motionSamples >= registers[MPU_MOT_DUR]){
+            registers[MPU_INT_STATUS] |= MPU_INT_STATUS_MOT;
+        }
+    }
+
+    // Update the output registers, MSB first
+    memcpy(sensorValues, channels, sizeof(sensorValues));
+    updateOutputs();
+    registers[MPU_INT_STATUS] |= MPU_INT_STATUS_DATA_RDY;
+
+    // Write the enabled channels to the FIFO in register order
+    if(registers[MPU_USER_CTRL] & MPU_USER_CTRL_FIFO_EN){
+        const __u8 fifoEnable = registers[MPU_FIFO_EN];
+        for(__u8 reg = MPU_BURST_START; reg < MPU_BURST_START + MPU_BURST_LENGTH; reg++){
+            bool enabled;
+            if(reg <= MPU_ACC_Z2){
+                enabled = fifoEnable & MPU_FIFO_EN_ACCEL;
+            }
+            else if(reg <= MPU_TEMP2){
+                enabled = fifoEnable & MPU_FIFO_EN_TEMP;
+            }
+            else if(reg <= MPU_GYRO_X2){
+                enabled = fifoEnable & MPU_FIFO_EN_XG;
+            }
+            else if(reg <= MPU_GYRO_Y2){
+                enabled = fifoEnable & MPU_FIFO_EN_YG;
+            }
+            else{
+                enabled = fifoEnable & MPU_FIFO_EN_ZG;
+            }
+            if(enabled){
+                pushFifo(registers[reg]);
+            }
+        }
+
+        // Then the external data of the enabled slaves, in slave order
+        int offset = 0;
+        for(int slave = 0; slave < MPU_I2C_SLV_COUNT; slave++){
+            const __u8 control = registers[MPU_I2C_SLV_CTRL(slave)];
+            if(!(control & MPU_I2C_SLV_EN)){
+                continue;
+            }
+            const int length = MPU_FIELD_I2C_SLV_LEN.decode(control);
+            const bool slaveEnabled = slave < 3 ? (fifoEnable & (MPU_FIFO_EN_SLV0 << slave)) :
+                                                  (registers[MPU_I2C_MST_CTRL] & MPU_I2C_MST_CTRL_SLV_3_FIFO_EN);
+            for(int i = 0; slaveEnabled && i < length && offset + i < MPU_EXT_SENS_DATA_LENGTH; i++){
+                pushFifo(registers[MPU_EXT_SENS_DATA + offset + i]);
+            }
+            offset += length;
+        }
+    }
+}
+
+void MPU6050SimulatedTransport::setExternalData(const __u8 *data, int length){
+    if(length > MPU_EXT_SENS_DATA_LENGTH){
+        length = MPU_EXT_SENS_DATA_LENGTH;
+    }
+    memcpy(&registers[MPU_EXT_SENS_DATA], data, length);
+}
+
+void MPU6050SimulatedTransport::setLatency(long transactionNs, long byteNs){
+    latencyTransactionNs = transactionNs;
+    latencyByteNs = byteNs;
+}
+
+void MPU6050SimulatedTransport::injectErrors(int count){pendingErrors = count;}
+
+void MPU6050SimulatedTransport::setErrorInterval(int n){errorInterval = n;}
+
+__u8 MPU6050SimulatedTransport::peekRegister(__u8 deviceRegister){
+    return deviceRegister < MPU_SIM_REGISTER_COUNT ? registers[deviceRegister] : 0;
+}
+
+int MPU6050SimulatedTransport::getFifoCount(){return fifoCount;}
+
+// Apply the latency and error injection for one transaction
+bool MPU6050SimulatedTransport::beginTransaction(unsigned long bytesOnBus){
+    countTransaction(bytesOnBus);
+    transactionNumber++;
+
+    // Busy-wait rather than sleep so short latencies are modelled accurately
+    long latencyNs = latencyTransactionNs + latencyByteNs*long(bytesOnBus);
+    if(latencyNs > 0){
+        struct timespec start, now;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        do{
+            clock_gettime(CLOCK_MONOTONIC, &now);
+        }while((now.tv_sec - start.tv_sec)*1000000000L + (now.tv_nsec - start.tv_nsec) < latencyNs);
+    }
+
+    if(pendingErrors > 0){
+        pendingErrors--;
+        return false;
+    }
+    if(errorInterval > 0 && transactionNumber % errorInterval == 0){
+        return false;
+    }
+    return true;
+}
+
+// Read a register, applying the side effects of the real device
+__u8 MPU6050SimulatedTransport::readInternal(__u8 deviceRegister){
+    __u8 value;
+    switch(deviceRegister){
+    case MPU_INT_STATUS:
+    case MPU_I2C_MST_STATUS:
+        // Reading the status clears it
+        value = registers[deviceRegister];
+        registers[deviceRegister] = 0;
+        return value;
+    case MPU_FIFO_COUNT1:
+        return __u8(fifoCount >> 8);
+    case MPU_FIFO_COUNT2:
+        return __u8(fifoCount);
+    case MPU_FIFO_R_W:
+        return popFifo();
+    default:
+        return registers[deviceRegister];
+    }
+}
+
+// Write a register, applying the side effects of the real device
+void MPU6050SimulatedTransport::writeInternal(__u8 deviceRegister, __u8 value){
+    if(deviceRegister >= MPU_SIM_REGISTER_COUNT){
+        return;
+    }
+    switch(deviceRegister){
+    case MPU_USER_CTRL:
+        // FIFO_RESET clears itself once the FIFO is empty
+        if(value & MPU_USER_CTRL_FIFO_RESET){
+            fifoHead = 0;
+            fifoCount = 0;
+        }
+        registers[MPU_USER_CTRL] = value & ~MPU_USER_CTRL_FIFO_RESET;
+        break;
+    case MPU_INT_STATUS:
+    case MPU_I2C_MST_STATUS:
+    case MPU_FIFO_COUNT1:
+    case MPU_FIFO_COUNT2:
+    case MPU_WHO_AM_I:
+        break; // Read only
+    case MPU_FIFO_R_W:
+        pushFifo(value);
+        break;
+    case MPU_I2C_SLV4_CTRL:
+        // The single transfer completes straight away and I2C_SLV4_EN clears itself
+        if(value & MPU_I2C_SLV_EN){
+            registers[MPU_I2C_MST_STATUS] |= MPU_I2C_MST_STATUS_SLV4_DONE;
+        }
+        registers[MPU_I2C_SLV4_CTRL] = value & ~MPU_I2C_SLV_EN;
+        break;
+    default:
+        registers[deviceRegister] = value;
+        break;
+    }
+
+    // New offsets take effect on the outputs straight away
+    if((deviceRegister >= MPU_XA_OFFS_H && deviceRegister <= MPU_ZA_OFFS_L) ||
+       (deviceRegister >= MPU_XG_OFFS_USRH && deviceRegister <= MPU_ZG_OFFS_USRL)){
+        updateOutputs();
+    }
+}
+
+// Write the sensor values to the output registers, adding the offsets scaled to the current full scale ranges
+void MPU6050SimulatedTransport::updateOutputs(){
+    const int accelRange = (registers[MPU_ACC_CONFIG] >> 3) & 3; // AFS_SEL
+    const int gyroRange = (registers[MPU_GYRO_CONFIG] >> 3) & 3; // FS_SEL
+
+    for(int i = 0; i < 7; i++){
+        long value = sensorValues[i];
+        if(i < 3){
+            // Accelerometer offsets are in ±16g units - 8 output LSB each at ±2g
+            int16_t offset = int16_t(registers[MPU_XA_OFFS_H + 2*i] << 8 | registers[MPU_XA_OFFS_L + 2*i]);
+            value += long(offset)*(8 >> accelRange);
+        }
+        else if(i > 3){
+            // Gyroscope offsets are in ±1000 °/s units - 4 output LSB each at ±250 °/s
+            int16_t offset = int16_t(registers[MPU_XG_OFFS_USRH + 2*(i - 4)] << 8 | registers[MPU_XG_OFFS_USRL + 2*(i - 4)]);
+            value += long(offset)*4/(1 << gyroRange);
+        }
+        value = value > 32767 ? 32767 : (value < -32768 ? -32768 : value);
+        registers[MPU_BURST_START + 2*i] = __u8(value >> 8);
+        registers[MPU_BURST_START + 2*i + 1] = __u8(value);
+    }
+}
+
+// Add a byte to the FIFO. When the FIFO is full the oldest byte is lost and the overflow is flagged.
+void MPU6050SimulatedTransport::pushFifo(__u8 value){
+    if(fifoCount == MPU_FIFO_SIZE){
+        fifoHead = (fifoHead + 1) % MPU_FIFO_SIZE;
+        fifoCount--;
+        registers[MPU_INT_STATUS] |= MPU_INT_STATUS_FIFO_OFLOW;
+    }
+    fifo[(fifoHead + fifoCount) % MPU_FIFO_SIZE] = value;
+    fifoCount++;
+}
+
+// Remove the oldest byte from the FIFO
+__u8 MPU6050SimulatedTransport::popFifo(){
+    if(fifoCount == 0){
+        return 0;
+    }
+    __u8 value = fifo[fifoHead];
+    fifoHead = (fifoHead + 1) % MPU_FIFO_SIZE;
+    fifoCount--;
+    return value;
+}
+// --------------------------------------------------------------------------------------------
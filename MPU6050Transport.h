@@ -0,0 +1,208 @@
+/* ============================================================================================
+ * MPU6050 Bus Transport Header for Raspberry Pi
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This header declares the transports the MPU6050 class uses to access the device registers.
+ * MPU6050I2CTransport talks to a real device through the user-space I2C interface
+ * (/dev/i2c-N). MPU6050SimulatedTransport models the MPU6050 register map in memory, including
+ * auto-incrementing burst reads and the FIFO, with configurable bus latency and injectable
+ * errors. This allows the driver to be benchmarked and tested on a machine without the device.
+ * Additional I2C documentation was found at
+ * https://www.kernel.org/doc/Documentation/i2c/dev-interface.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include "MPU6050.h" // For the register definitions
+#include <mutex>     // Serialises the SMBus accesses on a shared bus
+
+#ifndef MPU6050_TRANSPORT_H
+#define MPU6050_TRANSPORT_H
+
+// Size of the simulated register file - covers every register up to WHO_AM_I
+#define MPU_SIM_REGISTER_COUNT (MPU_WHO_AM_I + 1)
+
+// Interface for reading and writing MPU6050 registers. All functions return a negative value on error.
+class MPU6050Transport{
+public:
+	MPU6050Transport();
+	virtual ~MPU6050Transport(){}
+
+	virtual __s32 readRegister(__u8 deviceRegister) = 0;                                 // Returns the register value
+	virtual __s32 writeRegister(__u8 deviceRegister, __u8 value) = 0;                    // Returns 0 on success
+	virtual __s32 readBlock(__u8 startRegister, __u8 *buffer, int length) = 0;            // Returns the number of bytes read
+	virtual __s32 writeBlock(__u8 startRegister, const __u8 *buffer, int length) = 0;     // Returns 0 on success
+
+	virtual const char* getName() = 0; // Name of the bus, used for display
+	virtual int getAddress() = 0;      // I2C address of the device
+	virtual __s32 reopen();            // Reopen the bus after repeated errors. Returns 0 on success - the default does nothing.
+
+	// Bus usage counters. Each transaction is one syscall on a real bus. Bytes include address and register bytes.
+	unsigned long getTransactions();
+	unsigned long getBytes();
+	void resetCounters();
+
+protected:
+	// Called by every transport for each transaction so that the counters stay consistent
+	void countTransaction(unsigned long bytesOnBus);
+
+private:
+	unsigned long transactions;
+	unsigned long bytes;
+};
+
+// A user-space I2C bus which can be shared by several devices. Transfers use I2C_RDWR, which gives the address in each
+// message, so the bus does not need to be bound to one device with I2C_SLAVE. Adapters which can only do SMBus
+// transfers (no I2C_FUNC_I2C in I2C_FUNCS) are accessed with the SMBus byte and I2C block commands instead, binding the
+// handle to each device in turn. Buses from acquire() are reference counted, so every transport and
+// manager using the same bus number shares one handle.
+class MPU6050I2CBus{
+public:
+	MPU6050I2CBus(int busNumber); // Opens a handle of its own on /dev/i2c-<busNumber> - exits on error
+	~MPU6050I2CBus();
+
+	// Get the shared handle for /dev/i2c-<busNumber>, opening it if nothing else is using it. Returns NULL and sets status to
+	// I2C_BUS_INIT_ERROR if it can't be opened. Each bus returned must be given back with release().
+	static MPU6050I2CBus* acquire(int busNumber, int &status);
+	void release(); // The last release closes the bus
+
+	__s32 transfer(struct i2c_msg *messages, int count); // Run up to I2C_RDWR_IOCTL_MAX_MSGS messages in one transaction
+	__s32 smbusReadByte(int deviceAddress, __u8 deviceRegister);               // SMBus read byte data. Returns the value or -1.
+	__s32 smbusWriteByte(int deviceAddress, __u8 deviceRegister, __u8 value);  // SMBus write byte data. Returns 0 or -1.
+	// SMBus I2C block read and write of up to I2C_SMBUS_BLOCK_MAX bytes. Return the number of bytes read, or 0 on a successful
+	// write, or -1 on error.
+	__s32 smbusReadBlock(int deviceAddress, __u8 startRegister, __u8 *buffer, int length);
+	__s32 smbusWriteBlock(int deviceAddress, __u8 startRegister, const __u8 *buffer, int length);
+	bool supports(unsigned long functionality); // True if the adapter has all of the I2C_FUNC_* bits given
+	__s32 bindDevice(int deviceAddress); // Bind the handle to a device with I2C_SLAVE, which fails if a kernel driver has it. Returns 0 or -1.
+	bool isSmbusOnly(); // True if the adapter supports the SMBus byte commands but not I2C_RDWR
+	__s32 reopen(); // Replace the handle with a new one in place, so other threads using the bus see no gap. Returns 0 on success.
+	int getHandle();
+	int getBusNumber();
+	const char* getName();
+
+private:
+	MPU6050I2CBus(const MPU6050I2CBus& B);            // The handle cannot be shared
+	MPU6050I2CBus& operator=(const MPU6050I2CBus& B);
+
+	MPU6050I2CBus(int busNumber, int &status); // Used by acquire()
+	int openHandle(int busNumber);             // Returns CLEAN_EXIT or I2C_BUS_INIT_ERROR
+	__s32 bindLocked(int deviceAddress);       // As bindDevice(), with smbusLock already held
+
+	int busNumber;
+	char fileName[16];
+	int i2cHandle;
+	unsigned long functions;      // The adapter's I2C_FUNCS
+	int boundAddress = -1;        // Address the handle was last bound to with I2C_SLAVE, or -1
+	std::mutex smbusLock;         // Held from binding the handle to a device until its SMBus command is done
+	int references = 0;           // Users from acquire(), or 0 if the bus belongs to whoever constructed it
+	MPU6050I2CBus *next = NULL;   // Next shared bus
+};
+
+// Transport for a real MPU6050 on the user-space I2C interface. Register reads and writes use I2C_RDWR on the bus's handle.
+// On adapters which only support SMBus, registers use the SMBus byte commands, and blocks are split into I2C block
+// transfers of up to 32 bytes, or single registers if the adapter doesn't have those either.
+class MPU6050I2CTransport : public MPU6050Transport{
+public:
+	MPU6050I2CTransport(int busNumber, int deviceAddress); // Uses the shared handle for /dev/i2c-<busNumber> - exits on error
+	MPU6050I2CTransport(int busNumber, int deviceAddress, int &status); // As above, setting status to CLEAN_EXIT or the error code instead
+	MPU6050I2CTransport(MPU6050I2CBus &bus, int deviceAddress); // Uses a bus given by the caller, which must outlive the transport
+	~MPU6050I2CTransport();
+
+	__s32 readRegister(__u8 deviceRegister);
+	__s32 writeRegister(__u8 deviceRegister, __u8 value);
+	__s32 readBlock(__u8 startRegister, __u8 *buffer, int length);
+	__s32 writeBlock(__u8 startRegister, const __u8 *buffer, int length);
+
+	const char* getName();
+	int getAddress();
+	__s32 reopen(); // Reopen the bus handle, which every device on the bus shares
+	// Count a read of length bytes from this device which was made as part of a larger transaction on the bus, such as
+	// MPU6050Manager's batched reads, so the device's counters include it
+	void countBatchedRead(int length);
+
+private:
+	MPU6050I2CTransport(const MPU6050I2CTransport& T);            // The bus reference cannot be shared
+	MPU6050I2CTransport& operator=(const MPU6050I2CTransport& T);
+
+	// Acquire the bus and check the address. Returns CLEAN_EXIT or the exit code for the error.
+	int openBus(int busNumber, int deviceAddress);
+	// Block reads and writes on SMBus-only adapters. FIFO_R_W is accessed repeatedly, and other registers follow on from
+	// the start register as the device's auto-increment would. Return as readBlock() and writeBlock().
+	__s32 smbusReadBlock(__u8 startRegister, __u8 *buffer, int length);
+	__s32 smbusWriteBlock(__u8 startRegister, const __u8 *buffer, int length);
+
+	int address;
+	MPU6050I2CBus *bus;
+	bool acquiredBus; // True if the bus came from MPU6050I2CBus::acquire() and must be released
+};
+
+// Transport which simulates an MPU6050 register file in memory
+class MPU6050SimulatedTransport : public MPU6050Transport{
+public:
+	MPU6050SimulatedTransport(int deviceAddress = MPU_DEFAULT_I2C_ADDR);
+
+	__s32 readRegister(__u8 deviceRegister);
+	__s32 writeRegister(__u8 deviceRegister, __u8 value);
+	__s32 readBlock(__u8 startRegister, __u8 *buffer, int length);
+	__s32 writeBlock(__u8 startRegister, const __u8 *buffer, int length);
+
+	const char* getName();
+	int getAddress();
+
+	// ---------- Simulation Control ----------
+	// Produce a new sample as the device would at its sample rate. The values are given in register order.
+	// This updates the output registers, sets DATA_RDY_INT and writes a frame to the FIFO if it is enabled. With the
+	// motion interrupt enabled, MOT_INT is set once the accelerometer has changed by more than MOT_THR for MOT_DUR samples.
+	// The offset registers are added to the accelerometer and gyro values as on the real device.
+	void generateSample(int16_t accelX, int16_t accelY, int16_t accelZ, int16_t temperature,
+	                    int16_t gyroX, int16_t gyroY, int16_t gyroZ);
+	// Set what the auxiliary devices return, as the I2C master would read it into EXT_SENS_DATA. It is written to the
+	// FIFO after each following sample's channels, for every enabled slave whose FIFO bit is set. Slave 4 writes are
+	// acknowledged at once.
+	void setExternalData(const __u8 *data, int length);
+
+	// Busy-wait for transactionNs plus byteNs for each byte on the bus during every transaction.
+	// For example, a 400kHz bus takes about 22500ns per byte.
+	void setLatency(long transactionNs, long byteNs);
+
+	void injectErrors(int count);   // Fail the next count transactions
+	void setErrorInterval(int n);   // Fail every nth transaction - 0 disables this
+	__u8 peekRegister(__u8 deviceRegister); // Read a register without side effects, latency or counting
+	int getFifoCount();             // Number of bytes currently in the FIFO
+	// ----------------------------------------
+
+private:
+	// Apply the latency and error injection for one transaction. Returns false if the transaction fails.
+	bool beginTransaction(unsigned long bytesOnBus);
+
+	// Register access without latency, errors or counting
+	__u8 readInternal(__u8 deviceRegister);
+	void writeInternal(__u8 deviceRegister, __u8 value);
+
+	// FIFO helpers
+	void pushFifo(__u8 value);
+	__u8 popFifo();
+
+	// Write the sensor values plus the offsets to the output registers
+	void updateOutputs();
+
+	int address;
+	__u8 registers[MPU_SIM_REGISTER_COUNT];
+	int16_t sensorValues[7]; // Last generated values, before the offsets are added
+	int motionSamples;       // Consecutive samples over the motion threshold
+
+	// The FIFO is a ring buffer
+	__u8 fifo[MPU_FIFO_SIZE];
+	int fifoHead;
+	int fifoCount;
+
+	// Latency and errors
+	long latencyTransactionNs;
+	long latencyByteNs;
+	int pendingErrors;
+	int errorInterval;
+	unsigned long transactionNumber;
+};
+
+#endif
@@ -0,0 +1,780 @@
+/* ============================================================================================
+ * MPU6050 Interface for Raspberry Pi - Benchmark
+ * ============================================================================================
+ * Written by Nathaniel Struselis & James Clarke.
+ * --------------------------------------------------------------------------------------------
+ * This benchmark times the driver's hot paths:
+ *  - Acquisition: the single-transaction burst read used by updateData() against the
+ *    per-register read path, the burst read with instrumentation attached, draining the FIFO
+ *    and handling read errors.
+ *  - Construction: from creating an object to having its first sample, both on a freshly
+ *    reset device and on one which is already configured.
+ *  - Conversion: scaling raw samples one at a time against the batch converter, each
+ *    orientation fusion filter, and each decimation filter in the multi-rate pipeline.
+ *  - Formatting: writing an object with operator<<, and exporting batches of samples as CSV
+ *    and JSON lines to /dev/null.
+ * For each it reports the sample rate, the time per sample, the number of I2C transactions
+ * (each of which is one syscall) and bus bytes per sample, and the number of heap allocations
+ * per sample.
+ * The benchmark runs against the first real device found on /dev/i2c-*, or on the bus given
+ * with "--device". Otherwise, or if "--simulated" is given, it runs against the simulated
+ * device with the latency of a 400kHz bus, so results are repeatable on any machine.
+ * "--transaction-ns" and "--byte-ns" change the simulated bus latency, and "--no-latency"
+ * removes it to measure only the CPU cost of the driver. "--json" prints one JSON object per
+ * benchmark instead of text, so runs can be compared across releases.
+ * --------------------------------------------------------------------------------------------
+ */
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <new>
+#include <glob.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "MPU6050.h"
+#include "MPU6050Transport.h"
+#include "MPU6050Converter.h"
+#include "MPU6050Config.h"
+#include "MPU6050Fusion.h"
+#include "MPU6050Pipeline.h"
+#ifndef MPU_NO_EXPORT
+#include "MPU6050Export.h"
+#endif
+#ifndef MPU_NO_METRICS
+#include "MPU6050Metrics.h"
+#endif
+
+using namespace std;
+
+#define BENCHMARK_SAMPLES  2000  // Number of samples to take for each benchmark
+#define BUS_BYTE_NS        22500 // Time for one byte (9 clocks) on a 400kHz bus
+#define BUS_TRANSACTION_NS 50000 // Time for the syscall and start/stop conditions of each transaction
+#define ERROR_INTERVAL     100   // Fail every nth transaction in the error handling benchmark
+#define CONVERT_SAMPLES    65536 // Number of raw samples in the conversion benchmark
+#define CONVERT_REPEATS    100   // Number of times the conversion benchmark converts every sample
+#define STARTUP_REPEATS    100   // Number of objects created in the startup benchmark
+#define FORMAT_REPEATS     10000 // Number of times the formatting benchmark writes the object
+#define EXPORT_REPEATS     20    // Number of times the export benchmark writes every sample
+#define DECIMATION_FACTOR  10    // Decimation factor in the pipeline benchmark
+
+// ------------------------------------ Allocation Counting -----------------------------------
+// Every heap allocation in the program goes through these, so each benchmark can count its own
+static atomic<unsigned long> allocationCount(0);
+
+void* operator new(size_t size)
+{
+    allocationCount.fetch_add(1, memory_order_relaxed);
+    void *memory = malloc(size > 0 ? size : 1);
+    if(memory == NULL){
+        throw bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    free(memory);
+}
+// --------------------------------------------------------------------------------------------
+
+// ----------------------------------------- Reporting ----------------------------------------
+// Settings shared by every benchmark
+struct BenchmarkSettings{
+    bool simulated;
+    bool json;
+    long transactionNs;   // Simulated bus latency
+    long byteNs;
+    int samples;          // Samples per acquisition benchmark
+    int busNumber;        // Real device
+    int deviceAddress;
+    string deviceName;    // Reported with every result
+};
+
+// An extra value reported by one benchmark
+struct BenchmarkExtra{
+    const char *key;   // JSON key
+    const char *label; // Text label
+    double value;
+};
+
+// Result of one benchmark
+struct BenchmarkResult{
+    const char *id;          // Machine-readable name
+    string name;             // Description for the text output
+    double seconds;
+    double samples;
+    double transactions;     // Negative if not measured
+    double bytes;
+    unsigned long allocations;
+    int status;              // CLEAN_EXIT, or the error if the benchmark could not run
+    vector<BenchmarkExtra> extras;
+};
+
+// Start of a timed section
+struct Measurement{
+    chrono::steady_clock::time_point start;
+    unsigned long startAllocations;
+};
+
+static BenchmarkSettings settings;
+
+void startMeasurement(Measurement &measurement)
+{
+    measurement.startAllocations = allocationCount.load(memory_order_relaxed);
+    measurement.start = chrono::steady_clock::now();
+}
+
+// Stop timing and add the time and allocations to a result
+void stopMeasurement(const Measurement &measurement, BenchmarkResult &result)
+{
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();
+    result.allocations += allocationCount.load(memory_order_relaxed) - measurement.startAllocations;
+    result.seconds += chrono::duration<double>(end - measurement.start).count();
+}
+
+BenchmarkResult newResult(const char *id, const string &name)
+{
+    BenchmarkResult result;
+    result.id = id;
+    result.name = name;
+    result.seconds = 0;
+    result.samples = 0;
+    result.transactions = -1;
+    result.bytes = -1;
+    result.allocations = 0;
+    result.status = CLEAN_EXIT;
+    return result;
+}
+
+// Write a number as JSON, which has no infinity or NaN
+void printJsonNumber(double value)
+{
+    if(isfinite(value)){
+        cout << value;
+    }
+    else{
+        cout << "null";
+    }
+}
+
+// Write a string as JSON. The names used here have nothing which needs escaping except quotes.
+void printJsonString(const string &value)
+{
+    cout << '"';
+    for(size_t i = 0; i < value.size(); i++){
+        if(value[i] == '"' || value[i] == '\\'){
+            cout << '\\';
+        }
+        cout << value[i];
+    }
+    cout << '"';
+}
+
+void printJsonField(const char *key, double value)
+{
+    cout << ",\"" << key << "\":";
+    printJsonNumber(value);
+}
+
+// Print the results of a benchmark
+void report(const BenchmarkResult &result)
+{
+    double perSample = result.samples > 0 ? 1/result.samples : 0;
+
+    if(settings.json){
+        cout << "{\"benchmark\":\"" << result.id << "\",\"description\":";
+        printJsonString(result.name);
+        cout << ",\"device\":";
+        printJsonString(settings.deviceName);
+        if(result.status != CLEAN_EXIT){
+            cout << ",\"error\":";
+            printJsonString(MPU6050::getStatusMessage(result.status));
+            cout << "}" << endl;
+            return;
+        }
+        printJsonField("samples", result.samples);
+        printJsonField("seconds", result.seconds);
+        printJsonField("samples_per_s", result.samples/result.seconds);
+        printJsonField("ns_per_sample", result.seconds*1e9*perSample);
+        printJsonField("syscalls_per_sample", result.transactions >= 0 ? result.transactions*perSample : NAN);
+        printJsonField("bus_bytes_per_sample", result.bytes >= 0 ? result.bytes*perSample : NAN);
+        printJsonField("allocs_per_sample", result.allocations*perSample);
+        for(size_t i = 0; i < result.extras.size(); i++){
+            printJsonField(result.extras[i].key, result.extras[i].value);
+        }
+        cout << "}" << endl;
+        return;
+    }
+
+    cout << result.name << endl;
+    if(result.status != CLEAN_EXIT){
+        cout << "  Failed: " << MPU6050::getStatusMessage(result.status) << endl;
+        return;
+    }
+    cout << "  Samples/s:            " << result.samples/result.seconds << endl;
+    cout << "  ns/sample:            " << result.seconds*1e9*perSample << endl;
+    if(result.transactions >= 0){
+        cout << "  Transactions/sample:  " << result.transactions*perSample << endl;
+        cout << "  Bus bytes/sample:     " << result.bytes*perSample << endl;
+    }
+    cout << "  Allocations/sample:   " << result.allocations*perSample << endl;
+    for(size_t i = 0; i < result.extras.size(); i++){
+        cout << "  " << result.extras[i].label << result.extras[i].value << endl;
+    }
+}
+
+// Fill in the bus usage of a result from an object's counters
+void addBusUsage(BenchmarkResult &result, MPU6050 &IMU)
+{
+    result.transactions = IMU.getBusTransactions();
+    result.bytes = IMU.getBusBytes();
+}
+
+void addExtra(BenchmarkResult &result, const char *key, const char *label, double value)
+{
+    BenchmarkExtra extra = {key, label, value};
+    result.extras.push_back(extra);
+}
+// --------------------------------------------------------------------------------------------
+
+// ---------------------------------------- Acquisition ---------------------------------------
+// Time a number of samples from one of the read paths
+BenchmarkResult runBenchmark(const char *id, const char *name, MPU6050 &IMU, int (MPU6050::*readPath)())
+{
+    BenchmarkResult result = newResult(id, name);
+    Measurement measurement;
+
+    IMU.resetBusCounters();
+    startMeasurement(measurement);
+    for(int i = 0; i < settings.samples; i++){
+        (IMU.*readPath)();
+    }
+    stopMeasurement(measurement, result);
+    result.samples = settings.samples;
+    addBusUsage(result, IMU);
+    return result;
+}
+
+#ifndef MPU_NO_METRICS
+// Time the burst read with instrumentation attached, and report what it recorded
+void runMetricsBenchmark(MPU6050 &IMU)
+{
+    MPU6050Metrics metrics;
+    MPU6050MetricsSnapshot snapshot;
+
+    IMU.setMetrics(&metrics);
+    BenchmarkResult result = runBenchmark("burst_read_metrics", "Burst read with metrics", IMU, &MPU6050::updateData);
+    IMU.setMetrics(NULL);
+
+    metrics.snapshot(snapshot);
+    addExtra(result, "latency_p50_us", "Latency p50 (us):     ", snapshot.transactionLatency.percentile(50)/1000.0);
+    addExtra(result, "latency_p99_us", "Latency p99 (us):     ", snapshot.transactionLatency.percentile(99)/1000.0);
+    addExtra(result, "latency_max_us", "Latency max (us):     ", snapshot.transactionLatency.max/1000.0);
+    addExtra(result, "interval_jitter_us", "Interval jitter (us): ", snapshot.intervalJitterNs/1000.0);
+    report(result);
+}
+#endif
+
+// Time draining the FIFO of the simulated device in batches
+void runFifoBenchmark(MPU6050 &IMU, MPU6050SimulatedTransport &device)
+{
+    BenchmarkResult result = newResult("fifo_drain", "FIFO drain (readFifo, 50 samples per batch)");
+    MPU6050Sample samples[MPU_FIFO_SIZE/MPU_FIFO_FRAME_LENGTH];
+    const int batchSize = 50; // Samples generated between each drain
+    Measurement measurement;
+    bool overflow;
+    int samplesRead = 0;
+
+    IMU.enableFifo(MPU_FIFO_DEFAULT_SMPLRT_DIV);
+    IMU.resetBusCounters();
+    while(samplesRead < settings.samples){
+        // The device fills the FIFO while the host is busy elsewhere, so this is not timed
+        for(int i = 0; i < batchSize; i++){
+            device.generateSample(i, 2*i, 3*i, 4*i, 5*i, 6*i, 7*i);
+        }
+
+        startMeasurement(measurement);
+        int count = IMU.readFifo(samples, batchSize, overflow);
+        stopMeasurement(measurement, result);
+
+        if(count <= 0 || overflow){
+            result.status = I2C_READ_ERROR;
+            break;
+        }
+        samplesRead += count;
+    }
+    IMU.disableFifo();
+
+    result.samples = samplesRead;
+    addBusUsage(result, IMU);
+    report(result);
+}
+
+// Time the error path, with the default retry policy and no error log
+void runErrorBenchmark(MPU6050 &IMU, MPU6050SimulatedTransport &device)
+{
+    BenchmarkResult result = newResult("burst_read_errors", "Burst read with 1 in 100 transactions failing");
+    Measurement measurement;
+    MPU6050ErrorCounts errors;
+    int failedSamples = 0;
+
+    device.setErrorInterval(ERROR_INTERVAL);
+    IMU.setErrorLog(NULL);
+    IMU.resetErrorCounts();
+    IMU.resetBusCounters();
+    startMeasurement(measurement);
+    for(int i = 0; i < settings.samples; i++){
+        if(IMU.updateData() & MPU_SAMPLE_CHANNEL_ERRORS){
+            failedSamples++;
+        }
+    }
+    stopMeasurement(measurement, result);
+    device.setErrorInterval(0);
+
+    result.samples = settings.samples;
+    addBusUsage(result, IMU);
+    IMU.getErrorCounts(errors);
+    addExtra(result, "failed_reads", "Failed reads:         ", errors.readFailures);
+    addExtra(result, "retry_recoveries", "Recovered by retry:   ", errors.retrySuccesses);
+    addExtra(result, "samples_lost", "Samples lost:         ", failedSamples);
+    report(result);
+}
+// --------------------------------------------------------------------------------------------
+
+// --------------------------------------- Construction ---------------------------------------
+// Set the simulated bus latency of a device
+void setLatency(MPU6050SimulatedTransport &device)
+{
+    if(settings.transactionNs > 0 || settings.byteNs > 0){
+        device.setLatency(settings.transactionNs, settings.byteNs);
+    }
+}
+
+// Report a startup benchmark, with the time to the first sample
+void reportStartup(BenchmarkResult &result)
+{
+    result.samples = STARTUP_REPEATS;
+    addExtra(result, "us_to_first_sample", "us to first sample:   ", result.seconds*1e6/STARTUP_REPEATS);
+    report(result);
+}
+
+// Time creating objects with create() until each has its first sample
+void runStartupBenchmark()
+{
+    MPU6050 *sensor;
+    Measurement measurement;
+
+    if(!settings.simulated){
+        // Opening the bus is part of starting up
+        BenchmarkResult result = newResult("startup_configured", "Startup on a configured device (create)");
+        startMeasurement(measurement);
+        for(int i = 0; i < STARTUP_REPEATS && result.status == CLEAN_EXIT; i++){
+            MPU6050I2CTransport busTransport(settings.busNumber, settings.deviceAddress, result.status);
+            if(result.status == CLEAN_EXIT){
+                result.status = MPU6050::create(sensor, busTransport);
+                delete sensor;
+            }
+        }
+        stopMeasurement(measurement, result);
+        reportStartup(result);
+        return;
+    }
+
+    // A new simulated device each time, with every register at its reset value
+    BenchmarkResult reset = newResult("startup_reset", "Startup on a reset device (create)");
+    startMeasurement(measurement);
+    for(int i = 0; i < STARTUP_REPEATS && reset.status == CLEAN_EXIT; i++){
+        MPU6050SimulatedTransport device;
+        setLatency(device);
+        reset.status = MPU6050::create(sensor, device);
+        delete sensor;
+    }
+    stopMeasurement(measurement, reset);
+    reportStartup(reset);
+
+    // The same device each time, as when a process is restarted - no configuration registers need writing
+    BenchmarkResult configured = newResult("startup_configured", "Startup on a configured device (create)");
+    MPU6050SimulatedTransport device;
+    setLatency(device);
+    configured.status = MPU6050::create(sensor, device);
+    delete sensor;
+    startMeasurement(measurement);
+    for(int i = 0; i < STARTUP_REPEATS && configured.status == CLEAN_EXIT; i++){
+        configured.status = MPU6050::create(sensor, device);
+        delete sensor;
+    }
+    stopMeasurement(measurement, configured);
+    reportStartup(configured);
+}
+// --------------------------------------------------------------------------------------------
+
+// ---------------------------------------- Conversion ----------------------------------------
+// Time scaling raw samples one at a time, and in batches with the converter
+void runConversionBenchmark(MPU6050 &IMU)
+{
+    static MPU6050RawSample raw[CONVERT_SAMPLES];
+    static MPU6050Sample samples[CONVERT_SAMPLES];
+    static float channels[7][CONVERT_SAMPLES];
+    MPU6050SampleArrays arrays = {channels[0], channels[1], channels[2], channels[3], channels[4], channels[5], channels[6]};
+    MPU6050Converter converter(IMU);
+    Measurement measurement;
+
+    for(int i = 0; i < CONVERT_SAMPLES; i++){
+        raw[i].accelX = int16_t(i*7);
+        raw[i].accelY = int16_t(i*11);
+        raw[i].accelZ = int16_t(i*13);
+        raw[i].temperature = int16_t(i*17);
+        raw[i].gyroX = int16_t(i*19);
+        raw[i].gyroY = int16_t(i*23);
+        raw[i].gyroZ = int16_t(i*29);
+    }
+
+    BenchmarkResult single = newResult("convert_sample", "Per-sample conversion (convertSample)");
+    startMeasurement(measurement);
+    for(int repeat = 0; repeat < CONVERT_REPEATS; repeat++){
+        for(int i = 0; i < CONVERT_SAMPLES; i++){
+            IMU.convertSample(raw[i], samples[i]);
+        }
+    }
+    stopMeasurement(measurement, single);
+    single.samples = double(CONVERT_SAMPLES)*CONVERT_REPEATS;
+    single.transactions = single.bytes = 0;
+    addExtra(single, "output_mb_per_s", "Output MB/s:          ", single.samples*sizeof(MPU6050Sample)/single.seconds/1e6);
+    report(single);
+
+    BenchmarkResult batch = newResult("convert_batch", string("Batch conversion (MPU6050Converter, ") + converter.getImplementation() + ")");
+    startMeasurement(measurement);
+    for(int repeat = 0; repeat < CONVERT_REPEATS; repeat++){
+        converter.convert(raw, CONVERT_SAMPLES, arrays);
+    }
+    stopMeasurement(measurement, batch);
+    batch.samples = double(CONVERT_SAMPLES)*CONVERT_REPEATS;
+    batch.transactions = batch.bytes = 0;
+    addExtra(batch, "output_mb_per_s", "Output MB/s:          ", batch.samples*sizeof(MPU6050Sample)/batch.seconds/1e6);
+    report(batch);
+
+    // The same conversions with the scales fixed at compile time, for the default configuration the IMU uses
+    BenchmarkResult fixed = newResult("convert_fixed", "Fixed configuration conversion (MPU6050Fixed::convertBatch)");
+    startMeasurement(measurement);
+    for(int repeat = 0; repeat < CONVERT_REPEATS; repeat++){
+        MPU6050Fixed<MPU6050Config<> >::convertBatch(raw, CONVERT_SAMPLES, arrays);
+    }
+    stopMeasurement(measurement, fixed);
+    fixed.samples = double(CONVERT_SAMPLES)*CONVERT_REPEATS;
+    fixed.transactions = fixed.bytes = 0;
+    addExtra(fixed, "output_mb_per_s", "Output MB/s:          ", fixed.samples*sizeof(MPU6050Sample)/fixed.seconds/1e6);
+    report(fixed);
+}
+
+// Time each fusion filter over the converted samples, in batches as they would come from the FIFO
+void runFusionBenchmark()
+{
+    const char *ids[] = {"fusion_complementary", "fusion_mahony", "fusion_madgwick"};
+    const char *names[] = {"Complementary fusion (updateBatch)", "Mahony fusion (updateBatch)", "Madgwick fusion (updateBatch)"};
+    const int filters[] = {MPU_FUSION_COMPLEMENTARY, MPU_FUSION_MAHONY, MPU_FUSION_MADGWICK};
+    const int batchSize = 64;
+    static float channels[7][CONVERT_SAMPLES];
+    Measurement measurement;
+
+    // A slow rotation with gravity along Z
+    for(int i = 0; i < CONVERT_SAMPLES; i++){
+        channels[0][i] = 10;
+        channels[1][i] = -5;
+        channels[2][i] = 20;
+        channels[3][i] = 0.01f;
+        channels[4][i] = -0.02f;
+        channels[5][i] = 1;
+    }
+
+    for(int f = 0; f < 3; f++){
+        BenchmarkResult result = newResult(ids[f], names[f]);
+        MPU6050Fusion fusion(filters[f]);
+        startMeasurement(measurement);
+        for(int repeat = 0; repeat < CONVERT_REPEATS/10; repeat++){
+            for(int i = 0; i + batchSize <= CONVERT_SAMPLES; i += batchSize){
+                MPU6050SampleArrays batch = {&channels[0][i], &channels[1][i], &channels[2][i], &channels[3][i], &channels[4][i], &channels[5][i], NULL};
+                fusion.updateBatch(batch, batchSize, 0.001f);
+            }
+        }
+        stopMeasurement(measurement, result);
+        result.samples = double(CONVERT_SAMPLES)*(CONVERT_REPEATS/10);
+        result.transactions = result.bytes = 0;
+        report(result);
+    }
+}
+// --------------------------------------------------------------------------------------------
+
+// Subscriber which only counts what it receives
+class CountingSubscriber : public MPU6050Subscriber{
+public:
+    CountingSubscriber() : count(0){}
+    void receive(const MPU6050SampleBlock &block){count += block.count;}
+    long count;
+};
+
+// Time the pipeline with each decimation filter. The time is per input sample, including the conversion.
+void runDecimationBenchmark()
+{
+    const char *ids[] = {"decimate_fir", "decimate_moving_average", "decimate_cic"};
+    const char *names[] = {"FIR decimation by 10 (MPU6050Pipeline)", "Moving average decimation by 10 (MPU6050Pipeline)",
+                           "CIC decimation by 10 (MPU6050Pipeline)"};
+    const int filters[] = {MPU_DECIMATE_FIR, MPU_DECIMATE_MOVING_AVERAGE, MPU_DECIMATE_CIC};
+    static MPU6050TimedSample samples[CONVERT_SAMPLES];
+    Measurement measurement;
+
+    for(int i = 0; i < CONVERT_SAMPLES; i++){
+        samples[i].timestampNs = uint64_t(i)*1000000;
+        samples[i].raw.accelX = int16_t(i*7);
+        samples[i].raw.accelY = int16_t(i*11);
+        samples[i].raw.accelZ = int16_t(i*13);
+        samples[i].raw.temperature = int16_t(i*17);
+        samples[i].raw.gyroX = int16_t(i*19);
+        samples[i].raw.gyroY = int16_t(i*23);
+        samples[i].raw.gyroZ = int16_t(i*29);
+    }
+
+    for(int f = 0; f < 3; f++){
+        BenchmarkResult result = newResult(ids[f], names[f]);
+        MPU6050Pipeline pipeline(MPU_GYRO_SCALE_500, MPU_ACC_SCALE_2);
+        MPU6050Decimator decimator(DECIMATION_FACTOR, filters[f]);
+        CountingSubscriber output;
+        pipeline.subscribe(decimator);
+        decimator.subscribe(output);
+
+        startMeasurement(measurement);
+        for(int repeat = 0; repeat < CONVERT_REPEATS/10; repeat++){
+            pipeline.push(samples, CONVERT_SAMPLES);
+        }
+        stopMeasurement(measurement, result);
+        result.samples = double(CONVERT_SAMPLES)*(CONVERT_REPEATS/10);
+        result.transactions = result.bytes = 0;
+        addExtra(result, "ns_per_output", "ns/output sample:     ", result.seconds*1e9/output.count);
+        report(result);
+    }
+}
+// --------------------------------------------------------------------------------------------
+
+// ---------------------------------------- Formatting ----------------------------------------
+// Time writing the object with operator<<. The stream is rewound rather than recreated, so only the formatting allocates.
+// Then time exporting samples, with the exporter's buffer allocated before the measurement, unless built with MPU_NO_EXPORT.
+void runFormattingBenchmark(MPU6050 &IMU)
+{
+    BenchmarkResult result = newResult("format_stream", "Text output (operator<<)");
+    ostringstream stream;
+    Measurement measurement;
+
+    stream << IMU; // Grow the stream's buffer first
+    IMU.resetBusCounters();
+    startMeasurement(measurement);
+    for(int i = 0; i < FORMAT_REPEATS; i++){
+        stream.seekp(0);
+        stream << IMU;
+    }
+    stopMeasurement(measurement, result);
+    result.samples = FORMAT_REPEATS;
+    addBusUsage(result, IMU);
+    addExtra(result, "output_bytes", "Output bytes/sample:  ", double(stream.tellp()));
+    report(result);
+
+#ifndef MPU_NO_EXPORT
+    // Export a varied stream of raw samples with every column, as a log shipper would take it
+    static MPU6050TimedSample samples[CONVERT_SAMPLES];
+    for(int i = 0; i < CONVERT_SAMPLES; i++){
+        samples[i].timestampNs = 1000000000ULL + uint64_t(i)*1000000;
+        samples[i].raw.accelX = int16_t(i*7);
+        samples[i].raw.accelY = int16_t(i*11);
+        samples[i].raw.accelZ = int16_t(i*13);
+        samples[i].raw.temperature = int16_t(i*17);
+        samples[i].raw.gyroX = int16_t(i*19);
+        samples[i].raw.gyroY = int16_t(i*23);
+        samples[i].raw.gyroZ = int16_t(i*29);
+    }
+
+    const char *ids[] = {"export_csv", "export_json"};
+    const char *names[] = {"CSV export (MPU6050Exporter)", "JSON lines export (MPU6050Exporter)"};
+    const int formats[] = {MPU_EXPORT_CSV, MPU_EXPORT_JSON};
+    int fd = open("/dev/null", O_WRONLY);
+    if(fd < 0){
+        return;
+    }
+    for(int f = 0; f < 2; f++){
+        BenchmarkResult exported = newResult(ids[f], names[f]);
+        MPU6050Exporter exporter(fd, IMU, formats[f]);
+        exporter.writeHeader();
+        startMeasurement(measurement);
+        for(int repeat = 0; repeat < EXPORT_REPEATS; repeat++){
+            exporter.write(samples, CONVERT_SAMPLES);
+        }
+        exporter.flush();
+        stopMeasurement(measurement, exported);
+        exported.samples = double(CONVERT_SAMPLES)*EXPORT_REPEATS;
+        exported.transactions = exported.bytes = 0;
+        addExtra(exported, "output_bytes", "Output bytes/sample:  ", exporter.getBytesWritten()/exported.samples);
+        addExtra(exported, "output_mb_per_s", "Output MB/s:          ", exporter.getBytesWritten()/exported.seconds/1e6);
+        report(exported);
+    }
+    close(fd);
+#endif
+}
+// --------------------------------------------------------------------------------------------
+
+// Find the first I2C bus with an MPU6050 at the address. Returns false if there is none. WHO_AM_I is read before anything is
+// written, so another device at the same address, such as an RTC at 0x68, is left alone.
+bool findDevice()
+{
+    glob_t buses;
+    bool found = false;
+
+    if(glob("/dev/i2c-*", 0, NULL, &buses) != 0){
+        return false;
+    }
+    for(size_t i = 0; i < buses.gl_pathc && !found; i++){
+        int busNumber = atoi(buses.gl_pathv[i] + strlen("/dev/i2c-"));
+        int status;
+        MPU6050I2CTransport busTransport(busNumber, settings.deviceAddress, status);
+        MPU6050 *sensor;
+        if(status != CLEAN_EXIT || busTransport.readRegister(MPU_WHO_AM_I) != MPU_WHO_AM_I_VALUE){
+            continue;
+        }
+        if(MPU6050::create(sensor, busTransport) == CLEAN_EXIT){
+            delete sensor;
+            settings.busNumber = busNumber;
+            found = true;
+        }
+    }
+    globfree(&buses);
+    return found;
+}
+
+// Run every benchmark which applies to the device
+void runBenchmarks(MPU6050 &IMU, MPU6050SimulatedTransport *device)
+{
+    if(!settings.json){
+        cout << "Device: " << settings.deviceName << endl;
+    }
+    report(runBenchmark("burst_read", "Burst read (updateData)", IMU, &MPU6050::updateData));
+    report(runBenchmark("per_register_read", "Per-register read (updateDataPerRegister)", IMU, &MPU6050::updateDataPerRegister));
+#ifndef MPU_NO_METRICS
+    runMetricsBenchmark(IMU);
+#endif
+    if(device != NULL){
+        runFifoBenchmark(IMU, *device);
+        runErrorBenchmark(IMU, *device);
+    }
+    runStartupBenchmark();
+    runConversionBenchmark(IMU);
+    runFusionBenchmark();
+    runDecimationBenchmark();
+    runFormattingBenchmark(IMU);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *devicePath = NULL;
+
+    settings.simulated = false;
+    settings.json = false;
+    settings.transactionNs = BUS_TRANSACTION_NS;
+    settings.byteNs = BUS_BYTE_NS;
+    settings.samples = BENCHMARK_SAMPLES;
+    settings.busNumber = -1;
+    settings.deviceAddress = MPU_DEFAULT_I2C_ADDR;
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "--simulated") == 0){
+            settings.simulated = true;
+        }
+        else if(strcmp(argv[i], "--no-latency") == 0){
+            settings.transactionNs = settings.byteNs = 0;
+        }
+        else if(strcmp(argv[i], "--json") == 0){
+            settings.json = true;
+        }
+        else if(strcmp(argv[i], "--transaction-ns") == 0 && i + 1 < argc){
+            settings.transactionNs = atol(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--byte-ns") == 0 && i + 1 < argc){
+            settings.byteNs = atol(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--samples") == 0 && i + 1 < argc){
+            settings.samples = atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--device") == 0 && i + 1 < argc){
+            devicePath = argv[++i];
+        }
+        else if(strcmp(argv[i], "--address") == 0 && i + 1 < argc){
+            settings.deviceAddress = int(strtol(argv[++i], NULL, 0));
+        }
+        else{
+            cerr << "Usage: " << argv[0] << " [--simulated] [--no-latency] [--transaction-ns ns] [--byte-ns ns] [--samples n]"
+                 << " [--device /dev/i2c-N] [--address 0x68] [--json]" << endl;
+            return MPU_INIT_PARAM_ERROR;
+        }
+    }
+    if(settings.samples <= 0){
+        settings.samples = BENCHMARK_SAMPLES;
+    }
+
+    // Use a real device if one was given or can be found
+    if(devicePath != NULL && !settings.simulated){
+        if(strncmp(devicePath, "/dev/i2c-", strlen("/dev/i2c-")) != 0){
+            cerr << "Devices must be given as /dev/i2c-N" << endl;
+            return MPU_INIT_PARAM_ERROR;
+        }
+        settings.busNumber = atoi(devicePath + strlen("/dev/i2c-"));
+    }
+    else if(!settings.simulated && !findDevice()){
+        settings.simulated = true;
+    }
+
+    if(!settings.simulated){
+        int status;
+        MPU6050I2CTransport busTransport(settings.busNumber, settings.deviceAddress, status);
+        MPU6050 *IMU = NULL;
+        if(status == CLEAN_EXIT){
+            status = MPU6050::create(IMU, busTransport);
+        }
+        if(status != CLEAN_EXIT){
+            cerr << MPU6050::getStatusMessage(status) << endl;
+            return status;
+        }
+        ostringstream name;
+        name << "/dev/i2c-" << settings.busNumber << " 0x" << hex << settings.deviceAddress;
+        settings.deviceName = name.str();
+        runBenchmarks(*IMU, NULL);
+        delete IMU;
+        return CLEAN_EXIT;
+    }
+
+    MPU6050SimulatedTransport device;
+    setLatency(device);
+    MPU6050 IMU(device);
+    device.generateSample(100, 200, 16384, -500, 10, 20, 30);
+
+    ostringstream name;
+    name << "simulated";
+    if(settings.transactionNs == BUS_TRANSACTION_NS && settings.byteNs == BUS_BYTE_NS){
+        name << " (400kHz bus)";
+    }
+    else if(settings.transactionNs > 0 || settings.byteNs > 0){
+        name << " (" << settings.transactionNs << "ns/transaction, " << settings.byteNs << "ns/byte)";
+    }
+    else{
+        name << " (no bus latency)";
+    }
+    settings.deviceName = name.str();
+    runBenchmarks(IMU, &device);
+
+    return CLEAN_EXIT;
+}